@@ -15,6 +15,8 @@
  *  
  **/
 
+#include <vector>
+
 #include "async_packet_socket.h"
 
 namespace rtcbase {
@@ -30,6 +32,17 @@ AsyncPacketSocket::AsyncPacketSocket() {}
 
 AsyncPacketSocket::~AsyncPacketSocket() {}
 
+int AsyncPacketSocket::send_to_v(const struct iovec* iov, size_t iov_count,
+        const SocketAddress& addr, const PacketOptions& options)
+{
+    if (1 == iov_count) {
+        return send_to(iov[0].iov_base, iov[0].iov_len, addr, options);
+    }
+    std::vector<char> data(iov_length(iov, iov_count));
+    iov_gather(data.data(), iov, iov_count);
+    return send_to(data.data(), data.size(), addr, options);
+}
+
 }  // namespace rtcbase
 
 
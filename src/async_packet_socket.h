@@ -40,13 +40,27 @@ struct PacketTimeUpdateParams {
     int64_t srtp_packet_index;        // Required for Rtp Packet authentication.
 };
 
+// Order in which queued packets leave a socket, and which are dropped first
+// when its send queue is full.
+enum PacketPriority {
+    PRIORITY_HIGH = 0,    // e.g. audio
+    PRIORITY_NORMAL,      // e.g. video
+    PRIORITY_LOW,         // e.g. retransmissions, probing
+    PRIORITY_COUNT
+};
+
 // This structure holds meta information for the packet which is about to send
 // over network.
 struct PacketOptions {
-    PacketOptions() : dscp(DSCP_NO_CHANGE), packet_id(-1) {}
-    explicit PacketOptions(DiffServCodePoint dscp) : dscp(dscp), packet_id(-1) {}
+    PacketOptions() : dscp(DSCP_NO_CHANGE), ecn(ECN_NO_CHANGE),
+        priority(PRIORITY_NORMAL), packet_id(-1) {}
+    explicit PacketOptions(DiffServCodePoint dscp) : dscp(dscp),
+        ecn(ECN_NO_CHANGE), priority(PRIORITY_NORMAL), packet_id(-1) {}
 
+    // Marks this packet only, without touching the socket's setting.
     DiffServCodePoint dscp;
+    EcnCodepoint ecn;
+    PacketPriority priority;
     int packet_id;  // 16 bits, -1 represents "not set".
     PacketTimeUpdateParams packet_time_params;
 };
@@ -54,9 +68,9 @@ struct PacketOptions {
 // This structure will have the information about when packet is actually
 // received by socket.
 struct PacketTime {
-    PacketTime() : timestamp(-1), not_before(-1) {}
+    PacketTime() : timestamp(-1), not_before(-1), ecn(ECN_NO_CHANGE) {}
     PacketTime(int64_t timestamp, int64_t not_before)
-        : timestamp(timestamp), not_before(not_before) {}
+        : timestamp(timestamp), not_before(not_before), ecn(ECN_NO_CHANGE) {}
 
     int64_t timestamp;   // Receive time after socket delivers the data.
 
@@ -65,6 +79,9 @@ struct PacketTime {
     // example, the time of the last select() call.
     // If unknown, this value will be set to zero.
     int64_t not_before;
+
+    // ECN field of the packet's IP header, ECN_NO_CHANGE if unknown.
+    EcnCodepoint ecn;
 };
 
 inline PacketTime create_packet_time(int64_t not_before) {
@@ -91,6 +108,11 @@ public:
     // Send a packet.
     virtual int send_to(const void *pv, size_t cb, const SocketAddress& addr,
             const PacketOptions& options) = 0;
+    // Sends the concatenation of |iov_count| buffers as one packet, e.g. a
+    // header and a payload kept apart, without joining them first. The
+    // default gathers them into one buffer for send_to().
+    virtual int send_to_v(const struct iovec* iov, size_t iov_count,
+            const SocketAddress& addr, const PacketOptions& options);
 
     // Close the socket.
     virtual int close() = 0;
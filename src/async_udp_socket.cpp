@@ -15,13 +15,29 @@
  **/
 
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include "logging.h"
 #include "event_loop.h"
+#include "io_uring.h"
+#include "physical_socket_server.h"
 #include "async_udp_socket.h"
 
+#ifdef HAVE_IO_URING
+#include <sys/socket.h>
+#endif
+
 namespace rtcbase {
 
+static void stats_timer_cb(EventLoop* el, TimerWatcher* w, void* data) {
+    (void)el;
+    (void)w;
+    ((AsyncUDPSocket*)data)->publish_stats();
+}
+
 void socket_io_cb(EventLoop *el, IOWatcher *w, int fd, int revents, void* data) {
     (void)el;
     (void)w;
@@ -42,38 +58,121 @@ void socket_io_cb(EventLoop *el, IOWatcher *w, int fd, int revents, void* data)
 }
 
 static const int BUF_SIZE = 64 * 1024;
+// Slots of the first chunk of the send queue and their size. The chunk is
+// only allocated once the socket queues a packet, and the queue grows from
+// there, so sockets that send directly or not at all stay small.
+static const size_t SEND_QUEUE_SLOTS = 32;
+static const size_t SEND_QUEUE_SLOT_SIZE = 2048;
+// Max number of packets handed to a single sendmmsg() call.
+static const size_t SEND_BATCH_SIZE = 64;
+// Max number of packets taken from the queue per sendmmsg() call when
+// segmentation offload is on, and the limits of one offloaded message.
+static const size_t GSO_BATCH_SIZE = 256;
+static const size_t GSO_MAX_SEGMENTS = 64;
+static const size_t GSO_MAX_SIZE = 65000;
+// Window of the rates and number of queueing delay samples of the stats.
+static const int64_t STATS_RATE_WINDOW_MS = 1000;
+static const size_t STATS_DELAY_SAMPLES = 512;
+
+#ifdef HAVE_IO_URING
+
+// Number of sendmsg entries one socket may have in flight, the rest waits in
+// the send queue. Packets up to the slot size are copied into the slot.
+static const size_t URING_SEND_SLOTS = 256;
+static const size_t URING_SEND_SLOT_SIZE = 2048;
+
+class AsyncUDPSocket::UringIo : public IoUringHandler {
+public:
+    UringIo(AsyncUDPSocket* owner, IoUring* ring, int fd);
+    ~UringIo() override;
+
+    bool start(size_t buffer_count, size_t max_packet_size, bool gro);
+    // Queues a sendmsg of the packet, gathering |iov| into the slot or
+    // keeping a reference to |buffer| when it is the packet's PacketBuffer.
+    // Returns false when every send slot is in flight.
+    bool send(const struct iovec* iov, size_t iov_count, PacketBuffer* buffer,
+            const SocketAddress& addr, int tos);
+    // The socket is going away. Cancels the requests in flight and deletes
+    // itself once they all completed.
+    void detach();
+
+    void on_completion(uint32_t tag, int32_t res, uint32_t flags) override;
+    void on_ring_destroyed() override;
+
+private:
+    enum {
+        TAG_RECV = 0xFFFFFFFE,
+        TAG_CANCEL = 0xFFFFFFFD
+    };
+
+    struct SendSlot {
+        struct msghdr msg;
+        struct iovec iov;
+        struct sockaddr_storage addr;
+        alignas(struct cmsghdr) char control[SEND_CONTROL_SIZE];
+        char* data;      // This slot's part of |_send_data|.
+        char* heap_data; // Only used for packets larger than a slot.
+        scoped_refptr<PacketBuffer> buffer; // For packets sent by reference.
+        int next_free;
+    };
+
+    bool arm_recv();
+    void on_recv(int32_t res, uint32_t flags);
+    void on_sent(uint32_t slot, int32_t res);
+    void deliver(char* buf, size_t size);
+    void maybe_delete();
+
+    AsyncUDPSocket* _owner;
+    IoUring* _ring;
+    int _fd;
+    uint32_t _id;
+
+    std::unique_ptr<IoUringBufferRing> _buffers;
+    struct msghdr _recv_msg;
+    bool _recv_armed;
+
+    std::vector<SendSlot> _send_slots;
+    std::unique_ptr<char[]> _send_data;
+    int _free_send;
+    size_t _sends_in_flight;
+    bool _cancel_in_flight;
+};
+
+#endif  // HAVE_IO_URING
 
 AsyncUDPSocket::AsyncUDPSocket(EventLoop* el, AsyncSocket* socket)
-    : _socket(socket), _total_send_data(0) 
+    : _socket(socket), _flow_table(NULL), _flow_cb(NULL),
+    _send_queue(SEND_QUEUE_SLOTS, SEND_QUEUE_SLOT_SIZE),
+    _send_msgs(SEND_BATCH_SIZE), _direct_send(false), _dscp(0), _inline_sent_packets(0),
+    _queued_packets(0), _stats_timer(NULL), _counted_queue_drops(0),
+    _gso_enabled(false), _gro_enabled(false), _uring_io(NULL)
 {
     assert(el);
     _el = el;
 
-    _size = BUF_SIZE;
-    _buf = new char[_size];
+    _buf = NULL;
+    set_recv_batch_size(1, BUF_SIZE);
  
     _socket_watcher = _el->create_io_event(socket_io_cb, (void*)this);
     enable_events(EventLoop::READ);
 }
 
 AsyncUDPSocket::~AsyncUDPSocket() {
+#ifdef HAVE_IO_URING
+    if (_uring_io) {
+        _uring_io->detach();
+        _uring_io = NULL;
+    }
+#endif
     if (_socket_watcher) {
         _el->delete_io_event(_socket_watcher);
         _socket_watcher = NULL;
     }
-    delete [] _buf;
-
-    UdpDataSendMap::iterator iter = _udp_data_send_map.begin();
-    for (; iter != _udp_data_send_map.end(); ++iter) {
-        if (iter->second.packet_list.empty()) {
-            continue;
-        }
-        
-        std::list<UdpPacketData*>::iterator it = iter->second.packet_list.begin();
-        for (; it != iter->second.packet_list.end(); ++it) {
-            delete *it;
-        }
+    if (_stats_timer) {
+        _el->delete_timer(_stats_timer);
+        _stats_timer = NULL;
     }
+    delete [] _buf;
 }
 
 void AsyncUDPSocket::enable_events(int events) {
@@ -88,95 +187,445 @@ SocketAddress AsyncUDPSocket::get_local_address() const {
     return _socket->get_local_address();
 }
 
+void AsyncUDPSocket::set_stats_interval(int64_t interval_ms) {
+    if (interval_ms <= 0) {
+        if (_stats_timer) {
+            _el->delete_timer(_stats_timer);
+            _stats_timer = NULL;
+        }
+        _stats.enable_rates(0, 0);
+        return;
+    }
+    if (!_stats.rates_enabled()) {
+        _stats.enable_rates(STATS_RATE_WINDOW_MS, STATS_DELAY_SAMPLES);
+    }
+    if (!_stats_timer) {
+        _stats_timer = _el->create_timer(stats_timer_cb, (void*)this, true);
+    } else {
+        _el->stop_timer(_stats_timer);
+    }
+    _el->start_timer(_stats_timer, (unsigned long)interval_ms * 1000);
+}
+
+void AsyncUDPSocket::publish_stats() {
+    _stats.publish(now_ms(), _send_queue.size(), _send_queue.bytes());
+}
+
+void AsyncUDPSocket::set_recv_batch_size(size_t batch_size,
+        size_t max_packet_size) 
+{
+    if (batch_size <= 1) {
+        batch_size = 1;
+        max_packet_size = BUF_SIZE;
+    } else if (_gro_enabled && max_packet_size < BUF_SIZE) {
+        // Coalesced receives need room for a whole GRO super-datagram.
+        max_packet_size = BUF_SIZE;
+    }
+
+    delete [] _buf;
+    _buf = NULL;
+    _size = max_packet_size;
+    _recv_msgs.clear();
+    _recv_msgs.resize(batch_size);
+    _recv_buffers.clear();
+
+    if (pooled_receive()) {
+        // Every slot is a packet buffer, the socket keeps no buffer of its own.
+        _recv_buffers.resize(batch_size);
+        for (size_t i = 0; i < batch_size; ++i) {
+            _recv_buffers[i] = _packet_pool->allocate();
+            _recv_msgs[i].buffer = _recv_buffers[i]->data();
+            _recv_msgs[i].length = _recv_buffers[i]->capacity();
+        }
+        return;
+    }
+
+    _buf = new char[batch_size * _size];
+    for (size_t i = 0; i < batch_size; ++i) {
+        _recv_msgs[i].buffer = _buf + i * _size;
+        _recv_msgs[i].length = _size;
+    }
+}
+
+void AsyncUDPSocket::set_packet_buffer_pool(
+        const scoped_refptr<PacketBufferPool>& pool)
+{
+    _packet_pool = pool;
+    set_recv_batch_size(_recv_msgs.size(), _size);
+}
+
 void AsyncUDPSocket::send_data() { 
-    while (_total_send_data > 0) {
-        UdpDataSendMap::iterator iter = _udp_data_send_map.begin();
-        for (; iter != _udp_data_send_map.end(); ++iter) {
-            if (iter->second.packet_list.empty()) {
-                continue;
+    while (!_send_queue.empty()) {
+        bool blocked = _gso_enabled ? send_gso_batch() : send_batch();
+        if (blocked) {
+            // Wait for the next write event.
+            return;
+        }
+    }
+
+    disable_events(EventLoop::WRITE);
+}
+
+void AsyncUDPSocket::on_packets_sent(size_t count) {
+    int64_t now_us = _el->now_micros();
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bytes += _send_msgs[i].size;
+        if (_stats.sample_queue_delay()) {
+            _stats.add_queue_delay(now_us - _send_queue.peeked_push_time(i));
+        }
+    }
+    _stats.count_sent(count, bytes, now_us / 1000);
+    _send_queue.pop(count);
+    rtcbase::SentPacket sent_packet(-1, rtcbase::time_millis());
+    for (size_t i = 0; i < count; ++i) {
+        signal_sent_packet(this, sent_packet);
+    }
+}
+
+bool AsyncUDPSocket::send_batch() {
+    size_t count = _send_queue.peek(&_send_msgs[0], SEND_BATCH_SIZE);
+    int sent = _socket->send_to_batch(&_send_msgs[0], count);
+    if (-1 == sent) {
+        // A hard error is specific to the first packet (e.g. unreachable
+        // destination), drop it and go on with the rest.
+        LOG(LS_WARNING) << "Send data return error, addr: " 
+            << _send_msgs[0].addr->to_sensitive_string();
+        _stats.count_send_errors(1);
+        _send_queue.pop(1);
+        return false;
+    } else if (0 == sent) {
+        _stats.count_would_block();
+        return true;
+    }
+
+    on_packets_sent(sent);
+    // A short count means the socket buffer is full.
+    return static_cast<size_t>(sent) < count;
+}
+
+bool AsyncUDPSocket::send_gso_batch() {
+    size_t count = _send_queue.peek(&_send_msgs[0], GSO_BATCH_SIZE, GSO_MAX_SEGMENTS);
+
+    // Coalesce runs of same sized packets to the same destination into one
+    // message, a shorter packet may only end a run.
+    size_t msg_count = 0;
+    for (size_t i = 0; i < count; ++msg_count) {
+        const SendMessage& first = _send_msgs[i];
+        size_t total = 0;
+        size_t j = i;
+        while (j < count && j - i < GSO_MAX_SEGMENTS
+                && _send_msgs[j].addr == first.addr
+                && _send_msgs[j].size <= first.size
+                && _send_msgs[j].tos == first.tos
+                && total + _send_msgs[j].size <= GSO_MAX_SIZE)
+        {
+            _gso_iovs[j].iov_base = const_cast<void*>(_send_msgs[j].data);
+            _gso_iovs[j].iov_len = _send_msgs[j].size;
+            total += _send_msgs[j].size;
+            if (_send_msgs[j++].size < first.size) {
+                break;
             }
-            UdpPacketData* packet_data = iter->second.packet_list.front();
-            int sent = _socket->send_to(packet_data->data(), 
-                    packet_data->size(), 
-                    packet_data->addr());
-            if (-1 == sent) {
-                LOG(LS_WARNING) << "Send data return error";
-                delete iter->second.packet_list.front();
-                iter->second.packet_list.pop_front();
-                --_total_send_data;
-                return;
-            } else if (0 == sent) {
-                LOG(LS_WARNING) << "Write zere bytes, addr: " << packet_data->addr().to_string();
-                return;
-            } else { // finish
-                delete iter->second.packet_list.front();
-                iter->second.packet_list.pop_front();
-                --_total_send_data;
-                rtcbase::SentPacket sent_packet(-1, rtcbase::time_millis());
-                signal_sent_packet(this, sent_packet);
-            } 
-        }
-    }
-
-    if (_total_send_data <= 0) {
-        disable_events(EventLoop::WRITE);
-    }
-}
-
-int AsyncUDPSocket::add_udp_send_data(const void* data, size_t size,
-        const SocketAddress& addr)
+        }
+
+        SendMessage& msg = _gso_msgs[msg_count];
+        msg.addr = first.addr;
+        msg.iov = &_gso_iovs[i];
+        msg.iov_count = j - i;
+        msg.size = total;
+        msg.segment_size = (j - i > 1) ? static_cast<int>(first.size) : 0;
+        msg.tos = first.tos;
+        _gso_packets[msg_count] = j - i;
+        i = j;
+    }
+
+    int sent = _socket->send_to_batch(&_gso_msgs[0], msg_count);
+    if (-1 == sent) {
+        int error = _socket->get_error();
+        if (_gso_msgs[0].segment_size > 0 && (EIO == error || EINVAL == error)) {
+            // The device or the path does not support segmentation offload.
+            LOG(LS_WARNING) << "UDP segmentation offload failed with error " 
+                << error << ", disable it";
+            _gso_enabled = false;
+            return false;
+        }
+        LOG(LS_WARNING) << "Send data return error, addr: " 
+            << _gso_msgs[0].addr->to_sensitive_string();
+        _stats.count_send_errors(_gso_packets[0]);
+        _send_queue.pop(_gso_packets[0]);
+        return false;
+    } else if (0 == sent) {
+        _stats.count_would_block();
+        return true;
+    }
+
+    size_t packets = 0;
+    for (int i = 0; i < sent; ++i) {
+        packets += _gso_packets[i];
+    }
+    on_packets_sent(packets);
+    return static_cast<size_t>(sent) < msg_count;
+}
+
+bool AsyncUDPSocket::push_send_queue(const struct iovec* iov, size_t iov_count,
+        PacketBuffer* buffer, const SocketAddress& addr, int tos,
+        PacketPriority priority)
 {
-    UdpPacketData* packet_data = new UdpPacketData(data, size, addr);
-    UdpDataSendMap::iterator iter;
-    std::string key = addr.to_string();
-    iter = _udp_data_send_map.find(key);
-    if (iter != _udp_data_send_map.end()) {
-        iter->second.packet_list.push_back(packet_data);
+    _send_queue.set_push_time(_el->now_micros());
+    bool queued = buffer
+        ? _send_queue.push(scoped_refptr<PacketBuffer>(buffer), addr, tos, priority)
+        : _send_queue.push_v(iov, iov_count, addr, tos, priority);
+    if (queued) {
+        ++_queued_packets;
     } else {
-        _udp_data_send_map[key].packet_list.push_back(packet_data);
+        // The queue is full, like a full socket buffer.
+        _socket->set_error(EWOULDBLOCK);
+    }
+    count_queue_drops();
+    return queued;
+}
+
+void AsyncUDPSocket::count_queue_drops() {
+    uint64_t dropped = _send_queue.dropped_packets();
+    if (dropped != _counted_queue_drops) {
+        _stats.count_queue_drops(dropped - _counted_queue_drops);
+        _counted_queue_drops = dropped;
+    }
+}
+
+int AsyncUDPSocket::add_udp_send_data(const struct iovec* iov, size_t iov_count,
+        PacketBuffer* buffer, const SocketAddress& addr, int tos,
+        PacketPriority priority)
+{
+    if (!push_send_queue(iov, iov_count, buffer, addr, tos, priority)) {
+        return -1;
     }
-    ++_total_send_data;
     enable_events(EventLoop::WRITE);
-    return size;
+    return static_cast<int>(iov_length(iov, iov_count));
 }
 
 int AsyncUDPSocket::send_to(const void *data, size_t size,
         const SocketAddress& addr,
         const rtcbase::PacketOptions& options) 
 { 
-    (void)options;
-    return add_udp_send_data(data, size, addr);    
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    return send_packet(&iov, 1, NULL, addr, options);
+}
+
+int AsyncUDPSocket::send_to_v(const struct iovec* iov, size_t iov_count,
+        const SocketAddress& addr, const PacketOptions& options)
+{
+    return send_packet(iov, iov_count, NULL, addr, options);
+}
+
+int AsyncUDPSocket::send_packet_buffer(const scoped_refptr<PacketBuffer>& buffer,
+        const SocketAddress& addr, const PacketOptions& options)
+{
+    struct iovec iov;
+    iov.iov_base = buffer->data();
+    iov.iov_len = buffer->size();
+    return send_packet(&iov, 1, buffer.get(), addr, options);
+}
+
+int AsyncUDPSocket::send_packet(const struct iovec* iov, size_t iov_count,
+        PacketBuffer* buffer, const SocketAddress& addr,
+        const PacketOptions& options)
+{
+    int tos = traffic_class(options);
+    int size = static_cast<int>(iov_length(iov, iov_count));
+#ifdef HAVE_IO_URING
+    if (_uring_io) {
+        // Keep the order: once packets wait, new ones queue behind them.
+        if (_send_queue.empty() && _uring_io->send(iov, iov_count, buffer, addr, tos)) {
+            ++_inline_sent_packets;
+            return size;
+        }
+        if (_send_queue.empty()) {
+            // Every send slot of the ring is in flight.
+            _stats.count_would_block();
+        }
+        if (!push_send_queue(iov, iov_count, buffer, addr, tos, options.priority)) {
+            return -1;
+        }
+        return size;
+    }
+#endif
+    if (_direct_send && !_send_queue.has_pending(addr)) {
+        int sent;
+        if (tos < 0 && 1 == iov_count) {
+            sent = _socket->send_to(iov[0].iov_base, iov[0].iov_len, addr);
+        } else if (tos < 0) {
+            sent = _socket->send_to_v(iov, iov_count, addr);
+        } else {
+            // Only a msghdr carries the per packet marking.
+            SendMessage msg;
+            msg.iov = iov;
+            msg.iov_count = iov_count;
+            msg.size = size;
+            msg.addr = &addr;
+            msg.tos = tos;
+            sent = _socket->send_to_batch(&msg, 1);
+            if (sent > 0) {
+                sent = size;
+            }
+        }
+        if (sent > 0) {
+            ++_inline_sent_packets;
+            _stats.count_sent(1, sent, now_ms());
+            rtcbase::SentPacket sent_packet(-1, rtcbase::time_millis());
+            signal_sent_packet(this, sent_packet);
+            return sent;
+        } else if (-1 == sent) {
+            _stats.count_send_errors(1);
+            return -1;
+        }
+        // The socket would block, fall back to the queue.
+        _stats.count_would_block();
+    }
+    return add_udp_send_data(iov, iov_count, buffer, addr, tos, options.priority);
+}
+
+int AsyncUDPSocket::traffic_class(const PacketOptions& options) const {
+    if (DSCP_NO_CHANGE == options.dscp && ECN_NO_CHANGE == options.ecn) {
+        return -1;
+    }
+    int dscp = (DSCP_NO_CHANGE == options.dscp) ? _dscp : options.dscp;
+    int ecn = (ECN_NO_CHANGE == options.ecn) ? ECN_NOT_ECT : options.ecn;
+    return (dscp << 2) | ecn;
 }
 
 void AsyncUDPSocket::recv_data(int fd) {
     assert(_socket->get_fd() == fd);
+    (void)fd;
 
-    SocketAddress remote_addr;
-    int64_t timestamp;
-    int len = _socket->recv_from(_buf, _size, &remote_addr, &timestamp);
-    SocketAddress local_addr = _socket->get_local_address();
-    if (len < 0) {
-        // An error here typically means we got an ICMP error in response to our
-        // send datagram, indicating the remote address was unreachable.
-        // When doing ICE, this kind of thing will often happen.
-        // TODO: Do something better like forwarding the error to the user.
-        LOG(LS_WARNING) << "AsyncUDPSocket[" << local_addr.to_sensitive_string() << "] "
-            << "receive failed with error " << _socket->get_error();
+    // Always through recvmmsg(), even for a single slot: the control
+    // messages carry the timestamp, GRO segment size and ECN field, and the
+    // truncation of a datagram is reported.
+    recv_batch_data();
+}
+
+void AsyncUDPSocket::recv_batch_data() {
+    int count = _socket->recv_from_batch(&_recv_msgs[0], _recv_msgs.size());
+    if (count < 0) {
+        LOG(LS_WARNING) << "AsyncUDPSocket[" 
+            << _socket->get_local_address().to_sensitive_string() << "] "
+            << "batch receive failed with error " << _socket->get_error();
         return;
-    } else if (0 == len) {
-        LOG(LS_WARNING) << "AsyncUDPSocket[" << local_addr.to_sensitive_string() << "] "
-            << "receive zero bytes";
+    }
+    
+    for (int i = 0; i < count; ++i) {
+        ReceivedMessage& msg = _recv_msgs[i];
+        if (msg.truncated) {
+            LOG(LS_WARNING) << "AsyncUDPSocket drop truncated packet from " 
+                << msg.addr.to_sensitive_string() << ", slot size: " << msg.length;
+            _stats.count_recv_drop();
+            continue;
+        } else if (msg.received <= 0) {
+            continue;
+        }
+        count_received(static_cast<size_t>(msg.received), msg.segment_size);
+        
+        PacketTime packet_time = (msg.timestamp > -1 ? 
+                PacketTime(msg.timestamp, 0) : create_packet_time(0));
+        if (msg.tos >= 0) {
+            packet_time.ecn = static_cast<EcnCodepoint>(msg.tos & 0x3);
+        }
+        if (!_recv_buffers.empty()) {
+            scoped_refptr<PacketBuffer>& buffer = _recv_buffers[i];
+            buffer->set_size(static_cast<size_t>(msg.received));
+            deliver_buffer(buffer, msg.addr, packet_time);
+            if (!buffer->has_one_ref()) {
+                // A listener kept the packet, the slot needs a new buffer.
+                buffer = _packet_pool->allocate();
+                msg.buffer = buffer->data();
+            }
+            continue;
+        }
+        deliver_packet(static_cast<const char*>(msg.buffer),
+                static_cast<size_t>(msg.received), msg.addr, packet_time,
+                msg.segment_size);
+    }
+}
+
+void AsyncUDPSocket::deliver_packet(const char* data, size_t size,
+        const SocketAddress& addr, const PacketTime& packet_time,
+        int segment_size)
+{
+    if (segment_size <= 0 && !_packet_pool) {
+        if (!dispatch_flow(data, size, addr, packet_time, NULL)) {
+            signal_read_packet(this, data, size, addr, packet_time);
+        }
+        return;
+    }
+
+    // Split a GRO super-datagram back into the original packets.
+    size_t segment = (segment_size > 0 ? static_cast<size_t>(segment_size) : size);
+    for (size_t offset = 0; offset < size; offset += segment) {
+        size_t len = std::min(segment, size - offset);
+        if (!_packet_pool) {
+            if (!dispatch_flow(data + offset, len, addr, packet_time, NULL)) {
+                signal_read_packet(this, data + offset, len, addr, packet_time);
+            }
+            continue;
+        }
+
+        if (len > _packet_pool->buffer_size()) {
+            LOG(LS_WARNING) << "AsyncUDPSocket drop packet of " << len
+                << " bytes from " << addr.to_sensitive_string()
+                << ", packet buffer size: " << _packet_pool->buffer_size();
+            _stats.count_recv_drop();
+            continue;
+        }
+        scoped_refptr<PacketBuffer> buffer = _packet_pool->allocate();
+        memcpy(buffer->data(), data + offset, len);
+        buffer->set_size(len);
+        deliver_buffer(buffer, addr, packet_time);
+    }
+}
+
+void AsyncUDPSocket::deliver_buffer(const scoped_refptr<PacketBuffer>& buffer,
+        const SocketAddress& addr, const PacketTime& packet_time)
+{
+    const char* data = reinterpret_cast<const char*>(buffer->data());
+    if (dispatch_flow(data, buffer->size(), addr, packet_time, buffer.get())) {
         return;
     }
+    signal_read_packet_buffer(this, buffer, addr, packet_time);
+    signal_read_packet(this, data, buffer->size(), addr, packet_time);
+}
+
+void AsyncUDPSocket::count_received(size_t size, int segment_size) {
+    size_t packets = 1;
+    if (segment_size > 0) {
+        packets = (size + segment_size - 1) / static_cast<size_t>(segment_size);
+    }
+    _stats.count_received(packets, size, now_ms());
+}
 
-    // TODO: Make sure that we got all of the packet.
-    // If we did not, then we should resize our buffer to be large enough.
-    signal_read_packet(
-            this, _buf, static_cast<size_t>(len), remote_addr,
-            (timestamp > -1 ? PacketTime(timestamp, 0) : create_packet_time(0))); 
+bool AsyncUDPSocket::dispatch_flow(const char* data, size_t size,
+        const SocketAddress& addr, const PacketTime& packet_time,
+        PacketBuffer* buffer)
+{
+    if (!_flow_table) {
+        return false;
+    }
+    void* flow_data = _flow_table->lookup(SocketAddressKey(addr));
+    if (!flow_data) {
+        return false;
+    }
+    _flow_cb(this, data, size, addr, packet_time, buffer, flow_data);
+    return true;
 }
 
 int AsyncUDPSocket::close() {
+#ifdef HAVE_IO_URING
+    if (_uring_io) {
+        _uring_io->detach();
+        _uring_io = NULL;
+    }
+#endif
     disable_events(EventLoop::READ | EventLoop::WRITE); 
     return _socket->close();
 }
@@ -186,17 +635,358 @@ AsyncUDPSocket::State AsyncUDPSocket::get_state() const {
 }
 
 int AsyncUDPSocket::get_option(Socket::Option opt, int* value) {
+    if (opt == Socket::OPT_UDP_SEGMENT) {
+        *value = _gso_enabled ? 1 : 0;
+        return 0;
+    }
     return _socket->get_option(opt, value);
 }
 
 int AsyncUDPSocket::set_option(Socket::Option opt, int value) {
-    return _socket->set_option(opt, value);
+    if (opt == Socket::OPT_UDP_SEGMENT) {
+        return enable_gso(value != 0);
+    }
+    
+    int ret = _socket->set_option(opt, value);
+    if (0 == ret && opt == Socket::OPT_DSCP) {
+        _dscp = value;
+    }
+    if (0 == ret && opt == Socket::OPT_UDP_GRO) {
+        bool was_pooled = pooled_receive();
+        _gro_enabled = (value != 0);
+        if ((_gro_enabled && _size < BUF_SIZE) || was_pooled != pooled_receive()) {
+            set_recv_batch_size(_recv_msgs.size(), _size);
+        }
+    }
+    return ret;
+}
+
+int AsyncUDPSocket::enable_gso(bool enable) {
+    if (enable) {
+        // Only probe for kernel support. Setting UDP_SEGMENT on the socket
+        // would segment every large send, the size is passed per message.
+        int segment_size = 0;
+        if (_socket->get_option(Socket::OPT_UDP_SEGMENT, &segment_size) != 0) {
+            LOG(LS_WARNING) << "UDP segmentation offload not supported";
+            return -1;
+        }
+        _send_msgs.resize(GSO_BATCH_SIZE);
+        _gso_msgs.resize(GSO_BATCH_SIZE);
+        _gso_iovs.resize(GSO_BATCH_SIZE);
+        _gso_packets.resize(GSO_BATCH_SIZE);
+    }
+    _gso_enabled = enable;
+    return 0;
 }
 
 int AsyncUDPSocket::get_error() const {
     return _socket->get_error();
 }
 
+//////////////////////// io_uring ////////////////
+
+#ifdef HAVE_IO_URING
+
+AsyncUDPSocket::UringIo::UringIo(AsyncUDPSocket* owner, IoUring* ring, int fd) :
+    _owner(owner), _ring(ring), _fd(fd), _id(ring->register_handler(this)),
+    _recv_armed(false), _send_slots(URING_SEND_SLOTS),
+    _send_data(new char[URING_SEND_SLOTS * URING_SEND_SLOT_SIZE]),
+    _free_send(-1), _sends_in_flight(0), _cancel_in_flight(false)
+{
+    memset(&_recv_msg, 0, sizeof(_recv_msg));
+    for (size_t i = URING_SEND_SLOTS; i > 0; --i) {
+        SendSlot& slot = _send_slots[i - 1];
+        slot.data = _send_data.get() + (i - 1) * URING_SEND_SLOT_SIZE;
+        slot.heap_data = NULL;
+        slot.next_free = _free_send;
+        _free_send = (int)(i - 1);
+    }
+}
+
+AsyncUDPSocket::UringIo::~UringIo() {
+    if (_ring) {
+        _ring->unregister_handler(_id);
+    }
+    for (size_t i = 0; i < _send_slots.size(); ++i) {
+        delete [] _send_slots[i].heap_data;
+    }
+}
+
+bool AsyncUDPSocket::UringIo::start(size_t buffer_count, size_t max_packet_size,
+        bool gro)
+{
+    // Multishot recvmsg lays out every buffer as io_uring_recvmsg_out, the
+    // source address, the control messages and then the payload.
+    _recv_msg.msg_namelen = sizeof(struct sockaddr_storage);
+    _recv_msg.msg_controllen = CMSG_SPACE(sizeof(struct timespec))
+        + CMSG_SPACE(sizeof(int)) + (gro ? CMSG_SPACE(sizeof(int)) : 0);
+    size_t header = sizeof(struct io_uring_recvmsg_out)
+        + _recv_msg.msg_namelen + _recv_msg.msg_controllen;
+
+    _buffers.reset(IoUringBufferRing::create(_ring, (unsigned)buffer_count,
+                header + max_packet_size));
+    if (!_buffers) {
+        return false;
+    }
+    return arm_recv();
+}
+
+bool AsyncUDPSocket::UringIo::arm_recv() {
+    struct io_uring_sqe* sqe = _ring->get_sqe();
+    if (!sqe) {
+        LOG(LS_WARNING) << "io_uring submission queue full, receive not armed";
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = _fd;
+    sqe->addr = (uint64_t)(uintptr_t)&_recv_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = _buffers->group_id();
+    sqe->user_data = IoUring::user_data(_id, TAG_RECV);
+    _recv_armed = true;
+    return true;
+}
+
+bool AsyncUDPSocket::UringIo::send(const struct iovec* iov, size_t iov_count,
+        PacketBuffer* buffer, const SocketAddress& addr, int tos)
+{
+    if (_free_send < 0 || !_ring) {
+        return false;
+    }
+    struct io_uring_sqe* sqe = _ring->get_sqe();
+    if (!sqe) {
+        return false;
+    }
+
+    int index = _free_send;
+    SendSlot& slot = _send_slots[index];
+    _free_send = slot.next_free;
+    ++_sends_in_flight;
+
+    char* buf = slot.data;
+    size_t size = iov_length(iov, iov_count);
+    if (buffer) {
+        slot.buffer = buffer;
+        buf = reinterpret_cast<char*>(buffer->data());
+    } else {
+        if (size > URING_SEND_SLOT_SIZE) {
+            slot.heap_data = new char[size];
+            buf = slot.heap_data;
+        }
+        iov_gather(buf, iov, iov_count);
+    }
+    slot.iov.iov_base = buf;
+    slot.iov.iov_len = size;
+    memset(&slot.msg, 0, sizeof(slot.msg));
+    slot.msg.msg_name = &slot.addr;
+    slot.msg.msg_namelen = addr.to_sockaddr_storage(&slot.addr);
+    slot.msg.msg_iov = &slot.iov;
+    slot.msg.msg_iovlen = 1;
+    slot.msg.msg_control = slot.control;
+    fill_send_control(&slot.msg, tos, 0);
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = _fd;
+    sqe->addr = (uint64_t)(uintptr_t)&slot.msg;
+    sqe->len = 1;
+    sqe->user_data = IoUring::user_data(_id, (uint32_t)index);
+    return true;
+}
+
+void AsyncUDPSocket::UringIo::detach() {
+    _owner = NULL;
+    if (_ring && (_recv_armed || _sends_in_flight > 0)) {
+        struct io_uring_sqe* sqe = _ring->get_sqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = _fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = IoUring::user_data(_id, TAG_CANCEL);
+            _cancel_in_flight = true;
+            // Before the socket is closed.
+            _ring->submit();
+        }
+    }
+    maybe_delete();
+}
+
+void AsyncUDPSocket::UringIo::maybe_delete() {
+    if (!_owner && (!_ring ||
+                (!_recv_armed && 0 == _sends_in_flight && !_cancel_in_flight)))
+    {
+        delete this;
+    }
+}
+
+void AsyncUDPSocket::UringIo::on_ring_destroyed() {
+    // The buffer ring has to be unregistered while the ring still exists.
+    _buffers.reset();
+    _ring = NULL;
+    _recv_armed = false;
+    maybe_delete();
+}
+
+void AsyncUDPSocket::UringIo::on_completion(uint32_t tag, int32_t res,
+        uint32_t flags)
+{
+    if (TAG_RECV == tag) {
+        on_recv(res, flags);
+    } else if (TAG_CANCEL == tag) {
+        _cancel_in_flight = false;
+        maybe_delete();
+    } else if (tag < _send_slots.size()) {
+        on_sent(tag, res);
+    }
+}
+
+void AsyncUDPSocket::UringIo::on_recv(int32_t res, uint32_t flags) {
+    if (res >= 0 && (flags & IORING_CQE_F_BUFFER)) {
+        uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (_owner) {
+            deliver(_buffers->buffer(bid), (size_t)res);
+        }
+        _buffers->recycle(bid);
+    } else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+        LOG(LS_WARNING) << "AsyncUDPSocket io_uring receive failed with error " << -res;
+    }
+
+    if (flags & IORING_CQE_F_MORE) {
+        return;
+    }
+    // The kernel ended the multishot request, e.g. because it ran out of
+    // buffers, which are all back by now.
+    _recv_armed = false;
+    if (_owner) {
+        arm_recv();
+    } else {
+        maybe_delete();
+    }
+}
+
+void AsyncUDPSocket::UringIo::deliver(char* buf, size_t size) {
+    const struct io_uring_recvmsg_out* out = (const struct io_uring_recvmsg_out*)buf;
+    size_t header = sizeof(*out) + _recv_msg.msg_namelen + _recv_msg.msg_controllen;
+    if (size < header) {
+        return;
+    }
+    if (out->flags & MSG_TRUNC) {
+        LOG(LS_WARNING) << "AsyncUDPSocket drop truncated packet, buffer size: "
+            << _buffers->buffer_size() - header;
+        _owner->_stats.count_recv_drop();
+        return;
+    }
+
+    SocketAddress addr;
+    struct sockaddr_storage name;
+    memset(&name, 0, sizeof(name));
+    memcpy(&name, buf + sizeof(*out),
+            std::min((size_t)out->namelen, sizeof(name)));
+    socket_address_from_sockaddr_storage(name, &addr);
+
+    ReceivedMessage msg;
+    if (out->controllen > 0) {
+        struct msghdr control;
+        memset(&control, 0, sizeof(control));
+        control.msg_control = buf + sizeof(*out) + _recv_msg.msg_namelen;
+        control.msg_controllen = out->controllen;
+        bool offset_valid = false;
+        int64_t offset_nanos = 0;
+        parse_recv_control(&control, &msg, &offset_valid, &offset_nanos);
+    }
+
+    PacketTime packet_time = (msg.timestamp > -1 ?
+            PacketTime(msg.timestamp, 0) : create_packet_time(0));
+    if (msg.tos >= 0) {
+        packet_time.ecn = static_cast<EcnCodepoint>(msg.tos & 0x3);
+    }
+    _owner->count_received(out->payloadlen, msg.segment_size);
+    _owner->deliver_packet(buf + header, out->payloadlen, addr,
+            packet_time, msg.segment_size);
+}
+
+void AsyncUDPSocket::UringIo::on_sent(uint32_t index, int32_t res) {
+    SendSlot& slot = _send_slots[index];
+    delete [] slot.heap_data;
+    slot.heap_data = NULL;
+    slot.buffer = NULL;
+    slot.next_free = _free_send;
+    _free_send = (int)index;
+    --_sends_in_flight;
+
+    if (!_owner) {
+        maybe_delete();
+        return;
+    }
+
+    if (res < 0) {
+        LOG(LS_WARNING) << "AsyncUDPSocket io_uring send failed with error " << -res;
+        _owner->_stats.count_send_errors(1);
+    } else {
+        _owner->_stats.count_sent(1, (size_t)res, _owner->now_ms());
+        rtcbase::SentPacket sent_packet(-1, rtcbase::time_millis());
+        _owner->signal_sent_packet(_owner, sent_packet);
+    }
+    _owner->flush_uring_sends();
+}
+
+#endif  // HAVE_IO_URING
+
+int AsyncUDPSocket::enable_io_uring(size_t buffer_count, size_t max_packet_size) {
+#ifdef HAVE_IO_URING
+    if (_uring_io) {
+        return 0;
+    }
+    IoUring* ring = _el->io_uring();
+    if (!ring) {
+        LOG(LS_WARNING) << "The event loop has no io_uring";
+        return -1;
+    }
+    if (_gro_enabled && max_packet_size < BUF_SIZE) {
+        max_packet_size = BUF_SIZE;
+    }
+
+    UringIo* uring_io = new UringIo(this, ring, _socket->get_fd());
+    if (!uring_io->start(buffer_count, max_packet_size, _gro_enabled)) {
+        uring_io->detach();
+        return -1;
+    }
+    _uring_io = uring_io;
+    disable_events(EventLoop::READ | EventLoop::WRITE);
+    // Whatever is queued goes out through the ring from now on.
+    flush_uring_sends();
+    return 0;
+#else
+    (void)buffer_count;
+    (void)max_packet_size;
+    LOG(LS_WARNING) << "Built without io_uring support";
+    return -1;
+#endif
+}
+
+void AsyncUDPSocket::flush_uring_sends() {
+#ifdef HAVE_IO_URING
+    while (!_send_queue.empty()) {
+        if (0 == _send_queue.peek(&_send_msgs[0], 1)) {
+            return;
+        }
+        // Packets queued by reference are copied into the ring's slot here.
+        const SendMessage& msg = _send_msgs[0];
+        struct iovec iov;
+        iov.iov_base = const_cast<void*>(msg.data);
+        iov.iov_len = msg.size;
+        if (!_uring_io->send(&iov, 1, NULL, *msg.addr, msg.tos)) {
+            return;
+        }
+        if (_stats.sample_queue_delay()) {
+            _stats.add_queue_delay(_el->now_micros() - _send_queue.peeked_push_time(0));
+        }
+        _send_queue.pop(1);
+    }
+#endif
+}
+
 } // namespace rtcbase
 
 
@@ -19,49 +19,34 @@
 #ifndef  __RTCBASE_ASYNC_UDP_SOCKET_H_
 #define  __RTCBASE_ASYNC_UDP_SOCKET_H_
 
+#include <assert.h>
+
 #include <memory>
-#include <map>
+#include <vector>
 
-#include "memcheck.h"
 #include "async_packet_socket.h"
 #include "socket_factory.h"
 #include "event_loop.h"
+#include "flow_table.h"
+#include "packet_buffer.h"
+#include "socket_stats.h"
+#include "udp_send_queue.h"
 
 namespace rtcbase {
 
-class UdpPacketData : public MemCheck {
-public:
-    UdpPacketData(const void* data, size_t size, const SocketAddress& addr) :
-        MemCheck("UdpPacketData"), _data(new char[size]), _size(size), _addr(addr)
-    {
-        memcpy(_data, data, size);
-    }
-     
-    ~UdpPacketData() {
-        if (_data) {
-            delete _data;
-            _data = NULL;    
-        }
-    }
-    
-    char* data() { return _data; }
-    size_t size() { return _size; }
-    SocketAddress addr() { return _addr; }
-
-private:
-    char* _data;
-    size_t _size;
-    SocketAddress _addr;
-};
-
-struct UdpPacketSendQueue {
-    std::list<UdpPacketData*> packet_list;
-};
+class AsyncUDPSocket;
 
-typedef std::map<std::string, UdpPacketSendQueue> UdpDataSendMap;
+// Receives the packets of a known flow, see AsyncUDPSocket::set_flow_table().
+// |buffer| is the packet buffer holding |data| in packet buffer pool mode,
+// keep a scoped_refptr to it to hold on to the packet, NULL otherwise.
+// |flow_data| is the data the flow was inserted with.
+typedef void (*flow_packet_cb_t)(AsyncUDPSocket* socket, const char* data,
+        size_t size, const SocketAddress& addr, const PacketTime& packet_time,
+        PacketBuffer* buffer, void* flow_data);
 
-// Provides the ability to receive packets asynchronously.  Sends are not
-// buffered since it is acceptable to drop packets under high load.
+// Provides the ability to receive packets asynchronously. Sends are queued
+// per destination and priority class and flushed with sendmmsg() once the
+// socket is writable.
 class AsyncUDPSocket : public AsyncPacketSocket {
 public:
     explicit AsyncUDPSocket(EventLoop* el, AsyncSocket* socket);
@@ -72,10 +57,31 @@ public:
 
     SocketAddress get_local_address() const override;
 
+    // Besides the regular socket options:
+    // OPT_UDP_SEGMENT, when non zero, coalesces queued packets of equal size
+    // to the same destination into one UDP GSO send.
+    // OPT_UDP_GRO, when non zero, accepts coalesced receives from the kernel,
+    // which are split back into the original packets before
+    // signal_read_packet.
+    //
+    // PacketOptions::dscp and ecn mark single packets through a control
+    // message of the send, the ECN field of received packets is reported in
+    // PacketTime::ecn.
+
     int send_to(const void* data,
             size_t size,
             const SocketAddress& addr,
             const rtcbase::PacketOptions& options) override;
+    // A packet that goes out right away is handed to sendmsg() as is, one
+    // that has to wait is gathered straight into the send queue.
+    int send_to_v(const struct iovec* iov, size_t iov_count,
+            const SocketAddress& addr, const PacketOptions& options) override;
+    // Sends the packet held in |buffer|, e.g. one received through
+    // signal_read_packet_buffer being forwarded. While it waits in the send
+    // queue, the queue keeps a reference to |buffer| instead of a copy, so
+    // its data must not change until it is sent.
+    int send_packet_buffer(const scoped_refptr<PacketBuffer>& buffer,
+            const SocketAddress& addr, const PacketOptions& options);
     int close() override;
 
     State get_state() const override;
@@ -84,22 +90,164 @@ public:
 
     int get_error() const override;
 
+    // Drains up to |batch_size| datagrams per read event with one recvmmsg()
+    // call. Each datagram is received into its own |max_packet_size| bytes
+    // slot, larger datagrams are dropped. A |batch_size| of 1 restores the
+    // default one datagram per event behaviour.
+    void set_recv_batch_size(size_t batch_size, size_t max_packet_size);
+    size_t recv_batch_size() const { return _recv_msgs.size(); }
+
+    // Receives into buffers of |pool| instead of the socket's own buffer,
+    // and emits each packet with signal_read_packet_buffer before
+    // signal_read_packet. Listeners keep a packet by keeping its
+    // scoped_refptr, no copy needed. Datagrams larger than the pool's
+    // buffer size are dropped. Coalesced (GRO) and io_uring receives still
+    // land in the socket's buffers, their packets are copied into the pool.
+    // A null |pool| switches back.
+    void set_packet_buffer_pool(const scoped_refptr<PacketBufferPool>& pool);
+    PacketBufferPool* packet_buffer_pool() const { return _packet_pool.get(); }
+
+    // Emitted for each packet received while a packet buffer pool is set.
+    rtcbase::Signal4<AsyncPacketSocket*, const scoped_refptr<PacketBuffer>&,
+        const SocketAddress&, const PacketTime&> signal_read_packet_buffer;
+
+    // Packets from a source that has a flow in |table| go to |cb| with the
+    // flow's data instead of to the signals, which then only see the
+    // packets of unknown sources, e.g. the first packet of a new session.
+    // The table may be shared by several sockets of the loop, a null
+    // |table| switches back. |cb| is required with a table.
+    void set_flow_table(FlowTable* table, flow_packet_cb_t cb) {
+        assert(!table || cb);
+        _flow_table = table;
+        _flow_cb = cb;
+    }
+    FlowTable* flow_table() const { return _flow_table; }
+
+    // In direct send mode send_to() calls the socket right away when nothing
+    // is queued for the destination, saving the copy into the send queue and
+    // the wait for the next write event. The packet is only queued when the
+    // socket would block. Disabled by default.
+    void set_direct_send(bool enable) { _direct_send = enable; }
+    bool direct_send() const { return _direct_send; }
+
+    // Bounds the packets waiting for the socket to become writable, which
+    // are unbounded by default. A full queue makes room according to
+    // |policy|, see PacketOptions::priority. send_to() returns -1 for a
+    // packet that is dropped right away, get_error() then is EWOULDBLOCK.
+    void set_send_queue_limits(size_t max_packets, size_t max_bytes,
+            UdpSendQueue::DropPolicy policy)
+    {
+        _send_queue.set_limits(max_packets, max_bytes, policy);
+    }
+    // Queue depth and drop counters.
+    void get_send_queue_stats(UdpSendQueue::Stats* stats) const {
+        _send_queue.get_stats(stats);
+    }
+
+    // Number of packets sent straight from send_to() and number of packets
+    // that went through the send queue.
+    uint64_t inline_sent_packets() const { return _inline_sent_packets; }
+    uint64_t queued_packets() const { return _queued_packets; }
+
+    // Traffic counters of the socket, safe to snapshot from any thread.
+    const SocketStats& stats() const { return _stats; }
+    // Every |interval_ms| the loop publishes the send and receive rates of
+    // the last second, the queueing delay percentiles of the last sampled
+    // packets and the send queue depth into stats(). Costs a timer and a
+    // little more work per packet, an |interval_ms| of 0, the default,
+    // only keeps the counters.
+    void set_stats_interval(int64_t interval_ms);
+    void publish_stats();
+
+    // Moves the socket onto the loop's io_uring (EventLoop::enable_io_uring()):
+    // one multishot recvmsg keeps receiving into |buffer_count| provided
+    // buffers of |max_packet_size| bytes, and sends are submitted as sendmsg
+    // entries flushed once per loop iteration, so neither direction costs a
+    // system call per packet. |buffer_count| must be a power of two. Returns
+    // -1 when io_uring is not available, the socket keeps working as before.
+    int enable_io_uring(size_t buffer_count, size_t max_packet_size);
+    bool io_uring_enabled() const { return _uring_io != NULL; }
+
     void send_data();
     void recv_data(int fd);
 
 protected:
-    int add_udp_send_data(const void* data, size_t size, const SocketAddress& addr);
+    // The send path of send_to(), send_to_v() and send_packet_buffer(),
+    // |buffer| is the packet's PacketBuffer if it has one.
+    int send_packet(const struct iovec* iov, size_t iov_count,
+            PacketBuffer* buffer, const SocketAddress& addr,
+            const PacketOptions& options);
+    bool push_send_queue(const struct iovec* iov, size_t iov_count,
+            PacketBuffer* buffer, const SocketAddress& addr, int tos,
+            PacketPriority priority);
+    int add_udp_send_data(const struct iovec* iov, size_t iov_count,
+            PacketBuffer* buffer, const SocketAddress& addr, int tos,
+            PacketPriority priority);
+    // Traffic class byte for a packet sent with |options|, -1 for the
+    // socket's default.
+    int traffic_class(const PacketOptions& options) const;
+    void recv_batch_data();
+    void deliver_packet(const char* data, size_t size, const SocketAddress& addr,
+            const PacketTime& packet_time, int segment_size);
+    void deliver_buffer(const scoped_refptr<PacketBuffer>& buffer,
+            const SocketAddress& addr, const PacketTime& packet_time);
+    // Returns false when the packet's source has no flow.
+    bool dispatch_flow(const char* data, size_t size, const SocketAddress& addr,
+            const PacketTime& packet_time, PacketBuffer* buffer);
+    // Whether reads go straight into packet buffers.
+    bool pooled_receive() const { return _packet_pool && !_gro_enabled; }
+
+    // Both return true when the socket would block.
+    bool send_batch();
+    bool send_gso_batch();
+    void on_packets_sent(size_t count);
+    // |size| bytes received as a datagram, coalesced when |segment_size| > 0.
+    void count_received(size_t size, int segment_size);
+    // Counts what the send queue dropped since the last call.
+    void count_queue_drops();
+    int64_t now_ms() const { return _el->now_micros() / 1000; }
+    int enable_gso(bool enable);
+
+    void flush_uring_sends();
 
 private:
+    class UringIo;
+
     std::unique_ptr<AsyncSocket> _socket;
     char* _buf;
     size_t _size;
+    std::vector<ReceivedMessage> _recv_msgs;
+    scoped_refptr<PacketBufferPool> _packet_pool;
+    // The buffers behind |_recv_msgs| in pooled receive mode.
+    std::vector<scoped_refptr<PacketBuffer> > _recv_buffers;
+    FlowTable* _flow_table;
+    flow_packet_cb_t _flow_cb;
 
     EventLoop* _el;
     IOWatcher* _socket_watcher;
 
-    UdpDataSendMap _udp_data_send_map;
-    int _total_send_data;
+    UdpSendQueue _send_queue;
+    std::vector<SendMessage> _send_msgs;
+    bool _direct_send;
+    // The socket's OPT_DSCP, the base of packets that only set an ECN mark.
+    int _dscp;
+    uint64_t _inline_sent_packets;
+    uint64_t _queued_packets;
+
+    SocketStats _stats;
+    TimerWatcher* _stats_timer;
+    // The send queue's dropped_packets() as of the last count_queue_drops().
+    uint64_t _counted_queue_drops;
+
+    bool _gso_enabled;
+    bool _gro_enabled;
+    std::vector<SendMessage> _gso_msgs;
+    std::vector<struct iovec> _gso_iovs;
+    std::vector<size_t> _gso_packets; // Number of packets in each message.
+
+    // Owns itself once the socket is gone, until the kernel has returned
+    // every request still in flight.
+    UringIo* _uring_io;
 };
 
 }  // namespace rtcbase
@@ -41,6 +41,26 @@ public:
         return __sync_val_compare_and_swap(i, old_value, new_value);
     }
     
+    // Relaxed accessors for counters that have a single writer and are
+    // only read by other threads: no ordering and no locked instruction,
+    // but never a torn value.
+    template <typename T>
+    static T relaxed_load(volatile const T* i) {
+        return __atomic_load_n(i, __ATOMIC_RELAXED);
+    }
+
+    template <typename T>
+    static void relaxed_store(volatile T* i, T value) {
+        __atomic_store_n(i, value, __ATOMIC_RELAXED);
+    }
+
+    // Adds |value| to a single writer counter.
+    template <typename T>
+    static void relaxed_add(volatile T* i, T value) {
+        __atomic_store_n(i, __atomic_load_n(i, __ATOMIC_RELAXED) + value,
+                __ATOMIC_RELAXED);
+    }
+    
     // Pointer variants.
     template <typename T>
     static T* acquire_load_ptr(T* volatile* ptr) {
@@ -51,6 +71,11 @@ public:
     static T* compare_and_swap_ptr(T* volatile* ptr, T* old_value, T* new_value) {
         return __sync_val_compare_and_swap(ptr, old_value, new_value);
     }
+
+    template <typename T>
+    static T* exchange_ptr(T* volatile* ptr, T* new_value) {
+        return __atomic_exchange_n(ptr, new_value, __ATOMIC_ACQ_REL);
+    }
 };
 
 } // namespace rtcbase
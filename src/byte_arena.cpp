@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file byte_arena.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <algorithm>
+#include <utility>
+
+#include "byte_arena.h"
+
+namespace rtcbase {
+
+const size_t ByteArena::ALIGNMENT;
+
+static inline size_t align_up(size_t offset) {
+    return (offset + ByteArena::ALIGNMENT - 1) & ~(ByteArena::ALIGNMENT - 1);
+}
+
+ByteArena::ByteArena(size_t chunk_size) :
+    MemCheck("ByteArena"),
+    _chunk_size(std::max(chunk_size, ALIGNMENT)), _current(0), _used(0)
+{
+}
+
+ByteArena::~ByteArena() {}
+
+char* ByteArena::allocate(size_t size) {
+    size_t offset = align_up(_used);
+    if (_current >= _chunks.size() || offset + size > _chunks[_current].size) {
+        next_chunk(size);
+        offset = 0;
+    }
+    _used = offset + size;
+    return _chunks[_current].data.get() + offset;
+}
+
+char* ByteArena::allocate_rest(size_t min_size, size_t* size) {
+    size_t offset = align_up(_used);
+    if (_current >= _chunks.size() || offset + min_size > _chunks[_current].size) {
+        next_chunk(min_size);
+        offset = 0;
+    }
+    Chunk& chunk = _chunks[_current];
+    *size = chunk.size - offset;
+    _used = chunk.size;
+    return chunk.data.get() + offset;
+}
+
+void ByteArena::next_chunk(size_t size) {
+    size_t next = (_current < _chunks.size()) ? _current + 1 : _current;
+    if (next >= _chunks.size() || _chunks[next].size < size) {
+        // The chunks of earlier rounds are reused in order, a larger one is
+        // put in front of the next.
+        Chunk chunk;
+        chunk.size = std::max(size, _chunk_size);
+        chunk.data.reset(new char[chunk.size]);
+        _chunks.insert(_chunks.begin() + next, std::move(chunk));
+    }
+    _current = next;
+    _used = 0;
+}
+
+void ByteArena::reset() {
+    _current = 0;
+    _used = 0;
+}
+
+size_t ByteArena::capacity() const {
+    size_t capacity = 0;
+    for (size_t i = 0; i < _chunks.size(); ++i) {
+        capacity += _chunks[i].size;
+    }
+    return capacity;
+}
+
+} // namespace rtcbase
+
+
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file byte_arena.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_BYTE_ARENA_H_
+#define  __RTCBASE_BYTE_ARENA_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+#include "memcheck.h"
+#include "constructor_magic.h"
+
+namespace rtcbase {
+
+// Hands out memory from large chunks by bumping a pointer, and takes it all
+// back at once with reset(), which keeps the chunks for the next round. Once
+// it has grown to the working set, e.g. the messages built for one packet,
+// allocating from it costs no call to the heap. Allocations are aligned for
+// any type. Not thread safe.
+class ByteArena : public MemCheck {
+public:
+    static const size_t ALIGNMENT = 16;
+
+    explicit ByteArena(size_t chunk_size = 4096);
+    ~ByteArena();
+
+    // |size| bytes valid until reset(). Sizes over the chunk size get a
+    // chunk of their own.
+    char* allocate(size_t size);
+    // Takes whatever the current chunk has left, at least |min_size| bytes,
+    // moving on to the next chunk if it has less. The size taken is stored
+    // in |*size|.
+    char* allocate_rest(size_t min_size, size_t* size);
+
+    // Frees everything allocated, the chunks are kept.
+    void reset();
+
+    size_t chunk_size() const { return _chunk_size; }
+    // Memory held, in use or not.
+    size_t capacity() const;
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    // Makes |_current| a chunk with at least |size| bytes free.
+    void next_chunk(size_t size);
+
+    const size_t _chunk_size;
+    std::vector<Chunk> _chunks;
+    // Chunk allocated from and the bytes of it in use.
+    size_t _current;
+    size_t _used;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(ByteArena);
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_BYTE_ARENA_H_
+
+
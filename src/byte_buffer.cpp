@@ -22,11 +22,55 @@
 #include "basic_types.h"
 #include "byte_order.h"
 #include "byte_buffer.h"
+#include "varint.h"
 
 namespace rtcbase {
 
 static const int DEFAULT_SIZE = 4096;
 
+// The byte order conversions shared by the writers.
+static inline uint16_t to_order16(ByteBuffer::ByteOrder order, uint16_t val) {
+    return (order == ByteBuffer::ORDER_NETWORK) ? host_to_network16(val) : val;
+}
+
+static inline uint32_t to_order32(ByteBuffer::ByteOrder order, uint32_t val) {
+    return (order == ByteBuffer::ORDER_NETWORK) ? host_to_network32(val) : val;
+}
+
+static inline uint64_t to_order64(ByteBuffer::ByteOrder order, uint64_t val) {
+    return (order == ByteBuffer::ORDER_NETWORK) ? host_to_network64(val) : val;
+}
+
+// Copies |count| 16 or 32 bit values between host order and |order|.
+static inline void copy_ordered16(ByteBuffer::ByteOrder order, void* dst,
+        const void* src, size_t count)
+{
+    if (order == ByteBuffer::ORDER_NETWORK) {
+        host_to_network16_array(dst, src, count);
+    } else {
+        memcpy(dst, src, count * 2);
+    }
+}
+
+static inline void copy_ordered32(ByteBuffer::ByteOrder order, void* dst,
+        const void* src, size_t count)
+{
+    if (order == ByteBuffer::ORDER_NETWORK) {
+        host_to_network32_array(dst, src, count);
+    } else {
+        memcpy(dst, src, count * 4);
+    }
+}
+
+// The 3 bytes of |*v|, once converted, that hold a 24 bit value.
+static inline const char* uint24_start(ByteBuffer::ByteOrder order, const uint32_t* v) {
+    const char* start = reinterpret_cast<const char*>(v);
+    if (order == ByteBuffer::ORDER_NETWORK || is_host_big_endian()) {
+        ++start;
+    }
+    return start;
+}
+
 ///////////////////// ByteBufferWriter //////////////////
 
 ByteBufferWriter::ByteBufferWriter()
@@ -54,10 +98,18 @@ ByteBufferWriter::ByteBufferWriter(const char* bytes, size_t len,
     construct(bytes, len);
 }
 
+ByteBufferWriter::ByteBufferWriter(const Storage& storage, ByteOrder byte_order)
+    : ByteBuffer(byte_order), _bytes(storage.data), _size(storage.capacity),
+    _start(0), _end(0), _owned(false), _overflow(false)
+{
+}
+
 void ByteBufferWriter::construct(const char* bytes, size_t len) {
     _start = 0;
     _size = len;
     _bytes = new char[_size];
+    _owned = true;
+    _overflow = false;
 
     if (bytes) {
         _end = len;
@@ -68,7 +120,9 @@ void ByteBufferWriter::construct(const char* bytes, size_t len) {
 }
 
 ByteBufferWriter::~ByteBufferWriter() {
-    delete[] _bytes;
+    if (_owned) {
+        delete[] _bytes;
+    }
 }
 
 void ByteBufferWriter::write_uint8(uint8_t val) {
@@ -76,41 +130,33 @@ void ByteBufferWriter::write_uint8(uint8_t val) {
 }
 
 void ByteBufferWriter::write_uint16(uint16_t val) {
-    uint16_t v = (order() == ORDER_NETWORK) ? host_to_network16(val) : val;
+    uint16_t v = to_order16(order(), val);
     write_bytes(reinterpret_cast<const char*>(&v), 2);
 }
 
 void ByteBufferWriter::write_uint24(uint32_t val) {
-    uint32_t v = (order() == ORDER_NETWORK) ? host_to_network32(val) : val;
-    char* start = reinterpret_cast<char*>(&v);
-    if (order() == ORDER_NETWORK || is_host_big_endian()) {
-        ++start;
-    }
-    write_bytes(start, 3);
+    uint32_t v = to_order32(order(), val);
+    write_bytes(uint24_start(order(), &v), 3);
 }
 
 void ByteBufferWriter::write_uint32(uint32_t val) {
-    uint32_t v = (order() == ORDER_NETWORK) ? host_to_network32(val) : val;
+    uint32_t v = to_order32(order(), val);
     write_bytes(reinterpret_cast<const char*>(&v), 4);
 }
 
 void ByteBufferWriter::write_uint64(uint64_t val) {
-    uint64_t v = (order() == ORDER_NETWORK) ? host_to_network64(val) : val;
+    uint64_t v = to_order64(order(), val);
     write_bytes(reinterpret_cast<const char*>(&v), 8);
 }
 
-// Serializes an unsigned varint in the format described by
-// https://developers.google.com/protocol-buffers/docs/encoding#varints
-// with the caveat that integers are 64-bit, not 128-bit.
 void ByteBufferWriter::write_uvarint(uint64_t val) {
-    while (val >= 0x80) {
-        // Write 7 bits at a time, then set the msb to a continuation byte (msb=1).
-        char byte = static_cast<char>(val) | 0x80;
-        write_bytes(&byte, 1);
-        val >>= 7;
+    if (capacity() - length() >= k_uvarint_max_size) {
+        _end += encode_uvarint(val, _bytes + _end);
+        return;
     }
-    char last_byte = static_cast<char>(val);
-    write_bytes(&last_byte, 1);
+    // Encoded in one piece, a varint that does not fit is dropped whole.
+    char bytes[k_uvarint_max_size];
+    write_bytes(bytes, encode_uvarint(val, bytes));
 }
 
 void ByteBufferWriter::write_string(const std::string& val) {
@@ -118,11 +164,48 @@ void ByteBufferWriter::write_string(const std::string& val) {
 }
 
 void ByteBufferWriter::write_bytes(const char* val, size_t len) {
-    memcpy(reserve_write_buffer(len), val, len);
+    char* dst = reserve_write_buffer(len);
+    if (dst) {
+        memcpy(dst, val, len);
+    }
+}
+
+void ByteBufferWriter::write_uint16s(const uint16_t* vals, size_t count) {
+    char* dst = reserve_write_buffer(count * 2);
+    if (dst) {
+        copy_ordered16(order(), dst, vals, count);
+    }
+}
+
+void ByteBufferWriter::write_uint32s(const uint32_t* vals, size_t count) {
+    char* dst = reserve_write_buffer(count * 4);
+    if (dst) {
+        copy_ordered32(order(), dst, vals, count);
+    }
+}
+
+void ByteBufferWriter::write_uvarints(const uint64_t* vals, size_t count) {
+    size_t len = uvarints_size(vals, count);
+    char* dst = reserve_write_buffer(len);
+    if (dst) {
+        encode_uvarints(vals, count, dst, len);
+    }
+}
+
+void ByteBufferWriter::write_packed_uint32s(const uint32_t* vals, size_t count) {
+    size_t len = packed_uint32s_size(vals, count);
+    char* dst = reserve_write_buffer(len);
+    if (dst) {
+        encode_packed_uint32s(vals, count, dst, len);
+    }
 }
 
 char* ByteBufferWriter::reserve_write_buffer(size_t len) {
     if (length() + len > capacity()) {
+        if (!_owned && length() + len > _size) {
+            _overflow = true;
+            return NULL;
+        }
         resize(length() + len);
     }
 
@@ -136,6 +219,10 @@ void ByteBufferWriter::resize(size_t size) {
     if (size <= _size) {
         // Don't reallocate, just move data backwards
         memmove(_bytes, _bytes + _start, len);
+    } else if (!_owned) {
+        // The caller's storage can not grow.
+        _overflow = true;
+        memmove(_bytes, _bytes + _start, len);
     } else {
         // Reallocate a larger buffer.
         _size = std::max(size, 3 * _size / 2);
@@ -151,6 +238,147 @@ void ByteBufferWriter::resize(size_t size) {
 void ByteBufferWriter::clear() {
     memset(_bytes, 0, _size);
     _start = _end = 0;
+    _overflow = false;
+}
+
+//////////////////// ChainedByteBufferWriter ////////////////////
+
+ChainedByteBufferWriter::ChainedByteBufferWriter(ByteArena* arena,
+        ByteOrder byte_order)
+    : ByteBuffer(byte_order), _arena(arena), _head(NULL), _tail(NULL),
+    _length(0), _segment_count(0)
+{
+    assert(arena);
+}
+
+ChainedByteBufferWriter::~ChainedByteBufferWriter() {}
+
+void ChainedByteBufferWriter::write_uint8(uint8_t val) {
+    write_bytes(reinterpret_cast<const char*>(&val), 1);
+}
+
+void ChainedByteBufferWriter::write_uint16(uint16_t val) {
+    uint16_t v = to_order16(order(), val);
+    write_bytes(reinterpret_cast<const char*>(&v), 2);
+}
+
+void ChainedByteBufferWriter::write_uint24(uint32_t val) {
+    uint32_t v = to_order32(order(), val);
+    write_bytes(uint24_start(order(), &v), 3);
+}
+
+void ChainedByteBufferWriter::write_uint32(uint32_t val) {
+    uint32_t v = to_order32(order(), val);
+    write_bytes(reinterpret_cast<const char*>(&v), 4);
+}
+
+void ChainedByteBufferWriter::write_uint64(uint64_t val) {
+    uint64_t v = to_order64(order(), val);
+    write_bytes(reinterpret_cast<const char*>(&v), 8);
+}
+
+void ChainedByteBufferWriter::write_uvarint(uint64_t val) {
+    if (_tail && _tail->capacity - _tail->length >= k_uvarint_max_size) {
+        size_t len = encode_uvarint(val, segment_data(_tail) + _tail->length);
+        _tail->length += len;
+        _length += len;
+        return;
+    }
+    char bytes[k_uvarint_max_size];
+    write_bytes(bytes, encode_uvarint(val, bytes));
+}
+
+void ChainedByteBufferWriter::write_string(const std::string& val) {
+    write_bytes(val.c_str(), val.size());
+}
+
+void ChainedByteBufferWriter::write_bytes(const char* val, size_t len) {
+    if (_tail && _tail->capacity - _tail->length >= len) {
+        memcpy(segment_data(_tail) + _tail->length, val, len);
+        _tail->length += len;
+        _length += len;
+        return;
+    }
+    while (len > 0) {
+        if (!_tail || _tail->length == _tail->capacity) {
+            add_segment(1);
+        }
+        size_t n = std::min(len, _tail->capacity - _tail->length);
+        memcpy(segment_data(_tail) + _tail->length, val, n);
+        _tail->length += n;
+        _length += n;
+        val += n;
+        len -= n;
+    }
+}
+
+void ChainedByteBufferWriter::write_uint16s(const uint16_t* vals, size_t count) {
+    copy_ordered16(order(), reserve_write_buffer(count * 2), vals, count);
+}
+
+void ChainedByteBufferWriter::write_uint32s(const uint32_t* vals, size_t count) {
+    copy_ordered32(order(), reserve_write_buffer(count * 4), vals, count);
+}
+
+void ChainedByteBufferWriter::write_uvarints(const uint64_t* vals, size_t count) {
+    size_t len = uvarints_size(vals, count);
+    encode_uvarints(vals, count, reserve_write_buffer(len), len);
+}
+
+void ChainedByteBufferWriter::write_packed_uint32s(const uint32_t* vals,
+        size_t count)
+{
+    size_t len = packed_uint32s_size(vals, count);
+    encode_packed_uint32s(vals, count, reserve_write_buffer(len), len);
+}
+
+char* ChainedByteBufferWriter::reserve_write_buffer(size_t len) {
+    if (!_tail || _tail->capacity - _tail->length < len) {
+        add_segment(len);
+    }
+    char* start = segment_data(_tail) + _tail->length;
+    _tail->length += len;
+    _length += len;
+    return start;
+}
+
+void ChainedByteBufferWriter::add_segment(size_t min_size) {
+    size_t size = 0;
+    char* memory = _arena->allocate_rest(sizeof(Segment) + min_size, &size);
+    Segment* segment = reinterpret_cast<Segment*>(memory);
+    segment->next = NULL;
+    segment->length = 0;
+    segment->capacity = size - sizeof(Segment);
+    if (_tail) {
+        _tail->next = segment;
+    } else {
+        _head = segment;
+    }
+    _tail = segment;
+    ++_segment_count;
+}
+
+size_t ChainedByteBufferWriter::gather(struct iovec* iov, size_t count) const {
+    size_t i = 0;
+    for (Segment* segment = _head; segment && i < count; segment = segment->next) {
+        iov[i].iov_base = segment_data(segment);
+        iov[i].iov_len = segment->length;
+        ++i;
+    }
+    return _segment_count;
+}
+
+void ChainedByteBufferWriter::copy_to(char* out) const {
+    for (Segment* segment = _head; segment; segment = segment->next) {
+        memcpy(out, segment_data(segment), segment->length);
+        out += segment->length;
+    }
+}
+
+void ChainedByteBufferWriter::clear() {
+    _head = _tail = NULL;
+    _length = 0;
+    _segment_count = 0;
 }
 
 ////////////////////// ByteBufferReader ////////////////////////
@@ -266,23 +494,60 @@ bool ByteBufferReader::read_uvarint(uint64_t* val) {
     if (!val) {
         return false;
     }
-    // Integers are deserialized 7 bits at a time, with each byte having a
-    // continuation byte (msb=1) if there are more bytes to be read.
-    uint64_t v = 0;
-    for (int i = 0; i < 64; i += 7) {
-        char byte;
-        if (!read_bytes(&byte, 1)) {
-            return false;
-        }
-        // Read the first 7 bits of the byte, then offset by bits read so far.
-        v |= (static_cast<uint64_t>(byte) & 0x7F) << i;
-        // True if the msb is not a continuation byte.
-        if (static_cast<uint64_t>(byte) < 0x80) {
-            *val = v;
-            return true;
-        }
+    size_t len = decode_uvarint(_bytes + _start, length(), val);
+    if (0 == len) {
+        return false;
+    }
+    _start += len;
+    return true;
+}
+
+bool ByteBufferReader::read_uint16s(uint16_t* vals, size_t count) {
+    if (!vals || count * 2 > length()) {
+        return false;
+    }
+    copy_ordered16(order(), vals, _bytes + _start, count);
+    _start += count * 2;
+    return true;
+}
+
+bool ByteBufferReader::read_uint32s(uint32_t* vals, size_t count) {
+    if (!vals || count * 4 > length()) {
+        return false;
+    }
+    copy_ordered32(order(), vals, _bytes + _start, count);
+    _start += count * 4;
+    return true;
+}
+
+bool ByteBufferReader::read_uvarints(uint64_t* vals, size_t count) {
+    if (!vals) {
+        return false;
+    }
+    if (0 == count) {
+        return true;
+    }
+    size_t len = decode_uvarints(_bytes + _start, length(), vals, count);
+    if (0 == len) {
+        return false;
+    }
+    _start += len;
+    return true;
+}
+
+bool ByteBufferReader::read_packed_uint32s(uint32_t* vals, size_t count) {
+    if (!vals) {
+        return false;
+    }
+    if (0 == count) {
+        return true;
+    }
+    size_t len = decode_packed_uint32s(_bytes + _start, length(), vals, count);
+    if (0 == len) {
+        return false;
     }
-    return false;
+    _start += len;
+    return true;
 }
 
 bool ByteBufferReader::read_string(std::string* val, size_t len) {
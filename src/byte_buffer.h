@@ -19,11 +19,16 @@
 #ifndef  __RTCBASE_BYTE_BUFFER_H_
 #define  __RTCBASE_BYTE_BUFFER_H_
 
+#include <string.h>
+#include <sys/uio.h>
+
 #include <string>
 
 #include "memcheck.h"
 #include "basic_types.h"
 #include "buffer.h"
+#include "byte_arena.h"
+#include "byte_order.h"
 #include "constructor_magic.h"
 
 namespace rtcbase {
@@ -47,17 +52,32 @@ private:
 
 class ByteBufferWriter : public ByteBuffer {
 public:
+    // Memory owned by the caller, see the constructor taking it.
+    struct Storage {
+        Storage(char* data, size_t capacity) : data(data), capacity(capacity) {}
+        char* data;
+        size_t capacity;
+    };
+
     // |byte_order| defines order of bytes in the buffer.
     ByteBufferWriter();
     explicit ByteBufferWriter(ByteOrder byte_order);
     ByteBufferWriter(const char* bytes, size_t len);
     ByteBufferWriter(const char* bytes, size_t len, ByteOrder byte_order);
+    // Writes into |storage|, e.g. a stack buffer or the data of a
+    // PacketBuffer, instead of allocating a buffer of its own. The storage
+    // must stay valid while the writer is used. It is never grown: a write
+    // that does not fit is dropped as a whole and sets overflow().
+    explicit ByteBufferWriter(const Storage& storage,
+            ByteOrder byte_order = ORDER_NETWORK);
 
     ~ByteBufferWriter();
 
     const char* data() const { return _bytes + _start; }
     size_t length() const { return _end - _start; }
     size_t capacity() const { return _size - _start; }
+    // Whether a write did not fit into the caller's storage.
+    bool overflow() const { return _overflow; }
 
     // Write value to the buffer. Resizes the buffer when it is
     // neccessary.
@@ -69,31 +89,110 @@ public:
     void write_uvarint(uint64_t val);
     void write_string(const std::string& val);
     void write_bytes(const char* val, size_t len);
+    // Write |count| values at once, e.g. the items of an RTCP NACK list,
+    // converted with vector instructions.
+    void write_uint16s(const uint16_t* vals, size_t count);
+    void write_uint32s(const uint32_t* vals, size_t count);
+    // Write |count| varints at once, dropped whole if they do not fit.
+    void write_uvarints(const uint64_t* vals, size_t count);
+    // Write |count| values packed as in varint.h, a format of its own the
+    // reader has to expect.
+    void write_packed_uint32s(const uint32_t* vals, size_t count);
 
     // Reserves the given number of bytes and returns a char* that can be written
     // into. Useful for functions that require a char* buffer and not a
-    // ByteBufferWriter.
+    // ByteBufferWriter. Returns NULL when the caller's storage is too small.
     char* reserve_write_buffer(size_t len);
 
     // Resize the buffer to the specified |size|.
     void resize(size_t size);
 
-    // Clears the contents of the buffer. After this, Length() will be 0.
+    // Clears the contents of the buffer and the overflow flag. After this,
+    // Length() will be 0.
     void clear();
 
-private:
-    void construct(const char* bytes, size_t size);
-
+protected:
     char* _bytes;
     size_t _size;
     size_t _start;
     size_t _end;
 
+private:
+    void construct(const char* bytes, size_t size);
+
+    // False when |_bytes| is the caller's storage.
+    bool _owned;
+    bool _overflow;
+
     // There are sensible ways to define these, but they aren't needed in our code
     // base.
     RTC_DISALLOW_COPY_AND_ASSIGN(ByteBufferWriter);
 };
 
+// Writes into segments taken from |arena| and chains them, so the content
+// is never copied to grow. Building a message into an arena that is reset
+// once the message is sent does not allocate.
+//
+// The content is not contiguous: gather() hands the segments to
+// AsyncPacketSocket::send_to_v(), copy_to() joins them. Each segment takes
+// what is left of the arena's current chunk.
+class ChainedByteBufferWriter : public ByteBuffer {
+public:
+    explicit ChainedByteBufferWriter(ByteArena* arena,
+            ByteOrder byte_order = ORDER_NETWORK);
+    ~ChainedByteBufferWriter();
+
+    size_t length() const { return _length; }
+    size_t segment_count() const { return _segment_count; }
+
+    void write_uint8(uint8_t val);
+    void write_uint16(uint16_t val);
+    void write_uint24(uint32_t val);
+    void write_uint32(uint32_t val);
+    void write_uint64(uint64_t val);
+    void write_uvarint(uint64_t val);
+    void write_string(const std::string& val);
+    void write_bytes(const char* val, size_t len);
+    void write_uint16s(const uint16_t* vals, size_t count);
+    void write_uint32s(const uint32_t* vals, size_t count);
+    void write_uvarints(const uint64_t* vals, size_t count);
+    void write_packed_uint32s(const uint32_t* vals, size_t count);
+
+    // Reserves |len| contiguous bytes, in a new segment if the current one
+    // has less room left.
+    char* reserve_write_buffer(size_t len);
+
+    // Fills |iov| with up to |count| segments, in order. Returns the number
+    // of segments, which may be more than |count|.
+    size_t gather(struct iovec* iov, size_t count) const;
+    // Copies the length() bytes of content to |out|.
+    void copy_to(char* out) const;
+
+    // Forgets the content, its segments return to the arena on its reset().
+    void clear();
+
+private:
+    // Header of a segment, followed by its |capacity| bytes.
+    struct Segment {
+        Segment* next;
+        size_t length;
+        size_t capacity;
+    };
+
+    static char* segment_data(Segment* segment) {
+        return reinterpret_cast<char*>(segment + 1);
+    }
+    void add_segment(size_t min_size);
+
+    ByteArena* _arena;
+    Segment* _head;
+    Segment* _tail;
+    size_t _length;
+    size_t _segment_count;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(ChainedByteBufferWriter);
+};
+
 // The ByteBufferReader references the passed data, i.e. the pointer must be
 // valid during the lifetime of the reader.
 class ByteBufferReader : public ByteBuffer {
@@ -122,6 +221,15 @@ public:
     bool read_uint64(uint64_t* val);
     bool read_uvarint(uint64_t* val);
     bool read_bytes(char* val, size_t len);
+    // Read |count| values at once, e.g. the report blocks of an RTCP
+    // packet, converted with vector instructions. Return false, reading
+    // nothing, if there isn't enough data left for all of them.
+    bool read_uint16s(uint16_t* vals, size_t count);
+    bool read_uint32s(uint32_t* vals, size_t count);
+    // The same for varints and packed values. Runs of one byte varints and
+    // groups of 4 packed values are decoded with vector instructions.
+    bool read_uvarints(uint64_t* vals, size_t count);
+    bool read_packed_uint32s(uint32_t* vals, size_t count);
 
     // Appends next |len| bytes from the buffer to |val|. Returns false
     // if there is less than |len| bytes left.
@@ -133,17 +241,94 @@ public:
     // after this call.
     bool consume(size_t size);
 
-private:
-    void construct(const char* bytes, size_t size);
-
+protected:
     const char* _bytes;
     size_t _size;
     size_t _start;
     size_t _end;
 
+private:
+    void construct(const char* bytes, size_t size);
+
     RTC_DISALLOW_COPY_AND_ASSIGN(ByteBufferReader);
 };
 
+// Converts host order values to and from |ORDER|, the conversion being its
+// own inverse.
+template <ByteBuffer::ByteOrder ORDER>
+struct ByteOrderConverter {
+    static uint8_t convert(uint8_t val) { return val; }
+    static uint16_t convert(uint16_t val) {
+        return (ORDER == ByteBuffer::ORDER_NETWORK) ? host_to_network16(val) : val;
+    }
+    static uint32_t convert(uint32_t val) {
+        return (ORDER == ByteBuffer::ORDER_NETWORK) ? host_to_network32(val) : val;
+    }
+    static uint64_t convert(uint64_t val) {
+        return (ORDER == ByteBuffer::ORDER_NETWORK) ? host_to_network64(val) : val;
+    }
+};
+
+// A ByteBufferReader whose byte order is fixed at compile time. Its fixed
+// size reads are inlined, without the byte order branch, which matters when
+// parsing field by field, e.g. RTCP feedback. Passed on as a
+// ByteBufferReader it reads the same, at the regular cost.
+template <ByteBuffer::ByteOrder ORDER>
+class ByteBufferReaderT : public ByteBufferReader {
+public:
+    ByteBufferReaderT(const char* bytes, size_t len)
+        : ByteBufferReader(bytes, len, ORDER) {}
+
+    bool read_uint8(uint8_t* val) { return read_value(val); }
+    bool read_uint16(uint16_t* val) { return read_value(val); }
+    bool read_uint32(uint32_t* val) { return read_value(val); }
+    bool read_uint64(uint64_t* val) { return read_value(val); }
+
+private:
+    template <typename T>
+    bool read_value(T* val) {
+        if (!val || sizeof(T) > _end - _start) {
+            return false;
+        }
+        T v;
+        memcpy(&v, _bytes + _start, sizeof(T));
+        _start += sizeof(T);
+        *val = ByteOrderConverter<ORDER>::convert(v);
+        return true;
+    }
+};
+
+// The ByteBufferWriter counterpart of ByteBufferReaderT. Only a write that
+// needs the buffer to grow, or overflows the caller's storage, leaves the
+// inlined path.
+template <ByteBuffer::ByteOrder ORDER>
+class ByteBufferWriterT : public ByteBufferWriter {
+public:
+    ByteBufferWriterT() : ByteBufferWriter(ORDER) {}
+    explicit ByteBufferWriterT(const Storage& storage)
+        : ByteBufferWriter(storage, ORDER) {}
+
+    void write_uint8(uint8_t val) { write_value(val); }
+    void write_uint16(uint16_t val) { write_value(val); }
+    void write_uint32(uint32_t val) { write_value(val); }
+    void write_uint64(uint64_t val) { write_value(val); }
+
+private:
+    template <typename T>
+    void write_value(T val) {
+        T v = ByteOrderConverter<ORDER>::convert(val);
+        if (_end + sizeof(T) <= _size) {
+            memcpy(_bytes + _end, &v, sizeof(T));
+            _end += sizeof(T);
+        } else {
+            write_bytes(reinterpret_cast<const char*>(&v), sizeof(T));
+        }
+    }
+};
+
+typedef ByteBufferReaderT<ByteBuffer::ORDER_NETWORK> NetworkByteBufferReader;
+typedef ByteBufferWriterT<ByteBuffer::ORDER_NETWORK> NetworkByteBufferWriter;
+
 }  // namespace rtcbase
 
 #endif  //__RTCBASE_BYTE_BUFFER_H_
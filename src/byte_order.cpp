@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file byte_order.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "byte_order.h"
+
+namespace rtcbase {
+
+static inline void swap16_scalar(char* dst, const char* src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t v;
+        memcpy(&v, src + i * 2, 2);
+        v = __builtin_bswap16(v);
+        memcpy(dst + i * 2, &v, 2);
+    }
+}
+
+static inline void swap32_scalar(char* dst, const char* src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t v;
+        memcpy(&v, src + i * 4, 4);
+        v = __builtin_bswap32(v);
+        memcpy(dst + i * 4, &v, 4);
+    }
+}
+
+#if defined(__SSSE3__)
+
+// Byte shuffles reversing each 2 and 4 byte lane of a 16 byte block.
+static inline __m128i swap16_mask() {
+    return _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+}
+
+static inline __m128i swap32_mask() {
+    return _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+}
+
+#elif defined(__SSE2__)
+
+static inline __m128i swap16_sse2(__m128i v) {
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+// Swaps the 16 bit halves of each 32 bit lane, then the bytes of each half.
+static inline __m128i swap32_sse2(__m128i v) {
+    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+    return swap16_sse2(v);
+}
+
+#endif
+
+// Reverses the bytes of each 2 byte lane, or 4 byte lane when |wide|, of
+// the whole vector blocks of |size| bytes. Returns the number of bytes done, the
+// caller finishes the tail.
+static size_t swap_blocks(char* dst, const char* src, size_t size, bool wide) {
+    size_t done = 0;
+#if defined(__AVX2__)
+    // AVX2 implies SSSE3, the same shuffle in both 16 byte halves.
+    const __m256i mask = _mm256_broadcastsi128_si256(
+            wide ? swap32_mask() : swap16_mask());
+    for (; done + 32 <= size; done += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + done));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + done),
+                _mm256_shuffle_epi8(v, mask));
+    }
+#endif
+#if defined(__SSSE3__)
+    const __m128i mask128 = wide ? swap32_mask() : swap16_mask();
+    for (; done + 16 <= size; done += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + done));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + done),
+                _mm_shuffle_epi8(v, mask128));
+    }
+#elif defined(__SSE2__)
+    for (; done + 16 <= size; done += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + done));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + done),
+                wide ? swap32_sse2(v) : swap16_sse2(v));
+    }
+#else
+    (void)dst;
+    (void)src;
+    (void)size;
+    (void)wide;
+#endif
+    return done;
+}
+
+void swap_bytes16(void* dst, const void* src, size_t count) {
+    char* d = static_cast<char*>(dst);
+    const char* s = static_cast<const char*>(src);
+    size_t done = swap_blocks(d, s, count * 2, false);
+    swap16_scalar(d + done, s + done, count - done / 2);
+}
+
+void swap_bytes32(void* dst, const void* src, size_t count) {
+    char* d = static_cast<char*>(dst);
+    const char* s = static_cast<const char*>(src);
+    size_t done = swap_blocks(d, s, count * 4, true);
+    swap32_scalar(d + done, s + done, count - done / 4);
+}
+
+} // namespace rtcbase
+
+
@@ -19,6 +19,9 @@
 #define  __RTCBASE_BYTE_ORDER_H_
 
 #include <arpa/inet.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 namespace rtcbase {
 
@@ -160,6 +163,30 @@ inline uint64_t network_to_host64(uint64_t n) {
     return get_be64(&n);
 }
 
+// Reverses the bytes of each of the |count| 16 or 32 bit values at |src|
+// into |dst|, which may be |src| itself but must not overlap it otherwise.
+// Neither needs to be aligned. Vectorized with AVX2, SSSE3 or SSE2,
+// whichever the build targets.
+void swap_bytes16(void* dst, const void* src, size_t count);
+void swap_bytes32(void* dst, const void* src, size_t count);
+
+// Array versions of host_to_network16/32(), which are also their inverse.
+inline void host_to_network16_array(void* dst, const void* src, size_t count) {
+    if (is_host_big_endian()) {
+        memmove(dst, src, count * 2);
+    } else {
+        swap_bytes16(dst, src, count);
+    }
+}
+
+inline void host_to_network32_array(void* dst, const void* src, size_t count) {
+    if (is_host_big_endian()) {
+        memmove(dst, src, count * 4);
+    } else {
+        swap_bytes32(dst, src, count);
+    }
+}
+
 }  // namespace rtcbase
 
 #endif  //__RTCBASE_BYTE_ORDER_H_
@@ -47,6 +47,16 @@ enum DiffServCodePoint {
     DSCP_CS7  = 56,  // Control messages
 };
 
+// Explicit Congestion Notification, the low two bits of the traffic class.
+// See http://tools.ietf.org/html/rfc3168 for details.
+enum EcnCodepoint {
+    ECN_NO_CHANGE = -1,
+    ECN_NOT_ECT = 0,  // Not ECN capable
+    ECN_ECT1 = 1,     // ECN capable, L4S (rfc9331)
+    ECN_ECT0 = 2,     // ECN capable
+    ECN_CE = 3,       // Congestion experienced
+};
+
 }  // namespace rtcbase
 
 #endif  //__RTCBASE_DSCP_H_
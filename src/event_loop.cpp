@@ -14,10 +14,18 @@
  **/
 
 #include <assert.h>
+#include <string.h>
 #include <ev.h>
 
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "atomicops.h"
+#include "io_uring.h"
 #include "logging.h"
 #include "time_utils.h"
+#include "timing_wheel.h"
 #include "event_loop.h"
 
 namespace rtcbase {
@@ -38,8 +46,136 @@ unsigned long EventLoop::current_time() {
     }
 }
 
+struct PostedTask {
+    task_cb_t cb;
+    task_cb_t drop_cb;
+    void* data;
+    PostedTask* next;
+};
+
+class TimerWatcher {
+public:
+    struct ev_timer timer;
+    timer_cb_t cb;
+    EventLoop* el;
+    void* data;
+    bool need_repeat;
+    // Only used by timers on the timing wheel.
+    bool on_wheel;
+    unsigned long interval_ms;
+    TimingWheel::Node wheel_node;
+    TimerWatcher(EventLoop* el, timer_cb_t cb, void* priv_data, bool repeat);
+
+    static void wheel_expired_cb(TimingWheel::Node* node, void* priv_data);
+};
+
+TimerWatcher::TimerWatcher(EventLoop *eventloop, timer_cb_t callback, 
+        void *priv_data, bool repeat) : 
+    cb(callback), el(eventloop), data(priv_data), need_repeat(repeat),
+    on_wheel(false), interval_ms(0)
+{
+    timer.data = (void*)this;
+    wheel_node.data = (void*)this;
+}
+
+class IOWatcher {
+public:
+    ev_io io;
+    io_cb_t cb;
+    EventLoop* el;
+    void* data;
+    IOWatcher(EventLoop* el, io_cb_t cb, void* priv_data);
+};
+
+IOWatcher::IOWatcher(EventLoop* eventloop, io_cb_t callback, void* priv_data)
+    : cb(callback), el(eventloop), data(priv_data)
+{
+    io.data = (void*)this;
+}
+
+// Watchers created per slab growth.
+static const size_t TIMER_SLAB_CHUNK = 256;
+static const size_t IO_SLAB_CHUNK = 64;
+
+// Fixed size object storage grown in chunks, with freed objects recycled
+// through an intrusive free list. Chunks are only released with the slab.
+template <class T>
+class WatcherSlab {
+public:
+    explicit WatcherSlab(size_t chunk_size) :
+        _chunk_size(chunk_size), _free(NULL), _live(0), _peak(0), _capacity(0) {}
+
+    ~WatcherSlab() {
+        for (size_t i = 0; i < _chunks.size(); ++i) {
+            delete[] _chunks[i];
+        }
+    }
+
+    void* alloc() {
+        if (NULL == _free) {
+            grow(_chunk_size);
+        }
+        Item* item = _free;
+        _free = item->next;
+        if (++_live > _peak) {
+            _peak = _live;
+        }
+        return item;
+    }
+
+    void free(void* ptr) {
+        Item* item = static_cast<Item*>(ptr);
+        item->next = _free;
+        _free = item;
+        --_live;
+    }
+
+    void reserve(size_t count) {
+        if (count > _capacity) {
+            grow(count - _capacity);
+        }
+    }
+
+    size_t live() const { return _live; }
+    size_t peak() const { return _peak; }
+    size_t capacity() const { return _capacity; }
+
+private:
+    union Item {
+        Item* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    void grow(size_t count) {
+        Item* chunk = new Item[count];
+        _chunks.push_back(chunk);
+        // Thread the new items in address order.
+        for (size_t i = count; i > 0; --i) {
+            chunk[i - 1].next = _free;
+            _free = &chunk[i - 1];
+        }
+        _capacity += count;
+    }
+
+    const size_t _chunk_size;
+    std::vector<Item*> _chunks;
+    Item* _free;
+    size_t _live;
+    size_t _peak;
+    size_t _capacity;
+};
+
 EventLoop::EventLoop(void* el_owner, bool use_default) 
-    : owner(el_owner), _loop(NULL)
+    : owner(el_owner), _loop(NULL), _post_watcher(NULL), _time_watcher(NULL),
+    _loop_time_ns((int64_t)time_nanos()), _busy_poll_ns(0), _dispatched(0),
+    _stopping(false), _posted_tasks(NULL),
+    _wheel(NULL), _wheel_timer(NULL), _wheel_deadline(UINT64_MAX),
+    _wheel_advancing(false),
+    _timer_slab(new WatcherSlab<TimerWatcher>(TIMER_SLAB_CHUNK)),
+    _io_slab(new WatcherSlab<IOWatcher>(IO_SLAB_CHUNK)),
+    _stats(NULL), _sleep_watcher(NULL), _iteration_start_ns(0),
+    _sleep_start_ns(0), _iteration_callbacks(0), _uring(NULL),
+    _uring_watcher(NULL), _uring_submit_watcher(NULL)
 {
     if (use_default) {
         _loop = EV_DEFAULT;
@@ -48,9 +184,74 @@ EventLoop::EventLoop(void* el_owner, bool use_default)
         _loop = ev_loop_new(EVFLAG_AUTO);
     }
     ev_set_userdata(_loop, (void*)this);
+
+    _post_watcher = new ev_async;
+    ev_async_init(_post_watcher, &EventLoop::posted_tasks_cb);
+    _post_watcher->data = (void*)this;
+    ev_async_start(_loop, _post_watcher);
+    // The wakeup watcher alone must not keep ev_run() going.
+    ev_unref(_loop);
+
+    // Highest priority, so the loop time is fresh before any other callback
+    // of the iteration.
+    _time_watcher = new ev_check;
+    ev_check_init(_time_watcher, &EventLoop::loop_time_cb);
+    ev_set_priority(_time_watcher, EV_MAXPRI);
+    _time_watcher->data = (void*)this;
+    ev_check_start(_loop, _time_watcher);
+    ev_unref(_loop);
 }
 
 EventLoop::~EventLoop() {
+    enable_stats(false);
+
+    if (_uring_submit_watcher) {
+        ev_ref(_loop);
+        ev_prepare_stop(_loop, _uring_submit_watcher);
+        delete _uring_submit_watcher;
+        _uring_submit_watcher = NULL;
+    }
+    if (_uring_watcher) {
+        delete_io_event(_uring_watcher);
+        _uring_watcher = NULL;
+    }
+#ifdef HAVE_IO_URING
+    delete _uring;
+#endif
+    _uring = NULL;
+
+    if (_wheel_timer) {
+        ev_timer_stop(_loop, _wheel_timer);
+        delete _wheel_timer;
+        _wheel_timer = NULL;
+    }
+    delete _wheel;
+    _wheel = NULL;
+
+    if (_time_watcher) {
+        ev_ref(_loop);
+        ev_check_stop(_loop, _time_watcher);
+        delete _time_watcher;
+        _time_watcher = NULL;
+    }
+
+    if (_post_watcher) {
+        ev_ref(_loop);
+        ev_async_stop(_loop, _post_watcher);
+        delete _post_watcher;
+        _post_watcher = NULL;
+    }
+
+    PostedTask* ordered = take_posted_tasks();
+    while (ordered) {
+        PostedTask* next = ordered->next;
+        if (ordered->drop_cb) {
+            ordered->drop_cb(this, ordered->data);
+        }
+        delete ordered;
+        ordered = next;
+    }
+
     if (_loop) {
         stop();
         // Only destroy the loop created with ev_loop_new
@@ -58,10 +259,44 @@ EventLoop::~EventLoop() {
             ev_loop_destroy(_loop);
         }
     }
+
+    // Watchers not deleted by their owners go away with the slabs.
+    delete _timer_slab;
+    delete _io_slab;
 }
 
 void EventLoop::run() {
-    ev_run(_loop);
+    // A stop() issued before run() ends it right away. ev_run() would not
+    // see it, it resets the break state on entry.
+    if (_stopping) {
+        _stopping = false;
+        return;
+    }
+    update_now();
+    if (_busy_poll_ns > 0) {
+        run_busy_poll();
+    } else {
+        ev_run(_loop);
+    }
+    _stopping = false;
+}
+
+void EventLoop::run_busy_poll() {
+    int64_t idle_since = _loop_time_ns;
+    while (!_stopping) {
+        uint64_t dispatched = _dispatched;
+        int flags = EVRUN_NOWAIT;
+        if ((int64_t)time_nanos() - idle_since >= _busy_poll_ns) {
+            flags = EVRUN_ONCE;
+        }
+        // Returns 0 once no active watcher is left, like ev_run() does.
+        if (!ev_run(_loop, flags)) {
+            break;
+        }
+        if (_dispatched != dispatched) {
+            idle_since = _loop_time_ns;
+        }
+    }
 }
 
 void EventLoop::suspend() {
@@ -73,6 +308,7 @@ void EventLoop::resume() {
 }
 
 void EventLoop::stop() {
+    _stopping = true;
     ev_break(_loop, EVBREAK_ALL);
 }
 
@@ -84,41 +320,83 @@ unsigned long EventLoop::now() {
     return (unsigned long)(ev_now(_loop)*1000000);
 }
 
-class TimerWatcher {
-public:
-    struct ev_timer timer;
-    timer_cb_t cb;
-    EventLoop* el;
-    void* data;
-    bool need_repeat;
-    TimerWatcher(EventLoop* el, timer_cb_t cb, void* priv_data, bool repeat);
-};
+void EventLoop::update_now() {
+    _loop_time_ns = (int64_t)time_nanos();
+}
 
-TimerWatcher::TimerWatcher(EventLoop *eventloop, timer_cb_t callback, 
-        void *priv_data, bool repeat) : 
-    cb(callback), el(eventloop), data(priv_data), need_repeat(repeat) 
-{
-    timer.data = (void*)this;
+void EventLoop::loop_time_cb(struct ev_loop* loop, struct ev_check* w, int revents) {
+    (void)loop;
+    (void)revents;
+    EventLoop* el = (EventLoop*)(w->data);
+    el->update_now();
+
+    LoopStats* stats = el->_stats;
+    if (stats) {
+        // Runs first thing after poll returned, see loop_sleep_cb().
+        stats->idle_ns += el->_loop_time_ns - el->_sleep_start_ns;
+        el->_iteration_start_ns = el->_loop_time_ns;
+        ++stats->iterations;
+    }
+}
+
+void EventLoop::loop_sleep_cb(struct ev_loop* loop, struct ev_prepare* w, int revents) {
+    (void)loop;
+    (void)revents;
+    EventLoop* el = (EventLoop*)(w->data);
+    LoopStats* stats = el->_stats;
+    int64_t now = (int64_t)time_nanos();
+    stats->busy_ns += now - el->_iteration_start_ns;
+    if (el->_iteration_callbacks > stats->max_callbacks_per_iteration) {
+        stats->max_callbacks_per_iteration = el->_iteration_callbacks;
+    }
+    el->_iteration_callbacks = 0;
+    el->_sleep_start_ns = now;
 }
 
 void generic_timer_cb(struct ev_loop* el, struct ev_timer* w, int revents) {
     (void)el;
     (void)revents;
     TimerWatcher* watcher = (TimerWatcher*)w;
-    watcher->cb(watcher->el, watcher, watcher->data);
+    EventLoop* loop = watcher->el;
+    ++loop->_dispatched;
+    if (loop->_stats) {
+        // The callback may delete the watcher.
+        void* data = watcher->data;
+        int64_t start = (int64_t)time_nanos();
+        watcher->cb(loop, watcher, data);
+        loop->record_callback(LoopStats::TIMER, start, data);
+        return;
+    }
+    watcher->cb(loop, watcher, watcher->data);
 }
 
 TimerWatcher* EventLoop::create_timer(timer_cb_t cb, void* priv_data,
         bool repeat) 
 {
-    TimerWatcher* w = new TimerWatcher(this, cb, priv_data, repeat);
+    TimerWatcher* w = new (_timer_slab->alloc()) TimerWatcher(this, cb, priv_data, repeat);
     ev_init(&(w->timer), generic_timer_cb);
+    w->on_wheel = (_wheel != NULL);
     return w;
 }
 
 void EventLoop::start_timer(TimerWatcher* w, unsigned long usec) {
+    start_timer_after(w, (int64_t)usec * k_num_nanosecs_per_microsec);
+}
+
+void EventLoop::start_timer_at(TimerWatcher* w, int64_t deadline_ns) {
+    int64_t delay_ns = deadline_ns - _loop_time_ns;
+    start_timer_after(w, delay_ns > 0 ? delay_ns : 0);
+}
+
+void EventLoop::start_timer_after(TimerWatcher* w, int64_t delay_ns) {
+    if (w->on_wheel) {
+        start_wheel_timer(w, delay_ns);
+        return;
+    }
+
     struct ev_timer* timer = &(w->timer);
-    float sec = (float)usec / 1000000;
+    // libev keeps its timestamps as doubles, convert once here.
+    ev_tstamp sec = (ev_tstamp)delay_ns / k_num_nanosecs_per_sec;
     if (!w->need_repeat) {
         ev_timer_stop(_loop, timer);
         ev_timer_set(timer, sec, 0);
@@ -131,41 +409,305 @@ void EventLoop::start_timer(TimerWatcher* w, unsigned long usec) {
 }
 
 void EventLoop::stop_timer(TimerWatcher* w) {
+    if (w->on_wheel) {
+        // The driver timer may fire once for nothing, that is cheaper than
+        // looking for the next expiry on every stop.
+        _wheel->remove(&(w->wheel_node));
+        return;
+    }
+
     struct ev_timer* timer = &(w->timer);
     ev_timer_stop(_loop, timer);
 }
 
 void EventLoop::delete_timer(TimerWatcher* w) {
     stop_timer(w);
-    delete w;
+    w->~TimerWatcher();
+    _timer_slab->free(w);
 }
 
-//////////////////////// IOWatcher ////////////////
+//////////////////////// Timing wheel ////////////////
 
-class IOWatcher {
-public:
-    ev_io io;
-    io_cb_t cb;
-    EventLoop* el;
-    void* data;
-    IOWatcher(EventLoop* el, io_cb_t cb, void* priv_data);
-};
+void EventLoop::enable_timer_wheel() {
+    if (_wheel) {
+        return;
+    }
+    _wheel = new TimingWheel((uint64_t)(_loop_time_ns / k_num_nanosecs_per_millisec));
+    _wheel_timer = new ev_timer;
+    ev_init(_wheel_timer, &EventLoop::wheel_timer_cb);
+    _wheel_timer->data = (void*)this;
+}
 
-IOWatcher::IOWatcher(EventLoop* eventloop, io_cb_t callback, void* priv_data)
-    : cb(callback), el(eventloop), data(priv_data)
+void EventLoop::start_wheel_timer(TimerWatcher* w, int64_t delay_ns) {
+    // Round up, a timer must never fire early.
+    const int64_t tick = k_num_nanosecs_per_millisec;
+    uint64_t expire = (uint64_t)((_loop_time_ns + delay_ns + tick - 1) / tick);
+    w->interval_ms = (unsigned long)((delay_ns + tick - 1) / tick);
+    _wheel->add(&(w->wheel_node), expire);
+    if (expire < _wheel_deadline && !_wheel_advancing) {
+        update_wheel_timer();
+    }
+}
+
+void EventLoop::update_wheel_timer() {
+    uint64_t next = _wheel->next_expiry();
+    if (next == _wheel_deadline) {
+        return;
+    }
+
+    ev_timer_stop(_loop, _wheel_timer);
+    _wheel_deadline = next;
+    if (UINT64_MAX == next) {
+        return;
+    }
+    ev_tstamp delay = (ev_tstamp)((int64_t)next * k_num_nanosecs_per_millisec
+            - _loop_time_ns) / k_num_nanosecs_per_sec;
+    ev_timer_set(_wheel_timer, delay > 0 ? delay : 0, 0);
+    ev_timer_start(_loop, _wheel_timer);
+}
+
+void EventLoop::wheel_timer_cb(struct ev_loop* loop, struct ev_timer* w, int revents) {
+    (void)loop;
+    (void)revents;
+    EventLoop* el = (EventLoop*)(w->data);
+    el->_wheel_deadline = UINT64_MAX;
+    el->_wheel_advancing = true;
+    el->_wheel->advance((uint64_t)(el->_loop_time_ns / k_num_nanosecs_per_millisec),
+            &TimerWatcher::wheel_expired_cb, el);
+    el->_wheel_advancing = false;
+    el->update_wheel_timer();
+}
+
+void TimerWatcher::wheel_expired_cb(TimingWheel::Node* node, void* priv_data) {
+    EventLoop* el = (EventLoop*)priv_data;
+    TimerWatcher* w = (TimerWatcher*)(node->data);
+    if (w->need_repeat) {
+        // Rearmed before the callback, which may still stop or restart it.
+        uint64_t now_ms = (uint64_t)(el->_loop_time_ns / k_num_nanosecs_per_millisec);
+        el->_wheel->add(node, now_ms + (w->interval_ms ? w->interval_ms : 1));
+    }
+    ++el->_dispatched;
+    if (el->_stats) {
+        void* data = w->data;
+        int64_t start = (int64_t)time_nanos();
+        w->cb(el, w, data);
+        el->record_callback(LoopStats::TIMER, start, data);
+        return;
+    }
+    w->cb(el, w, w->data);
+}
+
+//////////////////////// Posted tasks ////////////////
+
+void EventLoop::post(task_cb_t cb, void* priv_data, task_cb_t drop_cb) {
+    PostedTask* task = new PostedTask;
+    task->cb = cb;
+    task->drop_cb = drop_cb;
+    task->data = priv_data;
+
+    PostedTask* head = _posted_tasks;
+    while (true) {
+        task->next = head;
+        PostedTask* prev = AtomicOps::compare_and_swap_ptr(&_posted_tasks, head, task);
+        if (prev == head) {
+            break;
+        }
+        head = prev;
+    }
+
+    // Only the task that finds the stack empty has to wake the loop up, the
+    // others are picked up by the same wakeup.
+    if (NULL == head) {
+        ev_async_send(_loop, _post_watcher);
+    }
+}
+
+void EventLoop::posted_tasks_cb(struct ev_loop* loop, struct ev_async* w, int revents) {
+    (void)loop;
+    (void)revents;
+    ((EventLoop*)(w->data))->run_posted_tasks();
+}
+
+PostedTask* EventLoop::take_posted_tasks() {
+    PostedTask* task = AtomicOps::exchange_ptr(&_posted_tasks, (PostedTask*)NULL);
+
+    // Reverse into posting order.
+    PostedTask* ordered = NULL;
+    while (task) {
+        PostedTask* next = task->next;
+        task->next = ordered;
+        ordered = task;
+        task = next;
+    }
+    return ordered;
+}
+
+void EventLoop::run_posted_tasks() {
+    PostedTask* ordered = take_posted_tasks();
+    while (ordered) {
+        PostedTask* next = ordered->next;
+        ++_dispatched;
+        if (_stats) {
+            int64_t start = (int64_t)time_nanos();
+            ordered->cb(this, ordered->data);
+            record_callback(LoopStats::TASK, start, ordered->data);
+        } else {
+            ordered->cb(this, ordered->data);
+        }
+        delete ordered;
+        ordered = next;
+    }
+}
+
+//////////////////////// io_uring ////////////////
+
+bool EventLoop::enable_io_uring(unsigned entries) {
+#ifdef HAVE_IO_URING
+    if (_uring) {
+        return true;
+    }
+    _uring = IoUring::create(entries);
+    if (!_uring) {
+        return false;
+    }
+
+    // The ring fd polls readable while completions are waiting.
+    _uring_watcher = create_io_event(&EventLoop::uring_io_cb, NULL);
+    start_io_event(_uring_watcher, _uring->fd(), READ);
+
+    _uring_submit_watcher = new ev_prepare;
+    ev_prepare_init(_uring_submit_watcher, &EventLoop::uring_submit_cb);
+    _uring_submit_watcher->data = (void*)this;
+    ev_prepare_start(_loop, _uring_submit_watcher);
+    ev_unref(_loop);
+    return true;
+#else
+    (void)entries;
+    LOG(LS_WARNING) << "Built without io_uring support";
+    return false;
+#endif
+}
+
+void EventLoop::uring_io_cb(EventLoop* el, IOWatcher* w, int fd, int revents,
+        void* priv_data)
 {
-    io.data = (void*)this;
+    (void)w;
+    (void)fd;
+    (void)revents;
+    (void)priv_data;
+#ifdef HAVE_IO_URING
+    el->_uring->process_completions();
+#else
+    (void)el;
+#endif
+}
+
+void EventLoop::uring_submit_cb(struct ev_loop* loop, struct ev_prepare* w, int revents) {
+    (void)loop;
+    (void)revents;
+#ifdef HAVE_IO_URING
+    EventLoop* el = (EventLoop*)(w->data);
+    if (el->_uring->has_pending_sqes()) {
+        el->_uring->submit();
+    }
+#else
+    (void)w;
+#endif
+}
+
+//////////////////////// Stats ////////////////
+
+void EventLoop::enable_stats(bool enable) {
+    if (enable == (_stats != NULL)) {
+        return;
+    }
+
+    if (!enable) {
+        ev_ref(_loop);
+        ev_prepare_stop(_loop, _sleep_watcher);
+        delete _sleep_watcher;
+        _sleep_watcher = NULL;
+        delete _stats;
+        _stats = NULL;
+        return;
+    }
+
+    _stats = new LoopStats();
+    reset_stats();
+    // Lowest priority, so the sleep starts after every other prepare watcher.
+    _sleep_watcher = new ev_prepare;
+    ev_prepare_init(_sleep_watcher, &EventLoop::loop_sleep_cb);
+    ev_set_priority(_sleep_watcher, EV_MINPRI);
+    _sleep_watcher->data = (void*)this;
+    ev_prepare_start(_loop, _sleep_watcher);
+    ev_unref(_loop);
+}
+
+bool EventLoop::get_stats(LoopStats* stats) const {
+    if (!_stats) {
+        return false;
+    }
+    *stats = *_stats;
+    return true;
+}
+
+void EventLoop::reset_stats() {
+    if (!_stats) {
+        return;
+    }
+    memset(_stats, 0, sizeof(LoopStats));
+    _stats->slowest_type = LoopStats::TIMER;
+    _iteration_start_ns = (int64_t)time_nanos();
+    _sleep_start_ns = _iteration_start_ns;
+    _iteration_callbacks = 0;
+}
+
+void EventLoop::record_callback(LoopStats::WatcherType type, int64_t start_ns,
+        void* priv_data)
+{
+    int64_t elapsed = (int64_t)time_nanos() - start_ns;
+    LoopStats* stats = _stats;
+    if (!stats) {
+        // Disabled by the callback itself.
+        return;
+    }
+
+    ++_iteration_callbacks;
+    ++stats->callbacks[type];
+    stats->callback_ns[type] += elapsed;
+    int bucket = 63 - __builtin_clzll((uint64_t)elapsed | 1);
+    if (bucket >= LoopStats::HISTOGRAM_BUCKETS) {
+        bucket = LoopStats::HISTOGRAM_BUCKETS - 1;
+    }
+    ++stats->histogram[type][bucket];
+
+    if (elapsed > stats->slowest_ns) {
+        stats->slowest_ns = elapsed;
+        stats->slowest_type = type;
+        stats->slowest_priv_data = priv_data;
+    }
 }
 
+//////////////////////// IOWatcher ////////////////
+
 void generic_io_cb(struct ev_loop* el, struct ev_io* w, int revents) {
     (void)el;
     IOWatcher* watcher = (IOWatcher*)(w->data);
-    watcher->cb(watcher->el, watcher, w->fd,
+    EventLoop* loop = watcher->el;
+    ++loop->_dispatched;
+    if (loop->_stats) {
+        void* data = watcher->data;
+        int64_t start = (int64_t)time_nanos();
+        watcher->cb(loop, watcher, w->fd, TRANS_FROM_EV_MASK(revents), data);
+        loop->record_callback(LoopStats::IO, start, data);
+        return;
+    }
+    watcher->cb(loop, watcher, w->fd,
             TRANS_FROM_EV_MASK(revents), watcher->data);
 }
 
 IOWatcher* EventLoop::create_io_event(io_cb_t cb, void* data) {
-    IOWatcher* w = new IOWatcher(this, cb, data);
+    IOWatcher* w = new (_io_slab->alloc()) IOWatcher(this, cb, data);
     ev_init(&(w->io), generic_io_cb);
     return w;
 }
@@ -208,7 +750,26 @@ void EventLoop::stop_io_event(IOWatcher* w, int fd, int mask) {
 void EventLoop::delete_io_event(IOWatcher* w) {
     struct ev_io* io = &(w->io);
     ev_io_stop(_loop, io);
-    delete w;
+    w->~IOWatcher();
+    _io_slab->free(w);
+}
+
+//////////////////////// Watcher slabs ////////////////
+
+void EventLoop::reserve_watchers(size_t timers, size_t io_events) {
+    _timer_slab->reserve(timers);
+    _io_slab->reserve(io_events);
+}
+
+WatcherStats EventLoop::watcher_stats() const {
+    WatcherStats stats;
+    stats.live_timers = _timer_slab->live();
+    stats.peak_timers = _timer_slab->peak();
+    stats.live_io_events = _io_slab->live();
+    stats.peak_io_events = _io_slab->peak();
+    stats.timer_capacity = _timer_slab->capacity();
+    stats.io_event_capacity = _io_slab->capacity();
+    return stats;
 }
 
 } // namespace rtcbase
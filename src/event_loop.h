@@ -17,9 +17,15 @@
 #ifndef  __RTCBASE_EVENT_LOOP_H_
 #define  __RTCBASE_EVENT_LOOP_H_
 
+#include <stdint.h>
 #include <string>
 
 struct ev_loop;
+struct ev_async;
+struct ev_timer;
+struct ev_check;
+struct ev_prepare;
+struct ev_io;
 
 namespace rtcbase {
 
@@ -30,6 +36,49 @@ class IOWatcher;
 typedef void (*timer_cb_t)(EventLoop *el, TimerWatcher *w, void *priv_data);
 typedef void (*io_cb_t)(EventLoop* el, IOWatcher* w, int fd, int revents,
         void* priv_data);
+typedef void (*task_cb_t)(EventLoop* el, void* priv_data);
+
+struct PostedTask;
+class TimingWheel;
+class IoUring;
+template <class T> class WatcherSlab;
+
+struct WatcherStats {
+    size_t live_timers;
+    size_t peak_timers;
+    size_t live_io_events;
+    size_t peak_io_events;
+    // Watchers the slabs can hold without allocating.
+    size_t timer_capacity;
+    size_t io_event_capacity;
+};
+
+struct LoopStats {
+    enum WatcherType {
+        TIMER = 0,
+        IO,
+        TASK,
+        WATCHER_TYPES
+    };
+    // Bucket i counts the callbacks that took [2^i, 2^(i+1)) nanoseconds,
+    // the last one also everything longer.
+    static const int HISTOGRAM_BUCKETS = 32;
+
+    uint64_t iterations;
+    // Time spent running callbacks and loop overhead vs. blocked in poll.
+    int64_t busy_ns;
+    int64_t idle_ns;
+    uint64_t max_callbacks_per_iteration;
+
+    uint64_t callbacks[WATCHER_TYPES];
+    int64_t callback_ns[WATCHER_TYPES];
+    uint64_t histogram[WATCHER_TYPES][HISTOGRAM_BUCKETS];
+
+    // The slowest callback seen, with the priv_data of its watcher.
+    int64_t slowest_ns;
+    WatcherType slowest_type;
+    void* slowest_priv_data;
+};
 
 class EventLoop {
 public:
@@ -48,13 +97,39 @@ public:
     void stop();
     void sleep(unsigned long usec);
 
+    // Busy poll mode for latency critical loops on dedicated cores. run()
+    // then polls the sockets and timers without blocking, and only blocks
+    // in the kernel once no callback ran for |budget_ns|. Spinning iterations
+    // count as busy time and iterations in the LoopStats. 0, the default,
+    // disables it. Call it before run() or from the loop thread.
+    void set_busy_poll(int64_t budget_ns) { _busy_poll_ns = budget_ns; }
+    int64_t busy_poll() const { return _busy_poll_ns; }
+
     unsigned long now(); // get current time
+
+    // Monotonic loop time on the time_nanos() clock. It is sampled once per
+    // loop iteration before any callback runs, so reading it costs nothing
+    // and every callback of an iteration sees the same value.
+    int64_t now_nanos() const { return _loop_time_ns; }
+    int64_t now_micros() const { return _loop_time_ns / 1000; }
+    // Resamples the loop time, e.g. after a long running callback.
+    void update_now();
     
     // Timer
     TimerWatcher *create_timer(timer_cb_t cb, void *priv_data, bool repeat);
     void start_timer(TimerWatcher *w, unsigned long usec);
+    // Starts |w| to fire when the loop time reaches |deadline_ns|, a
+    // deadline in the past fires on the next iteration. A repeating timer
+    // then repeats with the interval between now_nanos() and |deadline_ns|.
+    void start_timer_at(TimerWatcher* w, int64_t deadline_ns);
     void stop_timer(TimerWatcher *w);
     void delete_timer(TimerWatcher *w);
+
+    // Timers created after this call run on a hierarchical timing wheel
+    // driven by a single libev timer instead of one libev timer each, which
+    // makes starting, restarting and stopping them O(1). Their timeouts are
+    // rounded up to whole milliseconds.
+    void enable_timer_wheel();
     
     // io
     IOWatcher* create_io_event(io_cb_t cb, void* priv_data);
@@ -62,14 +137,95 @@ public:
     void stop_io_event(IOWatcher* w, int fd, int mask);
     void delete_io_event(IOWatcher *w);
 
+    // Watchers are carved out of per loop slabs and recycled through free
+    // lists, so creating and deleting them only allocates when a slab has to
+    // grow. The returned pointers stay valid until the watcher is deleted or
+    // the loop is destroyed, whichever comes first.
+    void reserve_watchers(size_t timers, size_t io_events);
+    WatcherStats watcher_stats() const;
+
+    // Loop instrumentation, disabled by default, when it costs a branch per
+    // callback. The counters are kept by the loop thread and must be read
+    // there, from another thread post() a task that calls get_stats().
+    void enable_stats(bool enable);
+    bool stats_enabled() const { return _stats != NULL; }
+    // Returns false when the stats are disabled.
+    bool get_stats(LoopStats* stats) const;
+    void reset_stats();
+
+    // Attaches an io_uring to the loop: its completions are dispatched from
+    // the loop like any IO event, and entries queued by the callbacks are
+    // submitted with one system call before the loop blocks. While attached
+    // the ring keeps run() going. Returns false when built without
+    // HAVE_IO_URING or when the kernel does not support it.
+    bool enable_io_uring(unsigned entries);
+    // nullptr unless enable_io_uring() succeeded.
+    IoUring* io_uring() const { return _uring; }
+
+    // Runs |cb| on the loop thread during one of the next iterations. Safe to
+    // call from any thread. Tasks run in posting order, and all tasks posted
+    // before the loop wakes up run in the same batch. Posted tasks do not
+    // keep run() from returning. Tasks still pending when the loop is
+    // destroyed do not run, |drop_cb|, if any, is called for them instead,
+    // e.g. to free |priv_data|.
+    void post(task_cb_t cb, void* priv_data, task_cb_t drop_cb = NULL);
+
     //Global current_time
     static unsigned long current_time();
 
 public:
     void* owner;
 
+private:
+    void run_busy_poll();
+    static void posted_tasks_cb(struct ev_loop* loop, struct ev_async* w, int revents);
+    // Takes the pending tasks, in posting order.
+    PostedTask* take_posted_tasks();
+    void run_posted_tasks();
+
+    friend class TimerWatcher;
+    static void wheel_timer_cb(struct ev_loop* loop, struct ev_timer* w, int revents);
+    void start_timer_after(TimerWatcher* w, int64_t delay_ns);
+    void start_wheel_timer(TimerWatcher* w, int64_t delay_ns);
+    void update_wheel_timer();
+    static void loop_time_cb(struct ev_loop* loop, struct ev_check* w, int revents);
+    static void loop_sleep_cb(struct ev_loop* loop, struct ev_prepare* w, int revents);
+    static void uring_io_cb(EventLoop* el, IOWatcher* w, int fd, int revents,
+            void* priv_data);
+    static void uring_submit_cb(struct ev_loop* loop, struct ev_prepare* w, int revents);
+
+    friend void generic_timer_cb(struct ev_loop* el, struct ev_timer* w, int revents);
+    friend void generic_io_cb(struct ev_loop* el, struct ev_io* w, int revents);
+    void record_callback(LoopStats::WatcherType type, int64_t start_ns,
+            void* priv_data);
+
 private:
     struct ev_loop* _loop;
+    struct ev_async* _post_watcher;
+    struct ev_check* _time_watcher;
+    int64_t _loop_time_ns;
+    int64_t _busy_poll_ns;
+    // Callbacks run so far, tells the busy poll loop whether it found work.
+    uint64_t _dispatched;
+    volatile bool _stopping;
+    // Lock free stack of posted tasks, newest first.
+    PostedTask* volatile _posted_tasks;
+    TimingWheel* _wheel;
+    struct ev_timer* _wheel_timer;
+    // Tick the driver timer is armed for, UINT64_MAX when it is stopped.
+    uint64_t _wheel_deadline;
+    bool _wheel_advancing;
+    WatcherSlab<TimerWatcher>* _timer_slab;
+    WatcherSlab<IOWatcher>* _io_slab;
+    // NULL while the stats are disabled.
+    LoopStats* _stats;
+    struct ev_prepare* _sleep_watcher;
+    int64_t _iteration_start_ns;
+    int64_t _sleep_start_ns;
+    uint64_t _iteration_callbacks;
+    IoUring* _uring;
+    IOWatcher* _uring_watcher;
+    struct ev_prepare* _uring_submit_watcher;
     // Reference to the default loop, not thread safe, only used for current_time()
     static EventLoop* _default_loop;
 };
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+/**
+ * @file event_loop_pool.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "event_loop_pool.h"
+
+namespace rtcbase {
+
+// Interval of the timer that keeps an otherwise idle loop running, in
+// microseconds.
+static const unsigned long KEEPALIVE_INTERVAL = 3600UL * 1000 * 1000;
+
+EventLoopPool::EventLoopPool(size_t size, const char* name) : _running(false) {
+    assert(size > 0);
+    for (size_t i = 0; i < size; ++i) {
+        char thread_name[32];
+        snprintf(thread_name, sizeof(thread_name), "%s_%zu", name, i);
+
+        Worker* worker = new Worker();
+        worker->el.reset(new EventLoop((void*)this, false));
+        worker->thread.reset(new PlatformThread(&EventLoopPool::run_loop,
+                    worker, thread_name));
+        // Keeps ev_run() from returning while the loop has nothing to do.
+        worker->keepalive_timer = worker->el->create_timer(
+                &EventLoopPool::keepalive_cb, worker, true);
+        _loops.push_back(worker);
+    }
+}
+
+EventLoopPool::~EventLoopPool() {
+    stop();
+    for (size_t i = 0; i < _loops.size(); ++i) {
+        _loops[i]->el->delete_timer(_loops[i]->keepalive_timer);
+        delete _loops[i];
+    }
+}
+
+void EventLoopPool::start() {
+    if (_running) {
+        return;
+    }
+
+    for (size_t i = 0; i < _loops.size(); ++i) {
+        Worker* worker = _loops[i];
+        worker->el->start_timer(worker->keepalive_timer, KEEPALIVE_INTERVAL);
+        worker->thread->start();
+    }
+    _running = true;
+}
+
+void EventLoopPool::stop() {
+    if (!_running) {
+        return;
+    }
+
+    for (size_t i = 0; i < _loops.size(); ++i) {
+        _loops[i]->el->post(&EventLoopPool::stop_task, _loops[i]);
+    }
+    for (size_t i = 0; i < _loops.size(); ++i) {
+        _loops[i]->thread->stop();
+    }
+    _running = false;
+}
+
+int EventLoopPool::current_index() const {
+    PlatformThreadRef ref = current_thread_ref();
+    for (size_t i = 0; i < _loops.size(); ++i) {
+        if (_loops[i]->thread->is_running() &&
+                is_thread_ref_equal(_loops[i]->thread->get_thread_ref(), ref))
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void EventLoopPool::run_loop(void* obj) {
+    Worker* worker = static_cast<Worker*>(obj);
+    worker->el->run();
+}
+
+void EventLoopPool::keepalive_cb(EventLoop* el, TimerWatcher* w, void* data) {
+    (void)el;
+    (void)w;
+    (void)data;
+}
+
+void EventLoopPool::stop_task(EventLoop* el, void* data) {
+    Worker* worker = static_cast<Worker*>(data);
+    el->stop_timer(worker->keepalive_timer);
+    el->stop();
+}
+
+} // namespace rtcbase
+
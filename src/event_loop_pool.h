@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+/**
+ * @file event_loop_pool.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_EVENT_LOOP_POOL_H_
+#define  __RTCBASE_EVENT_LOOP_POOL_H_
+
+#include <memory>
+#include <vector>
+
+#include "constructor_magic.h"
+#include "event_loop.h"
+#include "platform_thread.h"
+
+namespace rtcbase {
+
+// Runs |size| EventLoops, each on its own PlatformThread.
+//
+// Watchers of a loop may only be touched from the thread running it: set up
+// whatever should run on the pool (e.g. ShardedUDPSocket) before start(), or
+// hand the work to the loop with EventLoop::post().
+class EventLoopPool {
+public:
+    explicit EventLoopPool(size_t size, const char* name = "el_pool");
+    ~EventLoopPool();
+
+    void start();
+    // Breaks every loop and joins the threads.
+    void stop();
+    bool is_running() const { return _running; }
+
+    size_t size() const { return _loops.size(); }
+    EventLoop* loop(size_t index) { return _loops[index]->el.get(); }
+
+    // Returns the index of the loop run by the calling thread, or -1 if the
+    // caller is not one of the pool threads.
+    int current_index() const;
+
+private:
+    struct Worker {
+        std::unique_ptr<EventLoop> el;
+        std::unique_ptr<PlatformThread> thread;
+        TimerWatcher* keepalive_timer;
+    };
+
+    static void run_loop(void* obj);
+    static void keepalive_cb(EventLoop* el, TimerWatcher* w, void* data);
+    static void stop_task(EventLoop* el, void* data);
+
+    std::vector<Worker*> _loops;
+    bool _running;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(EventLoopPool);
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_EVENT_LOOP_POOL_H_
+
+
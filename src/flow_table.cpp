@@ -0,0 +1,270 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file flow_table.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "flow_table.h"
+
+namespace rtcbase {
+
+static const uint32_t NO_FLOW = 0xFFFFFFFF;
+static const size_t MIN_CAPACITY = 16;
+
+// Live flows have an odd generation, free ones an even one.
+static inline bool is_live(uint32_t generation) {
+    return (generation & 1) != 0;
+}
+
+// Bit i is set when byte i of the 16 byte |group| equals |value|.
+static inline uint32_t match_byte(const uint8_t* group, uint8_t value) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+    return (uint32_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        mask |= (uint32_t)(group[i] == value) << i;
+    }
+    return mask;
+#endif
+}
+
+// Bit i is set when slot i of |group| is empty or deleted, the only control
+// bytes with the high bit set.
+static inline uint32_t match_free(const uint8_t* group) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+    return (uint32_t)_mm_movemask_epi8(ctrl);
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        mask |= (uint32_t)(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+// The smallest power of two number of slots that holds |flows| at a load
+// factor of 7/8.
+static size_t capacity_for(size_t flows) {
+    size_t capacity = MIN_CAPACITY;
+    while (capacity * 7 / 8 < flows) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+FlowTable::FlowTable(size_t expected_flows) :
+    MemCheck("FlowTable"),
+    _capacity(0), _ctrl(NULL), _free_flow(NO_FLOW), _size(0), _used_slots(0)
+{
+    rehash(capacity_for(expected_flows));
+}
+
+FlowTable::~FlowTable() {}
+
+int32_t FlowTable::find_index(const SocketAddressKey& key) const {
+    size_t hash = key.hash();
+    uint8_t h2 = (uint8_t)(hash & 0x7F);
+    size_t mask = _capacity / GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & mask;
+
+    // Triangular probing over the groups visits each of them once.
+    for (size_t i = 1; i <= mask + 1; ++i) {
+        const uint8_t* ctrl = _ctrl + group * GROUP_SIZE;
+        uint32_t match = match_byte(ctrl, h2);
+        while (match) {
+            uint32_t index = _slots[group * GROUP_SIZE + __builtin_ctz(match)];
+            if (_flows[index].key == key) {
+                return (int32_t)index;
+            }
+            match &= match - 1;
+        }
+        // The key would have been placed in the first group with room.
+        if (match_byte(ctrl, CTRL_EMPTY)) {
+            return -1;
+        }
+        group = (group + i) & mask;
+    }
+    return -1;
+}
+
+size_t FlowTable::find_free_slot(size_t hash) const {
+    size_t mask = _capacity / GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & mask;
+    for (size_t i = 1; ; ++i) {
+        uint32_t match = match_free(_ctrl + group * GROUP_SIZE);
+        if (match) {
+            return group * GROUP_SIZE + __builtin_ctz(match);
+        }
+        // The load factor keeps free slots around, this ends.
+        group = (group + i) & mask;
+    }
+}
+
+FlowTable::Handle FlowTable::insert(const SocketAddressKey& key, void* data) {
+    if (find_index(key) >= 0) {
+        return INVALID_HANDLE;
+    }
+
+    if (_used_slots + 1 > _capacity * 7 / 8) {
+        // Mostly deleted slots are cleaned up in place.
+        rehash(_size + 1 > _capacity * 7 / 16 ? _capacity * 2 : _capacity);
+    }
+
+    uint32_t index;
+    if (_free_flow != NO_FLOW) {
+        index = _free_flow;
+        _free_flow = _flows[index].slot;
+        ++_flows[index].generation;
+    } else {
+        index = (uint32_t)_flows.size();
+        _flows.push_back(Flow());
+        _flows[index].generation = 1;
+    }
+
+    size_t hash = key.hash();
+    size_t slot = find_free_slot(hash);
+    if (CTRL_EMPTY == _ctrl[slot]) {
+        ++_used_slots;
+    }
+    set_ctrl(slot, (uint8_t)(hash & 0x7F));
+    _slots[slot] = index;
+
+    Flow& flow = _flows[index];
+    flow.key = key;
+    flow.slot = (uint32_t)slot;
+    flow.data = data;
+    ++_size;
+    return make_handle(index);
+}
+
+const FlowTable::Flow* FlowTable::flow_of(Handle handle) const {
+    uint32_t index = (uint32_t)handle;
+    uint32_t generation = (uint32_t)(handle >> 32);
+    if (index >= _flows.size() || !is_live(generation)
+            || _flows[index].generation != generation)
+    {
+        return NULL;
+    }
+    return &_flows[index];
+}
+
+bool FlowTable::erase(Handle handle) {
+    if (!flow_of(handle)) {
+        return false;
+    }
+
+    uint32_t index = (uint32_t)handle;
+    Flow& flow = _flows[index];
+    size_t slot = flow.slot;
+    // A group that still has an empty slot never overflowed into the next
+    // one, so no probe sequence depends on this slot staying occupied.
+    if (match_byte(_ctrl + (slot & ~(GROUP_SIZE - 1)), CTRL_EMPTY)) {
+        set_ctrl(slot, CTRL_EMPTY);
+        --_used_slots;
+    } else {
+        set_ctrl(slot, CTRL_DELETED);
+    }
+
+    ++flow.generation;
+    flow.data = NULL;
+    flow.slot = _free_flow;
+    _free_flow = index;
+    --_size;
+    return true;
+}
+
+void* FlowTable::data(Handle handle) const {
+    const Flow* flow = flow_of(handle);
+    return flow ? flow->data : NULL;
+}
+
+bool FlowTable::set_data(Handle handle, void* data) {
+    if (!flow_of(handle)) {
+        return false;
+    }
+    _flows[(uint32_t)handle].data = data;
+    return true;
+}
+
+SocketAddress FlowTable::address(Handle handle) const {
+    const Flow* flow = flow_of(handle);
+    return flow ? flow->key.to_socket_address() : SocketAddress();
+}
+
+void FlowTable::reserve(size_t flows) {
+    if (capacity() < flows) {
+        rehash(capacity_for(flows));
+    }
+}
+
+void FlowTable::clear() {
+    _free_flow = NO_FLOW;
+    for (size_t i = _flows.size(); i-- > 0;) {
+        Flow& flow = _flows[i];
+        if (is_live(flow.generation)) {
+            ++flow.generation;
+        }
+        flow.data = NULL;
+        flow.slot = _free_flow;
+        _free_flow = (uint32_t)i;
+    }
+    memset(_ctrl, CTRL_EMPTY, _capacity);
+    _size = 0;
+    _used_slots = 0;
+}
+
+void FlowTable::for_each(visit_cb_t cb, void* priv_data) const {
+    for (size_t i = 0; i < _flows.size(); ++i) {
+        const Flow& flow = _flows[i];
+        if (is_live(flow.generation)) {
+            cb(make_handle((int32_t)i), flow.key, flow.data, priv_data);
+        }
+    }
+}
+
+void FlowTable::rehash(size_t capacity) {
+    // Group loads want 16 byte alignment.
+    _ctrl_mem.reset(new uint8_t[capacity + GROUP_SIZE]);
+    _ctrl = reinterpret_cast<uint8_t*>(
+            ((uintptr_t)_ctrl_mem.get() + GROUP_SIZE - 1) & ~(uintptr_t)(GROUP_SIZE - 1));
+    memset(_ctrl, CTRL_EMPTY, capacity);
+    _slots.reset(new uint32_t[capacity]);
+    _capacity = capacity;
+    _used_slots = _size;
+
+    for (size_t i = 0; i < _flows.size(); ++i) {
+        Flow& flow = _flows[i];
+        if (!is_live(flow.generation)) {
+            continue;
+        }
+        size_t hash = flow.key.hash();
+        size_t slot = find_free_slot(hash);
+        set_ctrl(slot, (uint8_t)(hash & 0x7F));
+        _slots[slot] = (uint32_t)i;
+        flow.slot = (uint32_t)slot;
+    }
+}
+
+} // namespace rtcbase
+
+
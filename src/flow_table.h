@@ -0,0 +1,147 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file flow_table.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_FLOW_TABLE_H_
+#define  __RTCBASE_FLOW_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "memcheck.h"
+#include "constructor_magic.h"
+#include "socket_address.h"
+
+namespace rtcbase {
+
+// Maps remote addresses to per flow data, e.g. the session a packet belongs
+// to, for lookups on the packet path.
+//
+// An open addressing hash table in the style of SwissTable: slots are
+// grouped by 16, and a control byte per slot holds 7 bits of the hash of its
+// flow. A lookup compares a whole group of control bytes at once (SSE2, with
+// a portable fallback) and only touches the flows whose bits match, so most
+// lookups cost a single key comparison. The slots only hold indexes into a
+// flow array, growing the table never moves the flows.
+//
+// Flows are referred to by handles that stay valid until the flow is erased.
+// A handle of an erased flow is detected as stale, even once its place is
+// reused. Not thread safe.
+class FlowTable : public MemCheck {
+public:
+    typedef uint64_t Handle;
+    static const Handle INVALID_HANDLE = 0;
+
+    // Sized for |expected_flows| without growing.
+    explicit FlowTable(size_t expected_flows = 0);
+    ~FlowTable();
+
+    // Adds a flow with |data|. Returns INVALID_HANDLE when |addr| has a flow
+    // already.
+    Handle insert(const SocketAddress& addr, void* data) {
+        return insert(SocketAddressKey(addr), data);
+    }
+    Handle insert(const SocketAddressKey& key, void* data);
+
+    // Returns INVALID_HANDLE when |addr| has no flow.
+    Handle find(const SocketAddress& addr) const {
+        return find(SocketAddressKey(addr));
+    }
+    Handle find(const SocketAddressKey& key) const {
+        int32_t index = find_index(key);
+        return index < 0 ? INVALID_HANDLE : make_handle(index);
+    }
+
+    // Returns the data of |key|'s flow, NULL when there is none. The fast
+    // path for flows that never have NULL data.
+    void* lookup(const SocketAddressKey& key) const {
+        int32_t index = find_index(key);
+        return index < 0 ? NULL : _flows[index].data;
+    }
+
+    // Return false or NULL for stale handles.
+    bool erase(Handle handle);
+    bool erase(const SocketAddress& addr) { return erase(find(addr)); }
+    bool is_valid(Handle handle) const { return flow_of(handle) != NULL; }
+    void* data(Handle handle) const;
+    bool set_data(Handle handle, void* data);
+    // The address of a flow, v4-mapped addresses as IPv4. Nil for stale
+    // handles.
+    SocketAddress address(Handle handle) const;
+
+    size_t size() const { return _size; }
+    bool empty() const { return 0 == _size; }
+    // Flows the table holds before it grows.
+    size_t capacity() const { return _capacity * 7 / 8; }
+    void reserve(size_t flows);
+    // Erases every flow, all handles turn stale.
+    void clear();
+
+    // Calls |cb| for every flow, in no particular order. |cb| must not
+    // insert or erase flows.
+    typedef void (*visit_cb_t)(Handle handle, const SocketAddressKey& key,
+            void* data, void* priv_data);
+    void for_each(visit_cb_t cb, void* priv_data) const;
+
+private:
+    struct Flow {
+        SocketAddressKey key;
+        // Bumped on erase, part of the handles.
+        uint32_t generation;
+        // Slot of the flow, or the next free flow when unused.
+        uint32_t slot;
+        void* data;
+    };
+
+    // Control byte values, full slots hold the low 7 bits of the hash.
+    static const uint8_t CTRL_EMPTY = 0x80;
+    static const uint8_t CTRL_DELETED = 0xFE;
+    static const size_t GROUP_SIZE = 16;
+
+    Handle make_handle(int32_t index) const {
+        return ((uint64_t)_flows[index].generation << 32) | (uint32_t)index;
+    }
+    const Flow* flow_of(Handle handle) const;
+    int32_t find_index(const SocketAddressKey& key) const;
+    // A free slot on the probe sequence of |hash|.
+    size_t find_free_slot(size_t hash) const;
+    void rehash(size_t capacity);
+    void set_ctrl(size_t slot, uint8_t ctrl) { _ctrl[slot] = ctrl; }
+
+    // |_capacity| slots, a multiple of GROUP_SIZE and a power of two.
+    size_t _capacity;
+    // 16 byte aligned start of |_ctrl_mem|.
+    uint8_t* _ctrl;
+    std::unique_ptr<uint8_t[]> _ctrl_mem;
+    std::unique_ptr<uint32_t[]> _slots;
+
+    std::vector<Flow> _flows;
+    uint32_t _free_flow;
+    size_t _size;
+    // Slots that are either full or deleted, what probing has to skip.
+    size_t _used_slots;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(FlowTable);
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_FLOW_TABLE_H_
+
+
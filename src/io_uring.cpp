@@ -0,0 +1,328 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file io_uring.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#ifdef HAVE_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "logging.h"
+#include "io_uring.h"
+
+namespace rtcbase {
+
+static const uint32_t NO_HANDLER = 0xFFFFFFFF;
+
+template <typename T>
+static inline T load_acquire(const T* ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+static inline void store_release(T* ptr, T value) {
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+IoUring* IoUring::create(unsigned entries) {
+    IoUring* ring = new IoUring();
+    if (!ring->init(entries)) {
+        delete ring;
+        return nullptr;
+    }
+    return ring;
+}
+
+IoUring::IoUring() :
+    MemCheck("IoUring"),
+    _fd(-1), _sq_ring(MAP_FAILED), _sq_ring_size(0), _cq_ring(MAP_FAILED),
+    _cq_ring_size(0), _sqes((struct io_uring_sqe*)MAP_FAILED), _sqes_size(0),
+    _sq_head(NULL), _sq_tail(NULL), _sq_flags(NULL), _sq_mask(0),
+    _sq_entries(0), _cq_head(NULL), _cq_tail(NULL), _cq_mask(0), _cqes(NULL),
+    _sqe_tail(0), _sqe_submitted(0), _next_buffer_group(0)
+{
+}
+
+IoUring::~IoUring() {
+    for (size_t i = 0; i < _handlers.size(); ++i) {
+        if (_handlers[i]) {
+            _handlers[i]->on_ring_destroyed();
+        }
+    }
+
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqes_size);
+    }
+    if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring) {
+        munmap(_cq_ring, _cq_ring_size);
+    }
+    if (_sq_ring != MAP_FAILED) {
+        munmap(_sq_ring, _sq_ring_size);
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+bool IoUring::init(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // Multishot receives can complete many times per submission.
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    _fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (_fd < 0) {
+        LOG(LS_WARNING) << "io_uring_setup failed, error: " << errno;
+        return false;
+    }
+
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && _cq_ring_size > _sq_ring_size) {
+        _sq_ring_size = _cq_ring_size;
+    }
+
+    _sq_ring = mmap(NULL, _sq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED) {
+        LOG(LS_WARNING) << "mmap io_uring sq ring failed, error: " << errno;
+        return false;
+    }
+    if (single_mmap) {
+        _cq_ring = _sq_ring;
+    } else {
+        _cq_ring = mmap(NULL, _cq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cq_ring == MAP_FAILED) {
+            LOG(LS_WARNING) << "mmap io_uring cq ring failed, error: " << errno;
+            return false;
+        }
+    }
+
+    _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = (struct io_uring_sqe*)mmap(NULL, _sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        LOG(LS_WARNING) << "mmap io_uring sqes failed, error: " << errno;
+        return false;
+    }
+
+    char* sq = (char*)_sq_ring;
+    _sq_head = (unsigned*)(sq + params.sq_off.head);
+    _sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    _sq_flags = (unsigned*)(sq + params.sq_off.flags);
+    _sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+    // Entries are always submitted in order, map the index array 1:1 once.
+    unsigned* array = (unsigned*)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < _sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    char* cq = (char*)_cq_ring;
+    _cq_head = (unsigned*)(cq + params.cq_off.head);
+    _cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    _cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    _sqe_tail = _sqe_submitted = *_sq_tail;
+    return true;
+}
+
+int IoUring::enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    int ret;
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, _fd, to_submit, min_complete,
+                flags, NULL, 0);
+    } while (ret < 0 && EINTR == errno);
+    return ret < 0 ? -errno : ret;
+}
+
+uint32_t IoUring::register_handler(IoUringHandler* handler) {
+    if (!_free_handlers.empty()) {
+        uint32_t id = _free_handlers.back();
+        _free_handlers.pop_back();
+        _handlers[id] = handler;
+        return id;
+    }
+    _handlers.push_back(handler);
+    return (uint32_t)(_handlers.size() - 1);
+}
+
+void IoUring::unregister_handler(uint32_t id) {
+    if (id < _handlers.size() && _handlers[id]) {
+        _handlers[id] = NULL;
+        _free_handlers.push_back(id);
+    }
+}
+
+struct io_uring_sqe* IoUring::get_sqe() {
+    if (_sqe_tail - load_acquire(_sq_head) >= _sq_entries) {
+        submit();
+        if (_sqe_tail - load_acquire(_sq_head) >= _sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &_sqes[_sqe_tail & _sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++_sqe_tail;
+    return sqe;
+}
+
+int IoUring::submit() {
+    if (_sqe_tail != _sqe_submitted) {
+        store_release(_sq_tail, _sqe_tail);
+        _sqe_submitted = _sqe_tail;
+    }
+
+    unsigned to_submit = _sqe_submitted - load_acquire(_sq_head);
+    unsigned flags = 0;
+    if (load_acquire(_sq_flags) & IORING_SQ_CQ_OVERFLOW) {
+        // Let the kernel move the overflowed completions into the ring.
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    if (0 == to_submit && 0 == flags) {
+        return 0;
+    }
+
+    int ret = enter(to_submit, 0, flags);
+    if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+        LOG(LS_WARNING) << "io_uring_enter failed, error: " << -ret;
+    }
+    return ret;
+}
+
+void IoUring::process_completions() {
+    while (true) {
+        unsigned head = *_cq_head;
+        unsigned tail = load_acquire(_cq_tail);
+        if (head == tail) {
+            if (load_acquire(_sq_flags) & IORING_SQ_CQ_OVERFLOW) {
+                enter(0, 0, IORING_ENTER_GETEVENTS);
+                continue;
+            }
+            return;
+        }
+
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe* cqe = &_cqes[head & _cq_mask];
+            uint32_t id = (uint32_t)(cqe->user_data >> 32);
+            uint32_t tag = (uint32_t)cqe->user_data;
+            int32_t res = cqe->res;
+            uint32_t flags = cqe->flags;
+            // Free the entry before the handler runs, it may submit more.
+            store_release(_cq_head, head + 1);
+            if (id != NO_HANDLER && id < _handlers.size() && _handlers[id]) {
+                _handlers[id]->on_completion(tag, res, flags);
+            }
+        }
+    }
+}
+
+int IoUring::register_buffer_ring(void* ring, unsigned entries, uint16_t group) {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    int ret = (int)syscall(__NR_io_uring_register, _fd,
+            IORING_REGISTER_PBUF_RING, &reg, 1);
+    return ret < 0 ? -errno : 0;
+}
+
+int IoUring::unregister_buffer_ring(uint16_t group) {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = group;
+    int ret = (int)syscall(__NR_io_uring_register, _fd,
+            IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    return ret < 0 ? -errno : 0;
+}
+
+//////////////////////// IoUringBufferRing ////////////////
+
+IoUringBufferRing* IoUringBufferRing::create(IoUring* ring, unsigned count,
+        size_t size)
+{
+    if (0 == count || (count & (count - 1)) || count > 32768) {
+        LOG(LS_WARNING) << "Invalid io_uring buffer count: " << count;
+        return nullptr;
+    }
+
+    IoUringBufferRing* buffers = new IoUringBufferRing(ring, count, size);
+    // The kernel wants a page aligned ring.
+    void* mem = mmap(NULL, buffers->_buf_ring_size, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (mem == MAP_FAILED) {
+        LOG(LS_WARNING) << "mmap io_uring buffer ring failed, error: " << errno;
+        delete buffers;
+        return nullptr;
+    }
+    buffers->_buf_ring = (struct io_uring_buf_ring*)mem;
+
+    int ret = ring->register_buffer_ring(mem, count, buffers->_group);
+    if (ret < 0) {
+        LOG(LS_WARNING) << "Register io_uring buffer ring failed, error: " << -ret;
+        munmap(mem, buffers->_buf_ring_size);
+        buffers->_buf_ring = NULL;
+        delete buffers;
+        return nullptr;
+    }
+
+    buffers->_data = new char[(size_t)count * size];
+    for (unsigned i = 0; i < count; ++i) {
+        buffers->recycle((uint16_t)i);
+    }
+    return buffers;
+}
+
+IoUringBufferRing::IoUringBufferRing(IoUring* ring, unsigned count, size_t size) :
+    MemCheck("IoUringBufferRing"),
+    _ring(ring), _buf_ring(NULL),
+    _buf_ring_size(count * sizeof(struct io_uring_buf)),
+    _data(NULL), _count(count), _size(size),
+    _group(ring->alloc_buffer_group()), _tail(0)
+{
+}
+
+IoUringBufferRing::~IoUringBufferRing() {
+    if (_buf_ring) {
+        _ring->unregister_buffer_ring(_group);
+        munmap(_buf_ring, _buf_ring_size);
+    }
+    delete [] _data;
+}
+
+void IoUringBufferRing::recycle(uint16_t bid) {
+    // Not _buf_ring->bufs: in C++ the kernel header's flexible array member
+    // is preceded by an empty struct of size 1, which moves it off offset 0.
+    struct io_uring_buf* buf = (struct io_uring_buf*)_buf_ring + (_tail & (_count - 1));
+    buf->addr = (uint64_t)(uintptr_t)buffer(bid);
+    buf->len = (uint32_t)_size;
+    buf->bid = bid;
+    ++_tail;
+    store_release(&_buf_ring->tail, _tail);
+}
+
+} // namespace rtcbase
+
+#endif  // HAVE_IO_URING
+
+
@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file io_uring.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_IO_URING_H_
+#define  __RTCBASE_IO_URING_H_
+
+// Only built with -DHAVE_IO_URING, which needs the kernel headers of Linux
+// 5.19 or later (multishot receive and provided buffer rings). The Makefile
+// and BUILDMAKE define it when <linux/io_uring.h> has them.
+#ifdef HAVE_IO_URING
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+#include <vector>
+
+#include "memcheck.h"
+#include "constructor_magic.h"
+
+namespace rtcbase {
+
+// Receives the completions of the requests submitted with its id.
+class IoUringHandler {
+public:
+    virtual ~IoUringHandler() {}
+    // |tag| is the low half of the request's user data, see
+    // IoUring::user_data().
+    virtual void on_completion(uint32_t tag, int32_t res, uint32_t flags) = 0;
+    // The ring goes away, requests still in flight are cancelled by the
+    // kernel and will not complete.
+    virtual void on_ring_destroyed() {}
+};
+
+// A thin io_uring wrapper on top of the raw system calls. Not thread safe,
+// it belongs to the EventLoop driving it (see EventLoop::enable_io_uring()).
+class IoUring : public MemCheck {
+public:
+    // Returns nullptr when the kernel does not support io_uring.
+    static IoUring* create(unsigned entries);
+    ~IoUring();
+
+    int fd() const { return _fd; }
+
+    uint32_t register_handler(IoUringHandler* handler);
+    // Completions still arriving for |id| are dropped.
+    void unregister_handler(uint32_t id);
+    static uint64_t user_data(uint32_t id, uint32_t tag) {
+        return ((uint64_t)id << 32) | tag;
+    }
+
+    // Returns a zeroed submission entry, submitting the queued ones first
+    // when the queue is full. Returns nullptr when no entry is available.
+    struct io_uring_sqe* get_sqe();
+    bool has_pending_sqes() const { return _sqe_tail != _sqe_submitted; }
+    // Hands the queued entries to the kernel with one system call. Returns
+    // the number of entries consumed or -errno.
+    int submit();
+
+    // Dispatches every completion queued by the kernel.
+    void process_completions();
+
+    uint16_t alloc_buffer_group() { return _next_buffer_group++; }
+    int register_buffer_ring(void* ring, unsigned entries, uint16_t group);
+    int unregister_buffer_ring(uint16_t group);
+
+private:
+    IoUring();
+    bool init(unsigned entries);
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+
+    int _fd;
+    void* _sq_ring;
+    size_t _sq_ring_size;
+    void* _cq_ring;
+    size_t _cq_ring_size;
+    struct io_uring_sqe* _sqes;
+    size_t _sqes_size;
+
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned* _sq_flags;
+    unsigned _sq_mask;
+    unsigned _sq_entries;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned _cq_mask;
+    struct io_uring_cqe* _cqes;
+
+    // Entries handed out by get_sqe(), and the ones published to the kernel.
+    unsigned _sqe_tail;
+    unsigned _sqe_submitted;
+
+    std::vector<IoUringHandler*> _handlers;
+    std::vector<uint32_t> _free_handlers;
+    uint16_t _next_buffer_group;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(IoUring);
+};
+
+// A provided buffer ring: |count| buffers of |size| bytes the kernel picks
+// from for receives submitted with IOSQE_BUFFER_SELECT and group_id().
+class IoUringBufferRing : public MemCheck {
+public:
+    // |count| must be a power of two. Returns nullptr on failure.
+    static IoUringBufferRing* create(IoUring* ring, unsigned count, size_t size);
+    ~IoUringBufferRing();
+
+    uint16_t group_id() const { return _group; }
+    size_t buffer_size() const { return _size; }
+    char* buffer(uint16_t bid) { return _data + (size_t)bid * _size; }
+    // Gives the buffer back to the kernel.
+    void recycle(uint16_t bid);
+
+private:
+    IoUringBufferRing(IoUring* ring, unsigned count, size_t size);
+
+    IoUring* _ring;
+    struct io_uring_buf_ring* _buf_ring;
+    size_t _buf_ring_size;
+    char* _data;
+    unsigned _count;
+    size_t _size;
+    uint16_t _group;
+    uint16_t _tail;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(IoUringBufferRing);
+};
+
+} // namespace rtcbase
+
+#endif  // HAVE_IO_URING
+
+#endif  //__RTCBASE_IO_URING_H_
+
+
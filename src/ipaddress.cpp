@@ -24,7 +24,6 @@
 #include <netdb.h>
 #include <unistd.h>
 
-#include "net_helpers.h"
 #include "ipaddress.h"
 
 namespace rtcbase {
@@ -87,7 +86,8 @@ bool IPAddress::operator <(const IPAddress &other) const {
 }
 
 std::ostream& operator<<(std::ostream& os, const IPAddress& ip) {
-    os << ip.to_string();
+    char buf[k_ip_address_max_chars];
+    os.write(buf, ip.to_chars(buf, sizeof(buf)));
     return os;
 }
 
@@ -150,51 +150,152 @@ size_t IPAddress::size() const {
     return 0;
 }
 
-std::string IPAddress::to_string() const {
-    if (_family != AF_INET && _family != AF_INET6) {
-        return std::string();
+static const char k_hex_digits[] = "0123456789abcdef";
+
+// The writers below return the end of what they wrote and do not check for
+// room, callers pass buffers of k_ip_address_max_chars.
+static inline char* write_octet(char* p, uint32_t value) {
+    if (value >= 100) {
+        *p++ = (char)('0' + value / 100);
+        value %= 100;
+        *p++ = (char)('0' + value / 10);
+    } else if (value >= 10) {
+        *p++ = (char)('0' + value / 10);
     }
-    char buf[INET6_ADDRSTRLEN] = {0};
-    const void* src = &_u.ip4;
-    if (_family == AF_INET6) {
-        src = &_u.ip6;
+    *p++ = (char)('0' + value % 10);
+    return p;
+}
+
+static char* write_ipv4(char* p, const uint8_t* bytes) {
+    p = write_octet(p, bytes[0]);
+    for (size_t i = 1; i < 4; ++i) {
+        *p++ = '.';
+        p = write_octet(p, bytes[i]);
+    }
+    return p;
+}
+
+// Lowercase hex without leading zeros.
+static inline char* write_hex16(char* p, uint32_t value) {
+    if (value >= 0x1000) {
+        *p++ = k_hex_digits[value >> 12];
+    }
+    if (value >= 0x100) {
+        *p++ = k_hex_digits[(value >> 8) & 0xF];
+    }
+    if (value >= 0x10) {
+        *p++ = k_hex_digits[(value >> 4) & 0xF];
+    }
+    *p++ = k_hex_digits[value & 0xF];
+    return p;
+}
+
+// Same text as inet_ntop(): the first longest run of two or more zero words
+// becomes "::", and v4-compatible and v4-mapped addresses end in a dotted
+// quad.
+static char* write_ipv6(char* p, const uint8_t* bytes) {
+    uint32_t words[8];
+    for (size_t i = 0; i < 8; ++i) {
+        words[i] = ((uint32_t)bytes[2 * i] << 8) | bytes[2 * i + 1];
+    }
+
+    int best_base = -1;
+    int best_len = 0;
+    int cur_base = -1;
+    for (int i = 0; i <= 8; ++i) {
+        if (i < 8 && 0 == words[i]) {
+            if (cur_base < 0) {
+                cur_base = i;
+            }
+        } else if (cur_base >= 0) {
+            if (i - cur_base > best_len) {
+                best_base = cur_base;
+                best_len = i - cur_base;
+            }
+            cur_base = -1;
+        }
+    }
+    if (best_len < 2) {
+        best_base = -1;
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        if (i == best_base) {
+            *p++ = ':';
+            i += best_len - 1;
+            if (8 == i + 1) {
+                *p++ = ':';
+            }
+            continue;
+        }
+        if (i != 0) {
+            *p++ = ':';
+        }
+        if (6 == i && 0 == best_base && (6 == best_len
+                    || (7 == best_len && words[7] != 0x0001)
+                    || (5 == best_len && 0xFFFF == words[5])))
+        {
+            return write_ipv4(p, bytes + 12);
+        }
+        p = write_hex16(p, words[i]);
     }
-    if (!rtcbase::inet_ntop(_family, src, buf, sizeof(buf))) {
-        return std::string();
+    return p;
+}
+
+static size_t copy_chars(char* buf, size_t buf_size, const char* text, size_t len) {
+    if (0 == len || len >= buf_size) {
+        return 0;
     }
-    return std::string(buf);
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+    return len;
+}
+
+std::string IPAddress::to_string() const {
+    char buf[k_ip_address_max_chars];
+    return std::string(buf, to_chars(buf, sizeof(buf)));
 }
 
 std::string IPAddress::to_sensitive_string() const {
+    char buf[k_ip_address_max_chars];
+    return std::string(buf, to_sensitive_chars(buf, sizeof(buf)));
+}
+
+size_t IPAddress::to_chars(char* buf, size_t buf_size) const {
+    char text[k_ip_address_max_chars];
+    char* end = text;
+    if (AF_INET == _family) {
+        end = write_ipv4(text, reinterpret_cast<const uint8_t*>(&_u.ip4));
+    } else if (AF_INET6 == _family) {
+        end = write_ipv6(text, _u.ip6.s6_addr);
+    }
+    return copy_chars(buf, buf_size, text, end - text);
+}
+
+size_t IPAddress::to_sensitive_chars(char* buf, size_t buf_size) const {
 #if !defined(NDEBUG)
     // Return non-stripped in debug.
-    return to_string();
+    return to_chars(buf, buf_size);
 #else
-    switch (_family) {
-        case AF_INET: {
-            std::string address = to_string();
-            size_t find_pos = address.rfind('.');
-            if (find_pos == std::string::npos) {
-                return std::string();
-            }
-            address.resize(find_pos);
-            address += ".x";
-            return address;
+    char text[k_ip_address_max_chars];
+    char* end = text;
+    if (AF_INET == _family) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&_u.ip4);
+        for (size_t i = 0; i < 3; ++i) {
+            end = write_octet(end, bytes[i]);
+            *end++ = '.';
         }
-        case AF_INET6: {
-            std::string result;
-            result.resize(INET6_ADDRSTRLEN);
-            in6_addr addr = ipv6_address();
-            size_t len =
-                rtcbase::sprintfn(&(result[0]), result.size(), "%x:%x:%x:x:x:x:x:x",
-                        (addr.s6_addr[0] << 8) + addr.s6_addr[1],
-                        (addr.s6_addr[2] << 8) + addr.s6_addr[3],
-                        (addr.s6_addr[4] << 8) + addr.s6_addr[5]);
-            result.resize(len);
-            return result;
-        }
-    }
-    return std::string();
+        *end++ = 'x';
+    } else if (AF_INET6 == _family) {
+        const uint8_t* bytes = _u.ip6.s6_addr;
+        for (size_t i = 0; i < 3; ++i) {
+            end = write_hex16(end, ((uint32_t)bytes[2 * i] << 8) | bytes[2 * i + 1]);
+            *end++ = ':';
+        }
+        memcpy(end, "x:x:x:x:x", 9);
+        end += 9;
+    }
+    return copy_chars(buf, buf_size, text, end - text);
 #endif
 }
 
@@ -230,22 +331,139 @@ bool IPAddress::is_nil() const {
     return IP_is_unspec(*this);
 }
 
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline int hex_value(char c) {
+    if (is_digit(c)) {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// A dotted quad spanning all of [p, end), each part a decimal from 0 to 255
+// without leading zeros.
+static bool parse_ipv4(const char* p, const char* end, uint8_t* out) {
+    size_t octets = 0;
+    while (true) {
+        if (p == end || !is_digit(*p)) {
+            return false;
+        }
+        uint32_t value = *p++ - '0';
+        if (0 == value && p != end && is_digit(*p)) {
+            return false;
+        }
+        while (p != end && is_digit(*p)) {
+            value = value * 10 + (*p++ - '0');
+            if (value > 255) {
+                return false;
+            }
+        }
+        out[octets++] = (uint8_t)value;
+        if (p == end) {
+            return 4 == octets;
+        }
+        if (*p != '.' || 4 == octets) {
+            return false;
+        }
+        ++p;
+    }
+}
+
+// Up to eight groups of one to four hex digits, one "::" standing for at
+// least one zero group, and optionally a dotted quad for the last 32 bits.
+static bool parse_ipv6(const char* p, const char* end, uint8_t* out) {
+    if (p != end && ':' == *p && (++p == end || *p != ':')) {
+        return false;
+    }
+
+    size_t size = 0;
+    // Where "::" was seen, -1 when it was not.
+    int gap = -1;
+    const char* token = p;
+    uint32_t value = 0;
+    size_t digits = 0;
+    while (p != end) {
+        char c = *p++;
+        int x = hex_value(c);
+        if (x >= 0) {
+            if (++digits > 4) {
+                return false;
+            }
+            value = (value << 4) | x;
+            continue;
+        }
+        if (':' == c) {
+            token = p;
+            if (0 == digits) {
+                if (gap >= 0) {
+                    return false;
+                }
+                gap = (int)size;
+                continue;
+            }
+            if (p == end || size + 2 > 16) {
+                return false;
+            }
+            out[size++] = (uint8_t)(value >> 8);
+            out[size++] = (uint8_t)value;
+            value = 0;
+            digits = 0;
+            continue;
+        }
+        if ('.' == c && size + 4 <= 16 && parse_ipv4(token, end, out + size)) {
+            size += 4;
+            digits = 0;
+            break;
+        }
+        return false;
+    }
+    if (digits > 0) {
+        if (size + 2 > 16) {
+            return false;
+        }
+        out[size++] = (uint8_t)(value >> 8);
+        out[size++] = (uint8_t)value;
+    }
+
+    if (gap >= 0) {
+        if (16 == size) {
+            return false;
+        }
+        size_t tail = size - gap;
+        memmove(out + 16 - tail, out + gap, tail);
+        memset(out + gap, 0, 16 - size);
+        size = 16;
+    }
+    return 16 == size;
+}
+
 bool IP_from_string(const std::string& str, IPAddress* out) {
+    return IP_from_chars(str.c_str(), strlen(str.c_str()), out);
+}
+
+bool IP_from_chars(const char* str, size_t len, IPAddress* out) {
     if (!out) {
         return false;
     }
+    const char* end = str + len;
     in_addr addr;
-    if (rtcbase::inet_pton(AF_INET, str.c_str(), &addr) == 0) {
-        in6_addr addr6;
-        if (rtcbase::inet_pton(AF_INET6, str.c_str(), &addr6) == 0) {
-            *out = IPAddress();
-            return false;
-        }
-        *out = IPAddress(addr6);
-    } else {
+    if (parse_ipv4(str, end, reinterpret_cast<uint8_t*>(&addr))) {
         *out = IPAddress(addr);
+        return true;
     }
-    return true;
+    in6_addr addr6;
+    if (parse_ipv6(str, end, addr6.s6_addr)) {
+        *out = IPAddress(addr6);
+        return true;
+    }
+    *out = IPAddress();
+    return false;
 }
 
 bool IP_is_any(const IPAddress& ip) {
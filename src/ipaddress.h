@@ -19,7 +19,9 @@
 #ifndef  __RTCBASE_IPADDRESS_H_
 #define  __RTCBASE_IPADDRESS_H_
 
+#include <stdint.h>
 #include <string.h>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -32,6 +34,29 @@
 
 namespace rtcbase {
 
+// Room for the longest text form of an address, including the terminating
+// NUL.
+static const size_t k_ip_address_max_chars = INET6_ADDRSTRLEN;
+
+// Hashes 16 address bytes in network order plus a port. Shared by the hashes
+// of IPAddress and SocketAddressKey.
+inline size_t hash_address_bytes(const uint8_t* ip, uint16_t port) {
+    uint64_t hi;
+    uint64_t lo;
+    memcpy(&hi, ip, sizeof(hi));
+    memcpy(&lo, ip + sizeof(hi), sizeof(lo));
+    // The port lands in bytes that are zero for v4-mapped addresses, so the
+    // mixing input is unique for every IPv4 address and port.
+    uint64_t h = hi * UINT64_C(0x9E3779B97F4A7C15) + (lo ^ port);
+    // MurmurHash3 finalizer.
+    h ^= h >> 33;
+    h *= UINT64_C(0xFF51AFD7ED558CCD);
+    h ^= h >> 33;
+    h *= UINT64_C(0xC4CEB9FE1A85EC53);
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
+
 enum IPv6AddressFlag {
     IPV6_ADDRESS_FLAG_NONE =           0x00,
 
@@ -90,12 +115,41 @@ public:
     // Returns the number of bytes needed to store the raw address.
     size_t size() const;
 
-    // Wraps inet_ntop.
+    // Writes the address as 16 bytes in network byte order, IPv4 addresses
+    // v4-mapped (::ffff:a.b.c.d) and AF_UNSPEC as all zeros.
+    void to_ipv6_bytes(uint8_t* out) const {
+        if (AF_INET == _family) {
+            static const uint8_t k_v4_mapped_prefix[12] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+            memcpy(out, k_v4_mapped_prefix, sizeof(k_v4_mapped_prefix));
+            memcpy(out + 12, &_u.ip4, sizeof(_u.ip4));
+        } else if (AF_INET6 == _family) {
+            memcpy(out, &_u.ip6, sizeof(_u.ip6));
+        } else {
+            memset(out, 0, 16);
+        }
+    }
+
+    // Consistent with operator==, an IPv4 address hashes like its v4-mapped
+    // IPv6 form.
+    size_t hash() const {
+        uint8_t bytes[16];
+        to_ipv6_bytes(bytes);
+        return hash_address_bytes(bytes, 0);
+    }
+
     std::string to_string() const;
 
     // Same as ToString but anonymizes it by hiding the last part.
     std::string to_sensitive_string() const;
 
+    // Write the same text as to_string() and to_sensitive_string() into |buf|
+    // without allocating, NUL terminated. Return the length excluding the
+    // NUL, or 0 when the address is unspecified or |buf_size| is too small,
+    // k_ip_address_max_chars always fits.
+    size_t to_chars(char* buf, size_t buf_size) const;
+    size_t to_sensitive_chars(char* buf, size_t buf_size) const;
+
     // Returns an unmapped address from a possibly-mapped address.
     // Returns the same address if this isn't a mapped address.
     IPAddress normalized() const;
@@ -147,6 +201,10 @@ private:
 };
 
 bool IP_from_string(const std::string& str, IPAddress* out);
+// Parses the |len| characters at |str| as a numeric IPv4 or IPv6 address,
+// accepting the same forms as inet_pton(). Needs neither a NUL terminator
+// nor a copy.
+bool IP_from_chars(const char* str, size_t len, IPAddress* out);
 
 bool IP_is_any(const IPAddress& ip);
 bool IP_is_private(const IPAddress& ip);
@@ -177,6 +235,17 @@ int count_IP_mask_bits(IPAddress mask);
 
 } // namespace rtcbase
 
+namespace std {
+
+template <>
+struct hash<rtcbase::IPAddress> {
+    size_t operator()(const rtcbase::IPAddress& ip) const {
+        return ip.hash();
+    }
+};
+
+} // namespace std
+
 #endif  //__RTCBASE_IPADDRESS_H_
 
 
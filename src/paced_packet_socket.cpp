@@ -0,0 +1,367 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file paced_packet_socket.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <errno.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "time_utils.h"
+#include "paced_packet_socket.h"
+
+namespace rtcbase {
+
+static const int64_t k_default_burst_window_ms = 10;
+static const int64_t k_min_burst_bits = 1500 * 8;
+static const size_t k_default_max_queued_bytes = 1024 * 1024;
+static const int64_t k_rate_window_ms = 1000;
+// How often idle destinations are forgotten.
+static const int64_t k_sweep_interval_ns = k_num_nanosecs_per_sec;
+
+//////////////////////// TokenBucket ////////////////
+
+void PacedPacketSocket::TokenBucket::set_rate(int64_t bps, int64_t window_ms) {
+    bool was_unlimited = (0 == rate_bps);
+    rate_bps = bps;
+    burst_bits = std::max(bps * window_ms / k_num_millisecs_per_sec,
+            k_min_burst_bits);
+    if (was_unlimited || tokens > burst_bits) {
+        tokens = burst_bits;
+    }
+}
+
+void PacedPacketSocket::TokenBucket::refill(int64_t now_ns) {
+    if (0 == rate_bps) {
+        last_ns = now_ns;
+        return;
+    }
+    int64_t elapsed_ns = now_ns - last_ns;
+    if (elapsed_ns <= 0 || tokens >= burst_bits) {
+        last_ns = std::max(last_ns, now_ns);
+        return;
+    }
+    int64_t bits = (int64_t)((double)rate_bps * elapsed_ns / k_num_nanosecs_per_sec);
+    // Frequent calls would otherwise lose the fractions at low rates.
+    if (bits > 0) {
+        tokens = std::min(tokens + bits, burst_bits);
+        last_ns = now_ns;
+    }
+}
+
+void PacedPacketSocket::TokenBucket::consume(size_t bytes) {
+    if (rate_bps != 0) {
+        tokens -= (int64_t)bytes * 8;
+    }
+}
+
+int64_t PacedPacketSocket::TokenBucket::ready_ns() const {
+    if (can_send()) {
+        return 0;
+    }
+    // One nanosecond more covers the rounding in refill().
+    return last_ns + 1 + (int64_t)ceil(
+            (double)(1 - tokens) * k_num_nanosecs_per_sec / rate_bps);
+}
+
+//////////////////////// PacedPacketSocket ////////////////
+
+PacedPacketSocket::PacedPacketSocket(EventLoop* el, AsyncPacketSocket* socket) :
+    _el(el), _socket(socket), _timer(NULL), _timer_deadline(-1),
+    _default_flow_rate(0), _burst_window_ms(k_default_burst_window_ms),
+    _last_sweep_ns(el->now_nanos()),
+    _max_queued_bytes(k_default_max_queued_bytes), _queued_packets(0),
+    _queued_bytes(0), _dropped_packets(0), _error(0),
+    _send_rate(k_rate_window_ms, RateStatistics::k_bps_scale)
+{
+    _timer = _el->create_timer(&PacedPacketSocket::pacer_timer_cb, this, false);
+    _socket->signal_read_packet.connect(this, &PacedPacketSocket::on_read_packet);
+    _socket->signal_sent_packet.connect(this, &PacedPacketSocket::on_sent_packet);
+}
+
+PacedPacketSocket::~PacedPacketSocket() {
+    _el->delete_timer(_timer);
+}
+
+void PacedPacketSocket::set_rate(int64_t bps) {
+    int64_t now_ns = _el->now_nanos();
+    _bucket.refill(now_ns);
+    _bucket.set_rate(std::max(bps, (int64_t)0), _burst_window_ms);
+    process(now_ns);
+}
+
+void PacedPacketSocket::set_default_destination_rate(int64_t bps) {
+    int64_t now_ns = _el->now_nanos();
+    _default_flow_rate = std::max(bps, (int64_t)0);
+    for (FlowMap::iterator it = _flows.begin(); it != _flows.end(); ++it) {
+        if (!it->second.has_rate) {
+            it->second.bucket.refill(now_ns);
+            it->second.bucket.set_rate(_default_flow_rate, _burst_window_ms);
+        }
+    }
+    process(now_ns);
+}
+
+void PacedPacketSocket::set_destination_rate(const SocketAddress& addr,
+        int64_t bps)
+{
+    int64_t now_ns = _el->now_nanos();
+    Flow& flow = *get_flow(addr, now_ns);
+    flow.has_rate = (bps >= 0);
+    flow.bucket.refill(now_ns);
+    flow.bucket.set_rate(flow.has_rate ? bps : _default_flow_rate, _burst_window_ms);
+    process(now_ns);
+}
+
+void PacedPacketSocket::set_burst_window(int64_t ms) {
+    int64_t now_ns = _el->now_nanos();
+    _burst_window_ms = std::max(ms, (int64_t)0);
+    _bucket.refill(now_ns);
+    _bucket.set_rate(_bucket.rate_bps, _burst_window_ms);
+    for (FlowMap::iterator it = _flows.begin(); it != _flows.end(); ++it) {
+        it->second.bucket.refill(now_ns);
+        it->second.bucket.set_rate(it->second.bucket.rate_bps, _burst_window_ms);
+    }
+}
+
+size_t PacedPacketSocket::queue_depth(const SocketAddress& addr) const {
+    FlowMap::const_iterator it = _flows.find(SocketAddressKey(addr));
+    return it == _flows.end() ? 0 : it->second.packets.size();
+}
+
+Optional<uint32_t> PacedPacketSocket::send_rate() const {
+    return _send_rate.rate(_el->now_nanos() / k_num_nanosecs_per_millisec);
+}
+
+PacedPacketSocket::Flow* PacedPacketSocket::get_flow(const SocketAddress& addr,
+        int64_t now_ns)
+{
+    SocketAddressKey key(addr);
+    FlowMap::iterator it = _flows.find(key);
+    if (it != _flows.end()) {
+        return &it->second;
+    }
+    Flow* flow = &_flows.insert(std::make_pair(key, Flow(addr))).first->second;
+    // A new destination starts with a full bucket.
+    flow->bucket.set_rate(_default_flow_rate, _burst_window_ms);
+    flow->bucket.last_ns = now_ns;
+    return flow;
+}
+
+int PacedPacketSocket::send_to(const void* data,
+        size_t size,
+        const SocketAddress& addr,
+        const PacketOptions& options)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    return send_to_v(&iov, 1, addr, options);
+}
+
+int PacedPacketSocket::send_to_v(const struct iovec* iov, size_t iov_count,
+        const SocketAddress& addr, const PacketOptions& options)
+{
+    int64_t now_ns = _el->now_nanos();
+    sweep_flows(now_ns);
+
+    Flow& flow = *get_flow(addr, now_ns);
+    if (flow.packets.empty()) {
+        _bucket.refill(now_ns);
+        flow.bucket.refill(now_ns);
+        if (_bucket.can_send() && flow.bucket.can_send()) {
+            return forward_packet(iov, iov_count, addr, options, &flow, now_ns);
+        }
+    }
+
+    size_t size = iov_length(iov, iov_count);
+    if (_queued_bytes + size > _max_queued_bytes) {
+        ++_dropped_packets;
+        _error = EWOULDBLOCK;
+        return -1;
+    }
+
+    flow.packets.push_back(Packet(iov, iov_count, options));
+    ++_queued_packets;
+    _queued_bytes += size;
+    if (!flow.active) {
+        flow.active = true;
+        _active.push_back(&flow);
+    }
+    schedule(now_ns);
+    return static_cast<int>(size);
+}
+
+int PacedPacketSocket::forward_packet(const struct iovec* iov, size_t iov_count,
+        const SocketAddress& addr, const PacketOptions& options, Flow* flow,
+        int64_t now_ns)
+{
+    int ret = _socket->send_to_v(iov, iov_count, addr, options);
+    if (ret < 0) {
+        _error = _socket->get_error();
+        return ret;
+    }
+    size_t size = iov_length(iov, iov_count);
+    _error = 0;
+    _bucket.consume(size);
+    flow->bucket.consume(size);
+    _send_rate.update(size, now_ns / k_num_nanosecs_per_millisec);
+    return ret;
+}
+
+void PacedPacketSocket::process(int64_t now_ns) {
+    _bucket.refill(now_ns);
+
+    // Flows in a row that had to be skipped, a whole round of them means
+    // nobody can send.
+    size_t blocked = 0;
+    while (!_active.empty() && blocked < _active.size() && _bucket.can_send()) {
+        Flow& flow = *_active.front();
+        _active.pop_front();
+        flow.bucket.refill(now_ns);
+        if (!flow.bucket.can_send()) {
+            _active.push_back(&flow);
+            ++blocked;
+            continue;
+        }
+        blocked = 0;
+
+        // A listener of the inner socket may send from within, that only
+        // ever appends to the queues.
+        Packet& packet = flow.packets.front();
+        size_t size = packet.data.size();
+        struct iovec iov;
+        iov.iov_base = packet.data.data();
+        iov.iov_len = size;
+        if (forward_packet(&iov, 1, flow.addr, packet.options, &flow, now_ns) < 0) {
+            ++_dropped_packets;
+        }
+        flow.packets.pop_front();
+        --_queued_packets;
+        _queued_bytes -= size;
+
+        if (flow.packets.empty()) {
+            flow.active = false;
+        } else {
+            _active.push_back(&flow);
+        }
+    }
+
+    schedule(now_ns);
+}
+
+void PacedPacketSocket::schedule(int64_t now_ns) {
+    if (_active.empty()) {
+        if (_timer_deadline >= 0) {
+            _el->stop_timer(_timer);
+            _timer_deadline = -1;
+        }
+        return;
+    }
+
+    // The first flow that may send, once the socket may.
+    int64_t flow_ready = INT64_MAX;
+    for (size_t i = 0; i < _active.size(); ++i) {
+        flow_ready = std::min(flow_ready, _active[i]->bucket.ready_ns());
+    }
+    int64_t deadline = std::max(std::max(_bucket.ready_ns(), flow_ready), now_ns);
+
+    // A timer firing early only reschedules.
+    if (_timer_deadline >= 0 && _timer_deadline <= deadline) {
+        return;
+    }
+    _el->start_timer_at(_timer, deadline);
+    _timer_deadline = deadline;
+}
+
+void PacedPacketSocket::sweep_flows(int64_t now_ns) {
+    if (now_ns - _last_sweep_ns < k_sweep_interval_ns) {
+        return;
+    }
+    _last_sweep_ns = now_ns;
+
+    // Only destinations that would start over with the same full bucket.
+    FlowMap::iterator it = _flows.begin();
+    while (it != _flows.end()) {
+        Flow& flow = it->second;
+        if (!flow.active && !flow.has_rate) {
+            flow.bucket.refill(now_ns);
+            if (0 == flow.bucket.rate_bps
+                    || flow.bucket.tokens >= flow.bucket.burst_bits)
+            {
+                it = _flows.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+}
+
+void PacedPacketSocket::pacer_timer_cb(EventLoop* el, TimerWatcher* w,
+        void* priv_data)
+{
+    (void)w;
+    PacedPacketSocket* socket = static_cast<PacedPacketSocket*>(priv_data);
+    socket->_timer_deadline = -1;
+    socket->process(el->now_nanos());
+}
+
+SocketAddress PacedPacketSocket::get_local_address() const {
+    return _socket->get_local_address();
+}
+
+int PacedPacketSocket::close() {
+    _active.clear();
+    _flows.clear();
+    _queued_packets = 0;
+    _queued_bytes = 0;
+    schedule(_el->now_nanos());
+    return _socket->close();
+}
+
+PacedPacketSocket::State PacedPacketSocket::get_state() const {
+    return _socket->get_state();
+}
+
+int PacedPacketSocket::get_option(Socket::Option opt, int* value) {
+    return _socket->get_option(opt, value);
+}
+
+int PacedPacketSocket::set_option(Socket::Option opt, int value) {
+    return _socket->set_option(opt, value);
+}
+
+int PacedPacketSocket::get_error() const {
+    return _error != 0 ? _error : _socket->get_error();
+}
+
+void PacedPacketSocket::on_read_packet(AsyncPacketSocket* socket,
+        const char* data, size_t size, const SocketAddress& addr,
+        const PacketTime& packet_time)
+{
+    (void)socket;
+    signal_read_packet(this, data, size, addr, packet_time);
+}
+
+void PacedPacketSocket::on_sent_packet(AsyncPacketSocket* socket,
+        const SentPacket& sent_packet)
+{
+    (void)socket;
+    signal_sent_packet(this, sent_packet);
+}
+
+} // namespace rtcbase
+
+
@@ -0,0 +1,188 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file paced_packet_socket.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_PACED_PACKET_SOCKET_H_
+#define  __RTCBASE_PACED_PACKET_SOCKET_H_
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+#include "async_packet_socket.h"
+#include "buffer.h"
+#include "event_loop.h"
+#include "optional.h"
+#include "rate_statistics.h"
+#include "socket_address.h"
+
+namespace rtcbase {
+
+// A send pacer in front of another AsyncPacketSocket, usually an
+// AsyncUDPSocket. Packets leave through token buckets, one for the socket
+// and one per destination, refilled at the configured rates and holding up
+// to a burst window worth of data. A packet may be sent as long as both
+// buckets are positive and it drives them into debt, so packets larger than
+// a burst still pass at the average rate.
+//
+// Packets that can not be sent right away are queued per destination and
+// released from a loop timer, the destinations taking turns one packet at a
+// time. While nothing is queued for a destination and the buckets allow it,
+// send_to() passes the packet straight through without a copy.
+//
+// Packets received by the inner socket are emitted with this socket as the
+// source, so replies go through the pacer too. Not thread safe, use it on
+// the loop it was created with.
+class PacedPacketSocket : public AsyncPacketSocket {
+public:
+    // Takes ownership of |socket|. All rates are in bits per second, 0 means
+    // unlimited, which is the default.
+    PacedPacketSocket(EventLoop* el, AsyncPacketSocket* socket);
+    ~PacedPacketSocket() override;
+
+    AsyncPacketSocket* socket() const { return _socket.get(); }
+
+    // Rate of everything leaving the socket.
+    void set_rate(int64_t bps);
+    int64_t rate() const { return _bucket.rate_bps; }
+    // Rate of each destination without a rate of its own.
+    void set_default_destination_rate(int64_t bps);
+    int64_t default_destination_rate() const { return _default_flow_rate; }
+    // A negative |bps| reverts |addr| to the default destination rate.
+    void set_destination_rate(const SocketAddress& addr, int64_t bps);
+    // How long a bucket may save up unused rate for a burst, 10 ms by
+    // default. The buckets always hold at least one MTU.
+    void set_burst_window(int64_t ms);
+    // send_to() fails with EWOULDBLOCK once this much data is queued,
+    // 1 MiB by default.
+    void set_max_queued_bytes(size_t bytes) { _max_queued_bytes = bytes; }
+
+    // Packets and bytes waiting in the pacer, in total and for |addr|.
+    size_t queue_depth() const { return _queued_packets; }
+    size_t queued_bytes() const { return _queued_bytes; }
+    size_t queue_depth(const SocketAddress& addr) const;
+    // Packets refused because the queue was full or failed in the inner
+    // socket after being queued.
+    uint64_t dropped_packets() const { return _dropped_packets; }
+    // Measured output rate over the last second, in bits per second.
+    Optional<uint32_t> send_rate() const;
+
+    SocketAddress get_local_address() const override;
+
+    int send_to(const void* data,
+            size_t size,
+            const SocketAddress& addr,
+            const PacketOptions& options) override;
+    // Passes the iovec on to the inner socket while nothing is queued for
+    // the destination, a queued packet is gathered into one buffer.
+    int send_to_v(const struct iovec* iov, size_t iov_count,
+            const SocketAddress& addr, const PacketOptions& options) override;
+    // Drops the queued packets and closes the inner socket.
+    int close() override;
+
+    State get_state() const override;
+    int get_option(Socket::Option opt, int* value) override;
+    int set_option(Socket::Option opt, int value) override;
+
+    int get_error() const override;
+
+private:
+    struct TokenBucket {
+        TokenBucket() : rate_bps(0), burst_bits(0), tokens(0), last_ns(0) {}
+
+        void set_rate(int64_t bps, int64_t window_ms);
+        void refill(int64_t now_ns);
+        bool can_send() const { return 0 == rate_bps || tokens > 0; }
+        void consume(size_t bytes);
+        // Loop time can_send() turns true at, 0 when it already is.
+        int64_t ready_ns() const;
+
+        int64_t rate_bps;
+        int64_t burst_bits;
+        // Bits available, negative while in debt.
+        int64_t tokens;
+        int64_t last_ns;
+    };
+
+    struct Packet {
+        Packet(const struct iovec* iov, size_t iov_count,
+                const PacketOptions& options) :
+            data(iov_length(iov, iov_count)), options(options)
+        {
+            iov_gather(data.data(), iov, iov_count);
+        }
+
+        Buffer data;
+        PacketOptions options;
+    };
+
+    struct Flow {
+        explicit Flow(const SocketAddress& addr) :
+            addr(addr), has_rate(false), active(false) {}
+
+        SocketAddress addr;
+        TokenBucket bucket;
+        // Set by set_destination_rate(), such flows are never swept.
+        bool has_rate;
+        // In |_active|.
+        bool active;
+        std::deque<Packet> packets;
+    };
+
+    typedef std::unordered_map<SocketAddressKey, Flow> FlowMap;
+
+    Flow* get_flow(const SocketAddress& addr, int64_t now_ns);
+    int forward_packet(const struct iovec* iov, size_t iov_count,
+            const SocketAddress& addr, const PacketOptions& options, Flow* flow,
+            int64_t now_ns);
+    void process(int64_t now_ns);
+    void schedule(int64_t now_ns);
+    void sweep_flows(int64_t now_ns);
+    static void pacer_timer_cb(EventLoop* el, TimerWatcher* w, void* priv_data);
+
+    void on_read_packet(AsyncPacketSocket* socket, const char* data, size_t size,
+            const SocketAddress& addr, const PacketTime& packet_time);
+    void on_sent_packet(AsyncPacketSocket* socket, const SentPacket& sent_packet);
+
+    EventLoop* _el;
+    std::unique_ptr<AsyncPacketSocket> _socket;
+    TimerWatcher* _timer;
+    // Deadline the timer is armed for, -1 while it is stopped.
+    int64_t _timer_deadline;
+
+    TokenBucket _bucket;
+    int64_t _default_flow_rate;
+    int64_t _burst_window_ms;
+    FlowMap _flows;
+    // Flows with packets queued, in the order they are served.
+    std::deque<Flow*> _active;
+    int64_t _last_sweep_ns;
+
+    size_t _max_queued_bytes;
+    size_t _queued_packets;
+    size_t _queued_bytes;
+    uint64_t _dropped_packets;
+    int _error;
+    RateStatistics _send_rate;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(PacedPacketSocket);
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_PACED_PACKET_SOCKET_H_
+
+
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file packet_buffer.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include "atomicops.h"
+#include "ref_counted_object.h"
+#include "packet_buffer.h"
+
+namespace rtcbase {
+
+//////////////////////// PacketBuffer ////////////////
+
+PacketBuffer::PacketBuffer(PacketBufferPool* pool, size_t capacity) :
+    _ref_count(0), _pool(pool), _buffer(0, capacity), _next(NULL)
+{
+}
+
+RefCountReleaseStatus PacketBuffer::release() const {
+    const RefCountReleaseStatus status = _ref_count.dec_ref();
+    if (status == RefCountReleaseStatus::k_dropped_last_ref) {
+        _pool->recycle(const_cast<PacketBuffer*>(this));
+    }
+    return status;
+}
+
+//////////////////////// PacketBufferPool ////////////////
+
+scoped_refptr<PacketBufferPool> PacketBufferPool::create(size_t buffer_size) {
+    return new RefCountedObject<PacketBufferPool>(buffer_size);
+}
+
+PacketBufferPool::PacketBufferPool(size_t buffer_size) :
+    _buffer_size(buffer_size), _allocated(0), _free(NULL), _returned(NULL)
+{
+}
+
+PacketBufferPool::~PacketBufferPool() {
+    // Every buffer holds a reference to the pool, they are all back by now.
+    PacketBuffer* lists[2] = {
+        _free, AtomicOps::exchange_ptr(&_returned, (PacketBuffer*)NULL) };
+    for (int i = 0; i < 2; ++i) {
+        PacketBuffer* buffer = lists[i];
+        while (buffer) {
+            PacketBuffer* next = buffer->_next;
+            delete buffer;
+            buffer = next;
+        }
+    }
+}
+
+PacketBuffer* PacketBufferPool::take_free() {
+    if (!_free) {
+        _free = AtomicOps::exchange_ptr(&_returned, (PacketBuffer*)NULL);
+        if (!_free) {
+            return NULL;
+        }
+    }
+    PacketBuffer* buffer = _free;
+    _free = buffer->_next;
+    buffer->_next = NULL;
+    return buffer;
+}
+
+scoped_refptr<PacketBuffer> PacketBufferPool::allocate() {
+    PacketBuffer* buffer = take_free();
+    if (!buffer) {
+        buffer = new PacketBuffer(this, _buffer_size);
+        ++_allocated;
+    }
+    // Dropped by recycle().
+    add_ref();
+    return buffer;
+}
+
+void PacketBufferPool::reserve(size_t count) {
+    while (_allocated < count) {
+        PacketBuffer* buffer = new PacketBuffer(this, _buffer_size);
+        ++_allocated;
+        buffer->_next = _free;
+        _free = buffer;
+    }
+}
+
+void PacketBufferPool::recycle(PacketBuffer* buffer) {
+    buffer->set_size(0);
+
+    PacketBuffer* head = _returned;
+    while (true) {
+        buffer->_next = head;
+        PacketBuffer* prev = AtomicOps::compare_and_swap_ptr(&_returned, head, buffer);
+        if (prev == head) {
+            break;
+        }
+        head = prev;
+    }
+
+    // May delete the pool, and the buffer with it.
+    release();
+}
+
+} // namespace rtcbase
+
+
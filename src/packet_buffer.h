@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file packet_buffer.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_PACKET_BUFFER_H_
+#define  __RTCBASE_PACKET_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "buffer.h"
+#include "constructor_magic.h"
+#include "ref_count.h"
+#include "ref_counter.h"
+#include "scoped_ref_ptr.h"
+
+namespace rtcbase {
+
+class PacketBufferPool;
+
+// A packet received into a buffer of a PacketBufferPool. Holders share it
+// through scoped_refptr, the buffer goes back to its pool when the last
+// reference is dropped, from whichever thread that happens on.
+class PacketBuffer : public RefCountInterface {
+public:
+    const uint8_t* data() const { return _buffer.data(); }
+    uint8_t* data() { return _buffer.data(); }
+    size_t size() const { return _buffer.size(); }
+    size_t capacity() const { return _buffer.capacity(); }
+    // |size| must not exceed capacity(), buffers never grow.
+    void set_size(size_t size) { _buffer.set_size(size); }
+
+    void add_ref() const override { _ref_count.inc_ref(); }
+    RefCountReleaseStatus release() const override;
+    bool has_one_ref() const { return _ref_count.has_one_ref(); }
+
+private:
+    friend class PacketBufferPool;
+
+    PacketBuffer(PacketBufferPool* pool, size_t capacity);
+    ~PacketBuffer() override {}
+
+    mutable RefCounter _ref_count;
+    PacketBufferPool* _pool;
+    Buffer _buffer;
+    // Free list link while the buffer is in the pool.
+    PacketBuffer* _next;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(PacketBuffer);
+};
+
+// Recycles fixed size PacketBuffers, sized for one datagram (the MTU) so that
+// sockets receive straight into them and hand them on without a copy.
+//
+// allocate() must be called by one thread at a time, usually the loop of the
+// sockets sharing the pool. Buffers may be released on any thread. The pool
+// grows to the number of buffers in use at the peak and stays alive until
+// its last buffer has been returned.
+class PacketBufferPool : public RefCountInterface {
+public:
+    static scoped_refptr<PacketBufferPool> create(size_t buffer_size);
+
+    scoped_refptr<PacketBuffer> allocate();
+    // Makes sure |count| buffers can be allocated without allocating memory.
+    void reserve(size_t count);
+
+    size_t buffer_size() const { return _buffer_size; }
+    // Number of buffers created so far, in use or not.
+    size_t allocated_buffers() const { return _allocated; }
+
+protected:
+    explicit PacketBufferPool(size_t buffer_size);
+    ~PacketBufferPool() override;
+
+private:
+    friend class PacketBuffer;
+    // Called by the buffers when their last reference is dropped.
+    void recycle(PacketBuffer* buffer);
+    PacketBuffer* take_free();
+
+    const size_t _buffer_size;
+    size_t _allocated;
+    // Owned by the allocating thread.
+    PacketBuffer* _free;
+    // Lock free stack of the buffers returned since, moved to |_free| in one
+    // go once it runs empty.
+    PacketBuffer* volatile _returned;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(PacketBufferPool);
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_PACKET_BUFFER_H_
+
+
@@ -18,12 +18,27 @@
 
 #include <errno.h>
 #include <fcntl.h>
-#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/select.h>
 #include <unistd.h>
 #include <signal.h>
 #include <netinet/tcp.h>  // for TCP_NODELAY
+#include <netinet/udp.h>  // for UDP_SEGMENT, UDP_GRO
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
 
 #include "logging.h"
 #include "time_utils.h"
@@ -33,16 +48,88 @@ typedef void* SockOptArg;
 
 namespace rtcbase {
 
-int64_t get_socket_recv_timestamp(int socket) {
-    struct timeval tv_ioctl;
-    int ret = ioctl(socket, SIOCGSTAMP, &tv_ioctl);
-    if (ret != 0) {
-        return -1;
+// Per message room for ancillary data in batched sends and receives.
+static const size_t CONTROL_BUF_SIZE = 128;
+
+int64_t recv_timestamp_offset_nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t realtime = rtcbase::k_num_nanosecs_per_sec * static_cast<int64_t>(ts.tv_sec) +
+        static_cast<int64_t>(ts.tv_nsec);
+    return static_cast<int64_t>(time_nanos()) - realtime;
+}
+
+int64_t recv_timestamp_to_micros(const struct timespec& ts, int64_t offset_nanos) {
+    int64_t realtime = rtcbase::k_num_nanosecs_per_sec * static_cast<int64_t>(ts.tv_sec) +
+        static_cast<int64_t>(ts.tv_nsec);
+    return (realtime + offset_nanos) / rtcbase::k_num_nanosecs_per_microsec;
+}
+
+void parse_recv_control(struct msghdr* hdr, ReceivedMessage* msg,
+        bool* offset_valid, int64_t* offset_nanos)
+{
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr;
+            cmsg = CMSG_NXTHDR(hdr, cmsg)) 
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            if (!*offset_valid) {
+                *offset_nanos = recv_timestamp_offset_nanos();
+                *offset_valid = true;
+            }
+            msg->timestamp = recv_timestamp_to_micros(ts, *offset_nanos);
+        } else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            memcpy(&msg->segment_size, CMSG_DATA(cmsg), sizeof(int));
+        } else if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) {
+            // A single byte for IPv4.
+            msg->tos = *reinterpret_cast<const uint8_t*>(CMSG_DATA(cmsg));
+        } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_TCLASS) {
+            int tclass = 0;
+            memcpy(&tclass, CMSG_DATA(cmsg), sizeof(tclass));
+            msg->tos = tclass;
+        }
+    }
+}
+
+void fill_send_control(struct msghdr* hdr, int tos, int segment_size) {
+    size_t length = 0;
+    struct cmsghdr* cmsg = nullptr;
+    if (segment_size > 0 || tos >= 0) {
+        // The first header, CMSG_NXTHDR() only walks the length set so far.
+        hdr->msg_controllen = SEND_CONTROL_SIZE;
+        cmsg = CMSG_FIRSTHDR(hdr);
+    }
+    
+    if (segment_size > 0) {
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segment = static_cast<uint16_t>(segment_size);
+        memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+        length += CMSG_SPACE(sizeof(uint16_t));
+        cmsg = reinterpret_cast<struct cmsghdr*>(
+                static_cast<char*>(hdr->msg_control) + length);
+    }
+    
+    if (tos >= 0) {
+        const sockaddr* addr = static_cast<const sockaddr*>(hdr->msg_name);
+        if (addr && AF_INET6 == addr->sa_family) {
+            cmsg->cmsg_level = IPPROTO_IPV6;
+            cmsg->cmsg_type = IPV6_TCLASS;
+        } else {
+            cmsg->cmsg_level = IPPROTO_IP;
+            cmsg->cmsg_type = IP_TOS;
+        }
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &tos, sizeof(tos));
+        length += CMSG_SPACE(sizeof(int));
+    }
+
+    hdr->msg_controllen = length;
+    if (0 == length) {
+        hdr->msg_control = nullptr;
     }
-    int64_t timestamp =
-        rtcbase::k_num_microsecs_per_sec * static_cast<int64_t>(tv_ioctl.tv_sec) +
-        static_cast<int64_t>(tv_ioctl.tv_usec);
-    return timestamp;
 }
 
 ///////////////// PhysicalSocketServer //////////////////
@@ -74,7 +161,7 @@ AsyncSocket* PhysicalSocketServer::create_async_socket(int family, int type) {
 /////////////////// PhysicalSocket //////////////////
 
 PhysicalSocket::PhysicalSocket(PhysicalSocketServer* ss, SOCKET s) : 
-    MemCheck("PhysicalSocket"), _ss(ss), _s(s), _error(0)
+    MemCheck("PhysicalSocket"), _ss(ss), _s(s), _family(AF_UNSPEC), _error(0)
 {
     if (_s != INVALID_SOCKET) {
         int type = SOCK_STREAM;
@@ -82,7 +169,14 @@ PhysicalSocket::PhysicalSocket(PhysicalSocketServer* ss, SOCKET s) :
         if (getsockopt(_s, SOL_SOCKET, SO_TYPE, (SockOptArg)&type, &len) != 0) {
             LOG(LS_WARNING) << "getsockopt failed, socket: " << _s;
         }
+        len = sizeof(_family);
+        if (getsockopt(_s, SOL_SOCKET, SO_DOMAIN, (SockOptArg)&_family, &len) != 0) {
+            LOG(LS_WARNING) << "getsockopt failed, socket: " << _s;
+        }
         _udp = (SOCK_DGRAM == type);
+        if (_udp) {
+            enable_recv_control();
+        }
     }
 }
 
@@ -93,11 +187,41 @@ PhysicalSocket::~PhysicalSocket() {
 bool PhysicalSocket::create(int family, int type) {
     close();
     _s = ::socket(family, type, 0);
+    _family = family;
     _udp = (SOCK_DGRAM == type);
     update_last_error();
+    if (_s != INVALID_SOCKET && _udp) {
+        enable_recv_control();
+    }
     return _s != INVALID_SOCKET;
 }
 
+void PhysicalSocket::enable_recv_control() {
+    int value = 1;
+    if (::setsockopt(_s, SOL_SOCKET, SO_TIMESTAMPNS, (SockOptArg)&value,
+                sizeof(value)) != 0)
+    {
+        LOG(LS_WARNING) << "Enable SO_TIMESTAMPNS failed, error: " << errno
+            << ", socket: " << _s;
+    }
+    
+    // The traffic class byte carries the ECN bits. A dual stack socket gets
+    // IP_TOS for its IPv4 mapped peers, failing is fine there.
+    if (AF_INET6 == _family) {
+        if (::setsockopt(_s, IPPROTO_IPV6, IPV6_RECVTCLASS, (SockOptArg)&value,
+                    sizeof(value)) != 0)
+        {
+            LOG(LS_WARNING) << "Enable IPV6_RECVTCLASS failed, error: " << errno
+                << ", socket: " << _s;
+        }
+    }
+    int ret = ::setsockopt(_s, IPPROTO_IP, IP_RECVTOS, (SockOptArg)&value, sizeof(value));
+    if (ret != 0 && AF_INET == _family) {
+        LOG(LS_WARNING) << "Enable IP_RECVTOS failed, error: " << errno
+            << ", socket: " << _s;
+    }
+}
+
 bool PhysicalSocket::create_async(int family, int type) {
     if (!create(family, type)) {
         return false;
@@ -157,20 +281,114 @@ int PhysicalSocket::send_to(const void* buffer,
     return sent;
 }
 
+int PhysicalSocket::send_to_v(const struct iovec* iov, size_t iov_count,
+        const SocketAddress& addr)
+{
+    sockaddr_storage saddr;
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = &saddr;
+    hdr.msg_namelen = static_cast<socklen_t>(addr.to_sockaddr_storage(&saddr));
+    hdr.msg_iov = const_cast<struct iovec*>(iov);
+    hdr.msg_iovlen = iov_count;
+    int sent = ::sendmsg(_s, &hdr, MSG_NOSIGNAL);
+    update_last_error();
+
+    if (sent < 0) {
+        if (is_blocking_error(get_error())) {
+            sent = 0;
+        } else {
+            sent = -1; // error
+            LOG(LS_WARNING) << "Send data error, addr: " << addr.to_string() << ", socket: " << _s;
+        }
+    } else if (sent == 0) {
+        sent = -1;
+        LOG(LS_WARNING) << "Send data error, addr: " << addr.to_string() << ", socket: " << _s;
+    }
+    return sent;
+}
+
+int PhysicalSocket::send_to_batch(const SendMessage* msgs, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    
+    if (_send_hdrs.size() < count) {
+        _send_hdrs.resize(count);
+        _send_iovs.resize(count);
+        _send_addrs.resize(count);
+        _send_control.resize(count * CONTROL_BUF_SIZE);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const SendMessage& msg = msgs[i];
+        struct msghdr& hdr = _send_hdrs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &_send_addrs[i];
+        hdr.msg_namelen = static_cast<socklen_t>(
+                msg.addr->to_sockaddr_storage(&_send_addrs[i]));
+        if (msg.iov) {
+            hdr.msg_iov = const_cast<struct iovec*>(msg.iov);
+            hdr.msg_iovlen = msg.iov_count;
+        } else {
+            _send_iovs[i].iov_base = const_cast<void*>(msg.data);
+            _send_iovs[i].iov_len = msg.size;
+            hdr.msg_iov = &_send_iovs[i];
+            hdr.msg_iovlen = 1;
+        }
+        
+        hdr.msg_control = &_send_control[i * CONTROL_BUF_SIZE];
+        fill_send_control(&hdr, msg.tos, msg.segment_size);
+        _send_hdrs[i].msg_len = 0;
+    }
+
+    int sent = ::sendmmsg(_s, &_send_hdrs[0], static_cast<unsigned int>(count),
+            MSG_NOSIGNAL);
+    update_last_error();
+    
+    if (sent < 0) {
+        if (is_blocking_error(get_error())) {
+            return 0;
+        }
+        LOG(LS_WARNING) << "Send batch data error, addr: " << msgs[0].addr->to_string() 
+            << ", socket: " << _s;
+        return -1;
+    }
+    return sent;
+}
+
 int PhysicalSocket::recv_from(void* buffer,
         size_t length,
         SocketAddress* out_addr,
         int64_t* timestamp) 
 {
     sockaddr_storage addr_storage;
-    socklen_t addr_len = sizeof(addr_storage);
-    sockaddr* addr = reinterpret_cast<sockaddr*>(&addr_storage);
-    int received = ::recvfrom(_s, static_cast<char*>(buffer),
-            static_cast<int>(length), 0, addr, &addr_len);
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = length;
+    alignas(struct cmsghdr) char control[CONTROL_BUF_SIZE];
+    
+    // The kernel timestamp comes back as a control message of the same call.
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = &addr_storage;
+    hdr.msg_namelen = sizeof(addr_storage);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+    int received = ::recvmsg(_s, &hdr, 0);
+    update_last_error();
     if (timestamp) {
-        *timestamp = get_socket_recv_timestamp(_s);
+        *timestamp = -1;
+        if (received >= 0) {
+            ReceivedMessage msg;
+            bool offset_valid = false;
+            int64_t offset_nanos = 0;
+            parse_recv_control(&hdr, &msg, &offset_valid, &offset_nanos);
+            *timestamp = msg.timestamp;
+        }
     }
-    update_last_error();
     if ((received >= 0) && (out_addr != nullptr)) {
         socket_address_from_sockaddr_storage(addr_storage, out_addr);
     }
@@ -191,6 +409,62 @@ int PhysicalSocket::recv_from(void* buffer,
     return received;
 }
 
+int PhysicalSocket::recv_from_batch(ReceivedMessage* msgs, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    
+    if (_recv_hdrs.size() < count) {
+        _recv_hdrs.resize(count);
+        _recv_iovs.resize(count);
+        _recv_addrs.resize(count);
+        _recv_control.resize(count * CONTROL_BUF_SIZE);
+    }
+    
+    for (size_t i = 0; i < count; ++i) {
+        _recv_iovs[i].iov_base = msgs[i].buffer;
+        _recv_iovs[i].iov_len = msgs[i].length;
+        
+        struct msghdr& hdr = _recv_hdrs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &_recv_addrs[i];
+        hdr.msg_namelen = sizeof(sockaddr_storage);
+        hdr.msg_iov = &_recv_iovs[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = &_recv_control[i * CONTROL_BUF_SIZE];
+        hdr.msg_controllen = CONTROL_BUF_SIZE;
+        _recv_hdrs[i].msg_len = 0;
+    }
+
+    int received = ::recvmmsg(_s, &_recv_hdrs[0], static_cast<unsigned int>(count),
+            0, nullptr);
+    update_last_error();
+    
+    if (received < 0) {
+        if (is_blocking_error(get_error())) {
+            return 0;
+        }
+        LOG(LS_WARNING) << "Read batch data error, socket: " << _s;
+        return -1;
+    }
+    
+    // One clock sample converts the timestamps of the whole batch.
+    bool offset_valid = false;
+    int64_t offset_nanos = 0;
+    for (int i = 0; i < received; ++i) {
+        msgs[i].received = static_cast<int>(_recv_hdrs[i].msg_len);
+        msgs[i].truncated = (_recv_hdrs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+        msgs[i].timestamp = -1;
+        msgs[i].segment_size = 0;
+        msgs[i].tos = -1;
+        socket_address_from_sockaddr_storage(_recv_addrs[i], &msgs[i].addr);
+        parse_recv_control(&_recv_hdrs[i].msg_hdr, &msgs[i], &offset_valid,
+                &offset_nanos);
+    }
+    
+    return received;
+}
+
 int PhysicalSocket::close() {
     if (_s == INVALID_SOCKET) {
         return 0;
@@ -210,6 +484,18 @@ void PhysicalSocket::set_error(int error) {
 }
 
 int PhysicalSocket::get_option(Option opt, int* value) {
+    if (opt == OPT_DSCP) {
+        int tos = 0;
+        socklen_t optlen = sizeof(tos);
+        int ret = (AF_INET6 == _family)
+            ? ::getsockopt(_s, IPPROTO_IPV6, IPV6_TCLASS, (SockOptArg)&tos, &optlen)
+            : ::getsockopt(_s, IPPROTO_IP, IP_TOS, (SockOptArg)&tos, &optlen);
+        if (ret != -1) {
+            *value = tos >> 2;
+        }
+        return ret;
+    }
+
     int slevel;
     int sopt;
     if (translate_option(opt, &slevel, &sopt) == -1) {
@@ -224,6 +510,16 @@ int PhysicalSocket::get_option(Option opt, int* value) {
 }
 
 int PhysicalSocket::set_option(Option opt, int value) {
+    if (opt == OPT_DSCP) {
+        // The DSCP is the upper six bits of the traffic class byte.
+        int tos = value << 2;
+        if (AF_INET6 == _family) {
+            return ::setsockopt(_s, IPPROTO_IPV6, IPV6_TCLASS, (SockOptArg)&tos,
+                    sizeof(tos));
+        }
+        return ::setsockopt(_s, IPPROTO_IP, IP_TOS, (SockOptArg)&tos, sizeof(tos));
+    }
+
     int slevel;
     int sopt;
     if (translate_option(opt, &slevel, &sopt) == -1) {
@@ -267,9 +563,24 @@ int PhysicalSocket::translate_option(Option opt, int* slevel, int* sopt) {
             *slevel = IPPROTO_TCP;
             *sopt = TCP_NODELAY;
             break;
+        case OPT_UDP_SEGMENT:
+            *slevel = SOL_UDP;
+            *sopt = UDP_SEGMENT;
+            break;
+        case OPT_UDP_GRO:
+            *slevel = SOL_UDP;
+            *sopt = UDP_GRO;
+            break;
+        case OPT_REUSEPORT:
+            *slevel = SOL_SOCKET;
+            *sopt = SO_REUSEPORT;
+            break;
+        case OPT_BUSY_POLL:
+            *slevel = SOL_SOCKET;
+            *sopt = SO_BUSY_POLL;
+            break;
         case OPT_DSCP:
-            LOG(LS_WARNING) << "Socket::OPT_DSCP not supported.";
-            return -1;
+            return -1;  // Depends on the family, see get_option() and set_option().
         case OPT_RTP_SENDTIME_EXTN_ID:
             return -1;  // No logging is necessary as this not a OS socket option.
         default:
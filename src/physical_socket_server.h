@@ -18,6 +18,11 @@
 #ifndef  __RTCBASE_PHYSICAL_SOCKET_SERVER_H_
 #define  __RTCBASE_PHYSICAL_SOCKET_SERVER_H_
 
+#include <time.h>
+#include <sys/socket.h>
+
+#include <vector>
+
 #include "memcheck.h"
 #include "socket_factory.h"
 #include "async_socket.h"
@@ -26,6 +31,25 @@ typedef int SOCKET;
 
 namespace rtcbase {
 
+// Kernel receive timestamps (SO_TIMESTAMPNS) are CLOCK_REALTIME. They are
+// moved onto the time_micros() clock with the offset between the two clocks,
+// sample the offset once and reuse it for the packets of one read.
+int64_t recv_timestamp_offset_nanos();
+int64_t recv_timestamp_to_micros(const struct timespec& ts, int64_t offset_nanos);
+
+// Fills in |msg|'s timestamp, GRO segment size and traffic class from the
+// control messages of a received |hdr|. |offset_nanos| is sampled on first
+// use, as flagged by |offset_valid|.
+void parse_recv_control(struct msghdr* hdr, ReceivedMessage* msg,
+        bool* offset_valid, int64_t* offset_nanos);
+// Writes the control messages of a send into |hdr|'s msg_control and sets
+// msg_controllen: the GSO |segment_size| unless 0, and the traffic class
+// byte |tos| unless -1, as IP_TOS or IPV6_TCLASS by the family of msg_name.
+// msg_control needs room for SEND_CONTROL_SIZE bytes.
+static const size_t SEND_CONTROL_SIZE =
+    CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(int));
+void fill_send_control(struct msghdr* hdr, int tos, int segment_size);
+
 class PhysicalSocketServer : public SocketFactory {
 public:
     PhysicalSocketServer();
@@ -59,11 +83,15 @@ public:
     int send_to(const void* buffer,
             size_t length,
             const SocketAddress& addr) override;
+    int send_to_v(const struct iovec* iov, size_t iov_count,
+            const SocketAddress& addr) override;
+    int send_to_batch(const SendMessage* msgs, size_t count) override;
     
     int recv_from(void* buffer,
             size_t length,
             SocketAddress* out_addr,
             int64_t* timestamp) override;
+    int recv_from_batch(ReceivedMessage* msgs, size_t count) override;
     int close() override;
     
     SOCKET get_fd() { return _s; } 
@@ -73,14 +101,30 @@ protected:
             const struct sockaddr* dest_addr, socklen_t addrlen);
 
     void update_last_error();
+    // Has the kernel attach the receive timestamp (SO_TIMESTAMPNS) and the
+    // traffic class byte to every received datagram.
+    void enable_recv_control();
     
     static int translate_option(Option opt, int* slevel, int* sopt);
 
 private:
     PhysicalSocketServer* _ss;
     SOCKET _s;
+    int _family;
     bool _udp;
     int _error;
+
+    // Scratch space for recvmmsg(), grown on demand and reused across calls.
+    std::vector<struct mmsghdr> _recv_hdrs;
+    std::vector<struct iovec> _recv_iovs;
+    std::vector<sockaddr_storage> _recv_addrs;
+    std::vector<char> _recv_control;
+    
+    // Scratch space for sendmmsg().
+    std::vector<struct mmsghdr> _send_hdrs;
+    std::vector<struct iovec> _send_iovs;
+    std::vector<sockaddr_storage> _send_addrs;
+    std::vector<char> _send_control;
 };
 
 } // namespace rtcbase
@@ -159,6 +159,10 @@ bool PlatformThread::is_running() const {
     return _thread != 0;
 }
 
+PlatformThreadRef PlatformThread::get_thread_ref() const {
+    return _thread;
+}
+
 void PlatformThread::stop() {
     if (!is_running()) {
         return;
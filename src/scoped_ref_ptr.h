@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *  Copyright (c) 2011, The WebRTC project authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+/**
+ * @file scoped_ref_ptr.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_SCOPED_REF_PTR_H_
+#define  __RTCBASE_SCOPED_REF_PTR_H_
+
+#include <memory>
+
+namespace rtcbase {
+
+// Smart pointer for objects with an add_ref() and release() pair, such as
+// RefCountInterface implementations. It takes a reference when constructed
+// from a raw pointer and drops it when destroyed:
+//
+//   scoped_refptr<PacketBuffer> buffer = pool->allocate();
+//   queue.push_back(buffer);  // Both hold a reference now.
+template <class T>
+class scoped_refptr {
+public:
+    typedef T element_type;
+
+    scoped_refptr() : _ptr(nullptr) {}
+
+    scoped_refptr(T* p) : _ptr(p) {  // NOLINT(runtime/explicit)
+        if (_ptr) {
+            _ptr->add_ref();
+        }
+    }
+
+    scoped_refptr(const scoped_refptr<T>& r) : _ptr(r._ptr) {
+        if (_ptr) {
+            _ptr->add_ref();
+        }
+    }
+
+    template <typename U>
+    scoped_refptr(const scoped_refptr<U>& r) : _ptr(r.get()) {
+        if (_ptr) {
+            _ptr->add_ref();
+        }
+    }
+
+    // Move constructors.
+    scoped_refptr(scoped_refptr<T>&& r) : _ptr(r.release()) {}
+
+    template <typename U>
+    scoped_refptr(scoped_refptr<U>&& r) : _ptr(r.release()) {}
+
+    ~scoped_refptr() {
+        if (_ptr) {
+            _ptr->release();
+        }
+    }
+
+    T* get() const { return _ptr; }
+    operator T*() const { return _ptr; }
+    T* operator->() const { return _ptr; }
+
+    // Returns the (possibly null) raw pointer, and makes the scoped_refptr hold a
+    // null pointer, all without touching the reference count of the underlying
+    // pointed-to object. The object is still reference counted, and the caller of
+    // release() is now the proud owner of one reference, so it is responsible for
+    // calling release() once on the object when no longer using it.
+    T* release() {
+        T* retval = _ptr;
+        _ptr = nullptr;
+        return retval;
+    }
+
+    scoped_refptr<T>& operator=(T* p) {
+        // AddRef first so that self assignment should work
+        if (p) {
+            p->add_ref();
+        }
+        if (_ptr) {
+            _ptr->release();
+        }
+        _ptr = p;
+        return *this;
+    }
+
+    scoped_refptr<T>& operator=(const scoped_refptr<T>& r) {
+        return *this = r._ptr;
+    }
+
+    template <typename U>
+    scoped_refptr<T>& operator=(const scoped_refptr<U>& r) {
+        return *this = r.get();
+    }
+
+    scoped_refptr<T>& operator=(scoped_refptr<T>&& r) {
+        scoped_refptr<T>(std::move(r)).swap(*this);
+        return *this;
+    }
+
+    template <typename U>
+    scoped_refptr<T>& operator=(scoped_refptr<U>&& r) {
+        scoped_refptr<T>(std::move(r)).swap(*this);
+        return *this;
+    }
+
+    void swap(T** pp) {
+        T* p = _ptr;
+        _ptr = *pp;
+        *pp = p;
+    }
+
+    void swap(scoped_refptr<T>& r) {
+        swap(&r._ptr);
+    }
+
+protected:
+    T* _ptr;
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_SCOPED_REF_PTR_H_
+
+
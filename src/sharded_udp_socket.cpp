@@ -0,0 +1,209 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+/**
+ * @file sharded_udp_socket.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <string.h>
+
+#include "logging.h"
+#include "sharded_udp_socket.h"
+
+namespace rtcbase {
+
+struct ShardedUDPSocket::PostedPacket {
+    AsyncUDPSocket* shard;
+    SocketAddress addr;
+    PacketOptions options;
+    size_t size;
+    char* data;
+};
+
+struct ShardedUDPSocket::PostedOption {
+    AsyncUDPSocket* shard;
+    Socket::Option opt;
+    int value;
+};
+
+// Hashes the destination, so a flow always goes out through the same shard
+// and keeps its order.
+static size_t shard_of(const SocketAddress& addr, size_t shards) {
+    return SocketAddressKey(addr).hash() % shards;
+}
+
+ShardedUDPSocket* ShardedUDPSocket::create(EventLoopPool* pool,
+        SocketFactory* factory,
+        const SocketAddress& bind_addr)
+{
+    assert(pool && factory);
+    if (pool->is_running()) {
+        LOG(LS_WARNING) << "ShardedUDPSocket must be created before the pool is started";
+        return nullptr;
+    }
+
+    std::unique_ptr<ShardedUDPSocket> sharded(new ShardedUDPSocket(pool));
+    SocketAddress addr = bind_addr;
+    for (size_t i = 0; i < pool->size(); ++i) {
+        std::unique_ptr<AsyncSocket> socket(
+                factory->create_async_socket(bind_addr.family(), SOCK_DGRAM));
+        if (!socket) {
+            return nullptr;
+        }
+
+        if (socket->set_option(Socket::OPT_REUSEPORT, 1) != 0) {
+            LOG(LS_WARNING) << "Set SO_REUSEPORT failed, error: " << errno;
+            return nullptr;
+        }
+
+        if (socket->bind(addr) < 0) {
+            LOG(LS_WARNING) << "Bind " << addr.to_string() << " failed, error: "
+                << socket->get_error();
+            return nullptr;
+        }
+
+        // With port 0 the first bind picks the port, the rest join it.
+        if (0 == i) {
+            addr = socket->get_local_address();
+        }
+        sharded->_shards.push_back(std::unique_ptr<AsyncUDPSocket>(
+                    new AsyncUDPSocket(pool->loop(i), socket.release())));
+    }
+    return sharded.release();
+}
+
+ShardedUDPSocket::ShardedUDPSocket(EventLoopPool* pool) : _pool(pool) {}
+
+ShardedUDPSocket::~ShardedUDPSocket() {
+    // The shards' loops would still be using them.
+    assert(!_pool->is_running());
+}
+
+SocketAddress ShardedUDPSocket::get_local_address() const {
+    return _shards[0]->get_local_address();
+}
+
+int ShardedUDPSocket::send_to(const void* data,
+        size_t size,
+        const SocketAddress& addr,
+        const PacketOptions& options)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    return send_to_v(&iov, 1, addr, options);
+}
+
+int ShardedUDPSocket::send_to_v(const struct iovec* iov, size_t iov_count,
+        const SocketAddress& addr, const PacketOptions& options)
+{
+    int index = _pool->current_index();
+    if (index >= 0) {
+        return _shards[index]->send_to_v(iov, iov_count, addr, options);
+    }
+
+    size_t shard = shard_of(addr, _shards.size());
+    size_t size = iov_length(iov, iov_count);
+    PostedPacket* packet = new PostedPacket();
+    packet->shard = _shards[shard].get();
+    packet->addr = addr;
+    packet->options = options;
+    packet->size = size;
+    packet->data = new char[size];
+    iov_gather(packet->data, iov, iov_count);
+    _pool->loop(shard)->post(&ShardedUDPSocket::send_task, packet,
+            &ShardedUDPSocket::drop_task);
+    return static_cast<int>(size);
+}
+
+void ShardedUDPSocket::send_task(EventLoop* el, void* data) {
+    PostedPacket* packet = static_cast<PostedPacket*>(data);
+    packet->shard->send_to(packet->data, packet->size, packet->addr,
+            packet->options);
+    drop_task(el, data);
+}
+
+void ShardedUDPSocket::drop_task(EventLoop* el, void* data) {
+    (void)el;
+    PostedPacket* packet = static_cast<PostedPacket*>(data);
+    delete[] packet->data;
+    delete packet;
+}
+
+int ShardedUDPSocket::close() {
+    int ret = 0;
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        if (is_posted_to(i)) {
+            _pool->loop(i)->post(&ShardedUDPSocket::close_task, _shards[i].get());
+        } else if (_shards[i]->close() != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+void ShardedUDPSocket::close_task(EventLoop* el, void* data) {
+    (void)el;
+    if (static_cast<AsyncUDPSocket*>(data)->close() != 0) {
+        LOG(LS_WARNING) << "Close shard failed, error: "
+            << static_cast<AsyncUDPSocket*>(data)->get_error();
+    }
+}
+
+ShardedUDPSocket::State ShardedUDPSocket::get_state() const {
+    return STATE_BOUND;
+}
+
+int ShardedUDPSocket::get_option(Socket::Option opt, int* value) {
+    return _shards[0]->get_option(opt, value);
+}
+
+int ShardedUDPSocket::set_option(Socket::Option opt, int value) {
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        if (is_posted_to(i)) {
+            PostedOption* option = new PostedOption();
+            option->shard = _shards[i].get();
+            option->opt = opt;
+            option->value = value;
+            _pool->loop(i)->post(&ShardedUDPSocket::option_task, option,
+                    &ShardedUDPSocket::drop_option_task);
+            continue;
+        }
+        int ret = _shards[i]->set_option(opt, value);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+void ShardedUDPSocket::option_task(EventLoop* el, void* data) {
+    PostedOption* option = static_cast<PostedOption*>(data);
+    if (option->shard->set_option(option->opt, option->value) != 0) {
+        LOG(LS_WARNING) << "Set option " << option->opt << " on shard failed, error: "
+            << option->shard->get_error();
+    }
+    drop_option_task(el, data);
+}
+
+void ShardedUDPSocket::drop_option_task(EventLoop* el, void* data) {
+    (void)el;
+    delete static_cast<PostedOption*>(data);
+}
+
+int ShardedUDPSocket::get_error() const {
+    int index = _pool->current_index();
+    return _shards[index < 0 ? 0 : index]->get_error();
+}
+
+} // namespace rtcbase
+
@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+/**
+ * @file sharded_udp_socket.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_SHARDED_UDP_SOCKET_H_
+#define  __RTCBASE_SHARDED_UDP_SOCKET_H_
+
+#include <memory>
+#include <vector>
+
+#include "async_udp_socket.h"
+#include "event_loop_pool.h"
+#include "socket_factory.h"
+
+namespace rtcbase {
+
+// One UDP port served by every loop of an EventLoopPool. Each loop owns an
+// AsyncUDPSocket bound with SO_REUSEPORT to the same address, and the kernel
+// spreads the incoming flows over them.
+//
+// Packets are delivered on the thread of the shard that received them, with
+// the shard as the socket argument, so replies sent through that argument
+// stay on the same thread. A sigslot signal can not be emitted from several
+// threads at once, hence listeners connect to all shards through
+// connect_read_packet()/connect_sent_packet() instead of to the signals of
+// this object, which are never emitted.
+//
+// The socket must be destroyed while the pool is stopped. EventLoopPool::stop()
+// runs the packets posted before it, the ones posted later are freed unsent
+// when the pool is destroyed, so do not start the pool again once the socket
+// is gone.
+class ShardedUDPSocket : public AsyncPacketSocket {
+public:
+    // Binds one socket per pool loop to |bind_addr|. Must be called before
+    // the pool is started. Returns nullptr on failure.
+    static ShardedUDPSocket* create(EventLoopPool* pool, SocketFactory* factory,
+            const SocketAddress& bind_addr);
+    ~ShardedUDPSocket() override;
+
+    size_t shard_count() const { return _shards.size(); }
+    AsyncUDPSocket* shard(size_t index) { return _shards[index].get(); }
+
+    template <class desttype>
+    void connect_read_packet(desttype* pclass,
+            void (desttype::*pmemfun)(AsyncPacketSocket*, const char*, size_t,
+                const SocketAddress&, const PacketTime&))
+    {
+        for (size_t i = 0; i < _shards.size(); ++i) {
+            _shards[i]->signal_read_packet.connect(pclass, pmemfun);
+        }
+    }
+
+    template <class desttype>
+    void connect_sent_packet(desttype* pclass,
+            void (desttype::*pmemfun)(AsyncPacketSocket*, const SentPacket&))
+    {
+        for (size_t i = 0; i < _shards.size(); ++i) {
+            _shards[i]->signal_sent_packet.connect(pclass, pmemfun);
+        }
+    }
+
+    SocketAddress get_local_address() const override;
+
+    // Sends through the shard of the calling pool thread. From any other
+    // thread the packet is copied and posted to the shard picked by |addr|,
+    // and the return value only tells whether it was handed over.
+    int send_to(const void* data,
+            size_t size,
+            const SocketAddress& addr,
+            const PacketOptions& options) override;
+    int send_to_v(const struct iovec* iov, size_t iov_count,
+            const SocketAddress& addr, const PacketOptions& options) override;
+    // close() and set_option() apply to every shard. While the pool runs,
+    // each shard other than the caller's own is changed on its loop: the
+    // call is posted there, and the return value only covers the shards
+    // changed in place. Failures on the loops are logged.
+    int close() override;
+
+    State get_state() const override;
+    // Options are read from the first shard.
+    int get_option(Socket::Option opt, int* value) override;
+    int set_option(Socket::Option opt, int value) override;
+
+    int get_error() const override;
+
+private:
+    explicit ShardedUDPSocket(EventLoopPool* pool);
+
+    struct PostedPacket;
+    static void send_task(EventLoop* el, void* data);
+    static void drop_task(EventLoop* el, void* data);
+    struct PostedOption;
+    static void option_task(EventLoop* el, void* data);
+    static void drop_option_task(EventLoop* el, void* data);
+    static void close_task(EventLoop* el, void* data);
+
+    // Whether shard |index| has to be changed on its own loop, see close().
+    bool is_posted_to(size_t index) const {
+        return _pool->is_running() && _pool->current_index() != (int)index;
+    }
+
+    EventLoopPool* _pool;
+    std::vector<std::unique_ptr<AsyncUDPSocket> > _shards;
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_SHARDED_UDP_SOCKET_H_
+
+
@@ -19,9 +19,11 @@
 #define  __RTCBASE_SOCKET_H_
 
 #include <errno.h>
+#include <string.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #define SOCKET_EACCES EACCES
@@ -49,6 +51,64 @@ struct SentPacket {
     int64_t send_time_ms;
 };
 
+// One datagram slot of a batched receive. |buffer| and |length| are set by
+// the caller, the remaining fields are filled in by recv_from_batch().
+struct ReceivedMessage {
+    ReceivedMessage() : buffer(nullptr), length(0), received(0),
+        timestamp(-1), truncated(false), segment_size(0), tos(-1) {}
+
+    void* buffer;
+    size_t length;
+    int received;         // Number of bytes written into |buffer|.
+    SocketAddress addr;   // Address the datagram was received from.
+    int64_t timestamp;    // Kernel receive time, see Socket::recv_from().
+    bool truncated;       // The datagram did not fit into |buffer|.
+    // Non zero if the kernel coalesced several datagrams of this size (GRO)
+    // into |buffer|, the last one may be shorter.
+    int segment_size;
+    // Traffic class byte of the IP header (DSCP << 2 | ECN), -1 if unknown.
+    int tos;
+};
+
+// One datagram of a batched send. The payload is either |data| and |size|
+// or, if |iov| is set, the concatenation of |iov_count| buffers.
+struct SendMessage {
+    SendMessage() : data(nullptr), size(0), addr(nullptr), iov(nullptr),
+        iov_count(0), segment_size(0), tos(-1) {}
+
+    const void* data;
+    size_t size;
+    const SocketAddress* addr;
+    const struct iovec* iov;
+    size_t iov_count;
+    // Non zero to let the kernel split the payload into datagrams of this
+    // size (UDP GSO), the last one may be shorter.
+    int segment_size;
+    // Traffic class byte (DSCP << 2 | ECN) of this datagram, -1 to keep the
+    // socket's setting.
+    int tos;
+};
+
+// Total length of |iov_count| buffers.
+inline size_t iov_length(const struct iovec* iov, size_t iov_count) {
+    size_t size = 0;
+    for (size_t i = 0; i < iov_count; ++i) {
+        size += iov[i].iov_len;
+    }
+    return size;
+}
+
+// Copies |iov_count| buffers one after the other to |dst|, which must hold
+// iov_length() bytes. Returns the number of bytes copied.
+inline size_t iov_gather(void* dst, const struct iovec* iov, size_t iov_count) {
+    char* p = static_cast<char*>(dst);
+    for (size_t i = 0; i < iov_count; ++i) {
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+    return p - static_cast<char*>(dst);
+}
+
 // General interface for the socket implementations of various networks.  The
 // methods match those of normal UNIX sockets very closely.
 class Socket {
@@ -67,12 +127,23 @@ public:
     //virtual int Connect(const SocketAddress& addr) = 0;
     //virtual int Send(const void *pv, size_t cb) = 0;
     virtual int send_to(const void* pv, size_t cb, const SocketAddress& addr) = 0;
-    // |timestamp| is in units of microseconds.
+    // Sends the concatenation of |iov_count| buffers as one datagram.
+    virtual int send_to_v(const struct iovec* iov, size_t iov_count,
+            const SocketAddress& addr) = 0;
+    // Sends up to |count| datagrams with a single system call. Returns the
+    // number of messages sent, 0 if the socket would block or -1 if the first
+    // message failed.
+    virtual int send_to_batch(const SendMessage* msgs, size_t count) = 0;
+    // |timestamp| is the kernel receive time in microseconds on the
+    // time_micros() clock, -1 if unknown.
     //virtual int Recv(void* pv, size_t cb, int64_t* timestamp) = 0;
     virtual int recv_from(void* pv,
             size_t cb,
             SocketAddress* paddr,
             int64_t* timestamp) = 0;
+    // Receives up to |count| datagrams with a single system call. Returns the
+    // number of messages filled in, 0 if nothing is pending or -1 on error.
+    virtual int recv_from_batch(ReceivedMessage* msgs, size_t count) = 0;
     /*
     virtual int Listen(int backlog) = 0;
     virtual Socket *Accept(SocketAddress *paddr) = 0;
@@ -106,6 +177,12 @@ public:
         OPT_RTP_SENDTIME_EXTN_ID,  // This is a non-traditional socket option param.
                                    // This is specific to libjingle and will be used
                                    // if SendTime option is needed at socket level.
+        OPT_UDP_SEGMENT, // UDP GSO segment size, 0 disables segmentation offload.
+        OPT_UDP_GRO,     // Whether coalesced (GRO) UDP receives are accepted.
+        OPT_REUSEPORT,   // SO_REUSEPORT, must be set before bind.
+        OPT_BUSY_POLL,   // SO_BUSY_POLL, microseconds the kernel may spin on
+                         // the device queue for a read or poll, raising it
+                         // above net.core.busy_read needs CAP_NET_ADMIN.
     };
     
     virtual int get_option(Option opt, int* value) = 0;
@@ -15,7 +15,10 @@
  *  
  **/
 
-#include <sstream>
+#include <string.h>
+
+#include <algorithm>
+#include <ostream>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -127,10 +130,23 @@ std::string SocketAddress::host_as_URI_string() const {
     }
 }
 
+// Writes |value| in decimal, returns the end.
+static char* write_port(char* p, uint16_t value) {
+    char digits[5];
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (count > 0) {
+        *p++ = digits[--count];
+    }
+    return p;
+}
+
 std::string SocketAddress::port_as_string() const {
-    std::ostringstream ost;
-    ost << _port;
-    return ost.str();
+    char buf[5];
+    return std::string(buf, write_port(buf, _port) - buf);
 }
 
 std::string SocketAddress::host_as_sensitive_URI_string() const {
@@ -147,41 +163,120 @@ std::string SocketAddress::host_as_sensitive_URI_string() const {
 }
 
 std::string SocketAddress::to_string() const {
-    std::ostringstream ost;
-    ost << *this;
-    return ost.str();
+    char buf[k_socket_address_max_chars];
+    size_t len = to_chars(buf, sizeof(buf));
+    if (len > 0) {
+        return std::string(buf, len);
+    }
+    return host_as_URI_string() + ":" + port_as_string();
 }
 
 std::string SocketAddress::to_sensitive_string() const {
-    std::ostringstream ost;
-    ost << host_as_sensitive_URI_string() << ":" << port();
-    return ost.str();
+    char buf[k_socket_address_max_chars];
+    size_t len = to_sensitive_chars(buf, sizeof(buf));
+    if (len > 0) {
+        return std::string(buf, len);
+    }
+    return host_as_sensitive_URI_string() + ":" + port_as_string();
+}
+
+size_t SocketAddress::to_chars(char* buf, size_t buf_size) const {
+    return write_chars(buf, buf_size, false);
+}
+
+size_t SocketAddress::to_sensitive_chars(char* buf, size_t buf_size) const {
+    return write_chars(buf, buf_size, true);
+}
+
+size_t SocketAddress::write_chars(char* buf, size_t buf_size,
+        bool sensitive) const
+{
+    char ip[k_ip_address_max_chars];
+    const char* host = ip;
+    size_t host_len = 0;
+    bool brackets = false;
+    if (!_literal && !_hostname.empty()) {
+        host = _hostname.data();
+        host_len = _hostname.size();
+    } else {
+        host_len = sensitive ? _ip.to_sensitive_chars(ip, sizeof(ip))
+            : _ip.to_chars(ip, sizeof(ip));
+        brackets = (AF_INET6 == _ip.family());
+    }
+
+    char port[5];
+    size_t port_len = write_port(port, _port) - port;
+    size_t len = host_len + (brackets ? 2 : 0) + 1 + port_len;
+    if (len >= buf_size) {
+        return 0;
+    }
+
+    char* p = buf;
+    if (brackets) {
+        *p++ = '[';
+    }
+    memcpy(p, host, host_len);
+    p += host_len;
+    if (brackets) {
+        *p++ = ']';
+    }
+    *p++ = ':';
+    memcpy(p, port, port_len);
+    p[port_len] = '\0';
+    return len;
 }
 
 bool SocketAddress::from_string(const std::string& str) {
-    if (str.at(0) == '[') {
-        std::string::size_type closebracket = str.rfind(']');
-        if (closebracket != std::string::npos) {
-            std::string::size_type colon = str.find(':', closebracket);
-            if (colon != std::string::npos && colon > closebracket) {
-                set_port(strtoul(str.substr(colon + 1).c_str(), NULL, 10));
-                set_IP(str.substr(1, closebracket - 1));
-            } else {
-                return false;
+    return from_chars(str.data(), str.size());
+}
+
+bool SocketAddress::from_chars(const char* str, size_t len) {
+    const char* end = str + len;
+    const char* host = str;
+    const char* host_end = NULL;
+    const char* colon = NULL;
+    if (len > 0 && '[' == str[0]) {
+        for (const char* p = end; p != str; --p) {
+            if (']' == p[-1]) {
+                host_end = p - 1;
+                break;
             }
         }
-    } else {
-        std::string::size_type pos = str.find(':');
-        if (std::string::npos == pos)
+        if (!host_end) {
             return false;
-        set_port(strtoul(str.substr(pos + 1).c_str(), NULL, 10));
-        set_IP(str.substr(0, pos));
+        }
+        ++host;
+        colon = static_cast<const char*>(memchr(host_end, ':', end - host_end));
+    } else {
+        colon = static_cast<const char*>(memchr(str, ':', len));
+        host_end = colon;
+    }
+    if (!colon) {
+        return false;
     }
+
+    // Like strtoul(), digits up to the first other character, out of range
+    // ports leave the port unchanged.
+    int port = 0;
+    for (const char* p = colon + 1; p != end && *p >= '0' && *p <= '9'; ++p) {
+        port = std::min(port * 10 + (*p - '0'), 65536);
+    }
+    set_port(port);
+
+    _hostname.assign(host, host_end - host);
+    _literal = IP_from_chars(host, host_end - host, &_ip);
+    _scope_id = 0;
     return true;
 }
 
 std::ostream& operator<<(std::ostream& os, const SocketAddress& addr) {
-    os << addr.host_as_URI_string() << ":" << addr.port();
+    char buf[k_socket_address_max_chars];
+    size_t len = addr.to_chars(buf, sizeof(buf));
+    if (len > 0) {
+        os.write(buf, len);
+    } else {
+        os << addr.host_as_URI_string() << ":" << addr.port();
+    }
     return os;
 }
 
@@ -271,6 +366,12 @@ bool socket_address_from_sockaddr_storage(const sockaddr_storage& addr,
     return false;
 }
 
+SocketAddress SocketAddressKey::to_socket_address() const {
+    in6_addr ip6;
+    memcpy(&ip6, ip, sizeof(ip6));
+    return SocketAddress(IPAddress(ip6).normalized(), port);
+}
+
 } // namespace rtcbase
 
 
@@ -31,6 +31,11 @@ struct sockaddr_storage;
 
 namespace rtcbase {
 
+// Room for to_chars() of any address given as an IP, including the
+// terminating NUL: brackets, colon and five port digits around the longest
+// IP.
+static const size_t k_socket_address_max_chars = k_ip_address_max_chars + 8;
+
 // Records an IP address and port.
 class SocketAddress {
 public:
@@ -106,8 +111,17 @@ public:
     // Same as ToString but anonymizes it by hiding the last part.
     std::string to_sensitive_string() const;
     
+    // Write the same text as to_string() and to_sensitive_string() into
+    // |buf| without allocating, NUL terminated. Return the length excluding
+    // the NUL, or 0 when |buf_size| is too small. k_socket_address_max_chars
+    // fits anything but long hostnames.
+    size_t to_chars(char* buf, size_t buf_size) const;
+    size_t to_sensitive_chars(char* buf, size_t buf_size) const;
+
     // Parses hostname:port and [hostname]:port.
     bool from_string(const std::string& str);
+    // Same as from_string() on the |len| characters at |str|.
+    bool from_chars(const char* str, size_t len);
 
     friend std::ostream& operator<<(std::ostream& os, const SocketAddress& addr);
     
@@ -149,6 +163,8 @@ public:
     size_t to_sockaddr_storage(sockaddr_storage* saddr) const;
 
 private:
+    size_t write_chars(char* buf, size_t buf_size, bool sensitive) const;
+
     std::string _hostname;
     IPAddress _ip;
     uint16_t _port;
@@ -159,8 +175,56 @@ private:
 bool socket_address_from_sockaddr_storage(const sockaddr_storage& saddr,
         SocketAddress* out);
 
+// The IP and port of a SocketAddress packed into 18 bytes, for hashing and
+// comparing destinations on the packet path without touching the hostname
+// string. IPv4 addresses are stored v4-mapped, so 1.2.3.4 and ::ffff:1.2.3.4
+// give the same key, they name the same peer on a dual stack socket.
+// Hostnames and scope ids are not part of the key.
+struct SocketAddressKey {
+    SocketAddressKey() = default;
+    explicit SocketAddressKey(const SocketAddress& addr) : port(addr.port()) {
+        addr.ipaddr().to_ipv6_bytes(ip);
+    }
+
+    // The address the key was made from, v4-mapped addresses as IPv4.
+    SocketAddress to_socket_address() const;
+
+    bool operator==(const SocketAddressKey& other) const {
+        return port == other.port && 0 == memcmp(ip, other.ip, sizeof(ip));
+    }
+    bool operator!=(const SocketAddressKey& other) const {
+        return !(*this == other);
+    }
+
+    size_t hash() const { return hash_address_bytes(ip, port); }
+
+    uint8_t ip[16]; // Network byte order.
+    uint16_t port;  // Host byte order.
+};
+
+static_assert(sizeof(SocketAddressKey) == 18, "SocketAddressKey must stay 18 bytes");
+
 } // namespace rtcbase
 
+namespace std {
+
+template <>
+struct hash<rtcbase::SocketAddressKey> {
+    size_t operator()(const rtcbase::SocketAddressKey& key) const {
+        return key.hash();
+    }
+};
+
+// Consistent with SocketAddress::operator==, which also ignores the scope id.
+template <>
+struct hash<rtcbase::SocketAddress> {
+    size_t operator()(const rtcbase::SocketAddress& addr) const {
+        return rtcbase::SocketAddressKey(addr).hash();
+    }
+};
+
+} // namespace std
+
 #endif  //__RTCBASE_SOCKET_ADDRESS_H_
 
 
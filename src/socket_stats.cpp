@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file socket_stats.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include "socket_stats.h"
+
+namespace rtcbase {
+
+SocketStats::SocketStats() :
+    MemCheck("SocketStats"),
+    _packets_sent(0), _bytes_sent(0), _packets_received(0), _bytes_received(0),
+    _send_would_block(0), _send_errors(0), _send_queue_drops(0), _recv_drops(0),
+    _publish_time_ms(-1), _send_queue_packets(0), _send_queue_bytes(0),
+    _send_bps(0), _recv_bps(0), _queue_delay_p50_us(0), _queue_delay_p95_us(0),
+    _queue_delay_p99_us(0),
+    _delay_next(0), _delay_count(0), _delay_sample_count(0),
+    _delay_p50(0.5f), _delay_p95(0.95f), _delay_p99(0.99f)
+{
+}
+
+SocketStats::~SocketStats() {}
+
+void SocketStats::enable_rates(int64_t window_ms, size_t delay_samples) {
+    _delay_next = 0;
+    _delay_count = 0;
+    _delay_p50.reset();
+    _delay_p95.reset();
+    _delay_p99.reset();
+    if (window_ms <= 0) {
+        _send_rate.reset();
+        _recv_rate.reset();
+        _delay_samples.clear();
+        // Nothing updates them any more, do not leave the last values behind.
+        AtomicOps::relaxed_store(&_send_bps, (uint32_t)0);
+        AtomicOps::relaxed_store(&_recv_bps, (uint32_t)0);
+        AtomicOps::relaxed_store(&_queue_delay_p50_us, (int64_t)0);
+        AtomicOps::relaxed_store(&_queue_delay_p95_us, (int64_t)0);
+        AtomicOps::relaxed_store(&_queue_delay_p99_us, (int64_t)0);
+        return;
+    }
+    _send_rate.reset(new RateStatistics(window_ms, RateStatistics::k_bps_scale));
+    _recv_rate.reset(new RateStatistics(window_ms, RateStatistics::k_bps_scale));
+    _delay_samples.assign(delay_samples, 0);
+}
+
+void SocketStats::add_queue_delay(int64_t delay_us) {
+    if (_delay_samples.empty()) {
+        return;
+    }
+    if (_delay_count == _delay_samples.size()) {
+        int64_t oldest = _delay_samples[_delay_next];
+        _delay_p50.erase(oldest);
+        _delay_p95.erase(oldest);
+        _delay_p99.erase(oldest);
+    } else {
+        ++_delay_count;
+    }
+    _delay_samples[_delay_next] = delay_us;
+    _delay_next = (_delay_next + 1) % _delay_samples.size();
+    _delay_p50.insert(delay_us);
+    _delay_p95.insert(delay_us);
+    _delay_p99.insert(delay_us);
+}
+
+void SocketStats::publish(int64_t now_ms, size_t queue_packets,
+        size_t queue_bytes)
+{
+    AtomicOps::relaxed_store(&_send_queue_packets, (uint64_t)queue_packets);
+    AtomicOps::relaxed_store(&_send_queue_bytes, (uint64_t)queue_bytes);
+    if (_send_rate) {
+        AtomicOps::relaxed_store(&_send_bps, _send_rate->rate(now_ms).value_or(0));
+        AtomicOps::relaxed_store(&_recv_bps, _recv_rate->rate(now_ms).value_or(0));
+    }
+    if (_delay_count > 0) {
+        AtomicOps::relaxed_store(&_queue_delay_p50_us, _delay_p50.get_percentile_value());
+        AtomicOps::relaxed_store(&_queue_delay_p95_us, _delay_p95.get_percentile_value());
+        AtomicOps::relaxed_store(&_queue_delay_p99_us, _delay_p99.get_percentile_value());
+    }
+    AtomicOps::relaxed_store(&_publish_time_ms, now_ms);
+}
+
+void SocketStats::snapshot(Snapshot* snapshot) const {
+    snapshot->packets_sent = AtomicOps::relaxed_load(&_packets_sent);
+    snapshot->bytes_sent = AtomicOps::relaxed_load(&_bytes_sent);
+    snapshot->packets_received = AtomicOps::relaxed_load(&_packets_received);
+    snapshot->bytes_received = AtomicOps::relaxed_load(&_bytes_received);
+    snapshot->send_would_block = AtomicOps::relaxed_load(&_send_would_block);
+    snapshot->send_errors = AtomicOps::relaxed_load(&_send_errors);
+    snapshot->send_queue_drops = AtomicOps::relaxed_load(&_send_queue_drops);
+    snapshot->recv_drops = AtomicOps::relaxed_load(&_recv_drops);
+    snapshot->publish_time_ms = AtomicOps::relaxed_load(&_publish_time_ms);
+    snapshot->send_queue_packets = AtomicOps::relaxed_load(&_send_queue_packets);
+    snapshot->send_queue_bytes = AtomicOps::relaxed_load(&_send_queue_bytes);
+    snapshot->send_bps = AtomicOps::relaxed_load(&_send_bps);
+    snapshot->recv_bps = AtomicOps::relaxed_load(&_recv_bps);
+    snapshot->queue_delay_p50_us = AtomicOps::relaxed_load(&_queue_delay_p50_us);
+    snapshot->queue_delay_p95_us = AtomicOps::relaxed_load(&_queue_delay_p95_us);
+    snapshot->queue_delay_p99_us = AtomicOps::relaxed_load(&_queue_delay_p99_us);
+}
+
+} // namespace rtcbase
+
+
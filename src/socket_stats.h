@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file socket_stats.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_SOCKET_STATS_H_
+#define  __RTCBASE_SOCKET_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "memcheck.h"
+#include "constructor_magic.h"
+#include "atomicops.h"
+#include "rate_statistics.h"
+#include "percentile_filter.h"
+
+namespace rtcbase {
+
+// Traffic counters of a socket. They are written by the thread of the
+// socket's event loop and may be read from any other thread, e.g. a
+// monitoring thread, through snapshot().
+//
+// Every counter has a single writer, so counting costs a relaxed load and
+// store of a 64 bit word, no locked instruction on the packet path. The
+// fields of a snapshot are each read atomically, but not together: they may
+// be a few packets apart.
+//
+// Send and receive rates and the send queueing delay percentiles are only
+// kept once enable_rates() was called. The loop thread then feeds a
+// RateStatistics per direction and a PercentileFilter per percentile, and
+// publish() hands their values over to the readers.
+class SocketStats : public MemCheck {
+public:
+    struct Snapshot {
+        uint64_t packets_sent;
+        uint64_t bytes_sent;
+        uint64_t packets_received;
+        uint64_t bytes_received;
+        // Sends that found the socket buffer full.
+        uint64_t send_would_block;
+        // Packets dropped after a send error.
+        uint64_t send_errors;
+        // Packets the send queue dropped to respect its limits.
+        uint64_t send_queue_drops;
+        // Received packets dropped, truncated or too large for a buffer. The
+        // ones that were not truncated count as received as well.
+        uint64_t recv_drops;
+
+        // The fields below are as of the last publish(), at |publish_time_ms|
+        // of the loop clock, -1 when nothing has been published yet.
+        int64_t publish_time_ms;
+        uint64_t send_queue_packets;
+        uint64_t send_queue_bytes;
+        uint32_t send_bps;
+        uint32_t recv_bps;
+        // Time the sampled packets spent in the send queue, in microseconds.
+        int64_t queue_delay_p50_us;
+        int64_t queue_delay_p95_us;
+        int64_t queue_delay_p99_us;
+    };
+
+    SocketStats();
+    ~SocketStats();
+
+    // The methods below are for the loop thread only.
+
+    // Starts keeping rates over |window_ms| and the delay percentiles over
+    // the last |delay_samples| sampled packets. A |window_ms| of 0 stops and
+    // zeroes the published rates and percentiles.
+    void enable_rates(int64_t window_ms, size_t delay_samples);
+    bool rates_enabled() const { return _send_rate != NULL; }
+
+    void count_sent(size_t packets, size_t bytes, int64_t now_ms) {
+        AtomicOps::relaxed_add(&_packets_sent, (uint64_t)packets);
+        AtomicOps::relaxed_add(&_bytes_sent, (uint64_t)bytes);
+        if (_send_rate) {
+            _send_rate->update(bytes, now_ms);
+        }
+    }
+    void count_received(size_t packets, size_t bytes, int64_t now_ms) {
+        AtomicOps::relaxed_add(&_packets_received, (uint64_t)packets);
+        AtomicOps::relaxed_add(&_bytes_received, (uint64_t)bytes);
+        if (_recv_rate) {
+            _recv_rate->update(bytes, now_ms);
+        }
+    }
+    void count_would_block() {
+        AtomicOps::relaxed_add(&_send_would_block, (uint64_t)1);
+    }
+    void count_send_errors(size_t packets) {
+        AtomicOps::relaxed_add(&_send_errors, (uint64_t)packets);
+    }
+    void count_queue_drops(uint64_t packets) {
+        AtomicOps::relaxed_add(&_send_queue_drops, packets);
+    }
+    void count_recv_drop() {
+        AtomicOps::relaxed_add(&_recv_drops, (uint64_t)1);
+    }
+
+    // Whether the queueing delay of the next packet taken from the send
+    // queue should be passed to add_queue_delay(). One packet in
+    // DELAY_SAMPLE_RATE is, the filters are too costly for all of them.
+    bool sample_queue_delay() {
+        return _delay_samples.size() > 0
+            && 0 == (_delay_sample_count++ & (DELAY_SAMPLE_RATE - 1));
+    }
+    void add_queue_delay(int64_t delay_us);
+
+    // Makes the current rates, percentiles and the send queue depth visible
+    // to snapshot().
+    void publish(int64_t now_ms, size_t queue_packets, size_t queue_bytes);
+
+    // Thread safe.
+    void snapshot(Snapshot* snapshot) const;
+
+private:
+    static const uint32_t DELAY_SAMPLE_RATE = 8;
+
+    // Counters.
+    volatile uint64_t _packets_sent;
+    volatile uint64_t _bytes_sent;
+    volatile uint64_t _packets_received;
+    volatile uint64_t _bytes_received;
+    volatile uint64_t _send_would_block;
+    volatile uint64_t _send_errors;
+    volatile uint64_t _send_queue_drops;
+    volatile uint64_t _recv_drops;
+
+    // Published values.
+    volatile int64_t _publish_time_ms;
+    volatile uint64_t _send_queue_packets;
+    volatile uint64_t _send_queue_bytes;
+    volatile uint32_t _send_bps;
+    volatile uint32_t _recv_bps;
+    volatile int64_t _queue_delay_p50_us;
+    volatile int64_t _queue_delay_p95_us;
+    volatile int64_t _queue_delay_p99_us;
+
+    // Loop thread state.
+    std::unique_ptr<RateStatistics> _send_rate;
+    std::unique_ptr<RateStatistics> _recv_rate;
+    // The samples in the filters, oldest at |_delay_next| once it is full.
+    std::vector<int64_t> _delay_samples;
+    size_t _delay_next;
+    size_t _delay_count;
+    uint32_t _delay_sample_count;
+    PercentileFilter<int64_t> _delay_p50;
+    PercentileFilter<int64_t> _delay_p95;
+    PercentileFilter<int64_t> _delay_p99;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(SocketStats);
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_SOCKET_STATS_H_
+
+
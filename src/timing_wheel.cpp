@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file timing_wheel.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <string.h>
+
+#include "timing_wheel.h"
+
+namespace rtcbase {
+
+static void init_list(TimingWheel::Node* list) {
+    list->prev = list;
+    list->next = list;
+}
+
+TimingWheel::TimingWheel(uint64_t now) : _current(now), _size(0) {
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int i = 0; i < SLOTS; ++i) {
+            init_list(&_slots[level][i]);
+        }
+    }
+    memset(_bitmap, 0, sizeof(_bitmap));
+}
+
+TimingWheel::~TimingWheel() {
+    // Leave the nodes still queued in a state the owners can delete.
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int i = 0; i < SLOTS; ++i) {
+            Node* slot = &_slots[level][i];
+            while (slot->next != slot) {
+                unlink(slot->next);
+            }
+        }
+    }
+}
+
+void TimingWheel::add(Node* node, uint64_t expire) {
+    if (is_pending(node)) {
+        unlink(node);
+    } else {
+        ++_size;
+    }
+    node->expire = expire;
+    link(node);
+}
+
+void TimingWheel::remove(Node* node) {
+    if (!is_pending(node)) {
+        return;
+    }
+    unlink(node);
+    --_size;
+}
+
+void TimingWheel::link(Node* node) {
+    uint64_t expire = node->expire < _current ? _current : node->expire;
+    uint64_t delta = expire - _current;
+    int level;
+    if (delta < (1ULL << SLOT_BITS)) {
+        level = 0;
+    } else if (delta < (1ULL << (2 * SLOT_BITS))) {
+        level = 1;
+    } else if (delta < (1ULL << (3 * SLOT_BITS))) {
+        level = 2;
+    } else {
+        if (delta >= (1ULL << (4 * SLOT_BITS))) {
+            expire = _current + (1ULL << (4 * SLOT_BITS)) - 1;
+            node->expire = expire;
+        }
+        level = 3;
+    }
+    int index = (int)((expire >> (level * SLOT_BITS)) & SLOT_MASK);
+
+    Node* slot = &_slots[level][index];
+    node->prev = slot->prev;
+    node->next = slot;
+    slot->prev->next = node;
+    slot->prev = node;
+    node->slot = level * SLOTS + index;
+    _bitmap[level][index >> 6] |= 1ULL << (index & 63);
+}
+
+void TimingWheel::unlink(Node* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = NULL;
+    node->next = NULL;
+
+    if (node->slot >= 0) {
+        int level = node->slot / SLOTS;
+        int index = node->slot % SLOTS;
+        Node* slot = &_slots[level][index];
+        if (slot->next == slot) {
+            _bitmap[level][index >> 6] &= ~(1ULL << (index & 63));
+        }
+        node->slot = -1;
+    }
+}
+
+void TimingWheel::take_slot(int level, int index, Node* list) {
+    Node* slot = &_slots[level][index];
+    if (slot->next == slot) {
+        init_list(list);
+        return;
+    }
+
+    list->next = slot->next;
+    list->prev = slot->prev;
+    list->next->prev = list;
+    list->prev->next = list;
+    init_list(slot);
+    _bitmap[level][index >> 6] &= ~(1ULL << (index & 63));
+
+    for (Node* node = list->next; node != list; node = node->next) {
+        node->slot = -1;
+    }
+}
+
+void TimingWheel::cascade(int level, int index) {
+    Node list;
+    take_slot(level, index, &list);
+    while (list.next != &list) {
+        Node* node = list.next;
+        unlink(node);
+        link(node);
+    }
+}
+
+void TimingWheel::step_to(uint64_t tick) {
+    assert(tick >= _current);
+    _current = tick;
+    if (tick & SLOT_MASK) {
+        return;
+    }
+    for (int level = 1; level < LEVELS; ++level) {
+        int index = (int)((tick >> (level * SLOT_BITS)) & SLOT_MASK);
+        cascade(level, index);
+        if (index != 0) {
+            break;
+        }
+    }
+}
+
+int TimingWheel::find_slot(int from) const {
+    int word = from >> 6;
+    uint64_t bits = _bitmap[0][word] & (~0ULL << (from & 63));
+    while (true) {
+        if (bits) {
+            return (word << 6) + __builtin_ctzll(bits);
+        }
+        if (++word == BITMAP_WORDS) {
+            return -1;
+        }
+        bits = _bitmap[0][word];
+    }
+}
+
+void TimingWheel::advance(uint64_t now, expire_cb_t cb, void* priv_data) {
+    while (_current <= now) {
+        uint64_t window = _current & ~(uint64_t)SLOT_MASK;
+        int index = find_slot((int)(_current & SLOT_MASK));
+        if (index < 0) {
+            // Nothing left in this window, jump to the next one.
+            uint64_t next = window + SLOTS;
+            step_to(next <= now ? next : now + 1);
+            continue;
+        }
+
+        uint64_t tick = window + index;
+        if (tick > now) {
+            step_to(now + 1);
+            break;
+        }
+
+        Node expired;
+        take_slot(0, index, &expired);
+        // Timers added by the callbacks belong to the following ticks.
+        step_to(tick + 1);
+        while (expired.next != &expired) {
+            Node* node = expired.next;
+            unlink(node);
+            --_size;
+            cb(node, priv_data);
+        }
+    }
+}
+
+uint64_t TimingWheel::next_expiry() const {
+    if (_size == 0) {
+        return UINT64_MAX;
+    }
+    int index = find_slot((int)(_current & SLOT_MASK));
+    if (index >= 0) {
+        return (_current & ~(uint64_t)SLOT_MASK) + index;
+    }
+    return (_current | SLOT_MASK) + 1;
+}
+
+} // namespace rtcbase
+
+
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file timing_wheel.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_TIMING_WHEEL_H_
+#define  __RTCBASE_TIMING_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constructor_magic.h"
+
+namespace rtcbase {
+
+// Hierarchical timing wheel with a resolution of one tick (the EventLoop uses
+// milliseconds).
+//
+// Four levels of 256 slots cover 2^32 ticks, later expiries are clamped. Adding
+// and removing a timer is O(1): level 0 holds the timers due within the next
+// 256 ticks, one slot per tick, and each higher level holds 256 times coarser
+// slots which are cascaded down when the lower level wraps. Timers are
+// intrusive nodes owned by the caller, the wheel never allocates.
+class TimingWheel {
+public:
+    struct Node {
+        Node* prev;
+        Node* next;
+        uint64_t expire;
+        int slot;   // Managed by the wheel.
+        void* data; // Free for the owner of the node.
+
+        Node() : prev(NULL), next(NULL), expire(0), slot(-1), data(NULL) {}
+    };
+
+    typedef void (*expire_cb_t)(Node* node, void* priv_data);
+
+    explicit TimingWheel(uint64_t now);
+    ~TimingWheel();
+
+    // Schedules |node| to expire at tick |expire|. A pending node is moved.
+    // Expiries that already passed fire on the next advance().
+    void add(Node* node, uint64_t expire);
+    void remove(Node* node);
+    static bool is_pending(const Node* node) { return node->prev != NULL; }
+
+    // Expires every node due at or before |now|, calling |cb| for each with
+    // the node already removed. |cb| may add and remove any node.
+    void advance(uint64_t now, expire_cb_t cb, void* priv_data);
+
+    // Returns the tick advance() has to be called at next, or UINT64_MAX when
+    // the wheel is empty. This is exact for timers due within the current
+    // 256 tick window, otherwise it is the start of the next window.
+    uint64_t next_expiry() const;
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 8;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int SLOT_MASK = SLOTS - 1;
+    static const int BITMAP_WORDS = SLOTS / 64;
+
+    void link(Node* node);
+    void unlink(Node* node);
+    // Moves |_current| forward, cascading the upper levels when it enters a
+    // new window.
+    void step_to(uint64_t tick);
+    void cascade(int level, int index);
+    // Moves the nodes of a slot to the list headed by |list|.
+    void take_slot(int level, int index, Node* list);
+    // First non-empty level 0 slot in [from, SLOTS), or -1.
+    int find_slot(int from) const;
+
+    // The next tick to process, every tick before it has expired.
+    uint64_t _current;
+    Node _slots[LEVELS][SLOTS];
+    uint64_t _bitmap[LEVELS][BITMAP_WORDS];
+    size_t _size;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(TimingWheel);
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_TIMING_WHEEL_H_
+
+
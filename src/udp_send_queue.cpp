@@ -0,0 +1,445 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+/**
+ * @file udp_send_queue.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "udp_send_queue.h"
+
+namespace rtcbase {
+
+// The chunks of slots double in size up to this many slots.
+static const size_t MAX_CHUNK_SLOTS = 1024;
+
+UdpSendQueue::UdpSendQueue(size_t slot_count, size_t slot_size) :
+    MemCheck("UdpSendQueue"),
+    _slot_size(slot_size),
+    _chunk_slots(slot_count > 0 ? slot_count : 1),
+    _free_slot(-1),
+    _next_seq(0),
+    _push_time(0),
+    _size(0),
+    _bytes(0),
+    _max_packets(0),
+    _max_bytes(0),
+    _drop_policy(DROP_NEWEST)
+{
+    for (int i = 0; i < PRIORITY_COUNT; ++i) {
+        _active_flow[i] = -1;
+        _oldest[i] = _newest[i] = -1;
+        _dropped_packets[i] = 0;
+        _dropped_bytes[i] = 0;
+    }
+}
+
+UdpSendQueue::~UdpSendQueue() {
+    clear();
+}
+
+void UdpSendQueue::set_limits(size_t max_packets, size_t max_bytes,
+        DropPolicy policy)
+{
+    _max_packets = max_packets;
+    _max_bytes = max_bytes;
+    _drop_policy = policy;
+}
+
+bool UdpSendQueue::push(const void* data, size_t size, const SocketAddress& addr,
+        int tos, PacketPriority priority)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    return push_v(&iov, 1, addr, tos, priority);
+}
+
+bool UdpSendQueue::push_v(const struct iovec* iov, size_t iov_count,
+        const SocketAddress& addr, int tos, PacketPriority priority)
+{
+    size_t size = iov_length(iov, iov_count);
+    int index = add_slot(size, addr, tos, priority);
+    if (index < 0) {
+        return false;
+    }
+
+    Slot& slot = _slots[index];
+    if (size > _slot_size) {
+        slot.heap_data = new char[size];
+        slot.data = slot.heap_data;
+    } else {
+        slot.data = slot.pool_data;
+    }
+    iov_gather(slot.data, iov, iov_count);
+    return true;
+}
+
+bool UdpSendQueue::push(const scoped_refptr<PacketBuffer>& buffer,
+        const SocketAddress& addr, int tos, PacketPriority priority)
+{
+    int index = add_slot(buffer->size(), addr, tos, priority);
+    if (index < 0) {
+        return false;
+    }
+
+    Slot& slot = _slots[index];
+    slot.buffer = buffer;
+    slot.data = reinterpret_cast<char*>(buffer->data());
+    return true;
+}
+
+int UdpSendQueue::add_slot(size_t size, const SocketAddress& addr, int tos,
+        PacketPriority priority)
+{
+    assert(priority >= 0 && priority < PRIORITY_COUNT);
+    if (!make_room(size, priority)) {
+        ++_dropped_packets[priority];
+        _dropped_bytes[priority] += size;
+        return -1;
+    }
+
+    int index = alloc_slot(size);
+    Slot& slot = _slots[index];
+    slot.tos = tos;
+    slot.priority = priority;
+    slot.seq = _next_seq++;
+    slot.push_time = _push_time;
+    slot.newer = -1;
+    slot.older = _newest[priority];
+    if (slot.older >= 0) {
+        _slots[slot.older].newer = index;
+    } else {
+        _oldest[priority] = index;
+    }
+    _newest[priority] = index;
+
+    int flow = get_flow(addr);
+    Flow& f = _flows[flow];
+    slot.flow = flow;
+    slot.next = -1;
+    if (f.tail[priority] >= 0) {
+        _slots[f.tail[priority]].next = index;
+    } else {
+        f.head[priority] = index;
+        activate_flow(flow, priority);
+    }
+    f.tail[priority] = index;
+    ++_size;
+    _bytes += size;
+    return index;
+}
+
+bool UdpSendQueue::make_room(size_t size, int priority) {
+    if (_max_bytes > 0 && size > _max_bytes) {
+        return false;
+    }
+
+    bool dropped = false;
+    while ((_max_packets > 0 && _size + 1 > _max_packets)
+            || (_max_bytes > 0 && _bytes + size > _max_bytes))
+    {
+        int victim = -1;
+        if (DROP_OLDEST == _drop_policy) {
+            for (int i = 0; i < PRIORITY_COUNT; ++i) {
+                if (_oldest[i] >= 0 && (victim < 0
+                            || _slots[_oldest[i]].seq < _slots[_oldest[victim]].seq))
+                {
+                    victim = i;
+                }
+            }
+        } else if (DROP_LOWEST_PRIORITY == _drop_policy) {
+            for (int i = PRIORITY_COUNT - 1; i >= priority; --i) {
+                if (_oldest[i] >= 0) {
+                    victim = i;
+                    break;
+                }
+            }
+        }
+        if (victim < 0) {
+            return false;
+        }
+
+        // The oldest packet of a class is the first of its flow.
+        const Slot& slot = _slots[_oldest[victim]];
+        ++_dropped_packets[victim];
+        _dropped_bytes[victim] += slot.size;
+        remove_head(slot.flow, victim);
+        dropped = true;
+    }
+
+    if (dropped) {
+        _peeked.clear();
+    }
+    return true;
+}
+
+void UdpSendQueue::remove_head(int flow, int priority) {
+    Flow& f = _flows[flow];
+    int index = f.head[priority];
+    Slot& slot = _slots[index];
+    f.head[priority] = slot.next;
+    if (f.head[priority] < 0) {
+        f.tail[priority] = -1;
+    }
+
+    if (slot.older >= 0) {
+        _slots[slot.older].newer = slot.newer;
+    } else {
+        _oldest[priority] = slot.newer;
+    }
+    if (slot.newer >= 0) {
+        _slots[slot.newer].older = slot.older;
+    } else {
+        _newest[priority] = slot.older;
+    }
+
+    --_size;
+    _bytes -= slot.size;
+    free_slot(index);
+    if (f.head[priority] < 0) {
+        deactivate_flow(flow, priority);
+    }
+}
+
+bool UdpSendQueue::has_pending(const SocketAddress& addr) const {
+    if (_size == 0) {
+        return false;
+    }
+    return _flow_index.find(SocketAddressKey(addr)) != _flow_index.end();
+}
+
+void UdpSendQueue::get_stats(Stats* stats) const {
+    stats->packets = _size;
+    stats->bytes = _bytes;
+    for (int i = 0; i < PRIORITY_COUNT; ++i) {
+        stats->dropped_packets[i] = _dropped_packets[i];
+        stats->dropped_bytes[i] = _dropped_bytes[i];
+    }
+}
+
+uint64_t UdpSendQueue::dropped_packets() const {
+    uint64_t dropped = 0;
+    for (int i = 0; i < PRIORITY_COUNT; ++i) {
+        dropped += _dropped_packets[i];
+    }
+    return dropped;
+}
+
+size_t UdpSendQueue::peek(SendMessage* msgs, size_t count, size_t quantum) {
+    _peeked.clear();
+
+    size_t n = 0;
+    for (int k = 0; k < PRIORITY_COUNT && n < count; ++k) {
+        if (_active_flow[k] < 0) {
+            continue;
+        }
+
+        // One read cursor per active flow, in round robin order.
+        std::vector<int>& cursors = _cursors;
+        cursors.clear();
+        int flow = _active_flow[k];
+        do {
+            cursors.push_back(_flows[flow].head[k]);
+            flow = _flows[flow].next_active[k];
+        } while (flow != _active_flow[k]);
+
+        bool progress = true;
+        while (n < count && progress) {
+            progress = false;
+            flow = _active_flow[k];
+            for (size_t i = 0; i < cursors.size() && n < count; ++i) {
+                for (size_t j = 0; j < quantum && cursors[i] >= 0 && n < count; ++j) {
+                    const Slot& slot = _slots[cursors[i]];
+                    msgs[n].data = slot.data;
+                    msgs[n].size = slot.size;
+                    msgs[n].addr = &_flows[flow].addr;
+                    msgs[n].tos = slot.tos;
+                    _peeked.push_back(cursors[i]);
+                    cursors[i] = slot.next;
+                    progress = true;
+                    ++n;
+                }
+                flow = _flows[flow].next_active[k];
+            }
+        }
+    }
+    return n;
+}
+
+void UdpSendQueue::pop(size_t count) {
+    assert(count <= _peeked.size());
+    int last_flow[PRIORITY_COUNT];
+    for (int k = 0; k < PRIORITY_COUNT; ++k) {
+        last_flow[k] = -1;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        int index = _peeked[i];
+        int flow = _slots[index].flow;
+        int priority = _slots[index].priority;
+        assert(_flows[flow].head[priority] == index);
+        remove_head(flow, priority);
+        last_flow[priority] = flow;
+    }
+
+    // Continue with the destination after the last one served.
+    for (int k = 0; k < PRIORITY_COUNT; ++k) {
+        if (last_flow[k] >= 0 && _flows[last_flow[k]].head[k] >= 0) {
+            _active_flow[k] = _flows[last_flow[k]].next_active[k];
+        }
+    }
+    _peeked.clear();
+}
+
+void UdpSendQueue::clear() {
+    for (int k = 0; k < PRIORITY_COUNT; ++k) {
+        while (_active_flow[k] >= 0) {
+            int flow = _active_flow[k];
+            int index = _flows[flow].head[k];
+            while (index >= 0) {
+                int next = _slots[index].next;
+                free_slot(index);
+                index = next;
+            }
+            _flows[flow].head[k] = _flows[flow].tail[k] = -1;
+            deactivate_flow(flow, k);
+        }
+        _oldest[k] = _newest[k] = -1;
+    }
+    _peeked.clear();
+    _size = 0;
+    _bytes = 0;
+}
+
+int UdpSendQueue::alloc_slot(size_t size) {
+    if (_free_slot < 0) {
+        grow();
+    }
+
+    int index = _free_slot;
+    Slot& slot = _slots[index];
+    _free_slot = slot.next;
+    slot.size = size;
+    return index;
+}
+
+void UdpSendQueue::free_slot(int index) {
+    Slot& slot = _slots[index];
+    if (slot.heap_data) {
+        delete [] slot.heap_data;
+        slot.heap_data = nullptr;
+    }
+    slot.buffer = nullptr;
+    slot.data = nullptr;
+    slot.size = 0;
+    slot.flow = -1;
+    slot.next = _free_slot;
+    _free_slot = index;
+}
+
+void UdpSendQueue::grow() {
+    char* chunk = new char[_chunk_slots * _slot_size];
+    _chunks.push_back(std::unique_ptr<char[]>(chunk));
+
+    size_t base = _slots.size();
+    _slots.resize(base + _chunk_slots);
+    for (size_t i = 0; i < _chunk_slots; ++i) {
+        Slot& slot = _slots[base + i];
+        slot.pool_data = chunk + i * _slot_size;
+        slot.data = nullptr;
+        slot.heap_data = nullptr;
+        slot.size = 0;
+        slot.tos = -1;
+        slot.flow = -1;
+        slot.priority = PRIORITY_NORMAL;
+        slot.older = slot.newer = -1;
+        slot.seq = 0;
+        slot.push_time = 0;
+        slot.next = (i + 1 < _chunk_slots) ? static_cast<int>(base + i + 1) : _free_slot;
+    }
+    _free_slot = static_cast<int>(base);
+    _chunk_slots = std::min(_chunk_slots * 2, std::max(_chunk_slots, MAX_CHUNK_SLOTS));
+}
+
+int UdpSendQueue::get_flow(const SocketAddress& addr) {
+    SocketAddressKey key(addr);
+    std::unordered_map<SocketAddressKey, int>::iterator iter = _flow_index.find(key);
+    if (iter != _flow_index.end()) {
+        return iter->second;
+    }
+
+    int flow;
+    if (!_free_flows.empty()) {
+        flow = _free_flows.back();
+        _free_flows.pop_back();
+    } else {
+        flow = static_cast<int>(_flows.size());
+        _flows.resize(_flows.size() + 1);
+    }
+
+    Flow& f = _flows[flow];
+    f.addr = addr;
+    f.key = key;
+    for (int k = 0; k < PRIORITY_COUNT; ++k) {
+        f.head[k] = f.tail[k] = -1;
+        f.next_active[k] = f.prev_active[k] = -1;
+    }
+    f.classes = 0;
+    _flow_index[key] = flow;
+    return flow;
+}
+
+void UdpSendQueue::activate_flow(int flow, int priority) {
+    Flow& f = _flows[flow];
+    ++f.classes;
+    int& active = _active_flow[priority];
+    if (active < 0) {
+        f.next_active[priority] = f.prev_active[priority] = flow;
+        active = flow;
+        return;
+    }
+
+    // Insert before the current one, i.e. at the end of the round.
+    Flow& first = _flows[active];
+    f.next_active[priority] = active;
+    f.prev_active[priority] = first.prev_active[priority];
+    _flows[first.prev_active[priority]].next_active[priority] = flow;
+    first.prev_active[priority] = flow;
+}
+
+void UdpSendQueue::deactivate_flow(int flow, int priority) {
+    Flow& f = _flows[flow];
+    int& active = _active_flow[priority];
+    if (f.next_active[priority] == flow) {
+        active = -1;
+    } else {
+        _flows[f.prev_active[priority]].next_active[priority] = f.next_active[priority];
+        _flows[f.next_active[priority]].prev_active[priority] = f.prev_active[priority];
+        if (active == flow) {
+            active = f.next_active[priority];
+        }
+    }
+    f.next_active[priority] = f.prev_active[priority] = -1;
+
+    // Idle destinations are forgotten, the flow entry is recycled.
+    if (--f.classes == 0) {
+        _flow_index.erase(f.key);
+        _free_flows.push_back(flow);
+    }
+}
+
+} // namespace rtcbase
+
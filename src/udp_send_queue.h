@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file udp_send_queue.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_UDP_SEND_QUEUE_H_
+#define  __RTCBASE_UDP_SEND_QUEUE_H_
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "memcheck.h"
+#include "constructor_magic.h"
+#include "async_packet_socket.h"
+#include "packet_buffer.h"
+#include "socket.h"
+#include "socket_address.h"
+
+namespace rtcbase {
+
+// Outgoing datagram queue of AsyncUDPSocket.
+//
+// Payloads are copied into slots of a pool, so queueing a packet does not
+// allocate unless the pool has to grow or the packet is larger than a slot.
+// The pool is allocated on the first push and grows in chunks of doubling
+// size, a queue that is never used costs no slot memory. Packets already held
+// in a PacketBuffer are queued by reference instead, without a copy.
+//
+// Each destination owns a FIFO per priority class threaded through the
+// slots. Higher classes always go first, and within a class the destinations
+// with pending data are served round robin, one packet each per round, so a
+// single congested receiver can not starve the others.
+//
+// The queue may be bounded in packets and bytes, a full queue then makes
+// room according to its DropPolicy.
+class UdpSendQueue : public MemCheck {
+public:
+    enum DropPolicy {
+        // The packet being pushed is dropped.
+        DROP_NEWEST,
+        // The oldest queued packets are dropped, whatever their class.
+        DROP_OLDEST,
+        // The oldest packets of the lowest class are dropped, as long as it
+        // is not above the class of the packet being pushed.
+        DROP_LOWEST_PRIORITY
+    };
+
+    struct Stats {
+        size_t packets;
+        size_t bytes;
+        // Dropped by push() to respect the limits, per class.
+        uint64_t dropped_packets[PRIORITY_COUNT];
+        uint64_t dropped_bytes[PRIORITY_COUNT];
+    };
+
+    // |slot_count| is the number of slots of the first chunk.
+    UdpSendQueue(size_t slot_count, size_t slot_size);
+    ~UdpSendQueue();
+
+    // 0 leaves the packets or the bytes unbounded, which is the default.
+    void set_limits(size_t max_packets, size_t max_bytes, DropPolicy policy);
+    size_t max_packets() const { return _max_packets; }
+    size_t max_bytes() const { return _max_bytes; }
+    DropPolicy drop_policy() const { return _drop_policy; }
+
+    // Copies the packet into the queue. |tos| is handed on with the packet,
+    // see SendMessage. Returns false when the packet was dropped instead.
+    // Making room for it invalidates the last peek().
+    bool push(const void* data, size_t size, const SocketAddress& addr,
+            int tos = -1, PacketPriority priority = PRIORITY_NORMAL);
+    // Same as push() for the concatenation of |iov_count| buffers, gathered
+    // straight into the slot.
+    bool push_v(const struct iovec* iov, size_t iov_count,
+            const SocketAddress& addr, int tos = -1,
+            PacketPriority priority = PRIORITY_NORMAL);
+    // Queues |buffer| by reference, it is released once the packet has been
+    // sent or dropped. Its data must not change in the meantime.
+    bool push(const scoped_refptr<PacketBuffer>& buffer,
+            const SocketAddress& addr, int tos = -1,
+            PacketPriority priority = PRIORITY_NORMAL);
+
+    // Fills |msgs| with up to |count| packets to send next, without removing
+    // them from the queue. Every round takes up to |quantum| consecutive
+    // packets of each destination of a class. Returns the number of messages
+    // filled in. The messages point into the queue and are valid until the
+    // next pop.
+    size_t peek(SendMessage* msgs, size_t count, size_t quantum = 1);
+
+    // Removes the first |count| packets returned by the last peek().
+    void pop(size_t count);
+
+    // Packets pushed from now on are stamped with |time|, in whatever unit
+    // the caller uses, e.g. to tell how long they waited once sent.
+    void set_push_time(int64_t time) { _push_time = time; }
+    // The stamp of the |i|th packet of the last peek().
+    int64_t peeked_push_time(size_t i) const { return _slots[_peeked[i]].push_time; }
+
+    size_t size() const { return _size; }
+    size_t bytes() const { return _bytes; }
+    // Slots allocated, in use or not.
+    size_t slot_capacity() const { return _slots.size(); }
+    bool empty() const { return _size == 0; }
+    void get_stats(Stats* stats) const;
+    // Packets dropped to respect the limits, all classes together.
+    uint64_t dropped_packets() const;
+
+    // Whether any packet to |addr| is waiting.
+    bool has_pending(const SocketAddress& addr) const;
+
+    // Drops everything that is queued.
+    void clear();
+
+private:
+    struct Slot {
+        char* pool_data; // This slot's part of the pool.
+        char* data;      // Either |pool_data| or |heap_data|.
+        size_t size;
+        int tos;
+        int next;        // Next slot of the same flow or the free list.
+        int flow;
+        int priority;
+        // Neighbours in the arrival order of the class.
+        int older;
+        int newer;
+        uint64_t seq;
+        int64_t push_time;
+        char* heap_data; // Only used for packets larger than a slot.
+        // Owns the data of packets queued by reference.
+        scoped_refptr<PacketBuffer> buffer;
+    };
+
+    struct Flow {
+        SocketAddress addr;
+        SocketAddressKey key;
+        // One FIFO and one active ring link per class.
+        int head[PRIORITY_COUNT];
+        int tail[PRIORITY_COUNT];
+        int next_active[PRIORITY_COUNT];
+        int prev_active[PRIORITY_COUNT];
+        // Classes with packets queued.
+        int classes;
+    };
+
+    // Takes a slot for a packet of |size| bytes and links it into the
+    // queues, the caller points its data at the payload. Returns -1 when
+    // the packet is dropped.
+    int add_slot(size_t size, const SocketAddress& addr, int tos,
+            PacketPriority priority);
+    bool make_room(size_t size, int priority);
+    // Removes the first packet of |flow| in class |priority|.
+    void remove_head(int flow, int priority);
+    int alloc_slot(size_t size);
+    void free_slot(int index);
+    void grow();
+    int get_flow(const SocketAddress& addr);
+    void activate_flow(int flow, int priority);
+    void deactivate_flow(int flow, int priority);
+
+    const size_t _slot_size;
+    // Slots of the chunk allocated next.
+    size_t _chunk_slots;
+    std::vector<std::unique_ptr<char[]> > _chunks;
+    std::vector<Slot> _slots;
+    int _free_slot;
+
+    std::vector<Flow> _flows;
+    std::vector<int> _free_flows;
+    std::unordered_map<SocketAddressKey, int> _flow_index;
+    // Circular lists of the flows that have packets queued, per class.
+    int _active_flow[PRIORITY_COUNT];
+    // The packets of each class in arrival order.
+    int _oldest[PRIORITY_COUNT];
+    int _newest[PRIORITY_COUNT];
+    uint64_t _next_seq;
+    int64_t _push_time;
+
+    std::vector<int> _cursors;
+    std::vector<int> _peeked;
+    size_t _size;
+    size_t _bytes;
+
+    size_t _max_packets;
+    size_t _max_bytes;
+    DropPolicy _drop_policy;
+    uint64_t _dropped_packets[PRIORITY_COUNT];
+    uint64_t _dropped_bytes[PRIORITY_COUNT];
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(UdpSendQueue);
+};
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_UDP_SEND_QUEUE_H_
+
+
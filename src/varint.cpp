@@ -0,0 +1,265 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file varint.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+
+#include "varint.h"
+
+namespace rtcbase {
+
+size_t encode_uvarint_slow(uint64_t val, char* out) {
+    size_t len = 0;
+    while (val >= 0x80) {
+        // Write 7 bits at a time, then set the msb to a continuation byte (msb=1).
+        out[len++] = static_cast<char>(val) | 0x80;
+        val >>= 7;
+    }
+    out[len++] = static_cast<char>(val);
+    return len;
+}
+
+size_t decode_uvarint_slow(const char* in, size_t size, uint64_t* val) {
+    // Integers are deserialized 7 bits at a time, with each byte having a
+    // continuation byte (msb=1) if there are more bytes to be read.
+    uint64_t v = 0;
+    for (size_t i = 0; i < k_uvarint_max_size && i < size; ++i) {
+        uint8_t byte = static_cast<uint8_t>(in[i]);
+        v |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if (byte < 0x80) {
+            *val = v;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+size_t uvarints_size(const uint64_t* vals, size_t count) {
+    size_t size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size += uvarint_size(vals[i]);
+    }
+    return size;
+}
+
+size_t encode_uvarints(const uint64_t* vals, size_t count, char* out, size_t size) {
+    char* p = out;
+    char* end = out + size;
+    for (size_t i = 0; i < count; ++i) {
+        if (end - p >= (ptrdiff_t)k_uvarint_max_size) {
+            p += encode_uvarint(vals[i], p);
+            continue;
+        }
+        // Close to the end, without the whole word stores.
+        char bytes[k_uvarint_max_size];
+        size_t len = encode_uvarint(vals[i], bytes);
+        if ((size_t)(end - p) < len) {
+            return 0;
+        }
+        memcpy(p, bytes, len);
+        p += len;
+    }
+    return p - out;
+}
+
+size_t decode_uvarints(const char* in, size_t size, uint64_t* vals, size_t count) {
+    size_t pos = 0;
+    size_t n = 0;
+    while (n < count) {
+#if defined(__SSE2__)
+        // Room for a whole word load at any of the 16 bytes.
+        if (size - pos >= 24) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+            uint32_t ends = ~(uint32_t)_mm_movemask_epi8(bytes) & 0xFFFF;
+            if (0xFFFF == ends && count - n >= 16) {
+                // 16 one byte values, widened to 64 bits.
+                __m128i zero = _mm_setzero_si128();
+                __m128i words[2] = {
+                    _mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)
+                };
+                for (int i = 0; i < 2; ++i) {
+                    __m128i lo = _mm_unpacklo_epi16(words[i], zero);
+                    __m128i hi = _mm_unpackhi_epi16(words[i], zero);
+                    __m128i* dst = reinterpret_cast<__m128i*>(vals + n + i * 8);
+                    _mm_storeu_si128(dst, _mm_unpacklo_epi32(lo, zero));
+                    _mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(lo, zero));
+                    _mm_storeu_si128(dst + 2, _mm_unpacklo_epi32(hi, zero));
+                    _mm_storeu_si128(dst + 3, _mm_unpackhi_epi32(hi, zero));
+                }
+                n += 16;
+                pos += 16;
+                continue;
+            }
+            // The values that end in the block take their lengths from the
+            // mask, not from a scan of their own.
+            size_t offset = 0;
+            while (ends && n < count) {
+                size_t end = __builtin_ctz(ends) + 1;
+                size_t len = end - offset;
+                if (1 == len) {
+                    vals[n++] = static_cast<uint8_t>(in[pos + offset]);
+                } else if (len <= 8) {
+                    uint64_t word = load_le64(in + pos + offset);
+                    vals[n++] = gather_uvarint_bits(
+                            word & (0x7F7F7F7F7F7F7F7FULL >> (64 - 8 * len)));
+                } else {
+                    break;
+                }
+                offset = end;
+                ends &= ends - 1;
+            }
+            pos += offset;
+            if (offset > 0) {
+                continue;
+            }
+        }
+#endif
+        size_t len = decode_uvarint(in + pos, size - pos, &vals[n]);
+        if (0 == len) {
+            return 0;
+        }
+        pos += len;
+        ++n;
+    }
+    return pos;
+}
+
+// Byte length of a packed value, less one, as stored in the control bytes.
+static inline uint32_t packed_code(uint32_t val) {
+    return (val > 0xFF) + (val > 0xFFFF) + (val > 0xFFFFFF);
+}
+
+size_t packed_uint32s_size(const uint32_t* vals, size_t count) {
+    size_t size = (count + 3) / 4 + count;
+    for (size_t i = 0; i < count; ++i) {
+        size += packed_code(vals[i]);
+    }
+    return size;
+}
+
+size_t encode_packed_uint32s(const uint32_t* vals, size_t count, char* out,
+        size_t size)
+{
+    size_t control_size = (count + 3) / 4;
+    if (size < control_size + count) {
+        return 0;
+    }
+    uint8_t* control = reinterpret_cast<uint8_t*>(out);
+    char* p = out + control_size;
+    char* end = out + size;
+    for (size_t group = 0; group < control_size; ++group) {
+        // The control byte is built up in a register, not in the output.
+        uint32_t codes = 0;
+        size_t last = std::min(count, group * 4 + 4);
+        for (size_t i = group * 4; i < last; ++i) {
+            uint32_t code = packed_code(vals[i]);
+            codes |= code << (2 * (i % 4));
+            uint32_t v = vals[i];
+            if (is_host_big_endian()) {
+                v = __builtin_bswap32(v);
+            }
+            if (end - p >= 4) {
+                memcpy(p, &v, 4);
+            } else if ((size_t)(end - p) > code) {
+                memcpy(p, &v, code + 1);
+            } else {
+                return 0;
+            }
+            p += code + 1;
+        }
+        control[group] = (uint8_t)codes;
+    }
+    return p - out;
+}
+
+#if defined(__SSSE3__)
+
+// Per control byte, the data bytes of its 4 values and the shuffle that
+// moves them into 4 little endian words.
+struct PackedTables {
+    uint8_t lengths[256];
+    uint8_t shuffles[256][16];
+
+    PackedTables() {
+        for (int control = 0; control < 256; ++control) {
+            uint8_t offset = 0;
+            for (int k = 0; k < 4; ++k) {
+                int len = ((control >> (2 * k)) & 3) + 1;
+                for (int b = 0; b < 4; ++b) {
+                    shuffles[control][k * 4 + b] = (b < len) ? offset++ : 0x80;
+                }
+            }
+            lengths[control] = offset;
+        }
+    }
+};
+
+static const PackedTables& packed_tables() {
+    static const PackedTables tables;
+    return tables;
+}
+
+#endif
+
+size_t decode_packed_uint32s(const char* in, size_t size, uint32_t* vals,
+        size_t count)
+{
+    size_t control_size = (count + 3) / 4;
+    if (size < control_size) {
+        return 0;
+    }
+    const uint8_t* control = reinterpret_cast<const uint8_t*>(in);
+    const char* p = in + control_size;
+    const char* end = in + size;
+    size_t i = 0;
+
+#if defined(__SSSE3__)
+    const PackedTables& tables = packed_tables();
+    // The 16 byte load may read past the 4 values, stay clear of the end.
+    for (; i + 4 <= count && end - p >= 16; i += 4) {
+        uint8_t c = control[i / 4];
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i shuffle = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(tables.shuffles[c]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(vals + i),
+                _mm_shuffle_epi8(data, shuffle));
+        p += tables.lengths[c];
+    }
+#endif
+
+    for (; i < count; ++i) {
+        size_t len = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+        if ((size_t)(end - p) < len) {
+            return 0;
+        }
+        uint32_t v = 0;
+        for (size_t b = 0; b < len; ++b) {
+            v |= (uint32_t)(uint8_t)p[b] << (8 * b);
+        }
+        vals[i] = v;
+        p += len;
+    }
+    return p - in;
+}
+
+} // namespace rtcbase
+
+
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file varint.h
+ * @author str2num
+ * @brief
+ *
+ **/
+
+
+#ifndef  __RTCBASE_VARINT_H_
+#define  __RTCBASE_VARINT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byte_order.h"
+
+namespace rtcbase {
+
+// Unsigned varints in the format described by
+// https://developers.google.com/protocol-buffers/docs/encoding#varints
+// with the caveat that integers are 64-bit, not 128-bit.
+//
+// Values of up to 8 bytes are encoded and decoded without a loop or a
+// branch per byte: the 7 bit groups are spread out of, or gathered into, a
+// 64 bit word with a few shifts and masks, and the length comes from a bit
+// scan.
+
+// Longest encoding of a 64 bit value.
+static const size_t k_uvarint_max_size = 10;
+
+// 1 + bits / 7 for the 0 to 63 index of the highest bit, without a divide.
+inline size_t uvarint_size(uint64_t val) {
+    return ((63 - __builtin_clzll(val | 1)) * 9 + 73) >> 6;
+}
+
+// Little endian loads and stores of a whole word.
+inline uint64_t load_le64(const char* in) {
+    uint64_t word;
+    memcpy(&word, in, 8);
+    return is_host_big_endian() ? __builtin_bswap64(word) : word;
+}
+
+inline void store_le64(char* out, uint64_t word) {
+    word = is_host_big_endian() ? __builtin_bswap64(word) : word;
+    memcpy(out, &word, 8);
+}
+
+// The low 56 bits of |val| in the low 7 bits of each byte, and back.
+inline uint64_t spread_uvarint_bits(uint64_t val) {
+    val = ((val & 0x00FFFFFFF0000000ULL) << 4) | (val & 0x000000000FFFFFFFULL);
+    val = ((val & 0x0FFFC0000FFFC000ULL) << 2) | (val & 0x00003FFF00003FFFULL);
+    return ((val & 0x3F803F803F803F80ULL) << 1) | (val & 0x007F007F007F007FULL);
+}
+
+inline uint64_t gather_uvarint_bits(uint64_t word) {
+    word = ((word & 0x7F007F007F007F00ULL) >> 1) | (word & 0x007F007F007F007FULL);
+    word = ((word & 0x3FFF00003FFF0000ULL) >> 2) | (word & 0x00003FFF00003FFFULL);
+    return ((word & 0x0FFFFFFF00000000ULL) >> 4) | (word & 0x000000000FFFFFFFULL);
+}
+
+size_t encode_uvarint_slow(uint64_t val, char* out);
+size_t decode_uvarint_slow(const char* in, size_t size, uint64_t* val);
+
+// Writes |val| to |out|, which must have room for k_uvarint_max_size
+// bytes, even if the value takes less. Returns the number of bytes of the
+// encoding.
+inline size_t encode_uvarint(uint64_t val, char* out) {
+    // Most values on the wire are small, a one byte value is left to the
+    // branch predictor.
+    if (val < 0x80) {
+        *out = static_cast<char>(val);
+        return 1;
+    }
+    size_t len = uvarint_size(val);
+    if (len > 8) {
+        return encode_uvarint_slow(val, out);
+    }
+    // Continuation bits on all bytes but the last.
+    uint64_t more = 0x8080808080808080ULL & ((1ULL << (8 * (len - 1))) - 1);
+    store_le64(out, spread_uvarint_bits(val) | more);
+    return len;
+}
+
+// Reads a value from the |size| bytes at |in|. Returns the number of bytes
+// it took, 0 when the input ends before the value does or the value is
+// longer than k_uvarint_max_size.
+inline size_t decode_uvarint(const char* in, size_t size, uint64_t* val) {
+    if (size > 0 && static_cast<uint8_t>(in[0]) < 0x80) {
+        *val = static_cast<uint8_t>(in[0]);
+        return 1;
+    }
+    if (size >= 8) {
+        uint64_t word = load_le64(in);
+        uint64_t ends = ~word & 0x8080808080808080ULL;
+        if (ends) {
+            // The high bit of the last byte, and all bits below it.
+            uint64_t end = ends & (0 - ends);
+            *val = gather_uvarint_bits(word & (end ^ (end - 1)) & 0x7F7F7F7F7F7F7F7FULL);
+            return (__builtin_ctzll(end) + 1) / 8;
+        }
+    }
+    return decode_uvarint_slow(in, size, val);
+}
+
+// The same for arrays. encode_uvarints() writes to the |size| bytes at
+// |out| and returns the bytes used, 0 when they do not fit. decode_uvarints()
+// returns the bytes read, 0 on an error. Decoding takes the value ends of
+// 16 bytes at a time from one SSE2 byte mask, and widens a block of 16 one
+// byte values without looking at them one by one. SSE2 is part of x86_64,
+// so the default build has this path.
+size_t uvarints_size(const uint64_t* vals, size_t count);
+size_t encode_uvarints(const uint64_t* vals, size_t count, char* out, size_t size);
+size_t decode_uvarints(const char* in, size_t size, uint64_t* vals, size_t count);
+
+// Packed 32 bit values in the Stream VByte layout: a control byte per 4
+// values, holding the byte length of each in 2 bits, then the values in
+// as many little endian bytes. Unlike varints, decoding needs no scan for
+// the end of each value, so SSSE3 decodes 4 values with one byte shuffle.
+// That decoder is only compiled with -mssse3, which the default build does
+// not pass, otherwise values are decoded one at a time.
+// Not compatible with varints, both ends have to use it.
+size_t packed_uint32s_size(const uint32_t* vals, size_t count);
+// Returns the bytes used, 0 when they do not fit into |size|.
+size_t encode_packed_uint32s(const uint32_t* vals, size_t count, char* out,
+        size_t size);
+// Returns the bytes read, 0 when |size| is too short for |count| values.
+size_t decode_packed_uint32s(const char* in, size_t size, uint32_t* vals,
+        size_t count);
+
+} // namespace rtcbase
+
+#endif  //__RTCBASE_VARINT_H_
+
+
@@ -0,0 +1,1547 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file async_udp_socket_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <rtcbase/sigslot.h>
+#include <rtcbase/time_utils.h>
+#include <rtcbase/event_loop.h>
+#include <rtcbase/physical_socket_server.h>
+#include <rtcbase/buffer.h>
+#include <rtcbase/async_udp_socket.h>
+#include <rtcbase/paced_packet_socket.h>
+#include <rtcbase/platform_thread.h>
+
+static const int k_bench_rounds = 2000;
+static const int k_bench_burst = 256;
+static const size_t k_bench_packet_size = 200;
+// Packets the listener holds on to, like a jitter buffer.
+static const size_t k_bench_kept_packets = 64;
+
+enum KeepMode {
+    KEEP_NONE,
+    KEEP_COPY,      // Copies every packet into a buffer of its own.
+    KEEP_POOLED     // Keeps a reference to the socket's packet buffer.
+};
+
+// Each round the sender queues a burst of packets on the receiving socket and
+// only the time the loop needs to drain that burst is accounted, so sender
+// cost does not pollute the result. With io_uring part of the receive work
+// already runs as task work of the sending system calls, so the time from the
+// first send to the last delivery is reported as well.
+class UdpRecvBench : public rtcbase::HasSlots<> {
+public:
+    UdpRecvBench(rtcbase::Socket* sender, const rtcbase::SocketAddress& addr) :
+        _sender(sender), _addr(addr), _rounds(0), _pending(0),
+        _round_start(0), _send_start(0), _total_packets(0), _total_nanos(0),
+        _total_round_nanos(0), _kept(0), _copies(k_bench_kept_packets),
+        _buffers(k_bench_kept_packets) {}
+
+    void send_burst(rtcbase::EventLoop* el) {
+        if (_pending > 0) {
+            return;
+        }
+        if (++_rounds > k_bench_rounds) {
+            el->stop();
+            return;
+        }
+        char packet[k_bench_packet_size] = {0};
+        _send_start = rtcbase::time_nanos();
+        for (int i = 0; i < k_bench_burst; ++i) {
+            _sender->send_to(packet, sizeof(packet), _addr);
+        }
+        _pending = k_bench_burst;
+        _round_start = rtcbase::time_nanos();
+    }
+
+    void on_read_packet(rtcbase::AsyncPacketSocket*, const char*, size_t,
+            const rtcbase::SocketAddress&, const rtcbase::PacketTime&)
+    {
+        count_packet();
+    }
+
+    void on_read_packet_copy(rtcbase::AsyncPacketSocket*, const char* data,
+            size_t size, const rtcbase::SocketAddress&, const rtcbase::PacketTime&)
+    {
+        _copies[_kept++ % k_bench_kept_packets].reset(new rtcbase::Buffer(data, size));
+        count_packet();
+    }
+
+    void on_read_packet_buffer(rtcbase::AsyncPacketSocket*,
+            const rtcbase::scoped_refptr<rtcbase::PacketBuffer>& buffer,
+            const rtcbase::SocketAddress&, const rtcbase::PacketTime&)
+    {
+        _buffers[_kept++ % k_bench_kept_packets] = buffer;
+        count_packet();
+    }
+
+    void count_packet() {
+        ++_total_packets;
+        if (--_pending == 0) {
+            uint64_t now = rtcbase::time_nanos();
+            _total_nanos += now - _round_start;
+            _total_round_nanos += now - _send_start;
+        }
+    }
+
+    uint64_t packets_per_sec() const {
+        return _total_nanos ? _total_packets * rtcbase::k_num_nanosecs_per_sec / _total_nanos : 0;
+    }
+
+    uint64_t round_packets_per_sec() const {
+        return _total_round_nanos ?
+            _total_packets * rtcbase::k_num_nanosecs_per_sec / _total_round_nanos : 0;
+    }
+
+private:
+    rtcbase::Socket* _sender;
+    rtcbase::SocketAddress _addr;
+    int _rounds;
+    int _pending;
+    uint64_t _round_start;
+    uint64_t _send_start;
+    uint64_t _total_packets;
+    uint64_t _total_nanos;
+    uint64_t _total_round_nanos;
+    size_t _kept;
+    std::vector<std::unique_ptr<rtcbase::Buffer> > _copies;
+    std::vector<rtcbase::scoped_refptr<rtcbase::PacketBuffer> > _buffers;
+};
+
+static void bench_burst_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    static_cast<UdpRecvBench*>(data)->send_burst(el);
+    el->start_timer(w, 100);
+}
+
+static void bench_udp_recv(size_t batch_size, bool use_io_uring, KeepMode keep) {
+    rtcbase::EventLoop el(nullptr, false);
+    if (use_io_uring && !el.enable_io_uring(256)) {
+        return;
+    }
+    rtcbase::PhysicalSocketServer ss;
+    rtcbase::AsyncSocket* socket = ss.create_async_socket(AF_INET, SOCK_DGRAM);
+    socket->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+    socket->set_option(rtcbase::Socket::OPT_RCVBUF, 4 * 1024 * 1024);
+    std::unique_ptr<rtcbase::Socket> sender(ss.create_socket(AF_INET, SOCK_DGRAM));
+
+    rtcbase::AsyncUDPSocket udp_socket(&el, socket);
+    udp_socket.set_recv_batch_size(batch_size, 2048);
+    if (use_io_uring && udp_socket.enable_io_uring(512, 2048) != 0) {
+        return;
+    }
+    UdpRecvBench bench(sender.get(), udp_socket.get_local_address());
+    if (KEEP_POOLED == keep) {
+        udp_socket.set_packet_buffer_pool(rtcbase::PacketBufferPool::create(1500));
+        udp_socket.signal_read_packet_buffer.connect(&bench,
+                &UdpRecvBench::on_read_packet_buffer);
+    } else if (KEEP_COPY == keep) {
+        udp_socket.signal_read_packet.connect(&bench, &UdpRecvBench::on_read_packet_copy);
+    } else {
+        udp_socket.signal_read_packet.connect(&bench, &UdpRecvBench::on_read_packet);
+    }
+
+    rtcbase::TimerWatcher* timer = el.create_timer(bench_burst_cb, &bench, true);
+    el.start_timer(timer, 100);
+    el.run();
+    el.delete_timer(timer);
+
+    std::cout << "udp recv " << (use_io_uring ? "io_uring" : "batch_size=")
+        << (use_io_uring ? "" : std::to_string(batch_size))
+        << (KEEP_COPY == keep ? " copied" : (KEEP_POOLED == keep ? " pooled" : ""))
+        << ": " << bench.packets_per_sec() << " packets/sec, "
+        << bench.round_packets_per_sec() << " packets/sec with sends" << std::endl;
+}
+
+void test_udp_recv_batch_bench() {
+    bench_udp_recv(1, false, KEEP_NONE);
+    bench_udp_recv(32, false, KEEP_NONE);
+    bench_udp_recv(32, false, KEEP_COPY);
+    bench_udp_recv(32, false, KEEP_POOLED);
+    bench_udp_recv(1, true, KEEP_NONE);
+}
+
+static const int k_pacer_frames = 50;
+static const int k_pacer_frame_interval_ms = 20;
+static const int k_pacer_frame_packets = 10;
+static const size_t k_pacer_packet_size = 1000;
+
+// A 4 Mbps video like stream, a burst of packets every 20 ms, sent with and
+// without pacing. The receiver reports the largest number of packets that
+// arrived within any 2 ms.
+class PacedSendBench : public rtcbase::HasSlots<> {
+public:
+    PacedSendBench(rtcbase::AsyncPacketSocket* sender,
+            const rtcbase::SocketAddress& addr) :
+        _sender(sender), _addr(addr), _frames(0), _max_queue_depth(0) {}
+
+    void send_frame(rtcbase::EventLoop* el) {
+        if (++_frames > k_pacer_frames) {
+            if (0 == _max_queue_depth || 0 == queue_depth()) {
+                el->stop();
+            }
+            return;
+        }
+        char packet[k_pacer_packet_size] = {0};
+        rtcbase::PacketOptions options;
+        for (int i = 0; i < k_pacer_frame_packets; ++i) {
+            _sender->send_to(packet, sizeof(packet), _addr, options);
+        }
+        _max_queue_depth = std::max(_max_queue_depth, queue_depth());
+    }
+
+    void on_read_packet(rtcbase::AsyncPacketSocket*, const char*, size_t,
+            const rtcbase::SocketAddress&, const rtcbase::PacketTime&)
+    {
+        _arrivals.push_back(rtcbase::time_nanos());
+    }
+
+    size_t queue_depth() const {
+        rtcbase::PacedPacketSocket* paced =
+            dynamic_cast<rtcbase::PacedPacketSocket*>(_sender);
+        return paced ? paced->queue_depth() : 0;
+    }
+
+    size_t max_queue_depth() const { return _max_queue_depth; }
+    size_t received() const { return _arrivals.size(); }
+
+    size_t max_packets_per_2ms() const {
+        size_t max = 0;
+        size_t first = 0;
+        for (size_t i = 0; i < _arrivals.size(); ++i) {
+            while (_arrivals[i] - _arrivals[first] >= 2 * rtcbase::k_num_nanosecs_per_millisec) {
+                ++first;
+            }
+            max = std::max(max, i - first + 1);
+        }
+        return max;
+    }
+
+private:
+    rtcbase::AsyncPacketSocket* _sender;
+    rtcbase::SocketAddress _addr;
+    int _frames;
+    size_t _max_queue_depth;
+    std::vector<int64_t> _arrivals;
+};
+
+static void pacer_frame_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    static_cast<PacedSendBench*>(data)->send_frame(el);
+    el->start_timer(w, k_pacer_frame_interval_ms * 1000);
+}
+
+static void bench_paced_send(int64_t rate_bps) {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    rtcbase::AsyncSocket* socket = ss.create_async_socket(AF_INET, SOCK_DGRAM);
+    socket->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+    rtcbase::AsyncUDPSocket receiver(&el, socket);
+
+    socket = ss.create_async_socket(AF_INET, SOCK_DGRAM);
+    socket->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+    rtcbase::PacedPacketSocket sender(&el, new rtcbase::AsyncUDPSocket(&el, socket));
+    sender.set_rate(rate_bps);
+    rtcbase::AsyncPacketSocket* send_socket = rate_bps ? &sender : sender.socket();
+
+    PacedSendBench bench(send_socket, receiver.get_local_address());
+    receiver.signal_read_packet.connect(&bench, &PacedSendBench::on_read_packet);
+
+    rtcbase::TimerWatcher* timer = el.create_timer(pacer_frame_cb, &bench, false);
+    el.start_timer(timer, k_pacer_frame_interval_ms * 1000);
+    el.run();
+    el.delete_timer(timer);
+
+    rtcbase::Optional<uint32_t> rate = sender.send_rate();
+    std::cout << "paced send rate=" << rate_bps << " bps: received "
+        << bench.received() << " packets, max " << bench.max_packets_per_2ms()
+        << " packets in 2 ms, max queue depth " << bench.max_queue_depth()
+        << ", measured rate " << (rate ? *rate : 0) << " bps" << std::endl;
+}
+
+void test_paced_send_bench() {
+    bench_paced_send(0);
+    bench_paced_send(4800000);
+}
+
+static const int k_forward_rounds = 2000;
+static const int k_forward_burst = 64;
+static const size_t k_forward_header_size = 12;
+static const size_t k_forward_payload_size = 1200;
+static const size_t k_forward_tag_size = 10;
+
+enum ForwardMode {
+    FORWARD_CONCAT,  // Joins header, payload and tag for send_to().
+    FORWARD_IOV,     // Hands the three parts to send_to_v().
+    FORWARD_BUFFER   // Forwards a packet buffer as is, send_packet_buffer().
+};
+
+// A forwarding server sends bursts of RTP like packets, a header, a payload
+// and an authentication tag kept in separate buffers. Reported are the time
+// spent in the send calls, where the copies happen, and the time from the
+// first send of a burst until the socket signalled the last packet sent,
+// which the system calls dominate.
+class UdpForwardBench : public rtcbase::HasSlots<> {
+public:
+    UdpForwardBench(rtcbase::AsyncUDPSocket* sender,
+            const rtcbase::SocketAddress& addr, ForwardMode mode) :
+        _sender(sender), _addr(addr), _mode(mode), _rounds(0), _pending(0),
+        _round_start(0), _send_nanos(0), _total_nanos(0),
+        _header(k_forward_header_size, 'h'),
+        _payload(k_forward_payload_size, 'p'),
+        _tag(k_forward_tag_size, 't')
+    {
+        _packet = rtcbase::PacketBufferPool::create(2048)->allocate();
+        _packet->set_size(k_forward_header_size + k_forward_payload_size
+                + k_forward_tag_size);
+    }
+
+    void send_burst(rtcbase::EventLoop* el) {
+        if (_pending > 0) {
+            return;
+        }
+        if (++_rounds > k_forward_rounds) {
+            el->stop();
+            return;
+        }
+        _pending = k_forward_burst;
+        _round_start = rtcbase::time_nanos();
+        rtcbase::PacketOptions options;
+        for (int i = 0; i < k_forward_burst; ++i) {
+            if (FORWARD_BUFFER == _mode) {
+                _sender->send_packet_buffer(_packet, _addr, options);
+                continue;
+            }
+            struct iovec iov[3];
+            iov[0].iov_base = &_header[0];
+            iov[0].iov_len = _header.size();
+            iov[1].iov_base = &_payload[0];
+            iov[1].iov_len = _payload.size();
+            iov[2].iov_base = &_tag[0];
+            iov[2].iov_len = _tag.size();
+            if (FORWARD_IOV == _mode) {
+                _sender->send_to_v(iov, 3, _addr, options);
+            } else {
+                char packet[k_forward_header_size + k_forward_payload_size
+                    + k_forward_tag_size];
+                size_t size = rtcbase::iov_gather(packet, iov, 3);
+                _sender->send_to(packet, size, _addr, options);
+            }
+        }
+        _send_nanos += rtcbase::time_nanos() - _round_start;
+    }
+
+    void on_sent_packet(rtcbase::AsyncPacketSocket*, const rtcbase::SentPacket&) {
+        if (_pending > 0 && 0 == --_pending) {
+            _total_nanos += rtcbase::time_nanos() - _round_start;
+        }
+    }
+
+    uint64_t send_nanos_per_packet() const {
+        return _send_nanos / ((uint64_t)k_forward_rounds * k_forward_burst);
+    }
+    uint64_t nanos_per_packet() const {
+        return _total_nanos / ((uint64_t)k_forward_rounds * k_forward_burst);
+    }
+
+private:
+    rtcbase::AsyncUDPSocket* _sender;
+    rtcbase::SocketAddress _addr;
+    ForwardMode _mode;
+    int _rounds;
+    int _pending;
+    int64_t _round_start;
+    uint64_t _send_nanos;
+    uint64_t _total_nanos;
+    std::string _header;
+    std::string _payload;
+    std::string _tag;
+    rtcbase::scoped_refptr<rtcbase::PacketBuffer> _packet;
+};
+
+static void forward_burst_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    static_cast<UdpForwardBench*>(data)->send_burst(el);
+    el->start_timer(w, 100);
+}
+
+static void bench_udp_forward(ForwardMode mode, bool direct_send) {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    // Nobody reads the receiving socket, the kernel drops what does not fit.
+    std::unique_ptr<rtcbase::Socket> receiver(ss.create_socket(AF_INET, SOCK_DGRAM));
+    receiver->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+
+    rtcbase::AsyncSocket* socket = ss.create_async_socket(AF_INET, SOCK_DGRAM);
+    socket->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+    rtcbase::AsyncUDPSocket sender(&el, socket);
+    sender.set_direct_send(direct_send);
+
+    UdpForwardBench bench(&sender, receiver->get_local_address(), mode);
+    sender.signal_sent_packet.connect(&bench, &UdpForwardBench::on_sent_packet);
+
+    rtcbase::TimerWatcher* timer = el.create_timer(forward_burst_cb, &bench, false);
+    el.start_timer(timer, 100);
+    el.run();
+    el.delete_timer(timer);
+
+    static const char* k_mode_names[] = {"send_to", "send_to_v", "send_packet_buffer"};
+    std::cout << "udp forward " << k_mode_names[mode]
+        << (direct_send ? " direct" : " queued") << ": "
+        << bench.send_nanos_per_packet() << " ns/packet in send calls, "
+        << bench.nanos_per_packet() << " ns/packet until sent" << std::endl;
+}
+
+void test_udp_forward_bench() {
+    bench_udp_forward(FORWARD_CONCAT, false);
+    bench_udp_forward(FORWARD_IOV, false);
+    bench_udp_forward(FORWARD_BUFFER, false);
+    bench_udp_forward(FORWARD_CONCAT, true);
+    bench_udp_forward(FORWARD_IOV, true);
+}
+
+static const int k_stats_rounds = 1000;
+static const int k_stats_burst = 64;
+static const size_t k_stats_packet_size = 1200;
+static const int64_t k_stats_interval_ms = 100;
+
+// A loop thread sends bursts from one socket to another while a monitoring
+// thread prints the snapshots of both sockets' stats.
+struct StatsBench {
+    rtcbase::AsyncUDPSocket* sender;
+    rtcbase::AsyncUDPSocket* receiver;
+    rtcbase::SocketAddress addr;
+    std::string packet;
+    int rounds;
+};
+
+static void print_stats(const char* name, const rtcbase::SocketStats& stats) {
+    rtcbase::SocketStats::Snapshot s;
+    stats.snapshot(&s);
+    std::cout << name << ": sent " << s.packets_sent << " pkts " << s.send_bps
+        << " bps, received " << s.packets_received << " pkts " << s.recv_bps
+        << " bps, would block " << s.send_would_block
+        << ", queue " << s.send_queue_packets << " pkts, drops "
+        << s.send_queue_drops << "/" << s.recv_drops
+        << ", queue delay p50/p95/p99 " << s.queue_delay_p50_us << "/"
+        << s.queue_delay_p95_us << "/" << s.queue_delay_p99_us << " us" << std::endl;
+}
+
+static bool stats_monitor_run(void* data) {
+    StatsBench* bench = static_cast<StatsBench*>(data);
+    print_stats("sender", bench->sender->stats());
+    print_stats("receiver", bench->receiver->stats());
+    usleep(k_stats_interval_ms * 2 * 1000);
+    return true;
+}
+
+static void stats_burst_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    StatsBench* bench = static_cast<StatsBench*>(data);
+    if (++bench->rounds > k_stats_rounds) {
+        el->stop();
+        return;
+    }
+    rtcbase::PacketOptions options;
+    for (int i = 0; i < k_stats_burst; ++i) {
+        bench->sender->send_to(bench->packet.data(), bench->packet.size(),
+                bench->addr, options);
+    }
+    el->start_timer(w, 1000);
+}
+
+void test_socket_stats() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    rtcbase::AsyncSocket* socket = ss.create_async_socket(AF_INET, SOCK_DGRAM);
+    socket->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+    rtcbase::AsyncUDPSocket receiver(&el, socket);
+    receiver.set_recv_batch_size(32, 2048);
+    receiver.set_stats_interval(k_stats_interval_ms);
+
+    socket = ss.create_async_socket(AF_INET, SOCK_DGRAM);
+    socket->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+    rtcbase::AsyncUDPSocket sender(&el, socket);
+    sender.set_stats_interval(k_stats_interval_ms);
+
+    StatsBench bench;
+    bench.sender = &sender;
+    bench.receiver = &receiver;
+    bench.addr = receiver.get_local_address();
+    bench.packet.assign(k_stats_packet_size, 's');
+    bench.rounds = 0;
+
+    rtcbase::PlatformThread monitor(stats_monitor_run, &bench, "stats_monitor");
+    monitor.start();
+    rtcbase::TimerWatcher* timer = el.create_timer(stats_burst_cb, &bench, false);
+    el.start_timer(timer, 1000);
+    el.run();
+    el.delete_timer(timer);
+    monitor.stop();
+
+    sender.publish_stats();
+    receiver.publish_stats();
+    print_stats("sender", sender.stats());
+    print_stats("receiver", receiver.stats());
+
+    rtcbase::SocketStats::Snapshot s;
+    sender.stats().snapshot(&s);
+    // Whatever was not sent is still queued, dropped or failed.
+    assert(s.packets_sent + s.send_queue_packets + s.send_queue_drops + s.send_errors
+            == (uint64_t)k_stats_rounds * k_stats_burst);
+    assert(s.bytes_sent == s.packets_sent * k_stats_packet_size);
+    (void)s;
+}
+
+
+// Hands everything to a real socket and records what each send_to_batch()
+// call carried.
+class RecordingSocket : public rtcbase::AsyncSocket {
+public:
+    struct Batch {
+        std::vector<rtcbase::SocketAddress> addrs;
+        std::vector<int> segment_sizes;
+        std::vector<int> tos;
+    };
+
+    explicit RecordingSocket(rtcbase::AsyncSocket* socket) : _socket(socket) {}
+
+    rtcbase::SocketAddress get_local_address() const override {
+        return _socket->get_local_address();
+    }
+    int bind(const rtcbase::SocketAddress& addr) override {
+        return _socket->bind(addr);
+    }
+    int send_to(const void* pv, size_t cb, const rtcbase::SocketAddress& addr) override {
+        return _socket->send_to(pv, cb, addr);
+    }
+    int send_to_v(const struct iovec* iov, size_t iov_count,
+            const rtcbase::SocketAddress& addr) override
+    {
+        return _socket->send_to_v(iov, iov_count, addr);
+    }
+    int send_to_batch(const rtcbase::SendMessage* msgs, size_t count) override {
+        Batch batch;
+        for (size_t i = 0; i < count; ++i) {
+            batch.addrs.push_back(*msgs[i].addr);
+            batch.segment_sizes.push_back(msgs[i].segment_size);
+            batch.tos.push_back(msgs[i].tos);
+        }
+        batches.push_back(batch);
+        return _socket->send_to_batch(msgs, count);
+    }
+    int recv_from(void* pv, size_t cb, rtcbase::SocketAddress* paddr,
+            int64_t* timestamp) override
+    {
+        return _socket->recv_from(pv, cb, paddr, timestamp);
+    }
+    int recv_from_batch(rtcbase::ReceivedMessage* msgs, size_t count) override {
+        int received = _socket->recv_from_batch(msgs, count);
+        for (int i = 0; i < received; ++i) {
+            received_sizes.push_back(msgs[i].received);
+            received_segment_sizes.push_back(msgs[i].segment_size);
+        }
+        return received;
+    }
+    int close() override { return _socket->close(); }
+    int get_error() const override { return _socket->get_error(); }
+    void set_error(int error) override { _socket->set_error(error); }
+    int get_option(Option opt, int* value) override {
+        return _socket->get_option(opt, value);
+    }
+    int set_option(Option opt, int value) override {
+        return _socket->set_option(opt, value);
+    }
+    int get_fd() override { return _socket->get_fd(); }
+
+    std::vector<Batch> batches;
+    // Per datagram returned by recv_from_batch().
+    std::vector<int> received_sizes;
+    std::vector<int> received_segment_sizes;
+
+private:
+    std::unique_ptr<rtcbase::AsyncSocket> _socket;
+};
+
+// Stops the loop once |expected| packets were sent, or after a second.
+class SentCounter : public rtcbase::HasSlots<> {
+public:
+    explicit SentCounter(size_t expected) : sent(0), ticks(0), _expected(expected) {}
+
+    void on_sent_packet(rtcbase::AsyncPacketSocket*, const rtcbase::SentPacket&) {
+        ++sent;
+    }
+
+    static void check_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+        SentCounter* counter = static_cast<SentCounter*>(data);
+        if (counter->sent >= counter->_expected || ++counter->ticks > 1000) {
+            el->stop();
+            return;
+        }
+        el->start_timer(w, 1000);
+    }
+
+    size_t sent;
+    int ticks;
+
+private:
+    size_t _expected;
+};
+
+static rtcbase::AsyncSocket* bound_socket(rtcbase::PhysicalSocketServer* ss) {
+    rtcbase::AsyncSocket* socket = ss->create_async_socket(AF_INET, SOCK_DGRAM);
+    socket->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+    return socket;
+}
+
+// Reads the ids sent to |socket| and checks they arrived in order.
+static void check_received_ids(rtcbase::AsyncSocket* socket, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t id = 0;
+        rtcbase::SocketAddress addr;
+        int64_t timestamp;
+        int len = socket->recv_from(&id, sizeof(id), &addr, &timestamp);
+        assert(sizeof(id) == (size_t)len);
+        assert(i == id);
+        (void)len;
+    }
+    char extra[16];
+    rtcbase::SocketAddress addr;
+    int64_t timestamp;
+    // Nothing else is pending, which the socket reports as 0 bytes.
+    assert(0 == socket->recv_from(extra, sizeof(extra), &addr, &timestamp));
+    (void)extra;
+}
+
+static const uint32_t k_flush_bulk_packets = 100;
+static const uint32_t k_flush_few_packets = 5;
+
+void test_udp_send_flush() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    std::unique_ptr<rtcbase::AsyncSocket> receivers[3];
+    rtcbase::SocketAddress addrs[3];
+    for (int i = 0; i < 3; ++i) {
+        receivers[i].reset(bound_socket(&ss));
+        addrs[i] = receivers[i]->get_local_address();
+    }
+    RecordingSocket* recorder = new RecordingSocket(bound_socket(&ss));
+    rtcbase::AsyncUDPSocket sender(&el, recorder);
+    SentCounter counter(k_flush_bulk_packets + 2 * k_flush_few_packets);
+    sender.signal_sent_packet.connect(&counter, &SentCounter::on_sent_packet);
+
+    // Everything is queued before the loop runs, the first write event
+    // flushes it with as few sendmmsg() calls as the batch size allows.
+    rtcbase::PacketOptions options;
+    for (uint32_t id = 0; id < k_flush_bulk_packets; ++id) {
+        assert(sizeof(id) == (size_t)sender.send_to(&id, sizeof(id), addrs[0], options));
+    }
+    for (uint32_t id = 0; id < k_flush_few_packets; ++id) {
+        sender.send_to(&id, sizeof(id), addrs[1], options);
+        sender.send_to(&id, sizeof(id), addrs[2], options);
+    }
+    assert(0 == recorder->batches.size());
+
+    rtcbase::TimerWatcher* timer = el.create_timer(SentCounter::check_cb, &counter, false);
+    el.start_timer(timer, 1000);
+    el.run();
+    el.delete_timer(timer);
+
+    assert(k_flush_bulk_packets + 2 * k_flush_few_packets == counter.sent);
+    assert(counter.sent == sender.queued_packets());
+    // 110 packets in batches of 64.
+    assert(2 == recorder->batches.size());
+    const std::vector<rtcbase::SocketAddress>& first = recorder->batches[0].addrs;
+    assert(64 == first.size());
+    assert(46 == recorder->batches[1].addrs.size());
+    // One packet of each destination per round while all three have some,
+    // the bulk destination does not hold back the others.
+    for (size_t i = 0; i < 3 * k_flush_few_packets; ++i) {
+        assert(first[i] == first[i % 3]);
+        assert(first[i] != first[(i + 1) % 3]);
+    }
+    for (size_t i = 3 * k_flush_few_packets; i < first.size(); ++i) {
+        assert(addrs[0] == first[i]);
+    }
+    for (size_t i = 0; i < recorder->batches[1].addrs.size(); ++i) {
+        assert(addrs[0] == recorder->batches[1].addrs[i]);
+    }
+
+    check_received_ids(receivers[0].get(), k_flush_bulk_packets);
+    check_received_ids(receivers[1].get(), k_flush_few_packets);
+    check_received_ids(receivers[2].get(), k_flush_few_packets);
+    std::cout << "udp send flush: ok" << std::endl;
+}
+
+void test_udp_send_queue_limits() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    std::unique_ptr<rtcbase::AsyncSocket> receiver(bound_socket(&ss));
+    rtcbase::SocketAddress addr = receiver->get_local_address();
+    rtcbase::AsyncUDPSocket sender(&el, bound_socket(&ss));
+    rtcbase::PacketOptions options;
+
+    // Unbounded unless asked for, the loop does not run so all of them wait.
+    const uint32_t k_unbounded_packets = 20000;
+    for (uint32_t id = 0; id < k_unbounded_packets; ++id) {
+        assert(sizeof(id) == (size_t)sender.send_to(&id, sizeof(id), addr, options));
+    }
+    rtcbase::UdpSendQueue::Stats stats;
+    sender.get_send_queue_stats(&stats);
+    assert(k_unbounded_packets == stats.packets);
+
+    // Over the bound the newest packet is dropped and reported like a full
+    // socket buffer.
+    sender.set_send_queue_limits(k_unbounded_packets, 0,
+            rtcbase::UdpSendQueue::DROP_NEWEST);
+    uint32_t id = k_unbounded_packets;
+    assert(-1 == sender.send_to(&id, sizeof(id), addr, options));
+    assert(EWOULDBLOCK == sender.get_error());
+    sender.get_send_queue_stats(&stats);
+    assert(k_unbounded_packets == stats.packets);
+    assert(1 == stats.dropped_packets[rtcbase::PRIORITY_NORMAL]);
+
+    rtcbase::SocketStats::Snapshot s;
+    sender.publish_stats();
+    sender.stats().snapshot(&s);
+    assert(1 == s.send_queue_drops);
+    (void)s;
+    std::cout << "udp send queue limits: ok" << std::endl;
+}
+
+static void stop_loop_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher*, void*) {
+    el->stop();
+}
+
+// Runs |el| until something stops it, at most |timeout_ms|.
+static void run_loop(rtcbase::EventLoop* el, int timeout_ms) {
+    rtcbase::TimerWatcher* timer = el->create_timer(stop_loop_cb, nullptr, false);
+    el->start_timer(timer, timeout_ms * 1000);
+    el->run();
+    el->delete_timer(timer);
+}
+
+// Keeps the packets a socket signals and stops the loop once |expected|
+// arrived.
+class PacketCollector : public rtcbase::HasSlots<> {
+public:
+    PacketCollector(rtcbase::EventLoop* el, size_t expected) :
+        _el(el), _expected(expected) {}
+
+    void on_read_packet(rtcbase::AsyncPacketSocket*, const char* data, size_t size,
+            const rtcbase::SocketAddress&, const rtcbase::PacketTime& packet_time)
+    {
+        packets.push_back(std::string(data, size));
+        packet_times.push_back(packet_time);
+        delivery_times.push_back(rtcbase::time_micros());
+        if (packets.size() >= _expected) {
+            _el->stop();
+        }
+    }
+
+    void on_read_packet_buffer(rtcbase::AsyncPacketSocket* socket,
+            const rtcbase::scoped_refptr<rtcbase::PacketBuffer>& buffer,
+            const rtcbase::SocketAddress& addr, const rtcbase::PacketTime& packet_time)
+    {
+        on_read_packet(socket, reinterpret_cast<const char*>(buffer->data()),
+                buffer->size(), addr, packet_time);
+    }
+
+    std::vector<std::string> packets;
+    std::vector<rtcbase::PacketTime> packet_times;
+    std::vector<int64_t> delivery_times;
+
+private:
+    rtcbase::EventLoop* _el;
+    size_t _expected;
+};
+
+// |size| bytes, the id up front and a filler that differs between ids.
+static std::string make_packet(uint32_t id, size_t size) {
+    std::string packet(size, static_cast<char>('a' + id % 26));
+    memcpy(&packet[0], &id, std::min(sizeof(id), size));
+    return packet;
+}
+
+static const size_t k_gso_segment_size = 1000;
+static const uint32_t k_gso_packets = 10;
+static const size_t k_gso_last_size = 600;
+
+// Queued packets of one size to one destination leave as a single UDP GSO
+// send, a plain receiver still gets them one by one.
+static void check_gso_send() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    std::unique_ptr<rtcbase::AsyncSocket> receiver(bound_socket(&ss));
+    rtcbase::SocketAddress addr = receiver->get_local_address();
+    RecordingSocket* recorder = new RecordingSocket(bound_socket(&ss));
+    rtcbase::AsyncUDPSocket sender(&el, recorder);
+    if (sender.set_option(rtcbase::Socket::OPT_UDP_SEGMENT, 1) != 0) {
+        std::cout << "udp gso send: not supported, skipped" << std::endl;
+        return;
+    }
+
+    std::vector<std::string> sent;
+    for (uint32_t id = 0; id <= k_gso_packets; ++id) {
+        sent.push_back(make_packet(id,
+                    id < k_gso_packets ? k_gso_segment_size : k_gso_last_size));
+    }
+    rtcbase::PacketOptions options;
+    for (size_t i = 0; i < sent.size(); ++i) {
+        sender.send_to(sent[i].data(), sent[i].size(), addr, options);
+    }
+    SentCounter counter(sent.size());
+    sender.signal_sent_packet.connect(&counter, &SentCounter::on_sent_packet);
+    rtcbase::TimerWatcher* timer = el.create_timer(SentCounter::check_cb, &counter, false);
+    el.start_timer(timer, 1000);
+    el.run();
+    el.delete_timer(timer);
+    assert(sent.size() == counter.sent);
+
+    // One message, the shorter packet ends the run.
+    assert(1 == recorder->batches.size());
+    assert(1 == recorder->batches[0].segment_sizes.size());
+    assert((int)k_gso_segment_size == recorder->batches[0].segment_sizes[0]);
+
+    for (size_t i = 0; i < sent.size(); ++i) {
+        char buf[2048];
+        rtcbase::SocketAddress from;
+        int64_t timestamp;
+        int len = receiver->recv_from(buf, sizeof(buf), &from, &timestamp);
+        assert(sent[i].size() == (size_t)len);
+        assert(0 == memcmp(buf, sent[i].data(), len));
+        (void)len;
+    }
+    std::cout << "udp gso send: ok" << std::endl;
+}
+
+// A coalesced receive is split back into the datagrams that were sent, the
+// last one shorter.
+static void check_gro_receive() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    RecordingSocket* recorder = new RecordingSocket(bound_socket(&ss));
+    rtcbase::AsyncUDPSocket receiver(&el, recorder);
+    if (receiver.set_option(rtcbase::Socket::OPT_UDP_GRO, 1) != 0) {
+        std::cout << "udp gro receive: not supported, skipped" << std::endl;
+        return;
+    }
+    PacketCollector collector(&el, k_gso_packets + 1);
+    receiver.signal_read_packet.connect(&collector, &PacketCollector::on_read_packet);
+
+    std::string payload;
+    for (uint32_t id = 0; id <= k_gso_packets; ++id) {
+        payload += make_packet(id,
+                id < k_gso_packets ? k_gso_segment_size : k_gso_last_size);
+    }
+    std::unique_ptr<rtcbase::AsyncSocket> sender(bound_socket(&ss));
+    rtcbase::SocketAddress addr = receiver.get_local_address();
+    rtcbase::SendMessage msg;
+    msg.data = payload.data();
+    msg.size = payload.size();
+    msg.addr = &addr;
+    msg.segment_size = k_gso_segment_size;
+    if (sender->send_to_batch(&msg, 1) != 1) {
+        std::cout << "udp gro receive: gso send failed, skipped" << std::endl;
+        return;
+    }
+    run_loop(&el, 1000);
+
+    // The kernel handed over the whole send at once.
+    assert(1 == recorder->received_sizes.size());
+    assert((int)payload.size() == recorder->received_sizes[0]);
+    assert((int)k_gso_segment_size == recorder->received_segment_sizes[0]);
+
+    assert(k_gso_packets + 1 == collector.packets.size());
+    for (uint32_t id = 0; id <= k_gso_packets; ++id) {
+        assert(make_packet(id, id < k_gso_packets ? k_gso_segment_size : k_gso_last_size)
+                == collector.packets[id]);
+    }
+    std::cout << "udp gro receive: ok" << std::endl;
+}
+
+void test_udp_gso_gro() {
+    check_gso_send();
+    check_gro_receive();
+}
+
+static const int64_t k_timestamp_wait_us = 20000;
+
+// The receive time of a packet is the kernel's arrival stamp moved onto the
+// time_micros() clock, not the time the loop got to read it.
+void test_udp_recv_timestamp() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    rtcbase::AsyncUDPSocket receiver(&el, bound_socket(&ss));
+    PacketCollector collector(&el, 1);
+    receiver.signal_read_packet.connect(&collector, &PacketCollector::on_read_packet);
+    std::unique_ptr<rtcbase::AsyncSocket> sender(bound_socket(&ss));
+    std::unique_ptr<rtcbase::AsyncSocket> plain(bound_socket(&ss));
+
+    int64_t send_time = rtcbase::time_micros();
+    uint32_t id = 1;
+    sender->send_to(&id, sizeof(id), receiver.get_local_address());
+    sender->send_to(&id, sizeof(id), plain->get_local_address());
+    // The packets wait in the socket buffers before anyone reads them.
+    usleep(k_timestamp_wait_us);
+    run_loop(&el, 1000);
+
+    assert(1 == collector.packet_times.size());
+    int64_t timestamp = collector.packet_times[0].timestamp;
+    // Loopback delivery is immediate, allow for scheduling noise.
+    assert(timestamp >= send_time - 1000);
+    assert(timestamp < send_time + k_timestamp_wait_us / 2);
+    assert(collector.delivery_times[0] - timestamp >= k_timestamp_wait_us);
+
+    // Same for a plain read.
+    int64_t plain_timestamp = -1;
+    rtcbase::SocketAddress from;
+    assert(sizeof(id) == (size_t)plain->recv_from(&id, sizeof(id), &from,
+                &plain_timestamp));
+    assert(plain_timestamp >= send_time - 1000);
+    assert(plain_timestamp < send_time + k_timestamp_wait_us / 2);
+    (void)timestamp;
+    (void)plain_timestamp;
+    std::cout << "udp recv timestamp: ok" << std::endl;
+}
+
+// Sends one packet per marking from |sender| and reads the traffic class
+// byte of each on |receiver|.
+static void check_marking(rtcbase::AsyncUDPSocket* sender, rtcbase::EventLoop* el,
+        rtcbase::AsyncSocket* receiver)
+{
+    static const rtcbase::DiffServCodePoint k_dscps[] = {
+        rtcbase::DSCP_EF, rtcbase::DSCP_AF41, rtcbase::DSCP_NO_CHANGE
+    };
+    static const rtcbase::EcnCodepoint k_ecns[] = {
+        rtcbase::ECN_ECT1, rtcbase::ECN_NO_CHANGE, rtcbase::ECN_ECT0
+    };
+    rtcbase::SocketAddress addr = receiver->get_local_address();
+    for (uint32_t id = 0; id < 3; ++id) {
+        rtcbase::PacketOptions options(k_dscps[id]);
+        options.ecn = k_ecns[id];
+        sender->send_to(&id, sizeof(id), addr, options);
+    }
+    // Queued packets leave on the next write event.
+    run_loop(el, 20);
+
+    char bufs[3][16];
+    rtcbase::ReceivedMessage msgs[3];
+    for (int i = 0; i < 3; ++i) {
+        msgs[i].buffer = bufs[i];
+        msgs[i].length = sizeof(bufs[i]);
+    }
+    assert(3 == receiver->recv_from_batch(msgs, 3));
+    // EF with ECT(1), AF41 not ECN capable, the socket's DSCP with ECT(0).
+    assert(((rtcbase::DSCP_EF << 2) | rtcbase::ECN_ECT1) == msgs[0].tos);
+    assert((rtcbase::DSCP_AF41 << 2) == msgs[1].tos);
+    assert(((rtcbase::DSCP_CS1 << 2) | rtcbase::ECN_ECT0) == msgs[2].tos);
+}
+
+void test_udp_packet_marking() {
+    static const char* k_hosts[] = {"127.0.0.1", "::1"};
+    for (int h = 0; h < 2; ++h) {
+        rtcbase::EventLoop el(nullptr, false);
+        rtcbase::PhysicalSocketServer ss;
+        int family = (0 == h) ? AF_INET : AF_INET6;
+        rtcbase::AsyncSocket* socket = ss.create_async_socket(family, SOCK_DGRAM);
+        if (socket->bind(rtcbase::SocketAddress(k_hosts[h], 0)) != 0) {
+            std::cout << "udp packet marking " << k_hosts[h]
+                << ": not available, skipped" << std::endl;
+            delete socket;
+            continue;
+        }
+        std::unique_ptr<rtcbase::AsyncSocket> receiver(socket);
+        socket = ss.create_async_socket(family, SOCK_DGRAM);
+        socket->bind(rtcbase::SocketAddress(k_hosts[h], 0));
+        rtcbase::AsyncUDPSocket sender(&el, socket);
+        sender.set_option(rtcbase::Socket::OPT_DSCP, rtcbase::DSCP_CS1);
+
+        check_marking(&sender, &el, receiver.get());
+        sender.set_direct_send(true);
+        check_marking(&sender, &el, receiver.get());
+
+        // AsyncUDPSocket reports the ECN field of what it receives.
+        rtcbase::AsyncUDPSocket marked_receiver(&el, receiver.release());
+        PacketCollector collector(&el, 1);
+        marked_receiver.signal_read_packet.connect(&collector,
+                &PacketCollector::on_read_packet);
+        rtcbase::PacketOptions options;
+        options.ecn = rtcbase::ECN_CE;
+        uint32_t id = 0;
+        sender.send_to(&id, sizeof(id), marked_receiver.get_local_address(), options);
+        run_loop(&el, 1000);
+        assert(1 == collector.packet_times.size());
+        assert(rtcbase::ECN_CE == collector.packet_times[0].ecn);
+        std::cout << "udp packet marking " << k_hosts[h] << ": ok" << std::endl;
+    }
+}
+
+static const uint32_t k_uring_packets = 64;
+static const size_t k_uring_buffers = 16;
+static const size_t k_uring_max_packet_size = 2048;
+
+// Sends every packet it reads back to where it came from.
+class EchoSocket : public rtcbase::HasSlots<> {
+public:
+    void on_read_packet(rtcbase::AsyncPacketSocket* socket, const char* data,
+            size_t size, const rtcbase::SocketAddress& addr, const rtcbase::PacketTime&)
+    {
+        socket->send_to(data, size, addr, rtcbase::PacketOptions());
+    }
+};
+
+// Both ends receive with the multishot recvmsg and send through the ring,
+// with more packets in flight than the receiver has provided buffers.
+void test_udp_io_uring() {
+    rtcbase::EventLoop el(nullptr, false);
+    if (!el.enable_io_uring(256)) {
+        std::cout << "udp io_uring: not supported, skipped" << std::endl;
+        return;
+    }
+    rtcbase::PhysicalSocketServer ss;
+    rtcbase::AsyncUDPSocket client(&el, bound_socket(&ss));
+    rtcbase::AsyncUDPSocket server(&el, bound_socket(&ss));
+    if (client.enable_io_uring(k_uring_buffers, k_uring_max_packet_size) != 0 ||
+            server.enable_io_uring(k_uring_buffers, k_uring_max_packet_size) != 0)
+    {
+        std::cout << "udp io_uring: recvmsg multishot not supported, skipped"
+            << std::endl;
+        return;
+    }
+    assert(client.io_uring_enabled() && server.io_uring_enabled());
+    EchoSocket echo;
+    server.signal_read_packet.connect(&echo, &EchoSocket::on_read_packet);
+    PacketCollector collector(&el, k_uring_packets);
+    client.signal_read_packet.connect(&collector, &PacketCollector::on_read_packet);
+
+    std::vector<std::string> sent;
+    rtcbase::PacketOptions options;
+    for (uint32_t id = 0; id < k_uring_packets; ++id) {
+        sent.push_back(make_packet(id, 100 + id * 20));
+        assert((int)sent.back().size() == client.send_to(sent.back().data(),
+                    sent.back().size(), server.get_local_address(), options));
+    }
+    run_loop(&el, 1000);
+
+    // Loopback keeps the order, both ways.
+    assert(sent == collector.packets);
+    std::cout << "udp io_uring: ok" << std::endl;
+}
+
+// The packets of flows in the table, as seen by flow_cb.
+struct FlowPackets {
+    rtcbase::AsyncUDPSocket* socket;
+    std::vector<std::string> packets;
+    std::vector<void*> flow_data;
+    std::vector<bool> buffered;
+};
+
+static FlowPackets* g_flow_packets = NULL;
+
+static void flow_packet_cb(rtcbase::AsyncUDPSocket* socket, const char* data,
+        size_t size, const rtcbase::SocketAddress&, const rtcbase::PacketTime&,
+        rtcbase::PacketBuffer* buffer, void* flow_data)
+{
+    assert(socket == g_flow_packets->socket);
+    g_flow_packets->packets.push_back(std::string(data, size));
+    g_flow_packets->flow_data.push_back(flow_data);
+    g_flow_packets->buffered.push_back(buffer != NULL);
+    (void)socket;
+}
+
+// Sends |id| from both |known| and |unknown| and runs the loop until the
+// signal side got its packet.
+static void send_flow_round(rtcbase::EventLoop* el, rtcbase::AsyncSocket* known,
+        rtcbase::AsyncSocket* unknown, const rtcbase::SocketAddress& addr, uint32_t id)
+{
+    known->send_to(&id, sizeof(id), addr);
+    unknown->send_to(&id, sizeof(id), addr);
+    run_loop(el, 1000);
+}
+
+// Packets of a known source go to the flow callback with their flow's data,
+// the signals only see the others.
+void test_udp_flow_dispatch() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    rtcbase::AsyncUDPSocket receiver(&el, bound_socket(&ss));
+    std::unique_ptr<rtcbase::AsyncSocket> known(bound_socket(&ss));
+    std::unique_ptr<rtcbase::AsyncSocket> unknown(bound_socket(&ss));
+    rtcbase::SocketAddress addr = receiver.get_local_address();
+
+    int session = 0;
+    rtcbase::FlowTable table;
+    table.insert(known->get_local_address(), &session);
+    FlowPackets flows;
+    flows.socket = &receiver;
+    g_flow_packets = &flows;
+    receiver.set_flow_table(&table, flow_packet_cb);
+    assert(&table == receiver.flow_table());
+
+    PacketCollector collector(&el, 1);
+    receiver.signal_read_packet.connect(&collector, &PacketCollector::on_read_packet);
+    send_flow_round(&el, known.get(), unknown.get(), addr, 0);
+    // The loop stops on the unknown source's packet, the known one may be
+    // read in the same batch or the next.
+    for (int i = 0; i < 10 && flows.packets.empty(); ++i) {
+        run_loop(&el, 1);
+    }
+    assert(1 == flows.packets.size());
+    assert(make_packet(0, sizeof(uint32_t)) == flows.packets[0]);
+    assert(&session == flows.flow_data[0]);
+    assert(!flows.buffered[0]);
+    assert(1 == collector.packets.size());
+
+    // Same with a packet buffer pool, the callback gets the buffer.
+    receiver.set_packet_buffer_pool(rtcbase::PacketBufferPool::create(1500));
+    PacketCollector pooled(&el, 1);
+    receiver.signal_read_packet_buffer.connect(&pooled,
+            &PacketCollector::on_read_packet_buffer);
+    send_flow_round(&el, known.get(), unknown.get(), addr, 1);
+    for (int i = 0; i < 10 && flows.packets.size() < 2; ++i) {
+        run_loop(&el, 1);
+    }
+    assert(2 == flows.packets.size());
+    assert(make_packet(1, sizeof(uint32_t)) == flows.packets[1]);
+    assert(flows.buffered[1]);
+    assert(1 == pooled.packets.size());
+    receiver.set_packet_buffer_pool(NULL);
+
+    // An erased flow is an unknown source again.
+    assert(table.erase(known->get_local_address()));
+    receiver.signal_read_packet.disconnect(&collector);
+    PacketCollector both(&el, 2);
+    receiver.signal_read_packet.connect(&both, &PacketCollector::on_read_packet);
+    send_flow_round(&el, known.get(), unknown.get(), addr, 2);
+    assert(2 == both.packets.size());
+    assert(2 == flows.packets.size());
+
+    receiver.set_flow_table(NULL, NULL);
+    g_flow_packets = NULL;
+    std::cout << "udp flow dispatch: ok" << std::endl;
+}
+
+static const uint32_t k_counted_packets = 50;
+static const size_t k_counted_packet_size = 300;
+static const int64_t k_counted_queue_us = 5000;
+
+// Queues a round of packets while the loop does not run, so each waits at
+// least k_counted_queue_us, then runs the loop until |collector| has them.
+static void send_counted_round(rtcbase::EventLoop* el, rtcbase::AsyncUDPSocket* sender,
+        const rtcbase::SocketAddress& addr, PacketCollector* collector, uint32_t first)
+{
+    rtcbase::PacketOptions options;
+    for (uint32_t id = first; id < first + k_counted_packets; ++id) {
+        std::string packet = make_packet(id, k_counted_packet_size);
+        sender->send_to(packet.data(), packet.size(), addr, options);
+    }
+    usleep(k_counted_queue_us);
+    run_loop(el, 1000);
+    assert(first + k_counted_packets == collector->packets.size());
+}
+
+// Exact counters on both ends, rates and queueing delays once published,
+// and nothing left behind when the rates are turned off.
+void test_udp_socket_stats() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    rtcbase::AsyncUDPSocket receiver(&el, bound_socket(&ss));
+    rtcbase::AsyncUDPSocket sender(&el, bound_socket(&ss));
+    // Long enough for the timer to never publish on its own.
+    receiver.set_stats_interval(60 * 1000);
+    sender.set_stats_interval(60 * 1000);
+    PacketCollector collector(&el, 2 * k_counted_packets);
+    receiver.signal_read_packet.connect(&collector, &PacketCollector::on_read_packet);
+
+    rtcbase::SocketStats::Snapshot s;
+    sender.stats().snapshot(&s);
+    assert(-1 == s.publish_time_ms && 0 == s.packets_sent);
+
+    // Two rounds a few milliseconds apart, so the rates span a window.
+    send_counted_round(&el, &sender, receiver.get_local_address(), &collector, 0);
+    send_counted_round(&el, &sender, receiver.get_local_address(), &collector,
+            k_counted_packets);
+    sender.publish_stats();
+    receiver.publish_stats();
+
+    sender.stats().snapshot(&s);
+    assert(2 * k_counted_packets == s.packets_sent);
+    assert(2 * k_counted_packets * k_counted_packet_size == s.bytes_sent);
+    assert(0 == s.packets_received && 0 == s.bytes_received);
+    assert(0 == s.send_would_block && 0 == s.send_errors && 0 == s.send_queue_drops);
+    assert(s.publish_time_ms >= 0);
+    assert(0 == s.send_queue_packets && 0 == s.send_queue_bytes);
+    assert(s.send_bps > 0 && 0 == s.recv_bps);
+    // Every sampled packet waited in the queue while the loop slept.
+    assert(s.queue_delay_p50_us >= k_counted_queue_us);
+    assert(s.queue_delay_p50_us <= s.queue_delay_p95_us);
+    assert(s.queue_delay_p95_us <= s.queue_delay_p99_us);
+
+    receiver.stats().snapshot(&s);
+    assert(2 * k_counted_packets == s.packets_received);
+    assert(2 * k_counted_packets * k_counted_packet_size == s.bytes_received);
+    assert(0 == s.packets_sent && 0 == s.recv_drops);
+    assert(s.recv_bps > 0 && 0 == s.send_bps);
+
+    // Turned off, the counters stay and the published rates and delays go.
+    sender.set_stats_interval(0);
+    sender.publish_stats();
+    sender.stats().snapshot(&s);
+    assert(2 * k_counted_packets == s.packets_sent);
+    assert(0 == s.send_bps && 0 == s.recv_bps);
+    assert(0 == s.queue_delay_p50_us && 0 == s.queue_delay_p95_us
+            && 0 == s.queue_delay_p99_us);
+    (void)s;
+    std::cout << "udp socket stats: ok" << std::endl;
+}
+
+static const size_t k_paced_packets = 50;
+static const int64_t k_paced_rate_bps = 4000000;
+static const int64_t k_paced_slow_rate_bps = 2000000;
+// What the pacer may let through at once: its 10 ms burst window, or an
+// MTU for slow rates, plus the packet already in flight.
+static const size_t k_paced_burst_bytes = 5000 + 1500;
+
+// Records when packets arrive at one receiver.
+class PacedArrivals : public rtcbase::HasSlots<> {
+public:
+    void on_read_packet(rtcbase::AsyncPacketSocket*, const char*, size_t size,
+            const rtcbase::SocketAddress&, const rtcbase::PacketTime&)
+    {
+        bytes += size;
+        last_ns = rtcbase::time_nanos();
+        ++packets;
+    }
+
+    size_t packets = 0;
+    size_t bytes = 0;
+    uint64_t last_ns = 0;
+};
+
+// Stops the loop once the pacer has released everything and the receivers
+// got all of it.
+struct PacedDrain {
+    rtcbase::PacedPacketSocket* sender;
+    std::vector<PacedArrivals*> arrivals;
+    size_t expected;
+};
+
+static void paced_drain_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    PacedDrain* drain = static_cast<PacedDrain*>(data);
+    size_t received = 0;
+    for (size_t i = 0; i < drain->arrivals.size(); ++i) {
+        received += drain->arrivals[i]->packets;
+    }
+    if (0 == drain->sender->queue_depth() && received >= drain->expected) {
+        el->stop();
+        return;
+    }
+    el->start_timer(w, 1000);
+}
+
+static void run_paced(rtcbase::EventLoop* el, PacedDrain* drain) {
+    rtcbase::TimerWatcher* timer = el->create_timer(paced_drain_cb, drain, false);
+    el->start_timer(timer, 1000);
+    rtcbase::TimerWatcher* timeout = el->create_timer(stop_loop_cb, nullptr, false);
+    el->start_timer(timeout, 5 * 1000 * 1000);
+    el->run();
+    el->delete_timer(timeout);
+    el->delete_timer(timer);
+}
+
+static rtcbase::AsyncUDPSocket* paced_receiver(rtcbase::EventLoop* el,
+        rtcbase::PhysicalSocketServer* ss, PacedArrivals* arrivals)
+{
+    rtcbase::AsyncUDPSocket* receiver = new rtcbase::AsyncUDPSocket(el, bound_socket(ss));
+    receiver->signal_read_packet.connect(arrivals, &PacedArrivals::on_read_packet);
+    return receiver;
+}
+
+// No faster than the rate allows, past the initial burst.
+static void check_paced_duration(uint64_t start_ns, const PacedArrivals& arrivals,
+        int64_t rate_bps)
+{
+    assert(k_paced_packets == arrivals.packets);
+    assert(k_paced_packets * k_pacer_packet_size == arrivals.bytes);
+    uint64_t min_ns = (arrivals.bytes - k_paced_burst_bytes) * 8 *
+        rtcbase::k_num_nanosecs_per_sec / rate_bps;
+    assert(arrivals.last_ns - start_ns >= min_ns);
+    (void)start_ns;
+    (void)min_ns;
+    (void)rate_bps;
+}
+
+// The socket wide rate spreads a burst out over time.
+static void check_paced_rate() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    PacedArrivals arrivals;
+    std::unique_ptr<rtcbase::AsyncUDPSocket> receiver(paced_receiver(&el, &ss, &arrivals));
+    rtcbase::PacedPacketSocket sender(&el, new rtcbase::AsyncUDPSocket(&el, bound_socket(&ss)));
+    sender.set_rate(k_paced_rate_bps);
+
+    char packet[k_pacer_packet_size] = {0};
+    rtcbase::PacketOptions options;
+    uint64_t start_ns = rtcbase::time_nanos();
+    for (size_t i = 0; i < k_paced_packets; ++i) {
+        int sent = sender.send_to(packet, sizeof(packet), receiver->get_local_address(),
+                options);
+        assert((int)sizeof(packet) == sent);
+        (void)sent;
+    }
+    // Most of the burst waits for tokens.
+    assert(sender.queue_depth() > k_paced_packets / 2);
+    assert(sender.queue_depth() == sender.queue_depth(receiver->get_local_address()));
+
+    PacedDrain drain = {&sender, {&arrivals}, k_paced_packets};
+    run_paced(&el, &drain);
+    check_paced_duration(start_ns, arrivals, k_paced_rate_bps);
+    assert(0 == sender.queue_depth());
+    assert(0 == sender.queued_bytes());
+    assert(0 == sender.dropped_packets());
+}
+
+// A destination with its own rate is held to it while the others are not.
+static void check_paced_destination_rate() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    PacedArrivals slow_arrivals;
+    PacedArrivals fast_arrivals;
+    std::unique_ptr<rtcbase::AsyncUDPSocket> slow(paced_receiver(&el, &ss, &slow_arrivals));
+    std::unique_ptr<rtcbase::AsyncUDPSocket> fast(paced_receiver(&el, &ss, &fast_arrivals));
+    rtcbase::PacedPacketSocket sender(&el, new rtcbase::AsyncUDPSocket(&el, bound_socket(&ss)));
+    sender.set_destination_rate(slow->get_local_address(), k_paced_slow_rate_bps);
+
+    char packet[k_pacer_packet_size] = {0};
+    rtcbase::PacketOptions options;
+    uint64_t start_ns = rtcbase::time_nanos();
+    for (size_t i = 0; i < k_paced_packets; ++i) {
+        sender.send_to(packet, sizeof(packet), slow->get_local_address(), options);
+        sender.send_to(packet, sizeof(packet), fast->get_local_address(), options);
+    }
+    assert(sender.queue_depth(slow->get_local_address()) > k_paced_packets / 2);
+    assert(0 == sender.queue_depth(fast->get_local_address()));
+
+    PacedDrain drain = {&sender, {&slow_arrivals, &fast_arrivals}, 2 * k_paced_packets};
+    run_paced(&el, &drain);
+    check_paced_duration(start_ns, slow_arrivals, k_paced_slow_rate_bps);
+    assert(k_paced_packets == fast_arrivals.packets);
+    assert(fast_arrivals.last_ns < slow_arrivals.last_ns);
+    assert(0 == sender.queue_depth());
+}
+
+// Past the queue cap send_to() drops the packet and says so, and what was
+// queued still goes out.
+static void check_paced_queue_cap() {
+    static const size_t k_queue_cap = 8 * k_pacer_packet_size;
+
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    PacedArrivals arrivals;
+    std::unique_ptr<rtcbase::AsyncUDPSocket> receiver(paced_receiver(&el, &ss, &arrivals));
+    rtcbase::PacedPacketSocket sender(&el, new rtcbase::AsyncUDPSocket(&el, bound_socket(&ss)));
+    sender.set_rate(k_paced_rate_bps);
+    sender.set_max_queued_bytes(k_queue_cap);
+
+    char packet[k_pacer_packet_size] = {0};
+    rtcbase::PacketOptions options;
+    size_t accepted = 0;
+    int sent = 0;
+    while ((sent = sender.send_to(packet, sizeof(packet), receiver->get_local_address(),
+                    options)) > 0)
+    {
+        ++accepted;
+        assert(accepted <= k_paced_packets);
+    }
+    assert(-1 == sent);
+    assert(EWOULDBLOCK == sender.get_error());
+    assert(1 == sender.dropped_packets());
+    assert(k_queue_cap / k_pacer_packet_size == sender.queue_depth());
+    assert(k_queue_cap == sender.queued_bytes());
+
+    PacedDrain drain = {&sender, {&arrivals}, accepted};
+    run_paced(&el, &drain);
+    assert(accepted == arrivals.packets);
+    assert(0 == sender.queue_depth());
+    assert(0 == sender.queued_bytes());
+    // Room again once drained.
+    sent = sender.send_to(packet, sizeof(packet), receiver->get_local_address(), options);
+    assert((int)sizeof(packet) == sent);
+    assert(1 == sender.dropped_packets());
+}
+
+void test_paced_packet_socket() {
+    check_paced_rate();
+    check_paced_destination_rate();
+    check_paced_queue_cap();
+    std::cout << "paced packet socket: ok" << std::endl;
+}
+
+// A header, a payload in two parts with an empty one between them, and a
+// trailer, as a forwarder would send them.
+struct GatherPacket {
+    explicit GatherPacket(char tag) :
+        header("hdr"), first(100, tag), second(200, tag + 1), trailer("end")
+    {
+        set_iov(0, &header);
+        set_iov(1, &first);
+        iov[2].iov_base = nullptr;
+        iov[2].iov_len = 0;
+        set_iov(3, &second);
+        set_iov(4, &trailer);
+    }
+
+    void set_iov(size_t i, std::string* part) {
+        iov[i].iov_base = &(*part)[0];
+        iov[i].iov_len = part->size();
+    }
+
+    std::string joined() const { return header + first + second + trailer; }
+
+    std::string header;
+    std::string first;
+    std::string second;
+    std::string trailer;
+    struct iovec iov[5];
+};
+
+// Reads the next datagram of |socket| and checks it is |expected|, an empty
+// |expected| checks that nothing is pending.
+static void check_received(rtcbase::Socket* socket, const std::string& expected) {
+    char data[2048];
+    rtcbase::SocketAddress addr;
+    int64_t timestamp;
+    int len = socket->recv_from(data, sizeof(data), &addr, &timestamp);
+    assert(len >= 0);
+    assert(std::string(data, len > 0 ? len : 0) == expected);
+    (void)len;
+}
+
+static rtcbase::scoped_refptr<rtcbase::PacketBuffer> filled_buffer(
+        rtcbase::PacketBufferPool* pool, char tag)
+{
+    rtcbase::scoped_refptr<rtcbase::PacketBuffer> buffer = pool->allocate();
+    buffer->set_size(500);
+    memset(buffer->data(), tag, buffer->size());
+    return buffer;
+}
+
+static std::string buffer_string(const rtcbase::scoped_refptr<rtcbase::PacketBuffer>& buffer) {
+    return std::string((const char*)buffer->data(), buffer->size());
+}
+
+// The plain socket sends the concatenation of the parts as one datagram.
+static void check_physical_send_to_v() {
+    rtcbase::PhysicalSocketServer ss;
+    std::unique_ptr<rtcbase::AsyncSocket> receiver(bound_socket(&ss));
+    std::unique_ptr<rtcbase::Socket> sender(ss.create_socket(AF_INET, SOCK_DGRAM));
+    GatherPacket packet('a');
+    int sent = sender->send_to_v(packet.iov, 5, receiver->get_local_address());
+    assert((int)packet.joined().size() == sent);
+    check_received(receiver.get(), packet.joined());
+    check_received(receiver.get(), "");
+    (void)sent;
+}
+
+// Queued, the parts are gathered into the send queue and a PacketBuffer is
+// held by reference until it has been sent.
+static void check_queued_gather() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    std::unique_ptr<rtcbase::AsyncSocket> receiver(bound_socket(&ss));
+    rtcbase::SocketAddress addr = receiver->get_local_address();
+    rtcbase::AsyncUDPSocket sender(&el, bound_socket(&ss));
+    rtcbase::scoped_refptr<rtcbase::PacketBufferPool> pool =
+        rtcbase::PacketBufferPool::create(1500);
+    rtcbase::PacketOptions options;
+
+    GatherPacket packet('c');
+    rtcbase::scoped_refptr<rtcbase::PacketBuffer> buffer = filled_buffer(pool.get(), 'x');
+    int sent = sender.send_to_v(packet.iov, 5, addr, options);
+    assert((int)packet.joined().size() == sent);
+    sent = sender.send_packet_buffer(buffer, addr, options);
+    assert((int)buffer->size() == sent);
+    // The queue has its own copy of the parts.
+    packet.first.assign(packet.first.size(), 'z');
+    assert(!buffer->has_one_ref());
+    check_received(receiver.get(), "");
+
+    SentCounter counter(2);
+    sender.signal_sent_packet.connect(&counter, &SentCounter::on_sent_packet);
+    rtcbase::TimerWatcher* timer = el.create_timer(SentCounter::check_cb, &counter, false);
+    el.start_timer(timer, 1000);
+    el.run();
+    el.delete_timer(timer);
+    assert(2 == counter.sent);
+    assert(2 == sender.queued_packets());
+    assert(buffer->has_one_ref());
+    check_received(receiver.get(), GatherPacket('c').joined());
+    check_received(receiver.get(), buffer_string(buffer));
+
+    // Dropped from the queue, the reference goes as well.
+    sender.set_send_queue_limits(1, 0, rtcbase::UdpSendQueue::DROP_OLDEST);
+    sender.send_packet_buffer(buffer, addr, options);
+    assert(!buffer->has_one_ref());
+    sender.send_to_v(packet.iov, 5, addr, options);
+    assert(buffer->has_one_ref());
+    (void)sent;
+}
+
+// Sent right away, the parts go out in one datagram and nothing keeps the
+// PacketBuffer.
+static void check_direct_gather() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    std::unique_ptr<rtcbase::AsyncSocket> receiver(bound_socket(&ss));
+    rtcbase::SocketAddress addr = receiver->get_local_address();
+    rtcbase::AsyncUDPSocket sender(&el, bound_socket(&ss));
+    sender.set_direct_send(true);
+    rtcbase::scoped_refptr<rtcbase::PacketBufferPool> pool =
+        rtcbase::PacketBufferPool::create(1500);
+    rtcbase::PacketOptions options;
+
+    GatherPacket packet('e');
+    int sent = sender.send_to_v(packet.iov, 5, addr, options);
+    assert((int)packet.joined().size() == sent);
+    check_received(receiver.get(), packet.joined());
+    // Marked packets take the sendmsg() path.
+    options.dscp = rtcbase::DSCP_EF;
+    sent = sender.send_to_v(packet.iov, 5, addr, options);
+    assert((int)packet.joined().size() == sent);
+    check_received(receiver.get(), packet.joined());
+
+    rtcbase::scoped_refptr<rtcbase::PacketBuffer> buffer = filled_buffer(pool.get(), 'y');
+    sent = sender.send_packet_buffer(buffer, addr, options);
+    assert((int)buffer->size() == sent);
+    assert(buffer->has_one_ref());
+    check_received(receiver.get(), buffer_string(buffer));
+    assert(3 == sender.inline_sent_packets());
+    assert(0 == sender.queued_packets());
+    (void)sent;
+}
+
+void test_udp_send_gather() {
+    check_physical_send_to_v();
+    check_queued_gather();
+    check_direct_gather();
+    std::cout << "udp send gather: ok" << std::endl;
+}
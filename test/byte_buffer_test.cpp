@@ -0,0 +1,510 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file byte_buffer_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <rtcbase/random.h>
+#include <rtcbase/time_utils.h>
+#include <rtcbase/byte_arena.h>
+#include <rtcbase/byte_buffer.h>
+#include <rtcbase/byte_order.h>
+
+static const int k_bench_messages = 200000;
+// An RTCP sender report with this many report blocks, and a telemetry
+// batch with this many records.
+static const int k_report_blocks = 8;
+static const int k_telemetry_records = 1000;
+
+// Builds the same messages with any of the writers.
+template <typename Writer>
+static void write_sender_report(Writer* writer, uint32_t seed) {
+    writer->write_uint8(0x80 | k_report_blocks);
+    writer->write_uint8(200);
+    writer->write_uint16(6 + 6 * k_report_blocks);
+    writer->write_uint32(seed);
+    writer->write_uint64(0xE1A2B3C4D5E6F708ULL + seed);
+    writer->write_uint32(seed * 90);
+    writer->write_uint32(seed * 3);
+    writer->write_uint32(seed * 3000);
+    for (int i = 0; i < k_report_blocks; ++i) {
+        writer->write_uint32(seed + i);
+        writer->write_uint32((uint32_t)i << 24 | 0x10);
+        writer->write_uint32(seed + 1000);
+        writer->write_uint32(12);
+        writer->write_uint32(seed >> 4);
+        writer->write_uint32(0x100);
+    }
+}
+
+template <typename Writer>
+static void write_telemetry(Writer* writer, uint32_t seed) {
+    for (int i = 0; i < k_telemetry_records; ++i) {
+        writer->write_uint16((uint16_t)i);
+        writer->write_uvarint((uint64_t)seed * i);
+        writer->write_uint32(seed ^ i);
+        writer->write_uint24(i & 0xFFFFFF);
+    }
+}
+
+template <typename Writer>
+static void write_message(Writer* writer, bool telemetry, uint32_t seed) {
+    if (telemetry) {
+        write_telemetry(writer, seed);
+    } else {
+        write_sender_report(writer, seed);
+    }
+}
+
+static void report(const char* name, bool telemetry, uint64_t nanos,
+        size_t bytes, int messages)
+{
+    std::cout << (telemetry ? "telemetry " : "sender report ") << name << ": "
+        << nanos / messages << " ns/message, "
+        << bytes / messages << " bytes" << std::endl;
+}
+
+static void bench_writers(bool telemetry) {
+    int messages = telemetry ? k_bench_messages / 100 : k_bench_messages;
+    std::string expected;
+    {
+        rtcbase::ByteBufferWriter writer;
+        write_message(&writer, telemetry, 7);
+        expected.assign(writer.data(), writer.length());
+    }
+
+    // A writer per message as today, allocating and growing by
+    // reallocation once past the default size.
+    size_t bytes = 0;
+    uint64_t start = rtcbase::time_nanos();
+    for (int i = 0; i < messages; ++i) {
+        rtcbase::ByteBufferWriter writer;
+        write_message(&writer, telemetry, i);
+        bytes += writer.length();
+    }
+    report("ByteBufferWriter", telemetry,
+            rtcbase::time_nanos() - start, bytes, messages);
+
+    // Room for the longer varints of other seeds.
+    std::vector<char> storage(2 * expected.size());
+    bytes = 0;
+    start = rtcbase::time_nanos();
+    for (int i = 0; i < messages; ++i) {
+        rtcbase::ByteBufferWriter writer(rtcbase::ByteBufferWriter::Storage(
+                    &storage[0], storage.size()));
+        write_message(&writer, telemetry, i);
+        bytes += writer.length();
+        assert(!writer.overflow());
+    }
+    report("ByteBufferWriter on storage", telemetry,
+            rtcbase::time_nanos() - start, bytes, messages);
+
+    rtcbase::ByteArena arena(telemetry ? 4096 : 1024);
+    bytes = 0;
+    start = rtcbase::time_nanos();
+    for (int i = 0; i < messages; ++i) {
+        rtcbase::ChainedByteBufferWriter writer(&arena);
+        write_message(&writer, telemetry, i);
+        bytes += writer.length();
+        arena.reset();
+    }
+    report("ChainedByteBufferWriter", telemetry,
+            rtcbase::time_nanos() - start, bytes, messages);
+
+    // Same content whatever the writer.
+    rtcbase::ByteBufferWriter fixed(rtcbase::ByteBufferWriter::Storage(
+                &storage[0], storage.size()));
+    write_message(&fixed, telemetry, 7);
+    assert(std::string(fixed.data(), fixed.length()) == expected);
+    rtcbase::ChainedByteBufferWriter chained(&arena);
+    write_message(&chained, telemetry, 7);
+    std::vector<char> joined(chained.length());
+    chained.copy_to(&joined[0]);
+    assert(std::string(&joined[0], joined.size()) == expected);
+    std::vector<struct iovec> iov(chained.segment_count());
+    assert(chained.gather(&iov[0], iov.size()) == iov.size());
+    assert(telemetry == (iov.size() > 1));
+}
+
+static void check_overflow() {
+    char storage[16];
+    rtcbase::ByteBufferWriter writer(rtcbase::ByteBufferWriter::Storage(
+                storage, sizeof(storage)));
+    writer.write_uint64(1);
+    writer.write_uint32(2);
+    assert(!writer.overflow() && writer.length() == 12);
+    // Dropped whole, what was written before stays.
+    writer.write_uint64(3);
+    assert(writer.overflow() && writer.length() == 12);
+    assert(NULL == writer.reserve_write_buffer(5));
+    writer.write_uint32(4);
+    assert(writer.length() == 16);
+
+    rtcbase::ByteBufferReader reader(writer);
+    uint64_t v64 = 0;
+    uint32_t v32 = 0;
+    bool ok = reader.read_uint64(&v64);
+    assert(ok && 1 == v64);
+    ok = reader.read_uint32(&v32);
+    assert(ok && 2 == v32);
+    ok = reader.read_uint32(&v32);
+    assert(ok && 4 == v32);
+
+    writer.clear();
+    assert(!writer.overflow() && 0 == writer.length());
+    (void)ok;
+}
+
+// Writes the same values with both writers, the chained one from an arena
+// of small chunks so the content spans many segments.
+template <typename Writer>
+static void write_mixed(Writer* writer, int round) {
+    for (int i = 0; i < 200; ++i) {
+        writer->write_uint8((uint8_t)(i + round));
+        writer->write_uint16((uint16_t)(i * 7));
+        writer->write_uint24((uint32_t)(i * 0x10101));
+        writer->write_uint32((uint32_t)(i * 0x01020304));
+        writer->write_uint64(0x0102030405060708ULL * i);
+        writer->write_uvarint((uint64_t)i << (i % 57));
+        if (i % 16 == 0) {
+            // Longer than a chunk, split over segments.
+            std::string long_bytes(150 + i, (char)('a' + i % 26));
+            writer->write_string(long_bytes);
+            char* reserved = writer->reserve_write_buffer(40);
+            memset(reserved, i, 40);
+        }
+    }
+}
+
+static void check_chained_writer() {
+    rtcbase::ByteArena arena(64);
+    for (int round = 0; round < 3; ++round) {
+        rtcbase::ByteBufferWriter expected_writer;
+        write_mixed(&expected_writer, round);
+        std::string expected(expected_writer.data(), expected_writer.length());
+
+        rtcbase::ChainedByteBufferWriter writer(&arena);
+        write_mixed(&writer, round);
+        assert(writer.length() == expected.size());
+        assert(writer.segment_count() > 10);
+
+        std::vector<char> joined(writer.length());
+        writer.copy_to(&joined[0]);
+        assert(std::string(&joined[0], joined.size()) == expected);
+
+        // All segments, joined in order.
+        std::vector<struct iovec> iov(writer.segment_count());
+        assert(writer.gather(&iov[0], iov.size()) == iov.size());
+        std::string gathered;
+        for (size_t i = 0; i < iov.size(); ++i) {
+            assert(iov[i].iov_len > 0);
+            gathered.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+        assert(gathered == expected);
+
+        // Fewer entries than segments: a prefix is filled and the full count
+        // is returned, the entries past |count| are left alone.
+        size_t count = iov.size() / 2;
+        std::vector<struct iovec> part(count + 1);
+        part[count].iov_base = NULL;
+        part[count].iov_len = 12345;
+        assert(writer.gather(&part[0], count) == iov.size());
+        std::string prefix;
+        for (size_t i = 0; i < count; ++i) {
+            assert(part[i].iov_base == iov[i].iov_base);
+            prefix.append(static_cast<const char*>(part[i].iov_base), part[i].iov_len);
+        }
+        assert(0 == expected.compare(0, prefix.size(), prefix));
+        assert(NULL == part[count].iov_base && 12345 == part[count].iov_len);
+
+        writer.clear();
+        assert(0 == writer.length() && 0 == writer.segment_count());
+        assert(writer.gather(NULL, 0) == 0);
+
+        // The chunks of the first round are enough for the next ones.
+        size_t capacity = arena.capacity();
+        arena.reset();
+        if (round > 0) {
+            rtcbase::ChainedByteBufferWriter again(&arena);
+            write_mixed(&again, round);
+            assert(arena.capacity() == capacity);
+            arena.reset();
+        }
+        (void)capacity;
+    }
+}
+
+static void check_arena() {
+    rtcbase::ByteArena arena(100);
+    assert(arena.chunk_size() == 100);
+    char* a = arena.allocate(10);
+    char* b = arena.allocate(10);
+    assert(0 == (reinterpret_cast<uintptr_t>(a) % rtcbase::ByteArena::ALIGNMENT));
+    assert(0 == (reinterpret_cast<uintptr_t>(b) % rtcbase::ByteArena::ALIGNMENT));
+    assert(b >= a + 10);
+    // Larger than a chunk, a chunk of its own.
+    char* big = arena.allocate(1000);
+    memset(big, 1, 1000);
+    size_t rest = 0;
+    char* r = arena.allocate_rest(8, &rest);
+    assert(rest >= 8);
+    memset(r, 2, rest);
+    size_t capacity = arena.capacity();
+    arena.reset();
+    assert(arena.allocate(10) == a);
+    assert(arena.capacity() == capacity);
+    // A chunk size below the alignment is raised to it.
+    rtcbase::ByteArena tiny(1);
+    assert(tiny.chunk_size() == rtcbase::ByteArena::ALIGNMENT);
+    (void)b;
+    (void)r;
+    (void)capacity;
+}
+
+void test_chained_byte_buffer() {
+    check_arena();
+    check_chained_writer();
+    check_overflow();
+    std::cout << "chained byte buffer: ok" << std::endl;
+}
+
+void test_byte_buffer_bench() {
+    bench_writers(false);
+    bench_writers(true);
+}
+
+static const int k_order_rounds = 20000;
+// A receiver report's worth of report blocks, 6 words each, and a NACK
+// list of packet ids.
+static const size_t k_order_words = 31 * 6;
+static const size_t k_order_shorts = 256;
+
+static void report_order(const char* name, uint64_t nanos, size_t values) {
+    std::cout << name << ": " << nanos * 1000 / (k_order_rounds * values)
+        << " ps/value" << std::endl;
+}
+
+static void check_swap_bytes() {
+    rtcbase::Random random(77);
+    std::vector<char> src(1024 + 8);
+    for (size_t i = 0; i < src.size(); ++i) {
+        src[i] = (char)random.rand(0, 255);
+    }
+    // Every tail length and misalignment.
+    for (size_t count = 0; count < 200; ++count) {
+        for (size_t offset = 0; offset < 4; ++offset) {
+            const char* s = &src[offset];
+            std::vector<char> d16(count * 2 + 1), d32(count * 4 + 1);
+            rtcbase::swap_bytes16(&d16[1], s, count);
+            rtcbase::swap_bytes32(&d32[1], s, count);
+            for (size_t i = 0; i < count; ++i) {
+                assert(rtcbase::get_be16(s + i * 2) == rtcbase::get_le16(&d16[1 + i * 2]));
+                assert(rtcbase::get_be32(s + i * 4) == rtcbase::get_le32(&d32[1 + i * 4]));
+            }
+        }
+    }
+    // In place.
+    std::vector<char> copy(src);
+    rtcbase::swap_bytes32(&copy[0], &copy[0], 256);
+    rtcbase::swap_bytes32(&copy[0], &copy[0], 256);
+    assert(copy == src);
+}
+
+// The per value readers and writers, the network order templates and the
+// bulk calls all agree on the same wire bytes.
+static void check_byte_order() {
+    std::vector<uint32_t> words(k_order_words);
+    std::vector<uint16_t> shorts(k_order_shorts);
+    for (size_t i = 0; i < words.size(); ++i) {
+        words[i] = (uint32_t)(i * 0x01010101u + 0x10203);
+    }
+    for (size_t i = 0; i < shorts.size(); ++i) {
+        shorts[i] = (uint16_t)(i * 0x0101 + 7);
+    }
+
+    rtcbase::ByteBufferWriter writer;
+    for (size_t i = 0; i < words.size(); ++i) {
+        writer.write_uint32(words[i]);
+    }
+    for (size_t i = 0; i < shorts.size(); ++i) {
+        writer.write_uint16(shorts[i]);
+    }
+    std::string expected(writer.data(), writer.length());
+    assert(rtcbase::get_be32(writer.data()) == words[0]);
+
+    rtcbase::NetworkByteBufferWriter network_writer;
+    for (size_t i = 0; i < words.size(); ++i) {
+        network_writer.write_uint32(words[i]);
+    }
+    for (size_t i = 0; i < shorts.size(); ++i) {
+        network_writer.write_uint16(shorts[i]);
+    }
+    assert(std::string(network_writer.data(), network_writer.length()) == expected);
+
+    rtcbase::ByteBufferWriter bulk_writer;
+    bulk_writer.write_uint32s(&words[0], words.size());
+    bulk_writer.write_uint16s(&shorts[0], shorts.size());
+    assert(std::string(bulk_writer.data(), bulk_writer.length()) == expected);
+
+    std::vector<uint32_t> read_words(words.size());
+    std::vector<uint16_t> read_shorts(shorts.size());
+    bool ok = true;
+    rtcbase::ByteBufferReader reader(expected.data(), expected.size());
+    for (size_t i = 0; i < read_words.size(); ++i) {
+        ok = reader.read_uint32(&read_words[i]) && ok;
+    }
+    for (size_t i = 0; i < read_shorts.size(); ++i) {
+        ok = reader.read_uint16(&read_shorts[i]) && ok;
+    }
+    assert(ok && 0 == reader.length());
+    assert(read_words == words && read_shorts == shorts);
+
+    read_words.assign(words.size(), 0);
+    read_shorts.assign(shorts.size(), 0);
+    rtcbase::NetworkByteBufferReader network_reader(expected.data(), expected.size());
+    for (size_t i = 0; i < read_words.size(); ++i) {
+        ok = network_reader.read_uint32(&read_words[i]) && ok;
+    }
+    for (size_t i = 0; i < read_shorts.size(); ++i) {
+        ok = network_reader.read_uint16(&read_shorts[i]) && ok;
+    }
+    assert(ok && 0 == network_reader.length());
+    assert(read_words == words && read_shorts == shorts);
+
+    read_words.assign(words.size(), 0);
+    read_shorts.assign(shorts.size(), 0);
+    rtcbase::ByteBufferReader bulk_reader(expected.data(), expected.size());
+    ok = bulk_reader.read_uint32s(&read_words[0], read_words.size()) && ok;
+    ok = bulk_reader.read_uint16s(&read_shorts[0], read_shorts.size()) && ok;
+    assert(ok && 0 == bulk_reader.length());
+    assert(read_words == words && read_shorts == shorts);
+    // Too few bytes left for the bulk read.
+    ok = bulk_reader.read_uint32s(&read_words[0], 1);
+    assert(!ok);
+    (void)ok;
+}
+
+void test_byte_order() {
+    check_swap_bytes();
+    check_byte_order();
+    std::cout << "byte order: ok" << std::endl;
+}
+
+static void bench_read_order() {
+    std::vector<uint32_t> words(k_order_words);
+    std::vector<uint16_t> shorts(k_order_shorts);
+    rtcbase::ByteBufferWriter writer;
+    for (size_t i = 0; i < words.size(); ++i) {
+        writer.write_uint32((uint32_t)(i * 0x01010101u + 0x10203));
+    }
+    for (size_t i = 0; i < shorts.size(); ++i) {
+        writer.write_uint16((uint16_t)(i * 0x0101 + 7));
+    }
+    const char* data = writer.data();
+    size_t length = writer.length();
+
+    uint64_t check = 0;
+    uint64_t start = rtcbase::time_nanos();
+    for (int round = 0; round < k_order_rounds; ++round) {
+        rtcbase::ByteBufferReader reader(data, length);
+        for (size_t i = 0; i < words.size(); ++i) {
+            reader.read_uint32(&words[i]);
+        }
+        for (size_t i = 0; i < shorts.size(); ++i) {
+            reader.read_uint16(&shorts[i]);
+        }
+        check += words[round % words.size()] + shorts[round % shorts.size()];
+    }
+    report_order("read ByteBufferReader per value", rtcbase::time_nanos() - start,
+            words.size() + shorts.size());
+
+    uint64_t sum = 0;
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_order_rounds; ++round) {
+        rtcbase::NetworkByteBufferReader reader(data, length);
+        for (size_t i = 0; i < words.size(); ++i) {
+            reader.read_uint32(&words[i]);
+        }
+        for (size_t i = 0; i < shorts.size(); ++i) {
+            reader.read_uint16(&shorts[i]);
+        }
+        sum += words[round % words.size()] + shorts[round % shorts.size()];
+    }
+    report_order("read NetworkByteBufferReader per value", rtcbase::time_nanos() - start,
+            words.size() + shorts.size());
+
+    sum = 0;
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_order_rounds; ++round) {
+        rtcbase::ByteBufferReader reader(data, length);
+        reader.read_uint32s(&words[0], words.size());
+        reader.read_uint16s(&shorts[0], shorts.size());
+        sum += words[round % words.size()] + shorts[round % shorts.size()];
+    }
+    report_order("read ByteBufferReader bulk", rtcbase::time_nanos() - start,
+            words.size() + shorts.size());
+    // Keeps the reads from being optimized away.
+    if (sum == check) {
+        std::cout << "read checksum " << sum << std::endl;
+    }
+}
+
+static void bench_write_order() {
+    std::vector<uint32_t> words(k_order_words);
+    for (size_t i = 0; i < words.size(); ++i) {
+        words[i] = (uint32_t)(i * 0x01010101u + 0x10203);
+    }
+    std::vector<char> storage(words.size() * 4);
+    rtcbase::ByteBufferWriter::Storage out(&storage[0], storage.size());
+
+    uint64_t start = rtcbase::time_nanos();
+    for (int round = 0; round < k_order_rounds; ++round) {
+        rtcbase::ByteBufferWriter writer(out);
+        for (size_t i = 0; i < words.size(); ++i) {
+            writer.write_uint32(words[i]);
+        }
+    }
+    report_order("write ByteBufferWriter per value", rtcbase::time_nanos() - start,
+            words.size());
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_order_rounds; ++round) {
+        rtcbase::NetworkByteBufferWriter writer(out);
+        for (size_t i = 0; i < words.size(); ++i) {
+            writer.write_uint32(words[i]);
+        }
+    }
+    report_order("write NetworkByteBufferWriter per value", rtcbase::time_nanos() - start,
+            words.size());
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_order_rounds; ++round) {
+        rtcbase::ByteBufferWriter writer(out);
+        writer.write_uint32s(&words[0], words.size());
+    }
+    report_order("write ByteBufferWriter bulk", rtcbase::time_nanos() - start,
+            words.size());
+}
+
+void test_byte_order_bench() {
+    bench_read_order();
+    bench_write_order();
+}
+
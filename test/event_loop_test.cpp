@@ -0,0 +1,659 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file event_loop_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <rtcbase/atomicops.h>
+#include <rtcbase/random.h>
+#include <rtcbase/time_utils.h>
+#include <rtcbase/event_loop.h>
+#include <rtcbase/event_loop_pool.h>
+#include <rtcbase/platform_thread.h>
+
+static const int k_bench_timers = 100000;
+static const int k_bench_rearms = 1000000;
+// Timeouts of a retransmit/keepalive mix, in microseconds.
+static const uint32_t k_bench_min_timeout = 1000;
+static const uint32_t k_bench_max_timeout = 20000;
+
+struct TimerBench {
+    rtcbase::Random random;
+    uint64_t fired;
+
+    TimerBench() : random(1234), fired(0) {}
+
+    unsigned long next_timeout() {
+        return random.rand(k_bench_min_timeout, k_bench_max_timeout);
+    }
+};
+
+static void bench_timer_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    TimerBench* bench = static_cast<TimerBench*>(data);
+    ++bench->fired;
+    el->start_timer(w, bench->next_timeout());
+}
+
+static void bench_stop_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher*, void*) {
+    el->stop();
+}
+
+static void bench_timers(bool use_wheel) {
+    rtcbase::EventLoop el(nullptr, false);
+    if (use_wheel) {
+        el.enable_timer_wheel();
+    }
+
+    TimerBench bench;
+    std::vector<rtcbase::TimerWatcher*> timers;
+    for (int i = 0; i < k_bench_timers; ++i) {
+        timers.push_back(el.create_timer(bench_timer_cb, &bench, false));
+        el.start_timer(timers.back(), bench.next_timeout());
+    }
+
+    // Rearming live timers, as every received packet does with its session's
+    // keepalive timer.
+    uint64_t start = rtcbase::time_nanos();
+    for (int i = 0; i < k_bench_rearms; ++i) {
+        el.start_timer(timers[bench.random.rand(k_bench_timers - 1)],
+                bench.next_timeout());
+    }
+    uint64_t rearm_nanos = rtcbase::time_nanos() - start;
+
+    // Expiring: every timer restarts itself when it fires.
+    rtcbase::TimerWatcher* stop = el.create_timer(bench_stop_cb, nullptr, false);
+    el.start_timer(stop, 2 * 1000 * 1000);
+    start = rtcbase::time_nanos();
+    el.run();
+    uint64_t run_nanos = rtcbase::time_nanos() - start;
+
+    el.delete_timer(stop);
+    for (size_t i = 0; i < timers.size(); ++i) {
+        el.delete_timer(timers[i]);
+    }
+
+    std::cout << (use_wheel ? "timing wheel" : "libev timers")
+        << ": " << rearm_nanos / k_bench_rearms << " ns/rearm, "
+        << bench.fired * rtcbase::k_num_nanosecs_per_sec / run_nanos
+        << " expirations/sec" << std::endl;
+}
+
+void test_timer_bench() {
+    bench_timers(false);
+    bench_timers(true);
+}
+
+
+
+static const size_t k_pool_size = 4;
+
+struct PoolProbe {
+    rtcbase::EventLoopPool* pool;
+    // current_index() + 1 as seen by a task on each loop.
+    volatile int indexes[k_pool_size];
+    volatile int ran;
+    volatile int dropped;
+};
+
+static void pool_probe_task(rtcbase::EventLoop* el, void* data) {
+    PoolProbe* probe = static_cast<PoolProbe*>(data);
+    for (size_t i = 0; i < probe->pool->size(); ++i) {
+        if (probe->pool->loop(i) == el) {
+            rtcbase::AtomicOps::release_store(&probe->indexes[i],
+                    probe->pool->current_index() + 1);
+        }
+    }
+    rtcbase::AtomicOps::increment(&probe->ran);
+}
+
+static void pool_drop_task(rtcbase::EventLoop*, void* data) {
+    PoolProbe* probe = static_cast<PoolProbe*>(data);
+    rtcbase::AtomicOps::increment(&probe->dropped);
+}
+
+// Waits up to a second for |count| tasks to have run.
+static bool wait_ran(PoolProbe* probe, int count) {
+    for (int i = 0; i < 1000; ++i) {
+        if (rtcbase::AtomicOps::acquire_load(&probe->ran) >= count) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+static void post_probes(PoolProbe* probe) {
+    for (size_t i = 0; i < probe->pool->size(); ++i) {
+        probe->indexes[i] = 0;
+        probe->pool->loop(i)->post(pool_probe_task, probe, pool_drop_task);
+    }
+}
+
+void test_event_loop_pool() {
+    std::unique_ptr<rtcbase::EventLoopPool> pool(
+            new rtcbase::EventLoopPool(k_pool_size, "test_pool"));
+    PoolProbe probe;
+    probe.pool = pool.get();
+    probe.ran = 0;
+    probe.dropped = 0;
+    assert(k_pool_size == pool->size());
+    assert(!pool->is_running());
+    assert(-1 == pool->current_index());
+
+    // Tasks posted before start() run once the loops do, each on its own
+    // thread.
+    post_probes(&probe);
+    pool->start();
+    assert(pool->is_running());
+    pool->start();
+    assert(wait_ran(&probe, k_pool_size));
+    for (size_t i = 0; i < k_pool_size; ++i) {
+        assert((int)i + 1 == probe.indexes[i]);
+    }
+    assert(-1 == pool->current_index());
+
+    pool->stop();
+    assert(!pool->is_running());
+    pool->stop();
+
+    // Stopped loops keep their tasks until the pool is started again.
+    post_probes(&probe);
+    usleep(10000);
+    assert(k_pool_size == (size_t)probe.ran);
+    pool->start();
+    assert(wait_ran(&probe, 2 * k_pool_size));
+    for (size_t i = 0; i < k_pool_size; ++i) {
+        assert((int)i + 1 == probe.indexes[i]);
+    }
+    pool->stop();
+
+    // The tasks of a pool that is not started again are dropped with it.
+    post_probes(&probe);
+    pool.reset();
+    assert(2 * k_pool_size == (size_t)probe.ran);
+    assert(k_pool_size == (size_t)probe.dropped);
+    std::cout << "event loop pool: ok" << std::endl;
+}
+
+static const int k_post_producers = 4;
+static const uint32_t k_post_tasks = 200000;
+
+// Each producer posts its sequence numbers, the loop checks every producer's
+// tasks arrive once each and in posting order.
+struct PostOrder {
+    uint32_t next_seq[k_post_producers];
+    uint64_t ran;
+};
+
+static void post_order_task(rtcbase::EventLoop* el, void* data) {
+    // The producer and the sequence number travel in the pointer itself.
+    uintptr_t value = reinterpret_cast<uintptr_t>(data);
+    int producer = static_cast<int>(value % k_post_producers);
+    uint32_t seq = static_cast<uint32_t>(value / k_post_producers);
+    PostOrder* order = static_cast<PostOrder*>(el->owner);
+    assert(order->next_seq[producer] == seq);
+    ++order->next_seq[producer];
+    if (++order->ran == (uint64_t)k_post_producers * k_post_tasks) {
+        el->stop();
+    }
+}
+
+struct PostProducer {
+    rtcbase::EventLoop* el;
+    int producer;
+};
+
+static void post_producer_run(void* data) {
+    PostProducer* producer = static_cast<PostProducer*>(data);
+    for (uint32_t seq = 0; seq < k_post_tasks; ++seq) {
+        uintptr_t value = (uintptr_t)seq * k_post_producers + producer->producer;
+        producer->el->post(post_order_task, reinterpret_cast<void*>(value));
+    }
+}
+
+static void post_timeout_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher*, void*) {
+    el->stop();
+}
+
+void test_event_loop_post() {
+    PostOrder order;
+    rtcbase::EventLoop el(&order, false);
+    order.ran = 0;
+    for (int i = 0; i < k_post_producers; ++i) {
+        order.next_seq[i] = 0;
+    }
+
+    PostProducer producers[k_post_producers];
+    std::vector<std::unique_ptr<rtcbase::PlatformThread> > threads;
+    for (int i = 0; i < k_post_producers; ++i) {
+        producers[i].el = &el;
+        producers[i].producer = i;
+        threads.push_back(std::unique_ptr<rtcbase::PlatformThread>(
+                    new rtcbase::PlatformThread(post_producer_run, &producers[i],
+                        "post_producer")));
+    }
+    for (int i = 0; i < k_post_producers; ++i) {
+        threads[i]->start();
+    }
+    // Posted tasks do not keep the loop running, the timeout timer does.
+    rtcbase::TimerWatcher* timeout = el.create_timer(post_timeout_cb, nullptr, false);
+    el.start_timer(timeout, 30 * 1000 * 1000);
+    el.run();
+    el.delete_timer(timeout);
+    for (int i = 0; i < k_post_producers; ++i) {
+        threads[i]->stop();
+    }
+
+    assert((uint64_t)k_post_producers * k_post_tasks == order.ran);
+    for (int i = 0; i < k_post_producers; ++i) {
+        assert(k_post_tasks == order.next_seq[i]);
+    }
+    std::cout << "event loop post: ok" << std::endl;
+}
+
+static void noop_timer_cb(rtcbase::EventLoop*, rtcbase::TimerWatcher*, void*) {}
+
+static void noop_io_cb(rtcbase::EventLoop*, rtcbase::IOWatcher*, int, int, void*) {}
+
+void test_event_loop_watchers() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::WatcherStats stats = el.watcher_stats();
+    assert(0 == stats.live_timers && 0 == stats.peak_timers);
+    assert(0 == stats.live_io_events && 0 == stats.peak_io_events);
+    assert(0 == stats.timer_capacity && 0 == stats.io_event_capacity);
+
+    // Reserving allocates up front, a smaller reservation changes nothing.
+    el.reserve_watchers(1000, 100);
+    el.reserve_watchers(10, 10);
+    stats = el.watcher_stats();
+    assert(1000 == stats.timer_capacity && 100 == stats.io_event_capacity);
+    assert(0 == stats.live_timers && 0 == stats.live_io_events);
+
+    std::vector<rtcbase::TimerWatcher*> timers;
+    for (int i = 0; i < 1000; ++i) {
+        timers.push_back(el.create_timer(noop_timer_cb, nullptr, false));
+    }
+    stats = el.watcher_stats();
+    assert(1000 == stats.live_timers && 1000 == stats.peak_timers);
+    assert(1000 == stats.timer_capacity);
+    // One more grows the slab by a chunk.
+    timers.push_back(el.create_timer(noop_timer_cb, nullptr, false));
+    stats = el.watcher_stats();
+    assert(1001 == stats.live_timers && 1000 < stats.timer_capacity);
+    size_t capacity = stats.timer_capacity;
+
+    // Deleted watchers are recycled before the slab grows again.
+    for (int i = 0; i < 500; ++i) {
+        el.delete_timer(timers.back());
+        timers.pop_back();
+    }
+    stats = el.watcher_stats();
+    assert(501 == stats.live_timers && 1001 == stats.peak_timers);
+    rtcbase::TimerWatcher* last = timers.back();
+    el.delete_timer(last);
+    timers.back() = el.create_timer(noop_timer_cb, nullptr, true);
+    assert(last == timers.back());
+    for (int i = 0; i < 500; ++i) {
+        timers.push_back(el.create_timer(noop_timer_cb, nullptr, false));
+    }
+    stats = el.watcher_stats();
+    assert(1001 == stats.live_timers && 1001 == stats.peak_timers);
+    assert(capacity == stats.timer_capacity);
+
+    std::vector<rtcbase::IOWatcher*> io_events;
+    for (int i = 0; i < 3; ++i) {
+        io_events.push_back(el.create_io_event(noop_io_cb, nullptr));
+    }
+    el.delete_io_event(io_events.back());
+    io_events.pop_back();
+    stats = el.watcher_stats();
+    assert(2 == stats.live_io_events && 3 == stats.peak_io_events);
+    assert(100 == stats.io_event_capacity);
+
+    for (size_t i = 0; i < timers.size(); ++i) {
+        el.delete_timer(timers[i]);
+    }
+    for (size_t i = 0; i < io_events.size(); ++i) {
+        el.delete_io_event(io_events[i]);
+    }
+    stats = el.watcher_stats();
+    assert(0 == stats.live_timers && 0 == stats.live_io_events);
+    assert(1001 == stats.peak_timers && 3 == stats.peak_io_events);
+    (void)stats;
+    (void)capacity;
+    (void)last;
+    std::cout << "event loop watchers: ok" << std::endl;
+}
+
+static const int64_t k_deadline_ns = 30 * 1000 * 1000;
+
+struct DeadlineProbe {
+    int64_t past_fired_ns;
+    int64_t future_fired_ns;
+    std::vector<int64_t> repeat_fired_ns;
+};
+
+static void past_deadline_cb(rtcbase::EventLoop*, rtcbase::TimerWatcher*, void* data) {
+    DeadlineProbe* probe = static_cast<DeadlineProbe*>(data);
+    probe->past_fired_ns = rtcbase::time_nanos();
+}
+
+static void future_deadline_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher*, void* data) {
+    DeadlineProbe* probe = static_cast<DeadlineProbe*>(data);
+    probe->future_fired_ns = rtcbase::time_nanos();
+    el->stop();
+}
+
+static void repeat_deadline_cb(rtcbase::EventLoop*, rtcbase::TimerWatcher*, void* data) {
+    DeadlineProbe* probe = static_cast<DeadlineProbe*>(data);
+    probe->repeat_fired_ns.push_back(rtcbase::time_nanos());
+}
+
+static void check_deadline_timers(bool use_wheel) {
+    rtcbase::EventLoop el(nullptr, false);
+    if (use_wheel) {
+        el.enable_timer_wheel();
+    }
+    DeadlineProbe probe;
+    probe.past_fired_ns = -1;
+    probe.future_fired_ns = -1;
+    rtcbase::TimerWatcher* past = el.create_timer(past_deadline_cb, &probe, false);
+    rtcbase::TimerWatcher* future = el.create_timer(future_deadline_cb, &probe, false);
+    rtcbase::TimerWatcher* repeat = el.create_timer(repeat_deadline_cb, &probe, true);
+
+    el.update_now();
+    int64_t start = el.now_nanos();
+    // The loop time is on the time_nanos() clock.
+    assert(start <= (int64_t)rtcbase::time_nanos());
+    el.start_timer_at(past, start - k_deadline_ns);
+    el.start_timer_at(future, start + k_deadline_ns);
+    // Repeats with the interval between now and the first deadline.
+    el.start_timer_at(repeat, start + k_deadline_ns / 3);
+    el.run();
+
+    // Overdue, so it fired right away.
+    assert(probe.past_fired_ns >= start);
+    assert(probe.past_fired_ns < start + k_deadline_ns / 3);
+    // Not before its deadline.
+    assert(probe.future_fired_ns >= start + k_deadline_ns);
+    assert(probe.repeat_fired_ns.size() >= 2);
+    assert(probe.repeat_fired_ns[0] >= start + k_deadline_ns / 3);
+    assert(probe.repeat_fired_ns[1] >= start + 2 * (k_deadline_ns / 3));
+
+    el.delete_timer(past);
+    el.delete_timer(future);
+    el.delete_timer(repeat);
+}
+
+void test_event_loop_deadlines() {
+    check_deadline_timers(false);
+    check_deadline_timers(true);
+    std::cout << "event loop deadlines: ok" << std::endl;
+}
+
+static const int k_stats_timer_fires = 5;
+static const int k_stats_tasks = 100;
+static const int64_t k_stats_slow_us = 5000;
+
+struct StatsProbe {
+    rtcbase::TimerWatcher* timer;
+    int timer_fires;
+    int tasks;
+    int reads;
+    int pipe_fds[2];
+    // The priv_data of the slow callback.
+    char slow_tag;
+};
+
+static void stats_timer_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    StatsProbe* probe = static_cast<StatsProbe*>(data);
+    if (++probe->timer_fires == k_stats_timer_fires) {
+        el->stop();
+        return;
+    }
+    // Wakes the IO watcher up.
+    char byte = 1;
+    ssize_t written = write(probe->pipe_fds[1], &byte, 1);
+    assert(1 == written);
+    (void)written;
+    el->start_timer(w, 2000);
+}
+
+static void stats_task(rtcbase::EventLoop*, void* data) {
+    ++static_cast<StatsProbe*>(data)->tasks;
+}
+
+static void stats_slow_task(rtcbase::EventLoop*, void*) {
+    usleep(k_stats_slow_us);
+}
+
+static void stats_io_cb(rtcbase::EventLoop*, rtcbase::IOWatcher*, int fd, int, void* data) {
+    StatsProbe* probe = static_cast<StatsProbe*>(data);
+    char byte;
+    ssize_t len = read(fd, &byte, 1);
+    assert(1 == len);
+    (void)len;
+    ++probe->reads;
+}
+
+void test_event_loop_stats() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::LoopStats stats;
+    assert(!el.stats_enabled());
+    bool ok = el.get_stats(&stats);
+    assert(!ok);
+    el.enable_stats(true);
+    assert(el.stats_enabled());
+
+    StatsProbe probe;
+    probe.timer_fires = 0;
+    probe.tasks = 0;
+    probe.reads = 0;
+    int ret = pipe(probe.pipe_fds);
+    assert(0 == ret);
+    (void)ret;
+    probe.timer = el.create_timer(stats_timer_cb, &probe, false);
+    rtcbase::IOWatcher* io = el.create_io_event(stats_io_cb, &probe);
+    el.start_io_event(io, probe.pipe_fds[0], rtcbase::EventLoop::READ);
+    // Posted before run(), they all run in one iteration.
+    for (int i = 0; i < k_stats_tasks; ++i) {
+        el.post(stats_task, &probe);
+    }
+    el.post(stats_slow_task, &probe.slow_tag);
+    el.start_timer(probe.timer, 2000);
+    el.run();
+
+    ok = el.get_stats(&stats);
+    assert(ok);
+    assert(k_stats_tasks == probe.tasks);
+    assert((uint64_t)k_stats_timer_fires == stats.callbacks[rtcbase::LoopStats::TIMER]);
+    assert((uint64_t)k_stats_tasks + 1 == stats.callbacks[rtcbase::LoopStats::TASK]);
+    assert((uint64_t)probe.reads == stats.callbacks[rtcbase::LoopStats::IO]);
+    assert(k_stats_timer_fires - 1 == probe.reads);
+    for (int type = 0; type < rtcbase::LoopStats::WATCHER_TYPES; ++type) {
+        uint64_t total = 0;
+        for (int i = 0; i < rtcbase::LoopStats::HISTOGRAM_BUCKETS; ++i) {
+            total += stats.histogram[type][i];
+        }
+        assert(stats.callbacks[type] == total);
+        (void)total;
+    }
+    assert(stats.max_callbacks_per_iteration >= (uint64_t)k_stats_tasks + 1);
+    assert(stats.iterations > 0);
+    // Waiting for the timers, and running the slow task.
+    assert(stats.idle_ns > 0);
+    assert(stats.busy_ns >= k_stats_slow_us * 1000);
+    assert(stats.callback_ns[rtcbase::LoopStats::TASK] >= k_stats_slow_us * 1000);
+    assert(stats.slowest_ns >= k_stats_slow_us * 1000);
+    assert(rtcbase::LoopStats::TASK == stats.slowest_type);
+    assert(&probe.slow_tag == stats.slowest_priv_data);
+
+    el.reset_stats();
+    ok = el.get_stats(&stats);
+    assert(ok);
+    assert(0 == stats.iterations && 0 == stats.slowest_ns);
+    for (int type = 0; type < rtcbase::LoopStats::WATCHER_TYPES; ++type) {
+        assert(0 == stats.callbacks[type]);
+    }
+    el.enable_stats(false);
+    ok = el.get_stats(&stats);
+    assert(!ok);
+    (void)ok;
+
+    el.delete_io_event(io);
+    el.delete_timer(probe.timer);
+    close(probe.pipe_fds[0]);
+    close(probe.pipe_fds[1]);
+    std::cout << "event loop stats: ok" << std::endl;
+}
+
+static const int64_t k_busy_poll_budget_ns = 10 * 1000 * 1000;
+
+struct BusyPollProbe {
+    int fires;
+    int stop_at;
+};
+
+static void busy_poll_timer_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher*, void* data) {
+    BusyPollProbe* probe = static_cast<BusyPollProbe*>(data);
+    if (++probe->fires == probe->stop_at) {
+        el->stop();
+    }
+}
+
+static void busy_poll_guard_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher*, void*) {
+    el->stop();
+}
+
+// A stop() issued before run() is not lost without busy polling either,
+// and does not stop a later run().
+static void check_stop_before_run() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::TimerWatcher* guard = el.create_timer(busy_poll_guard_cb, nullptr, false);
+    el.start_timer(guard, 1000 * 1000);
+    el.stop();
+    int64_t start = rtcbase::time_nanos();
+    el.run();
+    assert((int64_t)rtcbase::time_nanos() - start < 500 * 1000 * 1000);
+
+    el.start_timer(guard, 20 * 1000);
+    start = rtcbase::time_nanos();
+    el.run();
+    assert((int64_t)rtcbase::time_nanos() - start >= 15 * 1000 * 1000);
+    el.delete_timer(guard);
+    (void)start;
+}
+
+void test_event_loop_busy_poll() {
+    check_stop_before_run();
+    rtcbase::EventLoop el(nullptr, false);
+    el.set_busy_poll(k_busy_poll_budget_ns);
+    assert(k_busy_poll_budget_ns == el.busy_poll());
+    rtcbase::TimerWatcher* guard = el.create_timer(busy_poll_guard_cb, nullptr, false);
+
+    // A stop() issued before run() is not lost.
+    el.start_timer(guard, 1000 * 1000);
+    el.stop();
+    int64_t start = rtcbase::time_nanos();
+    el.run();
+    assert((int64_t)rtcbase::time_nanos() - start < 500 * 1000 * 1000);
+
+    // The loop spins between the timers, and a later run() is not stopped
+    // by the earlier stop().
+    el.enable_stats(true);
+    BusyPollProbe probe;
+    probe.fires = 0;
+    probe.stop_at = 20;
+    rtcbase::TimerWatcher* timer = el.create_timer(busy_poll_timer_cb, &probe, true);
+    el.start_timer(timer, 1000);
+    el.run();
+    assert(20 == probe.fires);
+    rtcbase::LoopStats stats;
+    el.get_stats(&stats);
+    assert(stats.iterations > 20);
+
+    probe.stop_at = 25;
+    el.run();
+    assert(25 == probe.fires);
+    el.stop_timer(timer);
+
+    // Past the budget without work, the loop blocks in the kernel.
+    el.set_busy_poll(1000 * 1000);
+    el.reset_stats();
+    el.start_timer(guard, 50 * 1000);
+    el.run();
+    el.get_stats(&stats);
+    assert(stats.idle_ns > 20 * 1000 * 1000);
+
+    el.delete_timer(timer);
+    el.delete_timer(guard);
+    std::cout << "event loop busy poll: ok" << std::endl;
+}
+
+static const int k_lateness_timers = 200;
+static const unsigned long k_lateness_timeout_us = 500;
+
+struct LatenessBench {
+    int64_t deadline_ns;
+    int64_t total_ns;
+    int64_t max_ns;
+    int fired;
+};
+
+static void lateness_timer_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    LatenessBench* bench = static_cast<LatenessBench*>(data);
+    int64_t late = (int64_t)rtcbase::time_nanos() - bench->deadline_ns;
+    bench->total_ns += late;
+    bench->max_ns = std::max(bench->max_ns, late);
+    if (++bench->fired == k_lateness_timers) {
+        el->stop();
+        return;
+    }
+    bench->deadline_ns = (int64_t)rtcbase::time_nanos() + k_lateness_timeout_us * 1000;
+    el->start_timer(w, k_lateness_timeout_us);
+}
+
+// How late short timers fire, blocking in the kernel vs. busy polling.
+static void bench_timer_lateness(int64_t busy_poll_ns) {
+    rtcbase::EventLoop el(nullptr, false);
+    el.set_busy_poll(busy_poll_ns);
+    LatenessBench bench;
+    bench.total_ns = 0;
+    bench.max_ns = 0;
+    bench.fired = 0;
+    rtcbase::TimerWatcher* timer = el.create_timer(lateness_timer_cb, &bench, false);
+    el.update_now();
+    bench.deadline_ns = (int64_t)rtcbase::time_nanos() + k_lateness_timeout_us * 1000;
+    el.start_timer(timer, k_lateness_timeout_us);
+    el.run();
+    el.delete_timer(timer);
+
+    std::cout << "timer lateness "
+        << (busy_poll_ns > 0 ? "busy poll" : "blocking") << ": "
+        << bench.total_ns / k_lateness_timers / 1000 << " us average, "
+        << bench.max_ns / 1000 << " us worst" << std::endl;
+}
+
+void test_busy_poll_bench() {
+    bench_timer_lateness(0);
+    bench_timer_lateness(k_busy_poll_budget_ns);
+}
@@ -0,0 +1,285 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file flow_table_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <rtcbase/random.h>
+#include <rtcbase/time_utils.h>
+#include <rtcbase/socket_address.h>
+#include <rtcbase/flow_table.h>
+
+static const int k_bench_flows = 50000;
+static const int k_bench_lookups = 4000000;
+// Of every 8 lookups one is for an unknown source.
+static const int k_bench_miss_ratio = 8;
+
+struct FlowBench {
+    std::vector<rtcbase::SocketAddress> flows;
+    std::vector<rtcbase::SocketAddress> unknown;
+    std::vector<uint32_t> order;
+    std::vector<int> sessions;
+};
+
+static void make_flows(FlowBench* bench) {
+    rtcbase::Random random(1234);
+    for (int i = 0; i < k_bench_flows; ++i) {
+        // A tenth of the clients on IPv6.
+        if (i % 10 == 0) {
+            in6_addr ip6;
+            for (size_t j = 0; j < sizeof(ip6); j += 4) {
+                uint32_t word = random.rand<uint32_t>();
+                memcpy(reinterpret_cast<char*>(&ip6) + j, &word, 4);
+            }
+            bench->flows.push_back(rtcbase::SocketAddress(rtcbase::IPAddress(ip6),
+                        random.rand(1024, 65535)));
+        } else {
+            bench->flows.push_back(rtcbase::SocketAddress(random.rand<uint32_t>(),
+                        random.rand(1024, 65535)));
+        }
+        bench->unknown.push_back(rtcbase::SocketAddress(random.rand<uint32_t>(),
+                    random.rand(1024, 65535)));
+        bench->sessions.push_back(i);
+    }
+    for (int i = 0; i < k_bench_lookups; ++i) {
+        bench->order.push_back(random.rand(k_bench_flows - 1));
+    }
+}
+
+static const rtcbase::SocketAddress& lookup_addr(const FlowBench& bench, int i) {
+    uint32_t index = bench.order[i];
+    return (i % k_bench_miss_ratio == 0) ? bench.unknown[index] : bench.flows[index];
+}
+
+static void report(const char* name, uint64_t nanos, uint64_t found) {
+    std::cout << name << ": " << nanos / k_bench_lookups << " ns/lookup, "
+        << (uint64_t)k_bench_lookups * rtcbase::k_num_nanosecs_per_sec / nanos
+        << " lookups/sec, found " << found << std::endl;
+}
+
+// What consumers of signal_read_packet do today.
+static void bench_string_map(const FlowBench& bench) {
+    std::map<std::string, int*> table;
+    for (int i = 0; i < k_bench_flows; ++i) {
+        table[bench.flows[i].to_string()] = const_cast<int*>(&bench.sessions[i]);
+    }
+    uint64_t found = 0;
+    uint64_t start = rtcbase::time_nanos();
+    for (int i = 0; i < k_bench_lookups; ++i) {
+        std::map<std::string, int*>::iterator it =
+            table.find(lookup_addr(bench, i).to_string());
+        found += (it != table.end());
+    }
+    report("std::map<std::string>", rtcbase::time_nanos() - start, found);
+}
+
+static void bench_unordered_map(const FlowBench& bench) {
+    std::unordered_map<rtcbase::SocketAddressKey, int*> table;
+    for (int i = 0; i < k_bench_flows; ++i) {
+        table[rtcbase::SocketAddressKey(bench.flows[i])] =
+            const_cast<int*>(&bench.sessions[i]);
+    }
+    uint64_t found = 0;
+    uint64_t start = rtcbase::time_nanos();
+    for (int i = 0; i < k_bench_lookups; ++i) {
+        found += table.count(rtcbase::SocketAddressKey(lookup_addr(bench, i)));
+    }
+    report("std::unordered_map<SocketAddressKey>", rtcbase::time_nanos() - start, found);
+}
+
+static void bench_flow_table(const FlowBench& bench) {
+    rtcbase::FlowTable table;
+    std::vector<rtcbase::FlowTable::Handle> handles;
+    for (int i = 0; i < k_bench_flows; ++i) {
+        handles.push_back(table.insert(bench.flows[i],
+                    const_cast<int*>(&bench.sessions[i])));
+        assert(handles.back() != rtcbase::FlowTable::INVALID_HANDLE);
+    }
+    uint64_t found = 0;
+    uint64_t start = rtcbase::time_nanos();
+    for (int i = 0; i < k_bench_lookups; ++i) {
+        found += (table.lookup(rtcbase::SocketAddressKey(lookup_addr(bench, i))) != NULL);
+    }
+    report("FlowTable", rtcbase::time_nanos() - start, found);
+
+    // Session churn: half the flows go and come back, the handles of the
+    // old ones turn stale.
+    for (int i = 0; i < k_bench_flows; i += 2) {
+        table.erase(handles[i]);
+    }
+    for (int i = 0; i < k_bench_flows; i += 2) {
+        rtcbase::FlowTable::Handle handle = table.insert(bench.flows[i],
+                const_cast<int*>(&bench.sessions[i]));
+        assert(handle != handles[i] && !table.is_valid(handles[i]));
+        assert(table.data(handle) == &bench.sessions[i]);
+        (void)handle;
+    }
+    assert(table.size() == (size_t)k_bench_flows);
+    for (int i = 0; i < k_bench_flows; ++i) {
+        assert(table.lookup(rtcbase::SocketAddressKey(bench.flows[i]))
+                == &bench.sessions[i]);
+        assert(table.find(bench.unknown[i]) == rtcbase::FlowTable::INVALID_HANDLE);
+    }
+}
+
+void test_flow_table_bench() {
+    FlowBench bench;
+    make_flows(&bench);
+    bench_string_map(bench);
+    bench_unordered_map(bench);
+    bench_flow_table(bench);
+}
+
+
+
+static const int k_table_flows = 1000;
+
+// Insert, find and erase of a few flows, v4-mapped addresses are the same
+// flow as their IPv4 address.
+static void check_insert_find_erase() {
+    rtcbase::FlowTable table;
+    int sessions[3] = {0, 1, 2};
+    rtcbase::SocketAddress v4("192.168.1.10", 5000);
+    rtcbase::SocketAddress v6("2001:db8::1", 5000);
+    rtcbase::SocketAddress mapped("::ffff:192.168.1.10", 5000);
+    rtcbase::FlowTable::Handle h4 = table.insert(v4, &sessions[0]);
+    rtcbase::FlowTable::Handle h6 = table.insert(v6, &sessions[1]);
+    assert(h4 != rtcbase::FlowTable::INVALID_HANDLE);
+    assert(h6 != rtcbase::FlowTable::INVALID_HANDLE && h6 != h4);
+    assert(2 == table.size());
+
+    // One flow per address.
+    assert(rtcbase::FlowTable::INVALID_HANDLE == table.insert(v4, &sessions[2]));
+    assert(rtcbase::FlowTable::INVALID_HANDLE == table.insert(mapped, &sessions[2]));
+    assert(h4 == table.find(mapped));
+    assert(v4 == table.address(h4));
+    assert(v6 == table.address(h6));
+    assert(&sessions[1] == table.lookup(rtcbase::SocketAddressKey(v6)));
+    // Another port is another flow.
+    assert(rtcbase::FlowTable::INVALID_HANDLE ==
+            table.find(rtcbase::SocketAddress("192.168.1.10", 5001)));
+
+    assert(table.set_data(h4, &sessions[2]));
+    assert(&sessions[2] == table.data(h4));
+
+    assert(table.erase(v4));
+    assert(1 == table.size());
+    assert(rtcbase::FlowTable::INVALID_HANDLE == table.find(v4));
+    assert(NULL == table.lookup(rtcbase::SocketAddressKey(v4)));
+    assert(!table.erase(v4));
+    assert(h6 == table.find(v6));
+    (void)h4;
+    (void)h6;
+}
+
+// The handles of erased flows stay stale after their flow's place is taken
+// by a new flow, of the same address or another.
+static void check_stale_handles() {
+    rtcbase::FlowTable table;
+    int sessions[2] = {0, 1};
+    rtcbase::SocketAddress addr("10.0.0.1", 4000);
+    rtcbase::SocketAddress other("10.0.0.2", 4000);
+    rtcbase::FlowTable::Handle old = table.insert(addr, &sessions[0]);
+    assert(table.erase(old));
+
+    assert(!table.is_valid(old));
+    assert(NULL == table.data(old));
+    assert(!table.set_data(old, &sessions[1]));
+    assert(rtcbase::SocketAddress() == table.address(old));
+    assert(!table.erase(old));
+
+    // The erased flow's place comes back with a new generation.
+    rtcbase::FlowTable::Handle reinserted = table.insert(addr, &sessions[1]);
+    assert(reinserted != old);
+    assert((uint32_t)reinserted == (uint32_t)old);
+    assert(!table.is_valid(old) && table.is_valid(reinserted));
+    assert(&sessions[1] == table.data(reinserted));
+    assert(!table.erase(old));
+    assert(1 == table.size());
+
+    assert(table.erase(reinserted));
+    rtcbase::FlowTable::Handle taken = table.insert(other, &sessions[0]);
+    assert(!table.is_valid(old) && !table.is_valid(reinserted));
+    assert(other == table.address(taken));
+    (void)taken;
+
+    // clear() turns every handle stale.
+    table.clear();
+    assert(table.empty());
+    assert(!table.is_valid(taken));
+    assert(rtcbase::FlowTable::INVALID_HANDLE == table.find(other));
+}
+
+static void count_flow_cb(rtcbase::FlowTable::Handle, const rtcbase::SocketAddressKey&,
+        void*, void* priv_data)
+{
+    ++*static_cast<size_t*>(priv_data);
+}
+
+// Flows and handles survive the table growing, and erased flows leave no
+// trace for later lookups or inserts.
+static void check_growth_and_churn() {
+    rtcbase::FlowTable table;
+    std::vector<rtcbase::SocketAddress> addrs;
+    std::vector<int> sessions(k_table_flows);
+    std::vector<rtcbase::FlowTable::Handle> handles;
+    for (int i = 0; i < k_table_flows; ++i) {
+        addrs.push_back(rtcbase::SocketAddress(0x0A000000 + i, 1024 + i % 7));
+        handles.push_back(table.insert(addrs[i], &sessions[i]));
+        assert(handles[i] != rtcbase::FlowTable::INVALID_HANDLE);
+    }
+    assert((size_t)k_table_flows == table.size());
+    assert(table.capacity() >= table.size());
+    for (int i = 0; i < k_table_flows; ++i) {
+        assert(handles[i] == table.find(addrs[i]));
+        assert(&sessions[i] == table.data(handles[i]));
+    }
+
+    for (int i = 0; i < k_table_flows; i += 2) {
+        assert(table.erase(handles[i]));
+    }
+    assert((size_t)k_table_flows / 2 == table.size());
+    for (int i = 0; i < k_table_flows; ++i) {
+        bool erased = (0 == i % 2);
+        assert(erased == (rtcbase::FlowTable::INVALID_HANDLE == table.find(addrs[i])));
+        assert(erased != table.is_valid(handles[i]));
+        (void)erased;
+    }
+    for (int i = 0; i < k_table_flows; i += 2) {
+        rtcbase::FlowTable::Handle handle = table.insert(addrs[i], &sessions[i]);
+        assert(handle != handles[i] && !table.is_valid(handles[i]));
+        handles[i] = handle;
+    }
+    size_t visited = 0;
+    table.for_each(count_flow_cb, &visited);
+    assert((size_t)k_table_flows == visited);
+    for (int i = 0; i < k_table_flows; ++i) {
+        assert(handles[i] == table.find(addrs[i]));
+        assert(addrs[i] == table.address(handles[i]));
+    }
+}
+
+void test_flow_table() {
+    check_insert_find_erase();
+    check_stale_handles();
+    check_growth_and_churn();
+    std::cout << "flow table: ok" << std::endl;
+}
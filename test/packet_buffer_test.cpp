@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file packet_buffer_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <rtcbase/sigslot.h>
+#include <rtcbase/event_loop.h>
+#include <rtcbase/physical_socket_server.h>
+#include <rtcbase/platform_thread.h>
+#include <rtcbase/packet_buffer.h>
+#include <rtcbase/async_udp_socket.h>
+
+static const size_t k_pool_buffer_size = 1500;
+static const size_t k_pool_buffers = 64;
+
+typedef std::vector<rtcbase::scoped_refptr<rtcbase::PacketBuffer> > PacketBuffers;
+
+static void release_buffers_run(void* data) {
+    static_cast<PacketBuffers*>(data)->clear();
+}
+
+// Buffers dropped on another thread come back to the allocating thread
+// without the pool allocating new ones.
+static void check_cross_thread_release() {
+    rtcbase::scoped_refptr<rtcbase::PacketBufferPool> pool =
+        rtcbase::PacketBufferPool::create(k_pool_buffer_size);
+    PacketBuffers buffers;
+    std::vector<rtcbase::PacketBuffer*> released;
+    for (size_t i = 0; i < k_pool_buffers; ++i) {
+        buffers.push_back(pool->allocate());
+        buffers.back()->set_size(i + 1);
+        released.push_back(buffers.back().get());
+    }
+    assert(k_pool_buffers == pool->allocated_buffers());
+
+    rtcbase::PlatformThread thread(release_buffers_run, &buffers, "pool_release");
+    thread.start();
+    thread.stop();
+    assert(buffers.empty());
+
+    std::vector<rtcbase::PacketBuffer*> reused;
+    for (size_t i = 0; i < k_pool_buffers; ++i) {
+        buffers.push_back(pool->allocate());
+        // Handed out empty, whatever size they were released with.
+        assert(0 == buffers.back()->size());
+        assert(k_pool_buffer_size == buffers.back()->capacity());
+        reused.push_back(buffers.back().get());
+    }
+    assert(k_pool_buffers == pool->allocated_buffers());
+    std::sort(released.begin(), released.end());
+    std::sort(reused.begin(), reused.end());
+    assert(released == reused);
+}
+
+// The pool grows to the most buffers held at once and no further.
+static void check_peak_growth() {
+    rtcbase::scoped_refptr<rtcbase::PacketBufferPool> pool =
+        rtcbase::PacketBufferPool::create(k_pool_buffer_size);
+    PacketBuffers buffers;
+    static const size_t k_held[] = {16, 64, 8, 64, 32, 1};
+    size_t peak = 0;
+    for (size_t round = 0; round < sizeof(k_held) / sizeof(k_held[0]); ++round) {
+        for (size_t i = 0; i < k_held[round]; ++i) {
+            buffers.push_back(pool->allocate());
+        }
+        peak = std::max(peak, k_held[round]);
+        assert(peak == pool->allocated_buffers());
+        buffers.clear();
+    }
+    assert(k_pool_buffers == pool->allocated_buffers());
+
+    // Reserved buffers count towards the peak.
+    pool->reserve(2 * k_pool_buffers);
+    assert(2 * k_pool_buffers == pool->allocated_buffers());
+    for (size_t i = 0; i < 2 * k_pool_buffers; ++i) {
+        buffers.push_back(pool->allocate());
+    }
+    assert(2 * k_pool_buffers == pool->allocated_buffers());
+}
+
+static const uint32_t k_pool_packets = 3;
+
+// Keeps the buffers a socket signals and stops the loop once all arrived.
+class BufferCollector : public rtcbase::HasSlots<> {
+public:
+    explicit BufferCollector(rtcbase::EventLoop* el) : _el(el) {}
+
+    void on_read_packet_buffer(rtcbase::AsyncPacketSocket*,
+            const rtcbase::scoped_refptr<rtcbase::PacketBuffer>& buffer,
+            const rtcbase::SocketAddress&, const rtcbase::PacketTime&)
+    {
+        buffers.push_back(buffer);
+        if (k_pool_packets == buffers.size()) {
+            _el->stop();
+        }
+    }
+
+    PacketBuffers buffers;
+
+private:
+    rtcbase::EventLoop* _el;
+};
+
+static void stop_pool_loop_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher*, void*) {
+    el->stop();
+}
+
+// Packets held by the application keep the pool alive after the socket
+// that received them, and the only other reference, are gone.
+static void check_pool_outlives_socket() {
+    rtcbase::EventLoop el(nullptr, false);
+    rtcbase::PhysicalSocketServer ss;
+    rtcbase::AsyncSocket* socket = ss.create_async_socket(AF_INET, SOCK_DGRAM);
+    socket->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+    std::unique_ptr<rtcbase::AsyncUDPSocket> receiver(
+            new rtcbase::AsyncUDPSocket(&el, socket));
+    receiver->set_packet_buffer_pool(
+            rtcbase::PacketBufferPool::create(k_pool_buffer_size));
+    rtcbase::PacketBufferPool* pool = receiver->packet_buffer_pool();
+    BufferCollector collector(&el);
+    receiver->signal_read_packet_buffer.connect(&collector,
+            &BufferCollector::on_read_packet_buffer);
+
+    std::unique_ptr<rtcbase::Socket> sender(ss.create_socket(AF_INET, SOCK_DGRAM));
+    for (uint32_t id = 0; id < k_pool_packets; ++id) {
+        sender->send_to(&id, sizeof(id), receiver->get_local_address());
+    }
+    rtcbase::TimerWatcher* timer = el.create_timer(stop_pool_loop_cb, nullptr, false);
+    el.start_timer(timer, 1000 * 1000);
+    el.run();
+    el.delete_timer(timer);
+    assert(k_pool_packets == collector.buffers.size());
+
+    receiver.reset();
+    // Still readable, and so is the pool they point to.
+    for (uint32_t id = 0; id < k_pool_packets; ++id) {
+        const rtcbase::scoped_refptr<rtcbase::PacketBuffer>& buffer =
+            collector.buffers[id];
+        assert(sizeof(id) == buffer->size());
+        assert(0 == memcmp(buffer->data(), &id, sizeof(id)));
+        (void)buffer;
+    }
+    assert(pool->allocated_buffers() >= k_pool_packets);
+    assert(k_pool_buffer_size == pool->buffer_size());
+    // The last one frees the pool.
+    collector.buffers.clear();
+    (void)pool;
+}
+
+void test_packet_buffer_pool() {
+    check_cross_thread_release();
+    check_peak_growth();
+    check_pool_outlives_socket();
+    std::cout << "packet buffer pool: ok" << std::endl;
+}
@@ -0,0 +1,173 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file sharded_udp_socket_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <rtcbase/atomicops.h>
+#include <rtcbase/sigslot.h>
+#include <rtcbase/event_loop_pool.h>
+#include <rtcbase/physical_socket_server.h>
+#include <rtcbase/sharded_udp_socket.h>
+
+static const size_t k_shards = 4;
+static const int k_clients = 64;
+static const int k_client_packets = 4;
+
+// Counts the packets of each shard and echoes them through the shard that
+// received them.
+class ShardEcho : public rtcbase::HasSlots<> {
+public:
+    ShardEcho(rtcbase::EventLoopPool* pool, rtcbase::ShardedUDPSocket* sharded) :
+        _pool(pool), _sharded(sharded)
+    {
+        for (size_t i = 0; i < k_shards; ++i) {
+            received[i] = 0;
+        }
+    }
+
+    void on_read_packet(rtcbase::AsyncPacketSocket* socket, const char* data,
+            size_t size, const rtcbase::SocketAddress& addr,
+            const rtcbase::PacketTime&)
+    {
+        // Delivered on the thread of the shard that received it.
+        int index = _pool->current_index();
+        assert(index >= 0);
+        assert(socket == _sharded->shard(index));
+        rtcbase::AtomicOps::increment(&received[index]);
+        socket->send_to(data, size, addr, rtcbase::PacketOptions());
+    }
+
+    int total() {
+        int total = 0;
+        for (size_t i = 0; i < k_shards; ++i) {
+            total += rtcbase::AtomicOps::acquire_load(&received[i]);
+        }
+        return total;
+    }
+
+    volatile int received[k_shards];
+
+private:
+    rtcbase::EventLoopPool* _pool;
+    rtcbase::ShardedUDPSocket* _sharded;
+};
+
+// Reads |count| packets of |id| from |socket|, waiting up to a second.
+static void check_client_received(rtcbase::AsyncSocket* socket, int id, int count) {
+    for (int i = 0, waits = 0; i < count; ) {
+        int value = -1;
+        rtcbase::SocketAddress from;
+        int64_t timestamp;
+        int len = socket->recv_from(&value, sizeof(value), &from, &timestamp);
+        if (0 == len) {
+            assert(++waits < 1000);
+            usleep(1000);
+            continue;
+        }
+        assert(sizeof(value) == (size_t)len);
+        assert(id == value);
+        ++i;
+    }
+}
+
+void test_sharded_udp_socket() {
+    rtcbase::PhysicalSocketServer ss;
+    std::unique_ptr<rtcbase::EventLoopPool> pool(
+            new rtcbase::EventLoopPool(k_shards, "test_shard"));
+    std::unique_ptr<rtcbase::ShardedUDPSocket> sharded(
+            rtcbase::ShardedUDPSocket::create(pool.get(), &ss,
+                rtcbase::SocketAddress("127.0.0.1", 0)));
+    if (!sharded) {
+        std::cout << "sharded udp socket: SO_REUSEPORT not supported, skipped"
+            << std::endl;
+        return;
+    }
+    assert(k_shards == sharded->shard_count());
+    rtcbase::SocketAddress addr = sharded->get_local_address();
+    for (size_t i = 0; i < k_shards; ++i) {
+        assert(addr == sharded->shard(i)->get_local_address());
+    }
+    ShardEcho echo(pool.get(), sharded.get());
+    sharded->connect_read_packet(&echo, &ShardEcho::on_read_packet);
+    pool->start();
+
+    // The kernel spreads the clients over the shards by their source port.
+    std::vector<std::unique_ptr<rtcbase::AsyncSocket> > clients;
+    for (int id = 0; id < k_clients; ++id) {
+        clients.push_back(std::unique_ptr<rtcbase::AsyncSocket>(
+                    ss.create_async_socket(AF_INET, SOCK_DGRAM)));
+        clients.back()->bind(rtcbase::SocketAddress("127.0.0.1", 0));
+        for (int i = 0; i < k_client_packets; ++i) {
+            clients.back()->send_to(&id, sizeof(id), addr);
+        }
+    }
+    for (int i = 0; i < 1000 && echo.total() < k_clients * k_client_packets; ++i) {
+        usleep(1000);
+    }
+    assert(k_clients * k_client_packets == echo.total());
+    size_t busy_shards = 0;
+    for (size_t i = 0; i < k_shards; ++i) {
+        if (echo.received[i] > 0) {
+            ++busy_shards;
+        }
+    }
+    assert(busy_shards > 1);
+    for (int id = 0; id < k_clients; ++id) {
+        check_client_received(clients[id].get(), id, k_client_packets);
+    }
+
+    // From outside the pool a send is handed to a shard's loop.
+    int id = k_clients;
+    assert(sizeof(id) == (size_t)sharded->send_to(&id, sizeof(id),
+                clients[0]->get_local_address(), rtcbase::PacketOptions()));
+    check_client_received(clients[0].get(), id, 1);
+
+    // From outside the pool, options and close() are applied by each
+    // shard's own loop.
+    int ret = sharded->set_option(rtcbase::Socket::OPT_DSCP, rtcbase::DSCP_EF);
+    assert(0 == ret);
+    for (size_t i = 0; i < k_shards; ++i) {
+        int dscp = -1;
+        for (int waits = 0; dscp != rtcbase::DSCP_EF; ++waits) {
+            assert(waits < 1000);
+            usleep(1000);
+            sharded->shard(i)->get_option(rtcbase::Socket::OPT_DSCP, &dscp);
+        }
+    }
+    ret = sharded->close();
+    assert(0 == ret);
+    // Stopping runs what was posted before.
+    pool->stop();
+    for (size_t i = 0; i < k_shards; ++i) {
+        int dscp = -1;
+        assert(sharded->shard(i)->get_option(rtcbase::Socket::OPT_DSCP, &dscp) < 0);
+        (void)dscp;
+    }
+    (void)ret;
+
+    // Sends that find the pool stopped are freed with it.
+    sharded->send_to(&id, sizeof(id), clients[0]->get_local_address(),
+            rtcbase::PacketOptions());
+    sharded.reset();
+    pool.reset();
+    (void)busy_shards;
+    std::cout << "sharded udp socket: ok" << std::endl;
+}
@@ -0,0 +1,291 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file socket_address_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <arpa/inet.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rtcbase/random.h>
+#include <rtcbase/time_utils.h>
+#include <rtcbase/socket_address.h>
+
+static const int k_bench_addresses = 10000;
+static const int k_bench_rounds = 100;
+
+// The formatting and parsing as they were done before to_chars() and
+// IP_from_chars(), for comparison.
+static std::string legacy_to_string(const rtcbase::SocketAddress& addr) {
+    char buf[INET6_ADDRSTRLEN] = {0};
+    in_addr ip4 = addr.ipaddr().ipv4_address();
+    in6_addr ip6 = addr.ipaddr().ipv6_address();
+    const void* src = (AF_INET6 == addr.family()) ? (const void*)&ip6 : (const void*)&ip4;
+    std::string host = inet_ntop(addr.family(), src, buf, sizeof(buf)) ? buf : "";
+    std::ostringstream ost;
+    if (AF_INET6 == addr.family()) {
+        ost << "[" + host + "]";
+    } else {
+        ost << host;
+    }
+    ost << ":" << addr.port();
+    return ost.str();
+}
+
+static bool legacy_IP_from_string(const std::string& str, rtcbase::IPAddress* out) {
+    in_addr addr;
+    if (inet_pton(AF_INET, str.c_str(), &addr) == 0) {
+        in6_addr addr6;
+        if (inet_pton(AF_INET6, str.c_str(), &addr6) == 0) {
+            *out = rtcbase::IPAddress();
+            return false;
+        }
+        *out = rtcbase::IPAddress(addr6);
+    } else {
+        *out = rtcbase::IPAddress(addr);
+    }
+    return true;
+}
+
+static void make_addresses(std::vector<rtcbase::SocketAddress>* addrs) {
+    rtcbase::Random random(4321);
+    for (int i = 0; i < k_bench_addresses; ++i) {
+        // A quarter of the peers on IPv6, with the zero runs of real ones.
+        if (i % 4 == 0) {
+            in6_addr ip6;
+            memset(&ip6, 0, sizeof(ip6));
+            ip6.s6_addr[0] = 0x20;
+            ip6.s6_addr[1] = 0x01;
+            for (size_t j = 8; j < sizeof(ip6); ++j) {
+                ip6.s6_addr[j] = (uint8_t)random.rand(0, 255);
+            }
+            addrs->push_back(rtcbase::SocketAddress(rtcbase::IPAddress(ip6),
+                        random.rand(1024, 65535)));
+        } else {
+            addrs->push_back(rtcbase::SocketAddress(random.rand<uint32_t>(),
+                        random.rand(1024, 65535)));
+        }
+    }
+}
+
+static void report(const char* name, uint64_t nanos) {
+    uint64_t ops = (uint64_t)k_bench_addresses * k_bench_rounds;
+    std::cout << name << ": " << nanos / ops << " ns/op" << std::endl;
+}
+
+static void bench_format(const std::vector<rtcbase::SocketAddress>& addrs) {
+    size_t total = 0;
+    uint64_t start = rtcbase::time_nanos();
+    for (int round = 0; round < k_bench_rounds; ++round) {
+        for (size_t i = 0; i < addrs.size(); ++i) {
+            total += legacy_to_string(addrs[i]).size();
+        }
+    }
+    report("format inet_ntop + ostringstream", rtcbase::time_nanos() - start);
+
+    size_t check = 0;
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_bench_rounds; ++round) {
+        for (size_t i = 0; i < addrs.size(); ++i) {
+            check += addrs[i].to_string().size();
+        }
+    }
+    report("format SocketAddress::to_string", rtcbase::time_nanos() - start);
+    assert(check == total);
+
+    check = 0;
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_bench_rounds; ++round) {
+        for (size_t i = 0; i < addrs.size(); ++i) {
+            char buf[rtcbase::k_socket_address_max_chars];
+            check += addrs[i].to_chars(buf, sizeof(buf));
+        }
+    }
+    report("format SocketAddress::to_chars", rtcbase::time_nanos() - start);
+    assert(check == total);
+
+    for (size_t i = 0; i < addrs.size(); ++i) {
+        assert(addrs[i].to_string() == legacy_to_string(addrs[i]));
+    }
+    (void)check;
+}
+
+static void bench_parse(const std::vector<rtcbase::SocketAddress>& addrs) {
+    std::vector<std::string> texts;
+    for (size_t i = 0; i < addrs.size(); ++i) {
+        texts.push_back(addrs[i].ipaddr().to_string());
+    }
+
+    size_t found = 0;
+    uint64_t start = rtcbase::time_nanos();
+    for (int round = 0; round < k_bench_rounds; ++round) {
+        for (size_t i = 0; i < texts.size(); ++i) {
+            rtcbase::IPAddress ip;
+            found += legacy_IP_from_string(texts[i], &ip);
+        }
+    }
+    report("parse inet_pton", rtcbase::time_nanos() - start);
+
+    size_t check = 0;
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_bench_rounds; ++round) {
+        for (size_t i = 0; i < texts.size(); ++i) {
+            rtcbase::IPAddress ip;
+            check += rtcbase::IP_from_chars(texts[i].data(), texts[i].size(), &ip);
+        }
+    }
+    report("parse IP_from_chars", rtcbase::time_nanos() - start);
+    assert(check == found && found == texts.size() * k_bench_rounds);
+
+    for (size_t i = 0; i < texts.size(); ++i) {
+        rtcbase::IPAddress ip;
+        rtcbase::IP_from_chars(texts[i].data(), texts[i].size(), &ip);
+        assert(ip == addrs[i].ipaddr());
+        rtcbase::SocketAddress addr;
+        assert(addr.from_string(addrs[i].to_string()) && addr == addrs[i]);
+    }
+    (void)check;
+}
+
+void test_address_format_bench() {
+    std::vector<rtcbase::SocketAddress> addrs;
+    make_addresses(&addrs);
+    bench_format(addrs);
+    bench_parse(addrs);
+}
+
+
+
+// Inputs for IP_from_chars(), valid or not, what inet_pton() says decides.
+static const char* const k_ip_inputs[] = {
+    // IPv4.
+    "0.0.0.0", "1.2.3.4", "127.0.0.1", "255.255.255.255", "192.168.100.200",
+    "256.1.1.1", "1.2.3", "1.2.3.4.5", "1.2.3.4.", ".1.2.3.4", "01.2.3.4",
+    "1..2.3", "1.2.3.4x", " 1.2.3.4", "1.2.3.4 ", "0x1.2.3.4", "1.2.3.-4",
+    // IPv6, with and without "::" compression.
+    "::", "::1", "1::", "1:2:3:4:5:6:7:8", "2001:db8::1", "2001:DB8:0:0:1::1",
+    "fe80::1", "1:0:0:2::3", "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8",
+    "0:0:0:0:0:0:0:0", "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff",
+    // v4-mapped and other embedded IPv4.
+    "::ffff:1.2.3.4", "::ffff:0.0.0.0", "::1.2.3.4", "64:ff9b::192.0.2.33",
+    "1:2:3:4:5:6:1.2.3.4", "::ffff:1.2.3", "::ffff:256.1.2.3",
+    "1:2:3:4:5:6:7:1.2.3.4", "::1.2.3.4:5",
+    // Scoped addresses are not numeric addresses.
+    "fe80::1%eth0", "fe80::1%1",
+    // Overlong groups, too many or too few groups.
+    "12345::", "1:00000::", "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7", "1:2:3:4:5:6:7:8::",
+    // Misplaced or doubled "::".
+    "1::2::3", ":::", ":1::2", "1::2:", ":", "1:", "::1::",
+    // Trailing garbage and other characters.
+    "::1x", "::g", "2001:db8::1 ", "[::1]", "::1/128", "1:2:3:4:5:6:7:8.",
+    "",
+};
+
+// IP_from_chars() accepts exactly what inet_pton() accepts, with the same
+// bytes, and to_chars() writes what inet_ntop() writes.
+static void check_ip_chars_table() {
+    for (size_t i = 0; i < sizeof(k_ip_inputs) / sizeof(k_ip_inputs[0]); ++i) {
+        const char* input = k_ip_inputs[i];
+        rtcbase::IPAddress expected;
+        bool valid = legacy_IP_from_string(input, &expected);
+        rtcbase::IPAddress ip;
+        if (rtcbase::IP_from_chars(input, strlen(input), &ip) != valid || ip != expected) {
+            std::cout << "IP_from_chars mismatch: \"" << input << "\"" << std::endl;
+            assert(false);
+        }
+        if (!valid) {
+            assert(AF_UNSPEC == ip.family());
+            continue;
+        }
+        assert(expected.family() == ip.family());
+
+        char buf[INET6_ADDRSTRLEN] = {0};
+        in_addr ip4 = ip.ipv4_address();
+        in6_addr ip6 = ip.ipv6_address();
+        const void* src = (AF_INET6 == ip.family()) ? (const void*)&ip6 : (const void*)&ip4;
+        const char* text = inet_ntop(ip.family(), src, buf, sizeof(buf));
+        assert(text);
+        char chars[rtcbase::k_ip_address_max_chars];
+        size_t len = ip.to_chars(chars, sizeof(chars));
+        if (std::string(chars, len) != buf || strlen(chars) != len) {
+            std::cout << "to_chars mismatch: \"" << input << "\" -> \""
+                << std::string(chars, len) << "\", inet_ntop \"" << buf << "\""
+                << std::endl;
+            assert(false);
+        }
+        assert(std::string(buf) == ip.to_string());
+        // Too small a buffer for the text and its NUL.
+        assert(0 == ip.to_chars(chars, len));
+        (void)text;
+    }
+}
+
+// Only the |len| characters count, without a NUL terminator after them.
+static void check_ip_chars_length() {
+    static const char k_v4[] = "10.1.2.3:5000";
+    static const char k_v6[] = "fe80::1%eth0";
+    // Cut at each length, only the whole address parses.
+    static const struct {
+        const char* str;
+        size_t len;
+        bool valid;
+    } k_cuts[] = {
+        {k_v4, 8, true}, {k_v4, 9, false}, {k_v4, 5, false},
+        {k_v6, 7, true}, {k_v6, 8, false}, {k_v6, 0, false},
+    };
+    for (size_t i = 0; i < sizeof(k_cuts) / sizeof(k_cuts[0]); ++i) {
+        rtcbase::IPAddress ip;
+        bool valid = rtcbase::IP_from_chars(k_cuts[i].str, k_cuts[i].len, &ip);
+        assert(k_cuts[i].valid == valid);
+        rtcbase::IPAddress expected;
+        legacy_IP_from_string(std::string(k_cuts[i].str, k_cuts[i].len), &expected);
+        assert(expected == ip);
+        (void)valid;
+    }
+    bool valid = rtcbase::IP_from_chars(k_v6, 7, NULL);
+    assert(!valid);
+    (void)valid;
+}
+
+// A scope id is not part of the text, in either direction.
+static void check_scoped_address_chars() {
+    rtcbase::IPAddress ip;
+    rtcbase::IP_from_string("fe80::1", &ip);
+    rtcbase::SocketAddress addr(ip, 5000);
+    addr.set_scope_ID(2);
+    char chars[rtcbase::k_socket_address_max_chars];
+    size_t len = addr.to_chars(chars, sizeof(chars));
+    assert(std::string("[fe80::1]:5000") == std::string(chars, len));
+    assert(legacy_to_string(addr) == std::string(chars, len));
+
+    rtcbase::SocketAddress parsed;
+    bool valid = parsed.from_chars(chars, len);
+    assert(valid && parsed == addr && 0 == parsed.scope_id());
+    // With a scope the host is no numeric address, it is kept as a name.
+    valid = parsed.from_string("[fe80::1%2]:5000");
+    assert(valid && parsed.is_unresolved_IP() && 5000 == parsed.port());
+    (void)len;
+    (void)valid;
+}
+
+void test_address_chars() {
+    check_ip_chars_table();
+    check_ip_chars_length();
+    check_scoped_address_chars();
+    std::cout << "address chars: ok" << std::endl;
+}
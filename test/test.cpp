@@ -21,6 +21,42 @@ int main() {
     //test_create_networks();
     //test_array_size();
     test_base64();
+    //test_udp_recv_batch_bench();
+    //test_timer_bench();
+    test_timing_wheel();
+    test_event_loop_pool();
+    test_event_loop_post();
+    test_event_loop_watchers();
+    test_event_loop_deadlines();
+    test_event_loop_stats();
+    test_event_loop_busy_poll();
+    //test_busy_poll_bench();
+    test_sharded_udp_socket();
+    //test_paced_send_bench();
+    test_paced_packet_socket();
+    //test_udp_forward_bench();
+    test_flow_table();
+    //test_flow_table_bench();
+    test_address_chars();
+    //test_address_format_bench();
+    //test_socket_stats();
+    test_udp_socket_stats();
+    test_udp_send_queue();
+    test_udp_send_flush();
+    test_udp_send_queue_limits();
+    test_udp_send_gather();
+    test_udp_gso_gro();
+    test_udp_recv_timestamp();
+    test_udp_packet_marking();
+    test_udp_io_uring();
+    test_packet_buffer_pool();
+    test_udp_flow_dispatch();
+    test_chained_byte_buffer();
+    //test_byte_buffer_bench();
+    test_byte_order();
+    //test_byte_order_bench();
+    test_varint();
+    //test_varint_bench();
     return 0;
 }
 
@@ -23,6 +23,42 @@
 void test_create_networks();
 void test_array_size();
 void test_base64();
+void test_udp_recv_batch_bench();
+void test_timer_bench();
+void test_timing_wheel();
+void test_event_loop_pool();
+void test_event_loop_post();
+void test_event_loop_watchers();
+void test_event_loop_deadlines();
+void test_event_loop_stats();
+void test_event_loop_busy_poll();
+void test_busy_poll_bench();
+void test_sharded_udp_socket();
+void test_paced_send_bench();
+void test_paced_packet_socket();
+void test_udp_forward_bench();
+void test_flow_table();
+void test_flow_table_bench();
+void test_address_chars();
+void test_address_format_bench();
+void test_socket_stats();
+void test_udp_socket_stats();
+void test_udp_send_queue();
+void test_udp_send_flush();
+void test_udp_send_queue_limits();
+void test_udp_send_gather();
+void test_udp_gso_gro();
+void test_udp_recv_timestamp();
+void test_udp_packet_marking();
+void test_udp_io_uring();
+void test_packet_buffer_pool();
+void test_udp_flow_dispatch();
+void test_chained_byte_buffer();
+void test_byte_buffer_bench();
+void test_byte_order();
+void test_byte_order_bench();
+void test_varint();
+void test_varint_bench();
 
 #endif  //__RTCBASE_TEST_H_
 
@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file timing_wheel_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <vector>
+
+#include <rtcbase/time_utils.h>
+#include <rtcbase/event_loop.h>
+#include <rtcbase/timing_wheel.h>
+
+// Records the tick each node expired at.
+struct WheelProbe {
+    rtcbase::TimingWheel* wheel;
+    uint64_t now;
+    std::vector<rtcbase::TimingWheel::Node*> expired;
+    std::vector<uint64_t> ticks;
+};
+
+static void probe_expired_cb(rtcbase::TimingWheel::Node* node, void* data) {
+    WheelProbe* probe = static_cast<WheelProbe*>(data);
+    assert(!rtcbase::TimingWheel::is_pending(node));
+    probe->expired.push_back(node);
+    probe->ticks.push_back(probe->now);
+}
+
+// Advances one tick at a time up to |end|.
+static void advance_to(WheelProbe* probe, uint64_t end,
+        rtcbase::TimingWheel::expire_cb_t cb, void* data)
+{
+    while (probe->now < end) {
+        ++probe->now;
+        probe->wheel->advance(probe->now, cb, data);
+    }
+}
+
+// Every node fires at its own tick, never earlier, across the level 0
+// window and the cascades from the levels above.
+static void check_expiry_ticks() {
+    static const uint64_t k_start = 1000;
+    // Level 0, its last slot, the first ticks cascaded from level 1 and 2,
+    // and timers that wrap the level 1 window several times.
+    static const uint64_t k_delays[] = {
+        1, 5, 255, 256, 257, 300, 511, 512, 1000, 65535, 65536, 65537, 70000
+    };
+    static const size_t k_count = sizeof(k_delays) / sizeof(k_delays[0]);
+
+    rtcbase::TimingWheel wheel(k_start);
+    WheelProbe probe;
+    probe.wheel = &wheel;
+    probe.now = k_start;
+    std::vector<rtcbase::TimingWheel::Node> nodes(k_count);
+    for (size_t i = 0; i < k_count; ++i) {
+        wheel.add(&nodes[i], k_start + k_delays[i]);
+        assert(rtcbase::TimingWheel::is_pending(&nodes[i]));
+    }
+    assert(k_count == wheel.size());
+    // Exact within the first window.
+    assert(k_start + 1 == wheel.next_expiry());
+
+    advance_to(&probe, k_start + k_delays[k_count - 1], probe_expired_cb, &probe);
+    assert(k_count == probe.expired.size());
+    for (size_t i = 0; i < k_count; ++i) {
+        assert(&nodes[i] == probe.expired[i]);
+        assert(k_start + k_delays[i] == probe.ticks[i]);
+    }
+    assert(wheel.empty());
+    assert(UINT64_MAX == wheel.next_expiry());
+
+    // A jump over many ticks fires everything due, in expiry order, and an
+    // expiry in the past fires on the next advance.
+    wheel.add(&nodes[0], probe.now + 70000);
+    wheel.add(&nodes[1], probe.now + 300);
+    wheel.add(&nodes[2], probe.now - 10);
+    probe.expired.clear();
+    probe.now += 299;
+    wheel.advance(probe.now, probe_expired_cb, &probe);
+    assert(1 == probe.expired.size() && &nodes[2] == probe.expired[0]);
+    probe.now += 100000;
+    wheel.advance(probe.now, probe_expired_cb, &probe);
+    assert(3 == probe.expired.size());
+    assert(&nodes[1] == probe.expired[1] && &nodes[0] == probe.expired[2]);
+}
+
+// From within the callback: the expired node is restarted and another
+// pending node, due right after it, is removed.
+struct RestartProbe {
+    WheelProbe probe;
+    rtcbase::TimingWheel::Node* victim;
+    int restarts;
+};
+
+static void restart_expired_cb(rtcbase::TimingWheel::Node* node, void* data) {
+    RestartProbe* restart = static_cast<RestartProbe*>(data);
+    probe_expired_cb(node, &restart->probe);
+    if (node == restart->victim) {
+        return;
+    }
+    if (restart->victim && rtcbase::TimingWheel::is_pending(restart->victim)) {
+        restart->probe.wheel->remove(restart->victim);
+        assert(!rtcbase::TimingWheel::is_pending(restart->victim));
+    }
+    if (restart->restarts-- > 0) {
+        // Far enough to land on level 1.
+        restart->probe.wheel->add(node, restart->probe.now + 300);
+    }
+}
+
+static void check_restart_in_callback() {
+    rtcbase::TimingWheel wheel(0);
+    RestartProbe restart;
+    restart.probe.wheel = &wheel;
+    restart.probe.now = 0;
+    restart.restarts = 2;
+    rtcbase::TimingWheel::Node node;
+    rtcbase::TimingWheel::Node victim;
+    restart.victim = &victim;
+    wheel.add(&node, 10);
+    wheel.add(&victim, 11);
+    advance_to(&restart.probe, 2000, restart_expired_cb, &restart);
+    // The victim never fired, the node fired at 10, 310 and 610.
+    assert(3 == restart.probe.expired.size());
+    assert(10 == restart.probe.ticks[0]);
+    assert(310 == restart.probe.ticks[1]);
+    assert(610 == restart.probe.ticks[2]);
+    for (size_t i = 0; i < restart.probe.expired.size(); ++i) {
+        assert(&node == restart.probe.expired[i]);
+    }
+    assert(wheel.empty());
+}
+
+static const int64_t k_loop_timeout_us = 300 * 1000;
+
+// Wheel timers of an EventLoop, checked against the loop clock.
+struct LoopWheelProbe {
+    rtcbase::TimerWatcher* long_timer;
+    rtcbase::TimerWatcher* restarted;
+    rtcbase::TimerWatcher* stopped;
+    int64_t start_ns;
+    int64_t long_fired_ns;
+    int restarted_fires;
+    int stopped_fires;
+};
+
+static void long_timer_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher*, void* data) {
+    LoopWheelProbe* probe = static_cast<LoopWheelProbe*>(data);
+    probe->long_fired_ns = rtcbase::time_nanos();
+    el->stop();
+}
+
+static void restarted_timer_cb(rtcbase::EventLoop* el, rtcbase::TimerWatcher* w, void* data) {
+    LoopWheelProbe* probe = static_cast<LoopWheelProbe*>(data);
+    ++probe->restarted_fires;
+    // The other timer is due right after, it must not fire any more.
+    el->stop_timer(probe->stopped);
+    if (probe->restarted_fires < 3) {
+        el->start_timer(w, 20 * 1000);
+    }
+}
+
+static void stopped_timer_cb(rtcbase::EventLoop*, rtcbase::TimerWatcher*, void* data) {
+    ++static_cast<LoopWheelProbe*>(data)->stopped_fires;
+}
+
+static void check_loop_wheel() {
+    rtcbase::EventLoop el(nullptr, false);
+    el.enable_timer_wheel();
+    LoopWheelProbe probe;
+    probe.long_fired_ns = -1;
+    probe.restarted_fires = 0;
+    probe.stopped_fires = 0;
+    probe.long_timer = el.create_timer(long_timer_cb, &probe, false);
+    probe.restarted = el.create_timer(restarted_timer_cb, &probe, false);
+    probe.stopped = el.create_timer(stopped_timer_cb, &probe, true);
+
+    probe.start_ns = el.now_nanos();
+    // Beyond the 256 ms of level 0, cascaded down from level 1.
+    el.start_timer(probe.long_timer, k_loop_timeout_us);
+    el.start_timer(probe.restarted, 20 * 1000);
+    el.start_timer(probe.stopped, 21 * 1000);
+    el.run();
+
+    assert(probe.long_fired_ns - probe.start_ns >= k_loop_timeout_us * 1000);
+    // Generous, the loop is not alone on the machine.
+    assert(probe.long_fired_ns - probe.start_ns < 2 * k_loop_timeout_us * 1000);
+    assert(3 == probe.restarted_fires);
+    assert(0 == probe.stopped_fires);
+
+    el.delete_timer(probe.long_timer);
+    el.delete_timer(probe.restarted);
+    el.delete_timer(probe.stopped);
+}
+
+void test_timing_wheel() {
+    check_expiry_ticks();
+    check_restart_in_callback();
+    check_loop_wheel();
+    std::cout << "timing wheel: ok" << std::endl;
+}
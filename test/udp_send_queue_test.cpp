@@ -0,0 +1,297 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file udp_send_queue_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/uio.h>
+
+#include <iostream>
+#include <string>
+
+#include <rtcbase/packet_buffer.h>
+#include <rtcbase/udp_send_queue.h>
+
+static const size_t k_queue_slots = 32;
+static const size_t k_queue_slot_size = 256;
+
+// Pushes a packet carrying |id|.
+static bool push_id(rtcbase::UdpSendQueue* queue, uint32_t id,
+        const rtcbase::SocketAddress& addr,
+        rtcbase::PacketPriority priority = rtcbase::PRIORITY_NORMAL)
+{
+    return queue->push(&id, sizeof(id), addr, -1, priority);
+}
+
+static uint32_t message_id(const rtcbase::SendMessage& msg) {
+    assert(sizeof(uint32_t) == msg.size);
+    uint32_t id;
+    memcpy(&id, msg.data, sizeof(id));
+    return id;
+}
+
+static void check_lazy_growth() {
+    rtcbase::SocketAddress addr("127.0.0.1", 5000);
+    rtcbase::UdpSendQueue queue(k_queue_slots, k_queue_slot_size);
+    assert(0 == queue.slot_capacity());
+
+    push_id(&queue, 0, addr);
+    assert(k_queue_slots == queue.slot_capacity());
+    for (uint32_t i = 1; i < k_queue_slots; ++i) {
+        push_id(&queue, i, addr);
+    }
+    assert(k_queue_slots == queue.slot_capacity());
+    // The second chunk is twice the first.
+    push_id(&queue, k_queue_slots, addr);
+    assert(3 * k_queue_slots == queue.slot_capacity());
+
+    // The packets of every chunk come out in order.
+    rtcbase::SendMessage msgs[64];
+    size_t count = queue.peek(msgs, 64);
+    assert(k_queue_slots + 1 == count);
+    for (size_t i = 0; i < count; ++i) {
+        assert(i == message_id(msgs[i]));
+        assert(addr == *msgs[i].addr);
+    }
+    queue.pop(count);
+    assert(queue.empty());
+
+    // Freed slots are taken again before the pool grows.
+    for (uint32_t i = 0; i < 3 * k_queue_slots; ++i) {
+        push_id(&queue, i, addr);
+    }
+    assert(3 * k_queue_slots == queue.slot_capacity());
+}
+
+// Peeks everything that is queued and checks the ids come out as |ids|.
+static void check_peek_order(rtcbase::UdpSendQueue* queue, const uint32_t* ids,
+        size_t count)
+{
+    rtcbase::SendMessage msgs[16];
+    assert(count <= 16);
+    assert(count == queue->peek(msgs, 16));
+    for (size_t i = 0; i < count; ++i) {
+        assert(ids[i] == message_id(msgs[i]));
+    }
+}
+
+static void check_round_robin() {
+    rtcbase::SocketAddress a("127.0.0.1", 5000);
+    rtcbase::SocketAddress b("127.0.0.1", 5001);
+    rtcbase::UdpSendQueue queue(k_queue_slots, k_queue_slot_size);
+    for (uint32_t i = 0; i < 3; ++i) {
+        push_id(&queue, 10 + i, a);
+    }
+    for (uint32_t i = 0; i < 3; ++i) {
+        push_id(&queue, 20 + i, b);
+    }
+    static const uint32_t k_order[] = {10, 20, 11, 21, 12, 22};
+    check_peek_order(&queue, k_order, 6);
+
+    // A higher class goes first, whatever its arrival.
+    push_id(&queue, 30, b, rtcbase::PRIORITY_HIGH);
+    static const uint32_t k_high_first[] = {30, 10, 20, 11, 21, 12, 22};
+    check_peek_order(&queue, k_high_first, 7);
+
+    // Popping a part of the peek resumes with the next destination.
+    queue.pop(2);
+    static const uint32_t k_resumed[] = {20, 11, 21, 12, 22};
+    check_peek_order(&queue, k_resumed, 5);
+}
+
+static void check_drop_newest() {
+    rtcbase::SocketAddress addr("127.0.0.1", 5000);
+    rtcbase::UdpSendQueue queue(k_queue_slots, k_queue_slot_size);
+    queue.set_limits(3, 0, rtcbase::UdpSendQueue::DROP_NEWEST);
+    for (uint32_t i = 0; i < 3; ++i) {
+        assert(push_id(&queue, i, addr));
+    }
+    assert(!push_id(&queue, 3, addr));
+    // Not even a higher class gets in.
+    assert(!push_id(&queue, 4, addr, rtcbase::PRIORITY_HIGH));
+    static const uint32_t k_kept[] = {0, 1, 2};
+    check_peek_order(&queue, k_kept, 3);
+
+    rtcbase::UdpSendQueue::Stats stats;
+    queue.get_stats(&stats);
+    assert(3 == stats.packets);
+    assert(3 * sizeof(uint32_t) == stats.bytes);
+    assert(1 == stats.dropped_packets[rtcbase::PRIORITY_NORMAL]);
+    assert(1 == stats.dropped_packets[rtcbase::PRIORITY_HIGH]);
+    assert(0 == stats.dropped_packets[rtcbase::PRIORITY_LOW]);
+    assert(2 == queue.dropped_packets());
+
+    // The byte bound counts the payloads, a packet larger than the bound
+    // never fits.
+    rtcbase::UdpSendQueue bytes_queue(k_queue_slots, k_queue_slot_size);
+    bytes_queue.set_limits(0, 10, rtcbase::UdpSendQueue::DROP_NEWEST);
+    assert(push_id(&bytes_queue, 0, addr));
+    assert(push_id(&bytes_queue, 1, addr));
+    assert(!push_id(&bytes_queue, 2, addr));
+    char large[11] = {0};
+    assert(!bytes_queue.push(large, sizeof(large), addr));
+    assert(2 == bytes_queue.size());
+    (void)large;
+}
+
+static void check_drop_oldest() {
+    rtcbase::SocketAddress a("127.0.0.1", 5000);
+    rtcbase::SocketAddress b("127.0.0.1", 5001);
+    rtcbase::UdpSendQueue queue(k_queue_slots, k_queue_slot_size);
+    queue.set_limits(3, 0, rtcbase::UdpSendQueue::DROP_OLDEST);
+    push_id(&queue, 0, a, rtcbase::PRIORITY_HIGH);
+    push_id(&queue, 1, b);
+    push_id(&queue, 2, a);
+    // The oldest packet goes, whatever its class and destination.
+    assert(push_id(&queue, 3, b, rtcbase::PRIORITY_LOW));
+    assert(push_id(&queue, 4, a, rtcbase::PRIORITY_LOW));
+    static const uint32_t k_kept[] = {2, 3, 4};
+    check_peek_order(&queue, k_kept, 3);
+
+    rtcbase::UdpSendQueue::Stats stats;
+    queue.get_stats(&stats);
+    assert(1 == stats.dropped_packets[rtcbase::PRIORITY_HIGH]);
+    assert(1 == stats.dropped_packets[rtcbase::PRIORITY_NORMAL]);
+    assert(0 == stats.dropped_packets[rtcbase::PRIORITY_LOW]);
+    assert(sizeof(uint32_t) == stats.dropped_bytes[rtcbase::PRIORITY_HIGH]);
+}
+
+static void check_drop_lowest_priority() {
+    rtcbase::SocketAddress a("127.0.0.1", 5000);
+    rtcbase::SocketAddress b("127.0.0.1", 5001);
+    rtcbase::UdpSendQueue queue(k_queue_slots, k_queue_slot_size);
+    queue.set_limits(4, 0, rtcbase::UdpSendQueue::DROP_LOWEST_PRIORITY);
+    push_id(&queue, 0, a, rtcbase::PRIORITY_LOW);
+    push_id(&queue, 1, b, rtcbase::PRIORITY_LOW);
+    push_id(&queue, 2, a, rtcbase::PRIORITY_NORMAL);
+    push_id(&queue, 3, b, rtcbase::PRIORITY_HIGH);
+
+    // The oldest packets of the lowest class make room first.
+    assert(push_id(&queue, 4, a, rtcbase::PRIORITY_HIGH));
+    assert(push_id(&queue, 5, b, rtcbase::PRIORITY_NORMAL));
+    static const uint32_t k_after_low[] = {3, 4, 2, 5};
+    check_peek_order(&queue, k_after_low, 4);
+
+    // Then the next class up, but never a class above the new packet's.
+    assert(push_id(&queue, 6, a, rtcbase::PRIORITY_HIGH));
+    assert(!push_id(&queue, 7, a, rtcbase::PRIORITY_LOW));
+    static const uint32_t k_after_normal[] = {3, 4, 6, 5};
+    check_peek_order(&queue, k_after_normal, 4);
+
+    rtcbase::UdpSendQueue::Stats stats;
+    queue.get_stats(&stats);
+    assert(0 == stats.dropped_packets[rtcbase::PRIORITY_HIGH]);
+    assert(1 == stats.dropped_packets[rtcbase::PRIORITY_NORMAL]);
+    assert(3 == stats.dropped_packets[rtcbase::PRIORITY_LOW]);
+    assert(3 * sizeof(uint32_t) == stats.dropped_bytes[rtcbase::PRIORITY_LOW]);
+    assert(4 == queue.dropped_packets());
+}
+
+// The parts of a push_v() come out as one packet, in order, whether they
+// fit a slot or not.
+static void check_push_v() {
+    rtcbase::SocketAddress addr("127.0.0.1", 5000);
+    rtcbase::UdpSendQueue queue(k_queue_slots, k_queue_slot_size);
+    std::string header("hdr:");
+    std::string payload(k_queue_slot_size, 'p');
+    std::string trailer(":end");
+    struct iovec iov[4];
+    iov[0].iov_base = &header[0];
+    iov[0].iov_len = header.size();
+    iov[1].iov_base = &payload[0];
+    iov[1].iov_len = 16;
+    // Empty parts are skipped.
+    iov[2].iov_base = nullptr;
+    iov[2].iov_len = 0;
+    iov[3].iov_base = &trailer[0];
+    iov[3].iov_len = trailer.size();
+    bool pushed = queue.push_v(iov, 4, addr, 0x2e);
+    assert(pushed);
+    // Larger than a slot.
+    iov[1].iov_len = payload.size();
+    pushed = queue.push_v(iov, 4, addr);
+    assert(pushed);
+    assert(2 == queue.size());
+    assert(2 * (header.size() + trailer.size()) + 16 + payload.size() == queue.bytes());
+
+    rtcbase::SendMessage msgs[4];
+    size_t count = queue.peek(msgs, 4);
+    assert(2 == count);
+    std::string small = header + payload.substr(0, 16) + trailer;
+    std::string large = header + payload + trailer;
+    assert(std::string((const char*)msgs[0].data, msgs[0].size) == small);
+    assert(0x2e == msgs[0].tos);
+    assert(std::string((const char*)msgs[1].data, msgs[1].size) == large);
+    assert(-1 == msgs[1].tos);
+    queue.pop(count);
+    assert(queue.empty() && 0 == queue.bytes());
+    (void)pushed;
+    (void)count;
+}
+
+// A packet queued by reference is sent from the buffer itself, which the
+// queue holds on to until the packet is popped, dropped or cleared.
+static void check_push_buffer() {
+    rtcbase::SocketAddress addr("127.0.0.1", 5000);
+    rtcbase::UdpSendQueue queue(k_queue_slots, k_queue_slot_size);
+    rtcbase::scoped_refptr<rtcbase::PacketBufferPool> pool =
+        rtcbase::PacketBufferPool::create(1500);
+    rtcbase::scoped_refptr<rtcbase::PacketBuffer> buffer = pool->allocate();
+    // Larger than a slot, it is not copied either way.
+    buffer->set_size(1000);
+    memset(buffer->data(), 'b', buffer->size());
+
+    bool pushed = queue.push(buffer, addr);
+    assert(pushed);
+    assert(!buffer->has_one_ref());
+    assert(1000 == queue.bytes());
+    rtcbase::SendMessage msg;
+    size_t count = queue.peek(&msg, 1);
+    assert(1 == count);
+    assert(buffer->data() == msg.data);
+    assert(buffer->size() == msg.size);
+    queue.pop(1);
+    assert(buffer->has_one_ref());
+
+    // Dropped to make room.
+    queue.set_limits(1, 0, rtcbase::UdpSendQueue::DROP_OLDEST);
+    pushed = queue.push(buffer, addr);
+    assert(pushed && !buffer->has_one_ref());
+    pushed = push_id(&queue, 1, addr);
+    assert(pushed && buffer->has_one_ref());
+    assert(1 == queue.dropped_packets());
+
+    // Dropped by clear().
+    queue.set_limits(0, 0, rtcbase::UdpSendQueue::DROP_NEWEST);
+    pushed = queue.push(buffer, addr);
+    assert(pushed && !buffer->has_one_ref());
+    queue.clear();
+    assert(buffer->has_one_ref());
+    (void)pushed;
+    (void)count;
+}
+
+void test_udp_send_queue() {
+    check_lazy_growth();
+    check_round_robin();
+    check_drop_newest();
+    check_drop_oldest();
+    check_drop_lowest_priority();
+    check_push_v();
+    check_push_buffer();
+    std::cout << "udp send queue: ok" << std::endl;
+}
@@ -0,0 +1,431 @@
+/*
+ *  Copyright (c) 2018 str2num. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree.
+ */
+
+
+/**
+ * @file varint_test.cpp
+ * @author str2num
+ * @brief
+ *
+ **/
+
+#include <assert.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <rtcbase/random.h>
+#include <rtcbase/time_utils.h>
+#include <rtcbase/byte_buffer.h>
+#include <rtcbase/varint.h>
+
+static const int k_varint_rounds = 2000;
+// Sequence number deltas, timestamps and sizes of a telemetry batch.
+static const size_t k_varint_values = 4096;
+
+// The byte at a time loops ByteBufferWriter and ByteBufferReader used
+// before, kept to compare against, raw and as the members were.
+static size_t legacy_encode_uvarint(uint64_t val, char* out) {
+    size_t len = 0;
+    while (val >= 0x80) {
+        out[len++] = static_cast<char>(val) | 0x80;
+        val >>= 7;
+    }
+    out[len++] = static_cast<char>(val);
+    return len;
+}
+
+static size_t legacy_decode_uvarint(const char* in, size_t size, uint64_t* val) {
+    uint64_t v = 0;
+    size_t pos = 0;
+    for (int i = 0; i < 64; i += 7) {
+        if (pos >= size) {
+            return 0;
+        }
+        char byte = in[pos++];
+        v |= (static_cast<uint64_t>(byte) & 0x7F) << i;
+        if (static_cast<uint64_t>(byte) < 0x80) {
+            *val = v;
+            return pos;
+        }
+    }
+    return 0;
+}
+
+static void legacy_write_uvarint(rtcbase::ByteBufferWriter* writer, uint64_t val) {
+    char bytes[rtcbase::k_uvarint_max_size];
+    writer->write_bytes(bytes, legacy_encode_uvarint(val, bytes));
+}
+
+static bool legacy_read_uvarint(rtcbase::ByteBufferReader* reader, uint64_t* val) {
+    uint64_t v = 0;
+    for (int i = 0; i < 64; i += 7) {
+        char byte;
+        if (!reader->read_bytes(&byte, 1)) {
+            return false;
+        }
+        v |= (static_cast<uint64_t>(byte) & 0x7F) << i;
+        if (static_cast<uint64_t>(byte) < 0x80) {
+            *val = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Mostly small values, with a tail up to the full 64 bits.
+static uint64_t mixed_value(rtcbase::Random* random) {
+    uint32_t kind = random->rand(0, 99);
+    if (kind < 60) {
+        return random->rand(0, 0x7F);
+    } else if (kind < 85) {
+        return random->rand(0, 0x3FFF);
+    } else if (kind < 95) {
+        return random->rand(0, 0xFFFFFFF);
+    }
+    uint64_t high = random->rand<uint32_t>();
+    return (high << 32 | random->rand<uint32_t>()) >> random->rand(0, 63);
+}
+
+static void report(const char* name, uint64_t nanos, size_t values) {
+    std::cout << name << ": " << nanos * 1000 / (k_varint_rounds * values)
+        << " ps/value" << std::endl;
+}
+
+static void check_uvarint() {
+    rtcbase::Random random(31);
+    char legacy[rtcbase::k_uvarint_max_size];
+    char fast[rtcbase::k_uvarint_max_size];
+    for (int i = 0; i < 200000; ++i) {
+        uint64_t v = mixed_value(&random);
+        size_t len = legacy_encode_uvarint(v, legacy);
+        assert(rtcbase::uvarint_size(v) == len);
+        assert(rtcbase::encode_uvarint(v, fast) == len);
+        assert(0 == memcmp(legacy, fast, len));
+        (void)len;
+    }
+
+    // Random bytes, decoded the same whatever the size and the content,
+    // including the cut off and the too long.
+    std::vector<char> bytes(16);
+    for (int i = 0; i < 200000; ++i) {
+        for (size_t b = 0; b < bytes.size(); ++b) {
+            // Continuation bits more often than not, to get longer values.
+            bytes[b] = (char)(random.rand(0, 0x7F) |
+                    (random.rand(0, 9) < 8 ? 0x80 : 0));
+        }
+        size_t size = random.rand(0, bytes.size());
+        uint64_t expected = 0, v = 0;
+        size_t len = legacy_decode_uvarint(&bytes[0], size, &expected);
+        assert(rtcbase::decode_uvarint(&bytes[0], size, &v) == len);
+        assert(0 == len || v == expected);
+        (void)len;
+    }
+
+    // The same for a run of values, through the blocks of 16 bytes.
+    bytes.resize(64);
+    for (int i = 0; i < 20000; ++i) {
+        for (size_t b = 0; b < bytes.size(); ++b) {
+            bytes[b] = (char)(random.rand(0, 0x7F) |
+                    (random.rand(0, 9) < 5 ? 0x80 : 0));
+        }
+        size_t size = random.rand(0, bytes.size());
+        size_t count = random.rand(1, 24);
+        std::vector<uint64_t> expected(count), vals(count);
+        size_t pos = 0;
+        for (size_t n = 0; n < count && pos <= size; ++n) {
+            size_t len = legacy_decode_uvarint(&bytes[pos], size - pos, &expected[n]);
+            pos = (0 == len) ? size + 1 : pos + len;
+        }
+        size_t len = rtcbase::decode_uvarints(&bytes[0], size, &vals[0], count);
+        assert(len == (pos <= size ? pos : 0));
+        assert(0 == len || vals == expected);
+        (void)len;
+    }
+}
+
+static void check_bulk() {
+    rtcbase::Random random(57);
+    // Every count around the vector widths, runs of one byte values
+    // included.
+    for (size_t count = 0; count < 100; ++count) {
+        std::vector<uint64_t> vals(count + 1);
+        std::vector<uint32_t> words(count + 1);
+        for (size_t i = 0; i < count; ++i) {
+            vals[i] = (i % 20 < 17) ? random.rand(0, 0x7F) : mixed_value(&random);
+            words[i] = (uint32_t)mixed_value(&random);
+        }
+
+        rtcbase::ByteBufferWriter writer;
+        writer.write_uvarints(&vals[0], count);
+        writer.write_packed_uint32s(&words[0], count);
+        assert(writer.length() == rtcbase::uvarints_size(&vals[0], count) +
+                rtcbase::packed_uint32s_size(&words[0], count));
+
+        rtcbase::ByteBufferReader reader(writer);
+        std::vector<uint64_t> vals_out(count + 1);
+        std::vector<uint32_t> words_out(count + 1);
+        assert(reader.read_uvarints(&vals_out[0], count));
+        assert(reader.read_packed_uint32s(&words_out[0], count));
+        assert(0 == reader.length());
+        assert(vals_out == vals && words_out == words);
+
+        // Cut short, nothing is read.
+        if (count > 0) {
+            rtcbase::ByteBufferReader cut(writer.data(),
+                    rtcbase::uvarints_size(&vals[0], count) - 1);
+            assert(!cut.read_uvarints(&vals_out[0], count));
+            size_t packed = rtcbase::packed_uint32s_size(&words[0], count);
+            rtcbase::ByteBufferReader cut_packed(writer.data() + writer.length()
+                    - packed, packed - 1);
+            assert(!cut_packed.read_packed_uint32s(&words_out[0], count));
+            assert(packed - 1 == cut_packed.length());
+        }
+    }
+
+    // Storage too small for the batch, dropped whole.
+    uint64_t vals[4] = {1, 300, 70000, 5};
+    char storage[6];
+    rtcbase::ByteBufferWriter small(rtcbase::ByteBufferWriter::Storage(
+                storage, sizeof(storage)));
+    small.write_uvarints(vals, 4);
+    assert(small.overflow() && 0 == small.length());
+}
+
+// The lengths around each byte boundary, and input that is cut off or
+// runs past the longest encoding.
+static void check_malformed() {
+    static const struct {
+        uint64_t val;
+        size_t len;
+    } k_bounds[] = {
+        {0, 1}, {0x7F, 1}, {0x80, 2}, {0x3FFF, 2}, {0x4000, 3},
+        {(1ULL << 49) - 1, 7}, {1ULL << 49, 8}, {(1ULL << 56) - 1, 8},
+        {1ULL << 56, 9}, {(1ULL << 63) - 1, 9}, {1ULL << 63, 10},
+        {UINT64_MAX, 10},
+    };
+    for (size_t i = 0; i < sizeof(k_bounds) / sizeof(k_bounds[0]); ++i) {
+        char buf[rtcbase::k_uvarint_max_size];
+        size_t len = rtcbase::encode_uvarint(k_bounds[i].val, buf);
+        assert(k_bounds[i].len == len);
+        assert(len == rtcbase::uvarint_size(k_bounds[i].val));
+        uint64_t v = 0;
+        assert(len == rtcbase::decode_uvarint(buf, len, &v));
+        assert(k_bounds[i].val == v);
+        // Any shorter input ends before the value does.
+        for (size_t cut = 0; cut < len; ++cut) {
+            assert(0 == rtcbase::decode_uvarint(buf, cut, &v));
+        }
+        (void)len;
+    }
+
+    // Eleven bytes are one too many, even when the input goes on.
+    char overlong[24];
+    memset(overlong, 0x80, sizeof(overlong));
+    overlong[10] = 0;
+    uint64_t v = 0;
+    assert(0 == rtcbase::decode_uvarint(overlong, sizeof(overlong), &v));
+    // The same within a run of values, through the 16 byte blocks.
+    char run[40];
+    uint64_t vals[sizeof(run)];
+    memset(run, 1, sizeof(run));
+    memcpy(run + 3, overlong, 11);
+    assert(0 == rtcbase::decode_uvarints(run, sizeof(run), vals, 4));
+    // A run whose last value is cut off.
+    memset(run, 1, sizeof(run));
+    run[sizeof(run) - 1] = (char)0x80;
+    assert(0 == rtcbase::decode_uvarints(run, sizeof(run), vals, sizeof(run)));
+    (void)vals;
+
+    // Control bytes that promise more than the input has.
+    uint32_t words[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    char packed[8 + 32];
+    size_t size = rtcbase::encode_packed_uint32s(words, 8, packed, sizeof(packed));
+    assert(2 + 8 == size);
+    uint32_t out[8];
+    packed[1] = (char)0xFF;
+    assert(0 == rtcbase::decode_packed_uint32s(packed, size, out, 8));
+    assert(0 == rtcbase::decode_packed_uint32s(packed, 1, out, 8));
+    (void)size;
+    (void)out;
+}
+
+void test_varint() {
+    check_uvarint();
+    check_bulk();
+    check_malformed();
+    std::cout << "varint: ok" << std::endl;
+}
+
+static void bench_encode(const std::vector<uint64_t>& vals) {
+    std::vector<char> storage(vals.size() * rtcbase::k_uvarint_max_size);
+    size_t length = 0;
+
+    uint64_t start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        char* p = &storage[0];
+        for (size_t i = 0; i < vals.size(); ++i) {
+            p += legacy_encode_uvarint(vals[i], p);
+        }
+        length = p - &storage[0];
+    }
+    report("encode legacy loop", rtcbase::time_nanos() - start, vals.size());
+    std::string expected(&storage[0], length);
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        char* p = &storage[0];
+        for (size_t i = 0; i < vals.size(); ++i) {
+            p += rtcbase::encode_uvarint(vals[i], p);
+        }
+    }
+    report("encode encode_uvarint", rtcbase::time_nanos() - start, vals.size());
+    assert(std::string(&storage[0], length) == expected);
+
+    rtcbase::ByteBufferWriter::Storage out(&storage[0], storage.size());
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        rtcbase::ByteBufferWriter writer(out);
+        for (size_t i = 0; i < vals.size(); ++i) {
+            legacy_write_uvarint(&writer, vals[i]);
+        }
+    }
+    report("encode legacy write_uvarint", rtcbase::time_nanos() - start, vals.size());
+    assert(std::string(&storage[0], length) == expected);
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        rtcbase::ByteBufferWriter writer(out);
+        for (size_t i = 0; i < vals.size(); ++i) {
+            writer.write_uvarint(vals[i]);
+        }
+    }
+    report("encode write_uvarint", rtcbase::time_nanos() - start, vals.size());
+    assert(std::string(&storage[0], length) == expected);
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        rtcbase::ByteBufferWriter writer(out);
+        writer.write_uvarints(&vals[0], vals.size());
+    }
+    report("encode write_uvarints", rtcbase::time_nanos() - start, vals.size());
+    assert(std::string(&storage[0], length) == expected);
+}
+
+static void bench_decode(const std::vector<uint64_t>& vals) {
+    rtcbase::ByteBufferWriter writer;
+    writer.write_uvarints(&vals[0], vals.size());
+    const char* data = writer.data();
+    size_t length = writer.length();
+    std::vector<uint64_t> decoded(vals.size());
+
+    uint64_t start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        const char* p = data;
+        size_t left = length;
+        for (size_t i = 0; i < vals.size(); ++i) {
+            size_t len = legacy_decode_uvarint(p, left, &decoded[i]);
+            p += len;
+            left -= len;
+        }
+    }
+    report("decode legacy loop", rtcbase::time_nanos() - start, vals.size());
+    assert(decoded == vals);
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        const char* p = data;
+        size_t left = length;
+        for (size_t i = 0; i < vals.size(); ++i) {
+            size_t len = rtcbase::decode_uvarint(p, left, &decoded[i]);
+            p += len;
+            left -= len;
+        }
+    }
+    report("decode decode_uvarint", rtcbase::time_nanos() - start, vals.size());
+    assert(decoded == vals);
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        rtcbase::ByteBufferReader reader(data, length);
+        for (size_t i = 0; i < vals.size(); ++i) {
+            legacy_read_uvarint(&reader, &decoded[i]);
+        }
+    }
+    report("decode legacy read_uvarint", rtcbase::time_nanos() - start, vals.size());
+    assert(decoded == vals);
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        rtcbase::ByteBufferReader reader(data, length);
+        for (size_t i = 0; i < vals.size(); ++i) {
+            reader.read_uvarint(&decoded[i]);
+        }
+    }
+    report("decode read_uvarint", rtcbase::time_nanos() - start, vals.size());
+    assert(decoded == vals);
+
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        rtcbase::ByteBufferReader reader(data, length);
+        reader.read_uvarints(&decoded[0], decoded.size());
+    }
+    report("decode read_uvarints", rtcbase::time_nanos() - start, vals.size());
+    assert(decoded == vals);
+}
+
+static void bench_packed(const std::vector<uint64_t>& vals) {
+    std::vector<uint32_t> words(vals.size());
+    for (size_t i = 0; i < vals.size(); ++i) {
+        words[i] = (uint32_t)vals[i];
+    }
+    std::vector<char> storage(vals.size() * 5);
+    rtcbase::ByteBufferWriter::Storage out(&storage[0], storage.size());
+    size_t length = 0;
+
+    uint64_t start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        rtcbase::ByteBufferWriter writer(out);
+        writer.write_packed_uint32s(&words[0], words.size());
+        length = writer.length();
+    }
+    report("encode write_packed_uint32s", rtcbase::time_nanos() - start,
+            words.size());
+
+    std::vector<uint32_t> decoded(words.size());
+    start = rtcbase::time_nanos();
+    for (int round = 0; round < k_varint_rounds; ++round) {
+        rtcbase::ByteBufferReader reader(&storage[0], length);
+        reader.read_packed_uint32s(&decoded[0], decoded.size());
+    }
+    report("decode read_packed_uint32s", rtcbase::time_nanos() - start,
+            words.size());
+    assert(decoded == words);
+    std::cout << "packed " << length << " bytes, varints "
+        << rtcbase::uvarints_size(&vals[0], vals.size()) << " bytes" << std::endl;
+}
+
+void test_varint_bench() {
+    rtcbase::Random random(7);
+    std::vector<uint64_t> vals(k_varint_values);
+    for (size_t i = 0; i < vals.size(); ++i) {
+        vals[i] = mixed_value(&random);
+    }
+    bench_encode(vals);
+    bench_decode(vals);
+
+    // The 32 bit values, both ways.
+    for (size_t i = 0; i < vals.size(); ++i) {
+        vals[i] = (uint32_t)vals[i];
+    }
+    bench_packed(vals);
+}
+
+